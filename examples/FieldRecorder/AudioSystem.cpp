@@ -14,6 +14,7 @@ AudioPlayQueue AudioSystem::playQueue;
 AudioPlaySdWav AudioSystem::playWav;
 AudioAnalyzePeak AudioSystem::peakAnalyzer;
 AudioFilterBiquad AudioSystem::windCutFilter;
+AudioEffectSongbirdDynamics AudioSystem::dynamics;
 AudioMixer4 AudioSystem::inputMixer;
 AudioMixer4 AudioSystem::outputMixer;
 AudioControlSGTL5000 AudioSystem::audioShield;
@@ -22,9 +23,17 @@ AudioControlSGTL5000 AudioSystem::audioShield;
 static bool initializeAudioConnections()
 {
     static AudioConnection patchCord1(AudioSystem::audioInput, 0, AudioSystem::windCutFilter, 0);
+#ifdef SOFTWARE_AGC
+    // Everything downstream hears the AGC, the level meter included
+    static AudioConnection patchCord9(AudioSystem::windCutFilter, 0, AudioSystem::dynamics, 0);
+    static AudioConnection patchCord2(AudioSystem::dynamics, 0, AudioSystem::recordQueue, 0);
+    static AudioConnection patchCord3(AudioSystem::dynamics, 0, AudioSystem::peakAnalyzer, 0);
+    static AudioConnection patchCord4(AudioSystem::dynamics, 0, AudioSystem::inputMixer, 0);
+#else
     static AudioConnection patchCord2(AudioSystem::windCutFilter, 0, AudioSystem::recordQueue, 0);
     static AudioConnection patchCord3(AudioSystem::windCutFilter, 0, AudioSystem::peakAnalyzer, 0);
     static AudioConnection patchCord4(AudioSystem::windCutFilter, 0, AudioSystem::inputMixer, 0);
+#endif
     static AudioConnection patchCord5(AudioSystem::playWav, 0, AudioSystem::outputMixer, 0);
     static AudioConnection patchCord6(AudioSystem::inputMixer, 0, AudioSystem::outputMixer, 1);
     static AudioConnection patchCord7(AudioSystem::outputMixer, 0, AudioSystem::audioOutput, 0);
@@ -110,23 +119,7 @@ void AudioSystem::configureCodec()
     audioShield.lineOutLevel(13);  // Maximum line output for clean signal to external amp
 
     // Enable AGC if appropriate
-    if (agcEnabled)
-    {
-        // SGTL500 AGC Settings for voice recording
-        audioShield.autoVolumeControl(
-           AGC_MAX_GAIN,     // Maximum gain boost (2 = 12dB)
-           AGC_LVL_SELECT,   // Target level (1 = good for speech)
-           AGC_HARD_LIMIT,   // Hard limiter (0 = disabled)
-           AGC_THRESHOLD,    // Threshold in dB (-10dB below target)
-           AGC_ATTACK,       // Attack time in seconds (0.5s)
-           AGC_DECAY         // Decay time in seconds (0.5s)
-       );
-        audioShield.autoVolumeEnable();
-    }
-    else
-    {
-        audioShield.autoVolumeDisable();
-    }
+    updateAutoGainControl();
 
     // Audio enhancement for clarity
     audioShield.audioProcessorDisable();    // No need for extra bass here ;)
@@ -154,8 +147,24 @@ void AudioSystem::setMicGain(uint8_t gain)
 
 void AudioSystem::enableAutoGainControl(bool enable)
 {
-    if (enable)
+    agcEnabled = enable;
+    updateAutoGainControl();
+    DEBUG_PRINTLN(enable ? "AGC enabled" : "AGC disabled");
+}
+
+void AudioSystem::updateAutoGainControl()
+{
+#ifdef SOFTWARE_AGC
+    // The codec's AGC stays off; manual gain still keeps the limiter,
+    // with the same lookahead so switching does not jump the delay
+    audioShield.autoVolumeDisable();
+    DynamicsSettings settings = agcEnabled ? SOFTWARE_AGC_PRESET : dynamicsLimiter;
+    settings.lookaheadMs = SOFTWARE_AGC_PRESET.lookaheadMs;
+    dynamics.configure(settings);
+#else
+    if (agcEnabled)
     {
+        // SGTL500 AGC Settings for voice recording
         audioShield.autoVolumeControl(
             AGC_MAX_GAIN,     // Maximum gain boost (2 = 12dB)
             AGC_LVL_SELECT,   // Target level (1 = good for speech)
@@ -165,13 +174,12 @@ void AudioSystem::enableAutoGainControl(bool enable)
             AGC_DECAY         // Decay time in seconds (0.5s)
         );
         audioShield.autoVolumeEnable();
-        DEBUG_PRINTLN("AGC enabled");
     }
     else
     {
         audioShield.autoVolumeDisable();
-        DEBUG_PRINTLN("AGC disabled");
     }
+#endif
 }
 
 void AudioSystem::enableWindCut(bool enable)
@@ -9,6 +9,7 @@
 
 #include <Arduino.h>
 #include <Audio.h>
+#include <SongbirdDynamics.h>
 
 class AudioSystem
 {
@@ -57,6 +58,7 @@ public:
     static AudioPlaySdWav playWav;
     static AudioAnalyzePeak peakAnalyzer;
     static AudioFilterBiquad windCutFilter;
+    static AudioEffectSongbirdDynamics dynamics;
     static AudioMixer4 inputMixer;
     static AudioMixer4 outputMixer;
     static AudioControlSGTL5000 audioShield;
@@ -76,6 +78,7 @@ private:
     uint32_t lastClipTime;
 
     void configureCodec();
+    void updateAutoGainControl();
     void updateWindCutFilter();
 };
 
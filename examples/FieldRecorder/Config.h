@@ -79,6 +79,13 @@
 #define AGC_ATTACK             0.5      // Attack time (seconds) - (How quickly AGC responds to loud signals)
 #define AGC_DECAY              0.5      // Decay time (seconds) - (How quickly AGC recovers after loud signals)
 
+// Software AGC (SongbirdDynamics.h) after the wind-cut filter instead of
+// the SGTL5000's: it looks 3-5 ms ahead, adds a true-peak limiter at
+// -1 dBFS and has presets per use (dynamicsVoice, dynamicsAmbience).
+// With AGC off only the limiter runs. Comment out for the codec's AGC.
+#define SOFTWARE_AGC
+#define SOFTWARE_AGC_PRESET    dynamicsVoice
+
 // Wind-cut filter (high-pass at 100Hz)
 // Consider 80Hz for less aggressive filtering after field testing
 #define WINDCUT_FREQUENCY      100      // Hz
@@ -108,6 +115,7 @@
 
 // Auto-save
 #define AUTO_SAVE_INTERVAL_MS  5000     // Flush WAV data every 5 seconds
+#define SETTINGS_COMMIT_DELAY_MS 10000  // Settings written this long after the last change
 
 // AGC hint timing (all in milliseconds)
 #define HINT_INTERVAL_1_MIN    60000    // First 5 minutes: every 1 minute
@@ -161,11 +169,15 @@ struct Settings {
     bool agcEnabled;           // Automatic Gain Control on/off
     bool windCutEnabled;       // Wind-cut filter on/off
     uint32_t sequenceNumber;   // Next file sequence number
-    uint32_t checksum;         // Simple validity check
+    uint32_t checksum;         // Pre-journal layout only; journal records carry a CRC-32
 };
 
-// EEPROM addresses
+// EEPROM layout: settings go in a journal (SongbirdJournal.h) across the
+// whole region, so every save lands in different cells. Firmware before
+// the journal kept one Settings at EEPROM_SETTINGS_ADDR; begin() imports it.
 #define EEPROM_SETTINGS_ADDR   0
+#define EEPROM_JOURNAL_ADDR    0
+#define EEPROM_JOURNAL_SIZE    4096
 #define SETTINGS_VERSION       1
 
 // ============================================================================
@@ -195,4 +207,9 @@ struct Settings {
   #define DEBUG_PRINTF(...)
 #endif
 
+// Uncomment to time loop() by subsystem; the report goes to Serial
+// (see SongbirdProfiler.h)
+// #define SONGBIRD_PROFILE
+#define PROFILE_REPORT_MS      10000    // Profile report interval
+
 #endif // CONFIG_H
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "DisplayManager.h"
 #include <Arduino.h>
 #include <Wire.h>
+#include <SongbirdProfiler.h>
 
 DisplayManager::DisplayManager() : display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire1, -1)
 {
@@ -410,6 +411,7 @@ void DisplayManager::clear()
 
 void DisplayManager::update()
 {
+    PROFILE_ZONE("i2c_flush");
     if (needsUpdate) {
         display.display();
         needsUpdate = false;
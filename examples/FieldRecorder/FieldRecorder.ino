@@ -31,6 +31,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <Audio.h>
+#include <SongbirdTelemetry.h>
 
 // Include all modules
 #include "Config.h"
@@ -41,6 +42,7 @@
 #include "UIController.h"
 #include "LEDControl.h"
 #include "StorageManager.h"
+#include <SongbirdProfiler.h>      // After Config.h: SONGBIRD_PROFILE
 
 // =============================================================================
 // Global Objects
@@ -54,6 +56,7 @@ DisplayManager display;
 UIController ui;
 LEDControl leds;
 StorageManager storage;
+SongbirdTelemetry telemetry;
 
 // System state
 SystemState currentState = STATE_IDLE;
@@ -185,6 +188,8 @@ void setup()
         audioSystem.enableWindCut(currentSettings.windCutEnabled);
     }
 
+    telemetry.begin(AUDIO_MEMORY_BLOCKS);
+
     // Initialize recording engine
     if (!recorder.begin())
     {
@@ -210,6 +215,9 @@ void setup()
 
 void loop()
 {
+    PROFILE_LOOP();
+    telemetry.loopTick();
+
     // Update UI
     ui.update();
 
@@ -218,6 +226,11 @@ void loop()
 
     handleButtonEvents();
 
+    // Write settings back once button changes have settled; not while
+    // recording, where an EEPROM write would stall the record queue
+    // (stopRecording() flushes instead)
+    if (currentState != STATE_RECORDING) storage.update();
+
     // Handle state-specific processing
     switch (currentState) 
     {
@@ -230,6 +243,12 @@ void loop()
 
     // Update display if needed
     updateDisplay();
+
+    // Audio CPU and memory on request ("TELEMETRY" over USB serial)
+    telemetry.poll(Serial);
+
+    // Where loop() time goes, when built with SONGBIRD_PROFILE
+    PROFILE_REPORT(Serial, PROFILE_REPORT_MS);
 }
 
 // =============================================================================
@@ -255,6 +274,8 @@ void processCountdownState()
 
 void processRecordingState()
 {
+    PROFILE_ZONE("record");
+
     // Process audio recording
     AudioRecordQueue* queue = audioSystem.getRecordQueue();
     recorder.processRecording(queue);
@@ -267,6 +288,8 @@ void processRecordingState()
 
 void processPlaybackState()
 {
+    PROFILE_ZONE("playback");
+
     // Check if playback finished
     if (!AudioSystem::playWav.isPlaying()) 
     {
@@ -329,9 +352,10 @@ void startRecording()
         return;
     }
 
-    // Save the updated sequence number to EEPROM
+    // The sequence number reaches EEPROM when the recording stops; after
+    // power loss, recorder.begin() finds it from the files instead
     currentSettings.sequenceNumber = recorder.getNextSequenceNumber();
-    storage.saveSettings(currentSettings);
+    storage.queueSettings(currentSettings);
 
     currentState = STATE_RECORDING;
     recordingTimer = 0;
@@ -349,6 +373,9 @@ void stopRecording() {
     // Stop recording and save file
     recorder.stopRecording();
 
+    // Commit the sequence number and any gain changes made while recording
+    storage.flush();
+
     // Disable input monitoring
     audioSystem.enableInputMonitoring(false);
 
@@ -390,7 +417,7 @@ void enableAGC() {
 
     currentSettings.agcEnabled = true;
     audioSystem.enableAutoGainControl(true);
-    storage.saveSettings(currentSettings);
+    storage.queueSettings(currentSettings);
 
     // Show confirmation
     display.showAGCEnabled();
@@ -439,6 +466,8 @@ void updateDisplay()
 
     displayUpdateTimer = 0;
 
+    PROFILE_ZONE("display");
+
     // Update hint system
     display.updateHintSystem(!currentSettings.agcEnabled, agcJustEnabled);
     if (agcJustEnabled) agcJustEnabled = false;
@@ -513,6 +542,8 @@ void updateDisplay()
 
 void handleButtonEvents() 
 {
+    PROFILE_ZONE("buttons");
+
     for (Button btn : {BTN_UP, BTN_DOWN, BTN_LEFT, BTN_RIGHT}) 
     {
 
@@ -535,7 +566,7 @@ void handleButtonEvents()
                         {
                             currentSettings.windCutEnabled = !currentSettings.windCutEnabled;
                             audioSystem.enableWindCut(currentSettings.windCutEnabled);
-                            storage.saveSettings(currentSettings);
+                            storage.queueSettings(currentSettings);
                         } 
                         else 
                         {
@@ -543,7 +574,7 @@ void handleButtonEvents()
                             {
                                 currentSettings.micGain = max(MIN_MIC_GAIN, currentSettings.micGain - GAIN_STEP);
                                 audioSystem.setMicGain(currentSettings.micGain);
-                                storage.saveSettings(currentSettings);
+                                storage.queueSettings(currentSettings);
                                 showGainOverlay = true;
                                 gainDisplayTimer = 0;
                             }
@@ -555,7 +586,7 @@ void handleButtonEvents()
                         {
                             currentSettings.micGain = min(MAX_MIC_GAIN, currentSettings.micGain + GAIN_STEP);
                             audioSystem.setMicGain(currentSettings.micGain);
-                            storage.saveSettings(currentSettings);
+                            storage.queueSettings(currentSettings);
                             showGainOverlay = true;
                             gainDisplayTimer = 0;
                         }
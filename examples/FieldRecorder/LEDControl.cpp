@@ -5,6 +5,7 @@
  */
 
 #include "LEDControl.h"
+#include <SongbirdProfiler.h>
 
 LEDControl::LEDControl()
 {
@@ -86,6 +87,7 @@ void LEDControl::setPinkLED(uint8_t brightness)
 
 void LEDControl::update()
 {
+    PROFILE_ZONE("leds");
     uint32_t now = millis();
 
     // Handle countdown flashing
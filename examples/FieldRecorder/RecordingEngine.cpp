@@ -10,6 +10,7 @@
 #include "Config.h"
 #include <TimeLib.h>
 #include <WAVMaker.h>
+#include <SongbirdProfiler.h>
 
 RecordingEngine::RecordingEngine()
 {
@@ -208,6 +209,7 @@ bool RecordingEngine::startRecording()
 
 bool RecordingEngine::processRecording(AudioRecordQueue* queue)
 {
+    PROFILE_ZONE("sd_write");
     if (!recording || !queue)
     {
         return false;
@@ -4,8 +4,10 @@
 
 #include "StorageManager.h"
 
-StorageManager::StorageManager() {
-
+StorageManager::StorageManager()
+    : journal(EEPROM_JOURNAL_ADDR, EEPROM_JOURNAL_SIZE, sizeof(Settings)),
+      haveCommitted(false), dirty(false), lastChangeTime(0), commitCount(0)
+{
 }
 
 void StorageManager::begin()
@@ -13,6 +15,14 @@ void StorageManager::begin()
     // Initialize EEPROM
     EEPROM.begin();
 
+    // Settings saved before the journal existed become its first record
+    Settings legacy;
+    if (!journal.begin() && loadLegacySettings(legacy))
+    {
+        DEBUG_PRINTLN("Importing settings into the journal");
+        saveSettings(legacy);
+    }
+
     // Check if we need to initialize with defaults
     Settings test;
     if (!loadSettings(test))
@@ -27,8 +37,14 @@ void StorageManager::begin()
 
 bool StorageManager::loadSettings(Settings& settings)
 {
-    // Read settings from EEPROM
-    EEPROM.get(EEPROM_SETTINGS_ADDR, settings);
+    // Newest journal record; one from an older, shorter Settings comes
+    // back zero-filled for migrateSettings to complete
+    if (journal.load(&settings, sizeof(Settings)) == 0)
+    {
+        DEBUG_PRINTLN("No settings in the journal");
+        return false;
+    }
+    migrateSettings(settings);
 
     // Validate the settings
     if (!validateSettings(settings))
@@ -37,6 +53,9 @@ bool StorageManager::loadSettings(Settings& settings)
         return false;
     }
 
+    committed = settings;
+    haveCommitted = true;
+
     DEBUG_PRINTLN("Settings loaded successfully");
     DEBUG_PRINTF("  AGC: %s\n", settings.agcEnabled ? "ON" : "OFF");
     DEBUG_PRINTF("  Gain: %d\n", settings.micGain);
@@ -48,17 +67,69 @@ bool StorageManager::loadSettings(Settings& settings)
 
 bool StorageManager::saveSettings(const Settings& settings)
 {
-    // Calculate checksum
+    // The journal record's CRC-32 replaces the old checksum
     Settings toSave = settings;
-    toSave.checksum = calculateChecksum(toSave);
+    toSave.checksum = 0;
+
+    // Append to the journal: the next slot, not the same cells every time
+    if (!journal.append(&toSave, sizeof(Settings)))
+    {
+        DEBUG_PRINTLN("Settings save failed");
+        return false;
+    }
+
+    committed = toSave;
+    haveCommitted = true;
+    dirty = false;
+    commitCount++;
+
+    DEBUG_PRINTF("Settings saved (generation %lu)\n", journal.generation());
+    return true;
+}
+
+void StorageManager::queueSettings(const Settings& settings)
+{
+    pending = settings;
+    dirty = true;
+    lastChangeTime = millis();
+}
+
+void StorageManager::update()
+{
+    if (dirty && millis() - lastChangeTime >= SETTINGS_COMMIT_DELAY_MS)
+    {
+        flush();
+    }
+}
+
+bool StorageManager::flush()
+{
+    if (!dirty) return true;
 
-    // Write settings to EEPROM
-    EEPROM.put(EEPROM_SETTINGS_ADDR, toSave);
+    // Only a real difference costs a journal record
+    if (haveCommitted && sameSettings(pending, committed))
+    {
+        dirty = false;
+        return true;
+    }
 
-    DEBUG_PRINTLN("Settings saved");
+    // On failure stay dirty, so the next update() tries again
+    if (!saveSettings(pending))
+    {
+        lastChangeTime = millis();
+        return false;
+    }
     return true;
 }
 
+// Field by field: padding bytes are whatever the stack held
+bool StorageManager::sameSettings(const Settings& a, const Settings& b)
+{
+    return a.version == b.version && a.micGain == b.micGain && a.playbackVolume == b.playbackVolume
+           && a.agcEnabled == b.agcEnabled && a.windCutEnabled == b.windCutEnabled
+           && a.sequenceNumber == b.sequenceNumber;
+}
+
 void StorageManager::factoryReset()
 {
     Settings defaults = getDefaultSettings();
@@ -81,6 +152,22 @@ Settings StorageManager::getDefaultSettings()
     return defaults;
 }
 
+bool StorageManager::loadLegacySettings(Settings& settings)
+{
+    EEPROM.get(EEPROM_SETTINGS_ADDR, settings);
+    if (!validateSettings(settings)) return false;
+
+    uint32_t calculatedChecksum = calculateChecksum(settings);
+    if (calculatedChecksum != settings.checksum)
+    {
+        DEBUG_PRINTF("Checksum mismatch: calc=%08X, stored=%08X\n", calculatedChecksum, settings.checksum);
+        return false;
+    }
+
+    migrateSettings(settings);
+    return true;
+}
+
 uint32_t StorageManager::calculateChecksum(const Settings& settings)
 {
     // XOR all bytes except the checksum field
@@ -117,14 +204,6 @@ bool StorageManager::validateSettings(const Settings& settings)
         return false;
     }
 
-    // Checksum
-    uint32_t calculatedChecksum = calculateChecksum(settings);
-    if (calculatedChecksum != settings.checksum)
-    {
-        DEBUG_PRINTF("Checksum mismatch: calc=%08X, stored=%08X\n", calculatedChecksum, settings.checksum);
-        return false;
-    }
-
     return true;
 }
 
@@ -5,7 +5,14 @@
 /*
  * StorageManager.h - Settings persistence for field recorder
  *
- * Manages EEPROM storage of user settings
+ * Manages EEPROM storage of user settings, in a wear-leveled journal
+ *
+ * Button-driven changes go through a write-back cache: queueSettings()
+ * marks it dirty, and it is committed once SETTINGS_COMMIT_DELAY_MS pass
+ * without another change (update() from loop()) or at a state transition
+ * (flush()). A burst of gain presses becomes one write, and a change
+ * that is undone before the commit becomes none. A commit is a whole
+ * journal record, not a diff: its generation and CRC change every time.
  */
 
 #ifndef FIELDRECORDER_STORAGEMANAGER_H
@@ -13,6 +20,7 @@
 
 #include <Arduino.h>
 #include <EEPROM.h>
+#include <SongbirdJournal.h>
 #include "Config.h"
 
 class StorageManager
@@ -23,24 +31,49 @@ public:
     // Initialization
     void begin();
 
-    // Load/Save Settings
+    // Load/Save Settings (saveSettings writes immediately)
     bool loadSettings(Settings& settings);
     bool saveSettings(const Settings& settings);
 
+    // Write-back cache
+    void queueSettings(const Settings& settings);
+    void update();
+    bool flush();
+    bool isDirty() const { return dirty; }
+    uint32_t getCommitCount() const { return commitCount; }
+
     // Factory Reset
     void factoryReset();
 
     // Get Defaults
     Settings getDefaultSettings();
 
+    // Journal state, for diagnostics
+    const SongbirdJournal& getJournal() const { return journal; }
+
 private:
-    // Calculate checksum for settings validation
+    SongbirdJournal journal;
+
+    // What the journal holds, and what is waiting to go there
+    Settings committed;
+    Settings pending;
+    bool haveCommitted;
+    bool dirty;
+    uint32_t lastChangeTime;
+    uint32_t commitCount;
+
+    static bool sameSettings(const Settings& a, const Settings& b);
+
+    // Checksum of the pre-journal layout
     uint32_t calculateChecksum(const Settings& settings);
 
+    // Settings as firmware before the journal left them, if valid
+    bool loadLegacySettings(Settings& settings);
+
     // Validate Settings
     bool validateSettings(const Settings& settings);
 
-    // Migrate settings from older versions (not implemented)
+    // Migrate settings from older versions
     void migrateSettings(Settings& settings);
 };
 
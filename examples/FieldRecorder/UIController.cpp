@@ -1,4 +1,5 @@
 #include "UIController.h"
+#include <SongbirdProfiler.h>
 
 UIController::UIController() {
     justPressed = justReleased = longPressed = extraLongPressed = 0;
@@ -12,6 +13,7 @@ void UIController::begin() {
 }
 
 void UIController::update() {
+    PROFILE_ZONE("ui");
     justPressed = justReleased = longPressed = extraLongPressed = 0;
     for (uint8_t i = 0; i < 4; i++) updateButton(i);
 }
@@ -44,6 +44,7 @@ AudioAnalyzeRMS inputLevel;
 AudioControlSGTL5000 audioShield;
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire1, OLED_RESET);
 AudioSynthWaveformSine recordBeep;
+SongbirdTelemetry telemetry;
 
 
 void setup() 
@@ -73,6 +74,7 @@ void setup()
   Wire1.setSCL(OLED_SCL_PIN);
 
   setupAudioProcessing();
+  telemetry.begin(AUDIO_MEMORY_BLOCKS);
   initializeSDCard();
   initializeDisplay();
   updateDisplay();
@@ -83,6 +85,8 @@ void setup()
 
 void loop() 
 {
+  telemetry.loopTick();
+
   // Handle button presses
   handleButtons();
 
@@ -9,6 +9,7 @@
  * - DELETEALL: Delete all WAV files in the CALLS directory
  * - HELP: Show available commands
  * - STATUS: Show system status
+ * - TELEMETRY [BIN|RESET]: Audio CPU, block pool, loop time and free memory
  */
 
  #include "SongbirdRecorder.h"
@@ -73,6 +74,23 @@
   {
     showStatus();
   }
+  else if (command == "TELEMETRY")
+  {
+    arguments.toUpperCase();
+    if (arguments == "BIN")
+    {
+      telemetry.writeFrame(Serial);
+    }
+    else if (arguments == "RESET")
+    {
+      telemetry.resetPeaks();
+      Serial.println("Telemetry peaks cleared");
+    }
+    else
+    {
+      telemetry.print(Serial);
+    }
+  }
   else if (command == "SCAN")
   {
     Serial.println("Rescanning SD card...");
@@ -102,6 +120,7 @@
   Serial.println("DELETE filename.wav   - Delete a recording");
   Serial.println("DELETEALL             - Delete all recordings");
   Serial.println("STATUS                - Show system status");
+  Serial.println("TELEMETRY [BIN|RESET] - Audio CPU, memory and loop time");
   Serial.println("SCAN                  - Rescan SD card for files");
   Serial.println("INIT                  - Reinitialize SD card");
   Serial.println("HELP                  - Show this help");
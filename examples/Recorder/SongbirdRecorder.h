@@ -15,6 +15,7 @@
 #include <SerialFlash.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+#include <SongbirdTelemetry.h>
 
 // Hardware pin definitions
 
@@ -129,6 +130,7 @@ extern AudioAnalyzeRMS inputLevel;
 extern AudioControlSGTL5000 audioShield;
 extern Adafruit_SSD1306 display;
 extern AudioSynthWaveformSine recordBeep;
+extern SongbirdTelemetry telemetry;
 
 // Function declarations
 // From audio_manager.ino
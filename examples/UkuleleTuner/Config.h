@@ -40,6 +40,9 @@
 #define OLED_SDA_PIN     17
 #define SCREEN_WIDTH     128
 #define SCREEN_HEIGHT    32
+#define OLED_I2C_CLOCK   400000   // During transfers (as Adafruit_SSD1306)
+#define OLED_I2C_IDLE_CLOCK 100000
+#define OLED_I2C_CHUNK   32       // Data bytes per I2C transaction
 
 // Headphones
 #define HPAMP_VOL_CLK   52
@@ -53,7 +56,7 @@
 // Teensy Audio Library constants
 #define TEENSY_AUDIO_SAMPLE_RATE       44100
 #define AUDIO_BITS_PER_SAMPLE   16
-#define AUDIO_MEMORY_BLOCKS     120      // Memory for audio processing
+#define AUDIO_MEMORY_BLOCKS     30       // Memory for audio processing (TELEMETRY reports the peak)
 #define AUDIO_BLOCK_SAMPLES     128     // Teensy Audio block size
 
 // Recording settings
@@ -147,23 +150,66 @@ enum ErrorType {
 #define MIN_SIGNAL_THRESHOLD   0.01     // Minimum peak level to attempt detection
 
 // Pitch detection
-#define CONCERT_A              440.0    // Reference pitch in Hz
 #define CENTS_PER_SEMITONE     100
 #define TUNING_TOLERANCE_CENTS 2        // Within this = "in tune"
 #define DETECTION_MIN_FREQ     65.0     // C2 - lowest detection
 #define DETECTION_MAX_FREQ     2000.0   // Upper detection limit
 
-// String definitions for Standard GCEA (High G)
-#define NUM_STRINGS            4
-
-// Tuning modes
-enum TuningMode {
-    MODE_STANDARD_GCEA,
-    MODE_LOW_G,
-    MODE_BARITONE,
-    MODE_CHROMATIC,
-    MODE_COUNT  // Number of modes
-};
+// Pitch detector (PitchDetector.cpp)
+#define PITCH_DECIMATION       4        // 44.1 kHz -> ~11 kHz before analysis
+#define PITCH_SAMPLE_RATE      (AUDIO_SAMPLE_RATE_EXACT / PITCH_DECIMATION)
+#define PITCH_BUFFER_SIZE      1024     // Decimated history (power of 2, ~93 ms)
+#define PITCH_HOP              128      // New samples between analyses (~11.6 ms)
+#define PITCH_MIN_WINDOW       128      // Analysis window limits, in decimated samples
+#define PITCH_MAX_WINDOW       512
+#define PITCH_MAX_LAG          256      // Longest period searched (~43 Hz)
+#define PITCH_SEARCH_RATIO     1.4142   // Search +/- half an octave around the target
+#define PITCH_MPM_K            0.9      // Key maxima within this of the best are candidates
+#define PITCH_MIN_CLARITY      0.8      // Readings below this clarity are ignored
+
+// Note gate (NoteGate.cpp)
+#define GATE_MIN_LEVEL         0.003    // RMS below this never opens the gate (-50 dBFS)
+#define GATE_OPEN_RATIO        4.0      // Level over the noise floor that opens it (+12 dB)
+#define GATE_CLOSE_RATIO       2.0      // ...and that keeps it open (+6 dB)
+#define GATE_ONSET_RATIO       2.0      // Jump over the recent level that marks a pluck (+6 dB)
+#define GATE_SLOW_MS           30.0     // Recent level time constant
+#define GATE_HOLDOFF_MS        8.0      // Pick transient skipped after a pluck
+#define GATE_HANG_MS           60.0     // Stays open this long after the level drops
+#define GATE_FLOOR_RISE_MS     500.0    // Noise floor tracking, between notes
+#define GATE_FLOOR_FALL_MS     50.0
+#define GATE_NOISE_ANALYSES    24       // Analyses without a pitch before the gate decides it is noise
+
+// Strum mode (StrumAnalyzer.cpp)
+#define STRUM_WINDOW           2048     // Decimated samples analyzed (~186 ms)
+#define STRUM_FFT_SIZE         4096     // Zero-padded FFT length (2.7 Hz bins)
+#define STRUM_RING_SIZE        4096     // Decimated history (power of 2, 2x window)
+#define STRUM_HOP              512      // New samples between analyses (~46 ms)
+#define STRUM_HARMONICS        4        // Harmonics summed per string
+#define STRUM_SEARCH_CENTS     50.0     // Search each string +/- this far from its target
+#define STRUM_PRESENCE_RATIO   6.0      // Harmonic sum over noise floor to count as sounding
+
+// Automatic string identification (StringClassifier.cpp)
+#define STRING_ID_MAX_CENTS        350.0   // Further than this from every string: no match
+#define STRING_ID_HYSTERESIS_CENTS 50.0    // Another string must be this much closer to take over
+#define STRING_ID_CONFIRM          3       // ...for this many readings in a row
+#define STRING_ID_MAX_HARMONIC     2       // A reading at 2x a string's pitch still counts for it
+#define STRING_ID_HARMONIC_PENALTY 100.0   // Score penalty, in cents, for the 2x match
+#define LOG2_TABLE_BITS            8       // fastLog2 mantissa table (256 entries)
+
+// Strobe mode (StrobeTuner.cpp)
+#define STROBE_SINE_BITS       10       // NCO sine table (1024 entries, Q15)
+#define STROBE_BANDWIDTH       6.0      // I/Q low-pass corner, Hz (two one-pole stages)
+#define STROBE_FIT_BLOCKS      256      // Phase history fitted for the readout (~0.74 s)
+#define STROBE_SETTLE_BLOCKS   80       // Low-pass settling before the fit starts (~232 ms)
+#define STROBE_MIN_BLOCKS      32       // History needed before a reading (~93 ms)
+#define STROBE_IN_TUNE_CENTS   0.5      // Tighter than TUNING_TOLERANCE_CENTS
+#define STROBE_FRAME_MS        20       // Strobe band redraw (partial display update)
+#define STROBE_BAND_TOP        10       // Strobe band rows on the display
+#define STROBE_BAND_HEIGHT     12
+#define STROBE_STRIPE_PERIOD   16       // Pixels the pattern moves per turn of phase
+
+// Most strings per instrument (each tuning in Tunings.h has its own count)
+#define MAX_STRINGS            6
 
 // LED brightness levels for tuning accuracy
 #define LED_OFF                0
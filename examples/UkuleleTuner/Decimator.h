@@ -0,0 +1,73 @@
+/*
+ * Decimator.h - Fixed-point half-band decimation for the tuner analyzers
+ *
+ * Two half-band stages take the 44.1 kHz input down to ~11 kHz, which is
+ * plenty for ukulele fundamentals and their first few harmonics and cuts
+ * the cost of everything downstream by 4.
+ */
+
+#ifndef UKULELETUNER_DECIMATOR_H
+#define UKULELETUNER_DECIMATOR_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+// Kaiser-windowed half-band designs, Q15, one side outermost first.
+// The 0.5 center tap is implicit. Stage 1 only has to protect 0-4 kHz
+// from aliasing, so it can be short.
+static const int16_t HALFBAND_STAGE1[4] = { -55, 564, -2262, 9945 };
+static const int16_t HALFBAND_STAGE2[6] = { -6, 79, -345, 1031, -2720, 10153 };
+
+// Half-band decimate-by-2 FIR. Every other tap is zero, so only the
+// outer taps and the center are computed.
+template <int SIDE_TAPS>
+class HalfBandDecimator {
+public:
+    static const int TAPS = 4 * SIDE_TAPS - 1;
+
+    HalfBandDecimator(const int16_t* coefficients) : coeffs(coefficients) {
+        memset(history, 0, sizeof(history));
+    }
+
+    // Returns the number of output samples (count / 2). count must be even.
+    int process(const int16_t* in, int count, int16_t* out) {
+        // history holds the last TAPS - 1 inputs followed by this block
+        memcpy(history + TAPS - 1, in, count * sizeof(int16_t));
+
+        int outCount = count / 2;
+        for (int m = 0; m < outCount; m++) {
+            const int16_t* x = history + 2 * m;
+            int32_t acc = x[TAPS / 2] * (1 << 14);
+            for (int k = 0; k < SIDE_TAPS; k++) {
+                acc += coeffs[k] * (x[2 * k] + x[TAPS - 1 - 2 * k]);
+            }
+            acc = (acc + 16384) >> 15;
+            out[m] = (acc > 32767) ? 32767 : ((acc < -32768) ? -32768 : acc);
+        }
+
+        memmove(history, history + count, (TAPS - 1) * sizeof(int16_t));
+        return outCount;
+    }
+
+private:
+    const int16_t* coeffs;
+    int16_t history[TAPS - 1 + AUDIO_BLOCK_SAMPLES];
+};
+
+// 44.1 kHz block in, AUDIO_BLOCK_SAMPLES / 4 samples out
+class Decimator {
+public:
+    Decimator() : stage1(HALFBAND_STAGE1), stage2(HALFBAND_STAGE2) {}
+
+    int process(const int16_t* in, int16_t* out) {
+        int16_t half[AUDIO_BLOCK_SAMPLES / 2];
+        int count = stage1.process(in, AUDIO_BLOCK_SAMPLES, half);
+        return stage2.process(half, count, out);
+    }
+
+private:
+    HalfBandDecimator<4> stage1;   // 44.1 -> 22 kHz
+    HalfBandDecimator<6> stage2;   // 22 -> 11 kHz
+};
+
+#endif
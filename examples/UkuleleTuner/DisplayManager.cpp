@@ -417,7 +417,44 @@ void DisplayManager::update()
     }
 }
 
-void DisplayManager::showTunerScreen(const char* mode, uint8_t stringNum,
+// Push only the controller pages (8 rows each) covering the given rows.
+// A full frame is 512 bytes over I2C; the strobe band is a quarter of it.
+void DisplayManager::updateRows(uint8_t firstRow, uint8_t lastRow)
+{
+    // Rotation 2 turns the panel over, so the rows are counted from the
+    // other edge of the controller's memory
+    if (display.getRotation() == 2) {
+        uint8_t top = SCREEN_HEIGHT - 1 - lastRow;
+        lastRow = SCREEN_HEIGHT - 1 - firstRow;
+        firstRow = top;
+    }
+    uint8_t firstPage = firstRow / 8;
+    uint8_t lastPage = lastRow / 8;
+
+    display.ssd1306_command(SSD1306_PAGEADDR);
+    display.ssd1306_command(firstPage);
+    display.ssd1306_command(lastPage);
+    display.ssd1306_command(SSD1306_COLUMNADDR);
+    display.ssd1306_command(0);
+    display.ssd1306_command(SCREEN_WIDTH - 1);
+
+    const uint8_t* data = display.getBuffer() + firstPage * SCREEN_WIDTH;
+    uint16_t remaining = (lastPage - firstPage + 1) * SCREEN_WIDTH;
+
+    Wire1.setClock(OLED_I2C_CLOCK);
+    while (remaining > 0) {
+        uint16_t chunk = min(remaining, (uint16_t)OLED_I2C_CHUNK);
+        Wire1.beginTransmission(OLED_ADDRESS);
+        Wire1.write((uint8_t)0x40);   // Data follows
+        Wire1.write(data, chunk);
+        Wire1.endTransmission();
+        data += chunk;
+        remaining -= chunk;
+    }
+    Wire1.setClock(OLED_I2C_IDLE_CLOCK);
+}
+
+void DisplayManager::showTunerScreen(const char* mode, uint8_t stringNum, bool autoString,
                                     const char* detectedNote, const char* targetNote,
                                     float cents, bool inTune, bool hasSignal)
 {
@@ -427,8 +464,14 @@ void DisplayManager::showTunerScreen(const char* mode, uint8_t stringNum,
     display.setTextSize(1);
     display.setCursor(0, 0);
     display.print(mode);
-    display.print(" - STR ");
-    display.print(stringNum);
+    if (autoString) {
+        // stringNum is 0 until a string has been identified
+        display.print(" - AUTO ");
+        if (stringNum > 0) display.print(stringNum);
+    } else {
+        display.print(" - STR ");
+        display.print(stringNum);
+    }
     
     if (hasSignal) {
         // Show detected note (large)
@@ -473,6 +516,46 @@ void DisplayManager::showTunerScreen(const char* mode, uint8_t stringNum,
     needsUpdate = true;
 }
 
+void DisplayManager::showStrumScreen(const char* mode, const char* const notes[],
+                                     const float cents[], const bool detected[], uint8_t strings)
+{
+    display.clearDisplay();
+    
+    // Top line: Mode
+    display.setTextSize(1);
+    display.setCursor(0, 0);
+    display.print(mode);
+    display.print(" - STRUM");
+    
+    // One column per string, left to right as on the instrument
+    const uint8_t columnWidth = SCREEN_WIDTH / strings;
+    for (uint8_t i = 0; i < strings; i++) {
+        uint8_t x = i * columnWidth;
+        
+        display.setCursor(x + (columnWidth - strlen(notes[i]) * 6) / 2, 12);
+        display.print(notes[i]);
+        
+        char centsStr[8];
+        bool inTune = detected[i] && fabs(cents[i]) <= TUNING_TOLERANCE_CENTS;
+        if (!detected[i]) {
+            snprintf(centsStr, sizeof(centsStr), "--");
+        } else if (inTune) {
+            snprintf(centsStr, sizeof(centsStr), "OK");
+        } else {
+            snprintf(centsStr, sizeof(centsStr), "%+.0f", cents[i]);
+        }
+        display.setCursor(x + (columnWidth - strlen(centsStr) * 6) / 2, 23);
+        display.print(centsStr);
+        
+        // Box the strings that are in tune
+        if (inTune) {
+            display.drawRect(x + 1, 10, columnWidth - 2, 22, SSD1306_WHITE);
+        }
+    }
+    
+    needsUpdate = true;
+}
+
 void DisplayManager::drawText(uint8_t x, uint8_t y, const char* text, uint8_t size)
 {
     display.setTextSize(size);
@@ -480,3 +563,58 @@ void DisplayManager::drawText(uint8_t x, uint8_t y, const char* text, uint8_t si
     display.print(text);
     needsUpdate = true;
 }
+
+void DisplayManager::showStrobeScreen(const char* mode, const char* targetNote, float cents,
+                                      float phase, bool inTune, bool hasSignal)
+{
+    display.clearDisplay();
+    
+    // Top line: Mode and target
+    display.setTextSize(1);
+    display.setCursor(0, 0);
+    display.print(mode);
+    display.print(" - STROBE");
+    display.setCursor(SCREEN_WIDTH - strlen(targetNote) * 6, 0);
+    display.print(targetNote);
+    
+    drawStrobeBand(phase, hasSignal);
+    
+    // Bottom line: Cents to a tenth
+    display.setCursor(0, 24);
+    if (!hasSignal) {
+        display.print("NO SIGNAL");
+    } else {
+        char centsStr[16];
+        snprintf(centsStr, sizeof(centsStr), "%+.1f cents", cents);
+        display.print(centsStr);
+        if (inTune) {
+            display.setCursor(SCREEN_WIDTH - 7 * 6, 24);
+            display.print("IN TUNE");
+        }
+    }
+    
+    needsUpdate = true;
+}
+
+// Stripes that move one period per turn of phase: still when in tune,
+// drifting right when sharp and left when flat
+void DisplayManager::drawStrobeBand(float phase, bool hasSignal)
+{
+    display.fillRect(0, STROBE_BAND_TOP, SCREEN_WIDTH, STROBE_BAND_HEIGHT, SSD1306_BLACK);
+    
+    if (hasSignal) {
+        const int16_t stripe = STROBE_STRIPE_PERIOD / 2;
+        int16_t offset = (int16_t)(phase * STROBE_STRIPE_PERIOD) % STROBE_STRIPE_PERIOD;
+        for (int16_t x = offset - STROBE_STRIPE_PERIOD; x < SCREEN_WIDTH; x += STROBE_STRIPE_PERIOD) {
+            int16_t left = max(x, (int16_t)0);
+            int16_t right = min((int16_t)(x + stripe), (int16_t)SCREEN_WIDTH);
+            if (right > left) {
+                display.fillRect(left, STROBE_BAND_TOP, right - left, STROBE_BAND_HEIGHT, SSD1306_WHITE);
+            }
+        }
+    } else {
+        display.drawFastHLine(0, STROBE_BAND_TOP + STROBE_BAND_HEIGHT / 2, SCREEN_WIDTH, SSD1306_WHITE);
+    }
+    
+    needsUpdate = true;
+}
@@ -24,10 +24,19 @@ class DisplayManager
     bool begin();
 
     // Screen updates for different states
-    void showTunerScreen(const char* mode, uint8_t stringNum,
+    void showTunerScreen(const char* mode, uint8_t stringNum, bool autoString,
                     const char* detectedNote, const char* targetNote,
                     float cents, bool inTune, bool hasSignal);
 
+    void showStrumScreen(const char* mode, const char* const notes[],
+                    const float cents[], const bool detected[], uint8_t strings);
+
+    // Strobe mode: the full screen at the normal rate, the band alone in
+    // between (drawStrobeBand + updateRows)
+    void showStrobeScreen(const char* mode, const char* targetNote, float cents,
+                    float phase, bool inTune, bool hasSignal);
+    void drawStrobeBand(float phase, bool hasSignal);
+
     void drawText(uint8_t x, uint8_t y, const char* text, uint8_t size);
 
     void showIdleScreen(float hoursRemaining, const String& fileName,
@@ -59,6 +68,7 @@ class DisplayManager
     // Utility
     void clear();
     void update();  // Actually display the buffer
+    void updateRows(uint8_t firstRow, uint8_t lastRow);  // Send only these rows
 
 private:
     Adafruit_SSD1306 display;
@@ -0,0 +1,102 @@
+/*
+ * NoteGate.cpp - Noise gate and onset detector
+ */
+
+#include "NoteGate.h"
+
+// Block period of the decimated input, in ms
+#define GATE_BLOCK_MS  (1000.0 * AUDIO_BLOCK_SAMPLES / PITCH_DECIMATION / PITCH_SAMPLE_RATE)
+
+static float blockCoefficient(float timeConstantMs) {
+    return 1.0f - expf(-GATE_BLOCK_MS / timeConstantMs);
+}
+
+NoteGate::NoteGate() {
+    enabled = true;
+    state = GATE_CLOSED;
+    fastPower = 0.0;
+    slowPower = 0.0;
+    floorPower = 0.0;
+    countdown = 0;
+    failedAnalyses = 0;
+
+    holdoffBlocks = (uint16_t)ceilf(GATE_HOLDOFF_MS / GATE_BLOCK_MS);
+    hangBlocks = (uint16_t)ceilf(GATE_HANG_MS / GATE_BLOCK_MS);
+    slowCoeff = blockCoefficient(GATE_SLOW_MS);
+    floorRiseCoeff = blockCoefficient(GATE_FLOOR_RISE_MS);
+    floorFallCoeff = blockCoefficient(GATE_FLOOR_FALL_MS);
+}
+
+void NoteGate::setEnabled(bool on) {
+    enabled = on;
+    state = GATE_CLOSED;
+    failedAnalyses = 0;
+}
+
+void NoteGate::process(const int16_t* samples, int count) {
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += (int32_t)samples[i] * samples[i];
+    }
+    fastPower = (float)sum / (count * 32767.0f * 32767.0f);
+
+    // Powers, so the ratios are squared
+    bool onset = fastPower > GATE_ONSET_RATIO * GATE_ONSET_RATIO * slowPower;
+    float minPower = GATE_MIN_LEVEL * GATE_MIN_LEVEL;
+    float openPower = max(minPower, (float)(GATE_OPEN_RATIO * GATE_OPEN_RATIO) * floorPower);
+    float closePower = max(minPower, (float)(GATE_CLOSE_RATIO * GATE_CLOSE_RATIO) * floorPower);
+
+    slowPower += slowCoeff * (fastPower - slowPower);
+
+    switch (state) {
+        case GATE_CLOSED:
+            if (fastPower > openPower) {
+                state = onset ? GATE_HOLDOFF : GATE_OPEN;
+                countdown = onset ? holdoffBlocks : hangBlocks;
+                failedAnalyses = 0;
+            } else if (fastPower > floorPower) {
+                // The floor only rises between notes
+                floorPower += floorRiseCoeff * (fastPower - floorPower);
+            }
+            break;
+
+        case GATE_HOLDOFF:
+            if (fastPower < closePower) {
+                state = GATE_CLOSED;
+            } else if (--countdown == 0) {
+                state = GATE_OPEN;
+                countdown = hangBlocks;
+            }
+            break;
+
+        case GATE_OPEN:
+            if (onset && fastPower > openPower) {
+                // Plucked again
+                state = GATE_HOLDOFF;
+                countdown = holdoffBlocks;
+            } else if (fastPower >= closePower) {
+                countdown = hangBlocks;
+            } else if (--countdown == 0) {
+                state = GATE_CLOSED;
+            }
+            break;
+    }
+
+    // A level under the floor pulls it down in any state
+    if (fastPower < floorPower) {
+        floorPower += floorFallCoeff * (fastPower - floorPower);
+    }
+}
+
+void NoteGate::reportAnalysis(bool pitchFound) {
+    if (pitchFound) {
+        failedAnalyses = 0;
+        return;
+    }
+    if (++failedAnalyses >= GATE_NOISE_ANALYSES && state == GATE_OPEN) {
+        // Steady sound with no pitch: treat it as the new floor
+        floorPower = slowPower;
+        state = GATE_CLOSED;
+        failedAnalyses = 0;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * NoteGate.h - Noise gate and onset detector in front of the pitch search
+ *
+ * The pitch search is most of the tuner's CPU, and between notes it only
+ * finds noise. The gate follows the level of the decimated input block
+ * by block and lets the search run only while a note is sounding:
+ *
+ *   CLOSED   Below GATE_OPEN_RATIO over the noise floor (and below
+ *            GATE_MIN_LEVEL). The floor tracks the input here.
+ *   HOLDOFF  A pluck was detected (the block level jumped GATE_ONSET_RATIO
+ *            over the recent level). The pick transient is skipped for
+ *            GATE_HOLDOFF_MS.
+ *   OPEN     Analyze. A new pluck goes back to HOLDOFF; the level falling
+ *            under GATE_CLOSE_RATIO over the floor for GATE_HANG_MS closes.
+ *
+ * If the search finds no pitch for GATE_NOISE_ANALYSES in a row, what
+ * opened the gate was noise: the floor is raised to it and the gate
+ * closes.
+ */
+
+#ifndef UKULELETUNER_NOTEGATE_H
+#define UKULELETUNER_NOTEGATE_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Config.h"
+
+class NoteGate {
+public:
+    NoteGate();
+
+    // Disabled: always open (for comparison)
+    void setEnabled(bool on);
+
+    // One block of decimated input
+    void process(const int16_t* samples, int count);
+
+    // Outcome of each analysis run while open
+    void reportAnalysis(bool pitchFound);
+
+    bool isOpen() const { return !enabled || state == GATE_OPEN; }
+    bool isSounding() const { return !enabled || state != GATE_CLOSED; }
+
+    float level() const { return sqrtf(fastPower); }        // RMS, 0.0-1.0
+    float noiseFloor() const { return sqrtf(floorPower); }
+
+private:
+    enum State { GATE_CLOSED, GATE_HOLDOFF, GATE_OPEN };
+
+    bool enabled;
+    State state;
+
+    // Mean square, full scale = 1.0
+    float fastPower;        // This block
+    float slowPower;        // Recent blocks, for onsets
+    float floorPower;
+
+    uint16_t holdoffBlocks;
+    uint16_t hangBlocks;
+    uint16_t countdown;
+    uint16_t failedAnalyses;
+
+    // One-pole coefficients per block
+    float slowCoeff;
+    float floorRiseCoeff;
+    float floorFallCoeff;
+};
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * PitchDetector.cpp - Decimating McLeod pitch detector
+ */
+
+#include "PitchDetector.h"
+
+// =============================================================================
+// Correlation kernel
+// =============================================================================
+
+// Sum of a[i] * b[i]. On the Cortex-M7 two products per instruction
+// (SMLALD), reading the int16 pairs as words; b may be unaligned.
+static int64_t dotProduct(const int16_t* a, const int16_t* b, int n) {
+    int64_t sum = 0;
+    int i = 0;
+#if defined(__ARM_ARCH_7EM__)
+    uint32_t lo = 0, hi = 0;
+    for (; i + 1 < n; i += 2) {
+        uint32_t pa, pb;
+        memcpy(&pa, a + i, 4);
+        memcpy(&pb, b + i, 4);
+        asm volatile("smlald %0, %1, %2, %3" : "+r" (lo), "+r" (hi) : "r" (pa), "r" (pb));
+    }
+    sum = (int64_t)(((uint64_t)hi << 32) | lo);
+#endif
+    for (; i < n; i++) {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+// =============================================================================
+// PitchDetector
+// =============================================================================
+
+PitchDetector::PitchDetector()
+    : AudioStream(1, inputQueueArray)
+{
+    memset(ring, 0, sizeof(ring));
+    ringHead = 0;
+    sinceAnalysis = 0;
+    newResult = false;
+    resultFrequency = 0.0;
+    resultClarity = 0.0;
+    lastCycles = 0;
+    enabled = true;
+    gateWasOpen = false;
+    setTarget(0);
+}
+
+void PitchDetector::setTarget(float frequency) {
+    if (frequency <= 0) {
+        setRange(DETECTION_MIN_FREQ, DETECTION_MAX_FREQ);
+        return;
+    }
+    setLags(PITCH_SAMPLE_RATE / (frequency * PITCH_SEARCH_RATIO),
+            PITCH_SAMPLE_RATE * PITCH_SEARCH_RATIO / frequency, true);
+}
+
+void PitchDetector::setRange(float lowFrequency, float highFrequency) {
+    setLags(PITCH_SAMPLE_RATE / highFrequency, PITCH_SAMPLE_RATE / lowFrequency, false);
+}
+
+void PitchDetector::setLags(float shortest, float longest, bool narrow) {
+    uint16_t first = max((uint16_t)shortest, (uint16_t)2);
+    uint16_t last = min((uint16_t)(longest + 1), (uint16_t)PITCH_MAX_LAG);
+
+    // At least one full period beyond the longest lag
+    uint16_t length = constrain(2 * last, PITCH_MIN_WINDOW, PITCH_MAX_WINDOW);
+
+    __disable_irq();
+    minLag = first;
+    maxLag = last;
+    window = length;
+    narrowSearch = narrow;
+    __enable_irq();
+}
+
+void PitchDetector::setGateEnabled(bool on) {
+    __disable_irq();
+    gate.setEnabled(on);
+    __enable_irq();
+}
+
+bool PitchDetector::available() {
+    __disable_irq();
+    bool ready = newResult;
+    newResult = false;
+    __enable_irq();
+    return ready;
+}
+
+float PitchDetector::read() {
+    __disable_irq();
+    float frequency = resultFrequency;
+    __enable_irq();
+    return frequency;
+}
+
+float PitchDetector::probability() {
+    __disable_irq();
+    float clarity = resultClarity;
+    __enable_irq();
+    return clarity;
+}
+
+void PitchDetector::update(void) {
+    audio_block_t* block = receiveReadOnly(0);
+    if (!block) return;
+    if (!enabled) {
+        release(block);
+        return;
+    }
+
+    int16_t quarter[AUDIO_BLOCK_SAMPLES / 4];
+    int count = decimator.process(block->data, quarter);
+    release(block);
+
+    for (int i = 0; i < count; i++) {
+        ring[ringHead++ & (PITCH_BUFFER_SIZE - 1)] = quarter[i];
+    }
+
+    gate.process(quarter, count);
+
+    sinceAnalysis += count;
+    if (sinceAnalysis >= PITCH_HOP && ringHead >= window) {
+        sinceAnalysis = 0;
+        if (gate.isOpen()) {
+            analyze();
+            gate.reportAnalysis(resultClarity > PITCH_MIN_CLARITY);
+            gateWasOpen = true;
+        } else if (gateWasOpen) {
+            // One empty result when the note ends, so the display clears
+            resultFrequency = 0.0;
+            resultClarity = 0.0;
+            newResult = true;
+            lastCycles = 0;
+            gateWasOpen = false;
+        }
+    }
+}
+
+// Run MPM over the newest window of decimated samples
+void PitchDetector::analyze() {
+    uint32_t start = ARM_DWT_CYCCNT;
+
+    int length = window;
+    int first = minLag;
+    int last = maxLag;
+
+    uint32_t tail = ringHead - length;
+    int peak = 0;
+    for (int i = 0; i < length; i++) {
+        frame[i] = ring[(tail + i) & (PITCH_BUFFER_SIZE - 1)];
+        peak = max(peak, abs(frame[i]));
+    }
+
+    float frequency = 0.0;
+    float clarity = 0.0;
+
+    if (peak >= MIN_SIGNAL_THRESHOLD * 32767) {
+        // m(tau) = sum of x[j]^2 + x[j+tau]^2 over the overlap, stepped
+        // down from m(0) one lag at a time. r(tau) is only computed over
+        // the lags being searched (plus one each side for interpolation).
+        int64_t energy = 2 * dotProduct(frame, frame, length);
+        int from = narrowSearch ? first - 1 : 1;
+
+        for (int tau = 1; tau <= last + 1; tau++) {
+            int32_t lead = frame[tau - 1];
+            int32_t trail = frame[length - tau];
+            energy -= (int64_t)lead * lead + (int64_t)trail * trail;
+
+            if (tau < from) continue;
+            int64_t r = dotProduct(frame, frame + tau, length - tau);
+            nsdf[tau] = (energy > 0) ? (float)(2 * r) / (float)energy : 0.0f;
+        }
+
+        float lag;
+        if (pickPeak(first, last, lag, clarity)) {
+            frequency = PITCH_SAMPLE_RATE / lag;
+        } else {
+            clarity = 0.0;
+        }
+    }
+
+    resultFrequency = frequency;
+    resultClarity = clarity;
+    newResult = true;
+    lastCycles = ARM_DWT_CYCCNT - start;
+}
+
+// Find the pitch lag in nsdf[first..last]. A narrow search takes the
+// highest local maximum in range. The full search uses MPM key maxima:
+// the best peak between each pair of zero crossings, then the first one
+// within PITCH_MPM_K of the highest, which avoids octave-down errors.
+bool PitchDetector::pickPeak(int first, int last, float& lag, float& clarity) {
+    int best = -1;
+
+    if (narrowSearch) {
+        for (int tau = first; tau <= last; tau++) {
+            if (nsdf[tau] > nsdf[tau - 1] && nsdf[tau] >= nsdf[tau + 1]) {
+                if (best < 0 || nsdf[tau] > nsdf[best]) best = tau;
+            }
+        }
+    } else {
+        int keyMaxima[32];
+        int keyCount = 0;
+        float highest = 0.0;
+
+        // Skip the lobe around lag 0
+        int tau = 1;
+        while (tau <= last && nsdf[tau] > 0) tau++;
+
+        int candidate = -1;
+        for (; tau <= last; tau++) {
+            bool positive = nsdf[tau] > 0;
+            if (positive && (candidate < 0 || nsdf[tau] > nsdf[candidate])) {
+                candidate = tau;
+            }
+            if ((!positive || tau == last) && candidate >= 0) {
+                // Peaks above the search band are harmonics, not pitches
+                if (candidate >= first && keyCount < 32) {
+                    keyMaxima[keyCount++] = candidate;
+                    highest = max(highest, nsdf[candidate]);
+                }
+                candidate = -1;
+            }
+        }
+
+        for (int i = 0; i < keyCount; i++) {
+            if (nsdf[keyMaxima[i]] >= PITCH_MPM_K * highest) {
+                best = keyMaxima[i];
+                break;
+            }
+        }
+        // A maximum on the edge of the range is not a real peak
+        if (best == last) best = -1;
+    }
+
+    if (best < 0) return false;
+
+    // Parabolic interpolation through the peak and its neighbours
+    float left = nsdf[best - 1];
+    float center = nsdf[best];
+    float right = nsdf[best + 1];
+    float denominator = left - 2 * center + right;
+    float offset = (denominator < 0) ? 0.5f * (left - right) / denominator : 0.0f;
+
+    lag = best + offset;
+    clarity = min(center - 0.25f * (left - right) * offset, 1.0f);
+    return true;
+}
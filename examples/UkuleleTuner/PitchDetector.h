@@ -0,0 +1,91 @@
+/*
+ * PitchDetector.h - Low-latency pitch detector for the tuner
+ *
+ * Replaces AudioAnalyzeNoteFrequency. The input is decimated by 4 (to
+ * ~11 kHz) with two fixed-point half-band filters, then analyzed with the
+ * McLeod Pitch Method: normalized square difference function (NSDF),
+ * key-maximum peak picking and parabolic interpolation.
+ *
+ * When a target frequency is set, only lags within +/- half an octave of
+ * it are searched, and the analysis window shrinks to fit. A high string
+ * gets a ~12 ms window, baritone D2 about 40 ms. A range (automatic
+ * string identification) or no target at all (chromatic mode) searches
+ * more lags with MPM key-maximum picking.
+ *
+ * A NoteGate in front of the search keeps it asleep between notes and
+ * through the pick transient. Decimation keeps running, so the history
+ * is there the moment the gate opens.
+ */
+
+#ifndef UKULELETUNER_PITCHDETECTOR_H
+#define UKULELETUNER_PITCHDETECTOR_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Config.h"
+#include "Decimator.h"
+#include "NoteGate.h"
+
+class PitchDetector : public AudioStream {
+public:
+    PitchDetector();
+
+    // Search around this frequency (Hz), or the full range if <= 0
+    void setTarget(float frequency);
+
+    // Search a band with MPM peak picking (several strings at once)
+    void setRange(float lowFrequency, float highFrequency);
+
+    // Same interface as AudioAnalyzeNoteFrequency
+    bool available();
+    float read();           // Detected frequency in Hz
+    float probability();    // MPM clarity, 0.0-1.0 (0 = no pitch)
+
+    // Skip all work (the input is still consumed) while another view is up
+    void setEnabled(bool on) { enabled = on; }
+
+    // Analyze only while a note is sounding (default on)
+    void setGateEnabled(bool on);
+    bool isSounding() const { return gate.isSounding(); }
+
+    // Cost of the most recent analysis, in CPU cycles
+    uint32_t cyclesPerAnalysis() const { return lastCycles; }
+    uint16_t windowLength() const { return window; }
+
+    virtual void update(void);
+
+private:
+    audio_block_t* inputQueueArray[1];
+
+    Decimator decimator;
+    NoteGate gate;
+    bool gateWasOpen;
+
+    // Decimated input ring
+    int16_t ring[PITCH_BUFFER_SIZE];
+    uint32_t ringHead;
+    uint16_t sinceAnalysis;
+
+    // Search parameters, changed from loop()
+    volatile uint16_t minLag;
+    volatile uint16_t maxLag;
+    volatile uint16_t window;
+    volatile bool narrowSearch;
+    volatile bool enabled;
+
+    // Working buffers for one analysis
+    int16_t frame[PITCH_MAX_WINDOW];
+    float nsdf[PITCH_MAX_LAG + 2];
+
+    // Results, written by update()
+    volatile bool newResult;
+    float resultFrequency;
+    float resultClarity;
+    uint32_t lastCycles;
+
+    void setLags(float shortest, float longest, bool narrow);
+    void analyze();
+    bool pickPeak(int first, int last, float& lag, float& clarity);
+};
+
+#endif
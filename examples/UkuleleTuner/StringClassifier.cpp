@@ -0,0 +1,97 @@
+/*
+ * StringClassifier.cpp - Automatic string identification
+ */
+
+#include "StringClassifier.h"
+#include "TuningMath.h"
+
+StringClassifier::StringClassifier() {
+    for (int s = 0; s < MAX_STRINGS; s++) {
+        stringLog2[s] = 0.0;
+    }
+    stringCount = 0;
+    reset();
+}
+
+void StringClassifier::setStrings(const float* frequencies, uint8_t count) {
+    stringCount = min(count, (uint8_t)MAX_STRINGS);
+    for (int s = 0; s < stringCount; s++) {
+        stringLog2[s] = fastLog2(frequencies[s]);
+    }
+    reset();
+}
+
+void StringClassifier::reset() {
+    currentString = -1;
+    candidate = -1;
+    candidateCount = 0;
+}
+
+int StringClassifier::classify(float frequency, float& cents) {
+    float reading = fastLog2(frequency);
+
+    int best = -1;
+    float bestScore = 0.0;
+    float bestCents = 0.0;
+    float currentScore = 0.0;
+    float currentCents = 0.0;
+
+    for (int s = 0; s < stringCount; s++) {
+        // Harmonic k sits log2(k) octaves up: 0 and 1 for k = 1, 2
+        float stringScore = 0.0;
+        float stringCents = 0.0;
+        for (int k = 1; k <= STRING_ID_MAX_HARMONIC; k++) {
+            float offset = 1200.0f * (reading - stringLog2[s] - (k - 1));
+            float score = fabs(offset) + (k - 1) * STRING_ID_HARMONIC_PENALTY;
+            if (k == 1 || score < stringScore) {
+                stringScore = score;
+                stringCents = offset;
+            }
+        }
+
+        if (best < 0 || stringScore < bestScore) {
+            best = s;
+            bestScore = stringScore;
+            bestCents = stringCents;
+        }
+        if (s == currentString) {
+            currentScore = stringScore;
+            currentCents = stringCents;
+        }
+    }
+
+    if (bestScore > STRING_ID_MAX_CENTS) {
+        candidateCount = 0;
+        return -1;
+    }
+
+    // First string heard, or the current one is still the best
+    if (currentString < 0 || best == currentString) {
+        currentString = best;
+        candidateCount = 0;
+        cents = bestCents;
+        return currentString;
+    }
+
+    // Another string is closer: it has to be clearly and steadily closer
+    if (currentScore - bestScore >= STRING_ID_HYSTERESIS_CENTS) {
+        if (best == candidate) {
+            candidateCount++;
+        } else {
+            candidate = best;
+            candidateCount = 1;
+        }
+        if (candidateCount >= STRING_ID_CONFIRM) {
+            currentString = best;
+            candidateCount = 0;
+            cents = bestCents;
+            return currentString;
+        }
+    } else {
+        candidateCount = 0;
+    }
+
+    if (currentScore > STRING_ID_MAX_CENTS) return -1;
+    cents = currentCents;
+    return currentString;
+}
@@ -0,0 +1,47 @@
+/*
+ * StringClassifier.h - Automatic string identification
+ *
+ * Decides which string is being plucked from the detected pitch, so the
+ * player does not have to select it. Each string is scored by its
+ * distance in cents from the reading. A reading at twice a string's pitch
+ * (the detector locking onto the 2nd harmonic) also counts for that
+ * string, at a penalty.
+ *
+ * Hysteresis: once a string is chosen, another one must score
+ * STRING_ID_HYSTERESIS_CENTS better for STRING_ID_CONFIRM readings in a
+ * row to take over. A string tuned far flat toward its neighbour stays
+ * put while it is brought up.
+ */
+
+#ifndef UKULELETUNER_STRINGCLASSIFIER_H
+#define UKULELETUNER_STRINGCLASSIFIER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+class StringClassifier {
+public:
+    StringClassifier();
+
+    // Targets for the current mode. Builds the per-mode log2 table.
+    void setStrings(const float* frequencies, uint8_t count);
+
+    // Forget the current string (mode change, manual selection)
+    void reset();
+
+    // Returns the string index (or -1 if the reading matches none) and
+    // the offset in cents from that string's target
+    int classify(float frequency, float& cents);
+
+    int current() const { return currentString; }
+
+private:
+    float stringLog2[MAX_STRINGS];   // log2 of each target
+    uint8_t stringCount;
+
+    int currentString;
+    int candidate;
+    uint8_t candidateCount;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * StrobeTuner.cpp - Quadrature demodulating strobe tuner
+ */
+
+#include "StrobeTuner.h"
+#include "TuningMath.h"
+
+#define STROBE_SINE_SIZE  (1 << STROBE_SINE_BITS)
+
+static int16_t sineTable[STROBE_SINE_SIZE];   // Q15, one full turn
+
+StrobeTuner::StrobeTuner() : AudioStream(1, inputQueueArray) {
+    for (int i = 0; i < STROBE_SINE_SIZE; i++) {
+        sineTable[i] = (int16_t)lrintf(32767.0f * sinf(2.0f * (float)M_PI * i / STROBE_SINE_SIZE));
+    }
+
+    lowpass = 1.0f - expf(-2.0f * (float)M_PI * STROBE_BANDWIDTH / PITCH_SAMPLE_RATE);
+    enabled = false;
+    targetFrequency = 0.0;
+    phaseStep = 0;
+    lastCycles = 0;
+    restart();
+}
+
+void StrobeTuner::restart() {
+    ncoPhase = 0;
+    i1 = q1 = i2 = q2 = 0.0;
+    driftHead = 0;
+    driftCount = 0;
+    lastAngle = 0.0;
+    settleCount = 0;
+    resultCents = 0.0;
+    resultPhase = 0.0;
+    resultLevel = 0.0;
+    resultLocked = false;
+}
+
+void StrobeTuner::setTarget(float frequency) {
+    __disable_irq();
+    targetFrequency = frequency;
+    phaseStep = (frequency > 0) ? (uint32_t)llround(frequency / PITCH_SAMPLE_RATE * 4294967296.0) : 0;
+    restart();
+    __enable_irq();
+}
+
+void StrobeTuner::setEnabled(bool on) {
+    __disable_irq();
+    if (on && !enabled) restart();
+    enabled = on;
+    __enable_irq();
+}
+
+bool StrobeTuner::locked() {
+    __disable_irq();
+    bool isLocked = resultLocked;
+    __enable_irq();
+    return isLocked;
+}
+
+float StrobeTuner::cents() {
+    __disable_irq();
+    float offset = resultCents;
+    __enable_irq();
+    return offset;
+}
+
+float StrobeTuner::phase() {
+    __disable_irq();
+    float turns = resultPhase;
+    __enable_irq();
+    return turns;
+}
+
+float StrobeTuner::level() {
+    __disable_irq();
+    float amplitude = resultLevel;
+    __enable_irq();
+    return amplitude;
+}
+
+void StrobeTuner::update(void) {
+    audio_block_t* block = receiveReadOnly(0);
+    if (!block) return;
+    if (!enabled || phaseStep == 0) {
+        release(block);
+        return;
+    }
+
+    uint32_t start = ARM_DWT_CYCCNT;
+
+    int16_t quarter[AUDIO_BLOCK_SAMPLES / 4];
+    int count = decimator.process(block->data, quarter);
+    release(block);
+
+    // Mix down by the NCO and low-pass. The products are Q30 scaled;
+    // only the angle and a relative level are needed.
+    const int shift = 32 - STROBE_SINE_BITS;
+    uint32_t nco = ncoPhase;
+    for (int n = 0; n < count; n++) {
+        int32_t sine = sineTable[nco >> shift];
+        int32_t cosine = sineTable[(nco + 0x40000000) >> shift];
+        nco += phaseStep;
+
+        float inPhase = (float)(quarter[n] * cosine);
+        float quadrature = (float)(-quarter[n] * sine);
+        i1 += lowpass * (inPhase - i1);
+        q1 += lowpass * (quadrature - q1);
+        i2 += lowpass * (i1 - i2);
+        q2 += lowpass * (q1 - q2);
+    }
+    ncoPhase = nco;
+
+    // The mixer halves the amplitude
+    float amplitude = 2.0f * sqrtf(i2 * i2 + q2 * q2) / (32767.0f * 32767.0f);
+    float angle = atan2f(q2, i2);
+
+    if (amplitude < MIN_SIGNAL_THRESHOLD) {
+        // No fundamental: the angle is noise, start the fit again
+        driftCount = 0;
+        settleCount = 0;
+        resultLocked = false;
+    } else if (settleCount < STROBE_SETTLE_BLOCKS) {
+        // Let the low-pass settle on the new note; its start-up
+        // transient bends the phase
+        settleCount++;
+    } else {
+        float step = angle - lastAngle;
+        if (step > (float)M_PI) step -= 2.0f * (float)M_PI;
+        if (step < -(float)M_PI) step += 2.0f * (float)M_PI;
+
+        drift[driftHead] = step;
+        driftHead = (driftHead + 1) % STROBE_FIT_BLOCKS;
+        if (driftCount < STROBE_FIT_BLOCKS) driftCount++;
+
+        if (driftCount >= STROBE_MIN_BLOCKS) {
+            // Radians per block to Hz
+            float offset = fitSlope() * (PITCH_SAMPLE_RATE / count) / (2.0f * (float)M_PI);
+            resultCents = fastCents(targetFrequency + offset, targetFrequency);
+            resultLocked = true;
+        }
+    }
+
+    lastAngle = angle;
+    resultPhase = (angle + (float)M_PI) / (2.0f * (float)M_PI);
+    resultLevel = amplitude;
+    lastCycles = ARM_DWT_CYCCNT - start;
+}
+
+// Least-squares slope of the unwrapped phase, from its differences.
+// For n differences, difference k (oldest = 1) has weight
+// 6k(n + 1 - k) / (n(n + 1)(n + 2)); the weights sum to 1.
+float StrobeTuner::fitSlope() const {
+    int n = driftCount;
+    int oldest = (driftHead + STROBE_FIT_BLOCKS - n) % STROBE_FIT_BLOCKS;
+
+    float sum = 0.0;
+    for (int k = 1; k <= n; k++) {
+        sum += (float)(k * (n + 1 - k)) * drift[(oldest + k - 1) % STROBE_FIT_BLOCKS];
+    }
+    return 6.0f * sum / ((float)n * (n + 1) * (n + 2));
+}
@@ -0,0 +1,82 @@
+/*
+ * StrobeTuner.h - Phase-tracking strobe tuner
+ *
+ * Strobe mode: a fine readout for intonation work, once the string is
+ * close. The decimated input is mixed down by a numerically controlled
+ * oscillator (NCO) at the target frequency: a 32-bit phase accumulator
+ * indexing a Q15 sine table. The I/Q products are low-passed (two
+ * one-pole stages), which keeps only the fundamental, now near 0 Hz.
+ *
+ * The angle of that phasor is the strobe: it stands still when the
+ * string is exactly on the target and turns at the offset frequency when
+ * it is not. The readout is a least-squares fit of the phase over the
+ * last STROBE_FIT_BLOCKS blocks, so it resolves well under 0.1 cent and
+ * does not jitter.
+ *
+ * Everything runs in the audio interrupt; it is a few thousand cycles a
+ * block.
+ */
+
+#ifndef UKULELETUNER_STROBETUNER_H
+#define UKULELETUNER_STROBETUNER_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Config.h"
+#include "Decimator.h"
+
+class StrobeTuner : public AudioStream {
+public:
+    StrobeTuner();
+
+    // Track this frequency (Hz). Restarts the fit.
+    void setTarget(float frequency);
+    float target() const { return targetFrequency; }
+
+    // Skip all work (the input is still consumed) outside strobe mode
+    void setEnabled(bool on);
+
+    // True once there is a steady fundamental and enough phase history
+    bool locked();
+
+    float cents();      // Offset from the target
+    float phase();      // Strobe position, 0.0-1.0 of a turn
+    float level();      // Fundamental amplitude, 0.0-1.0 of full scale
+
+    uint32_t cyclesPerBlock() const { return lastCycles; }
+
+    virtual void update(void);
+
+private:
+    audio_block_t* inputQueueArray[1];
+    Decimator decimator;
+    volatile bool enabled;
+
+    // NCO
+    float targetFrequency;
+    uint32_t phaseStep;         // Per decimated sample
+    uint32_t ncoPhase;
+
+    // Two one-pole low-pass stages on I and Q
+    float lowpass;
+    float i1, q1, i2, q2;
+
+    // Phase change per block, oldest first from driftHead - driftCount
+    float drift[STROBE_FIT_BLOCKS];
+    uint16_t driftHead;
+    uint16_t driftCount;
+    float lastAngle;
+    uint16_t settleCount;       // Blocks with signal since the low-pass started
+
+    // Results, written by update()
+    float resultCents;
+    float resultPhase;
+    float resultLevel;
+    bool resultLocked;
+    uint32_t lastCycles;
+
+    void restart();
+    float fitSlope() const;
+};
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * StrumAnalyzer.cpp - Polyphonic strum tuning
+ */
+
+#include "StrumAnalyzer.h"
+#include "TuningMath.h"
+
+#define STRUM_BIN_HZ  (PITCH_SAMPLE_RATE / STRUM_FFT_SIZE)
+
+StrumAnalyzer::StrumAnalyzer() : AudioStream(1, inputQueueArray) {
+    memset(ring, 0, sizeof(ring));
+    ringHead = 0;
+    analyzedHead = 0;
+    enabled = false;
+    lastCycles = 0;
+    targetCount = 0;
+
+    for (int i = 0; i < STRUM_WINDOW; i++) {
+        hann[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (STRUM_WINDOW - 1));
+    }
+    for (int k = 0; k < STRUM_FFT_SIZE / 2; k++) {
+        twiddleCos[k] = cosf(2.0f * (float)M_PI * k / STRUM_FFT_SIZE);
+        twiddleSin[k] = sinf(2.0f * (float)M_PI * k / STRUM_FFT_SIZE);
+    }
+    for (int s = 0; s < MAX_STRINGS; s++) {
+        targets[s] = 0.0;
+        cleanHarmonics[s] = 1;
+        strings[s] = { false, 0.0, 0.0, 0.0 };
+    }
+}
+
+void StrumAnalyzer::setTargets(const float* frequencies, uint8_t count) {
+    targetCount = min(count, (uint8_t)MAX_STRINGS);
+    for (int s = 0; s < targetCount; s++) {
+        targets[s] = frequencies[s];
+    }
+
+    // A harmonic is unusable if another string's harmonic can fall inside
+    // its search window (both windows, plus a Hann main lobe)
+    const float limit = 2 * STRUM_SEARCH_CENTS + 30.0;
+    for (int s = 0; s < targetCount; s++) {
+        cleanHarmonics[s] = 1;   // The fundamental is always used
+        for (int k = 2; k <= STRUM_HARMONICS; k++) {
+            bool clean = true;
+            for (int t = 0; t < targetCount && clean; t++) {
+                if (t == s) continue;
+                for (int j = 1; j <= 2 * STRUM_HARMONICS; j++) {
+                    float cents = 1200.0 * log2((k * targets[s]) / (j * targets[t]));
+                    if (fabs(cents) < limit) {
+                        clean = false;
+                        break;
+                    }
+                }
+            }
+            if (clean) cleanHarmonics[s] |= 1 << (k - 1);
+        }
+    }
+}
+
+void StrumAnalyzer::setEnabled(bool on) {
+    __disable_irq();
+    if (on && !enabled) {
+        // Start from an empty window rather than stale audio
+        ringHead = 0;
+        analyzedHead = 0;
+    }
+    enabled = on;
+    __enable_irq();
+
+    for (int s = 0; s < targetCount; s++) {
+        strings[s].detected = false;
+    }
+}
+
+void StrumAnalyzer::update(void) {
+    audio_block_t* block = receiveReadOnly(0);
+    if (!block) return;
+    if (!enabled) {
+        release(block);
+        return;
+    }
+
+    int16_t quarter[AUDIO_BLOCK_SAMPLES / 4];
+    int count = decimator.process(block->data, quarter);
+    release(block);
+
+    uint32_t head = ringHead;
+    for (int i = 0; i < count; i++) {
+        ring[head++ & (STRUM_RING_SIZE - 1)] = quarter[i];
+    }
+    ringHead = head;
+}
+
+bool StrumAnalyzer::analyze() {
+    if (!enabled) return false;
+
+    // The ring holds twice the window, so the interrupt cannot reach the
+    // samples being copied
+    uint32_t head = ringHead;
+    if (head < STRUM_WINDOW || head - analyzedHead < STRUM_HOP) return false;
+    analyzedHead = head;
+
+    uint32_t start = ARM_DWT_CYCCNT;
+
+    uint32_t tail = head - STRUM_WINDOW;
+    int peak = 0;
+    for (int i = 0; i < STRUM_WINDOW; i++) {
+        int16_t x = ring[(tail + i) & (STRUM_RING_SIZE - 1)];
+        peak = max(peak, abs(x));
+        re[i] = x * hann[i];
+        im[i] = 0.0;
+    }
+    for (int i = STRUM_WINDOW; i < STRUM_FFT_SIZE; i++) {
+        re[i] = 0.0;
+        im[i] = 0.0;
+    }
+
+    if (peak < MIN_SIGNAL_THRESHOLD * 32767) {
+        for (int s = 0; s < targetCount; s++) strings[s].detected = false;
+        lastCycles = ARM_DWT_CYCCNT - start;
+        return true;
+    }
+
+    fft();
+
+    // Magnitudes replace the real parts
+    for (int k = 0; k <= STRUM_FFT_SIZE / 2; k++) {
+        re[k] = sqrtf(re[k] * re[k] + im[k] * im[k]);
+    }
+
+    // Noise floor: mean of the bins below the mean, which keeps the
+    // string peaks themselves out of it
+    int lo = (int)(DETECTION_MIN_FREQ / STRUM_BIN_HZ);
+    int hi = (int)(DETECTION_MAX_FREQ / STRUM_BIN_HZ);
+    float mean = 0.0;
+    for (int k = lo; k < hi; k++) mean += re[k];
+    mean /= (hi - lo);
+    float floorSum = 0.0;
+    int floorCount = 0;
+    for (int k = lo; k < hi; k++) {
+        if (re[k] < mean) {
+            floorSum += re[k];
+            floorCount++;
+        }
+    }
+    float noiseFloor = floorCount ? floorSum / floorCount : mean;
+
+    for (int s = 0; s < targetCount; s++) {
+        findString(s, noiseFloor);
+    }
+
+    lastCycles = ARM_DWT_CYCCNT - start;
+    return true;
+}
+
+// In-place iterative radix-2 FFT over re/im
+void StrumAnalyzer::fft() {
+    const int n = STRUM_FFT_SIZE;
+
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for (int size = 2; size <= n; size <<= 1) {
+        int half = size >> 1;
+        int step = n / size;
+        for (int start = 0; start < n; start += size) {
+            for (int k = 0; k < half; k++) {
+                float wr = twiddleCos[k * step];
+                float wi = -twiddleSin[k * step];
+                int a = start + k;
+                int b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// Magnitude near a fractional bin (the larger of the two around it)
+float StrumAnalyzer::magnitudeAt(float bin) const {
+    int k = (int)bin;
+    if (k < 1 || k + 1 >= STRUM_FFT_SIZE / 2) return 0.0;
+    return max(re[k], re[k + 1]);
+}
+
+// Local maximum within a bin of the estimate, Gaussian interpolated
+// (parabola through log magnitudes, near exact for a Hann window)
+bool StrumAnalyzer::refinePeak(float bin, float& peakBin, float& peakMagnitude) const {
+    int k = (int)(bin + 0.5f);
+    if (k < 2 || k + 2 >= STRUM_FFT_SIZE / 2) return false;
+    if (re[k - 1] > re[k]) k--;
+    if (re[k + 1] > re[k]) k++;
+    if (re[k] < re[k - 1] || re[k] < re[k + 1]) return false;
+
+    float a = logf(re[k - 1] + 1e-6f);
+    float b = logf(re[k] + 1e-6f);
+    float c = logf(re[k + 1] + 1e-6f);
+    float denominator = a - 2 * b + c;
+    float offset = (denominator < 0) ? 0.5f * (a - c) / denominator : 0.0f;
+
+    peakBin = k + offset;
+    peakMagnitude = expf(b - 0.25f * (a - c) * offset);
+    return true;
+}
+
+void StrumAnalyzer::findString(uint8_t s, float noiseFloor) {
+    StrumString& out = strings[s];
+    out.detected = false;
+
+    float target = targets[s];
+    if (target <= 0) return;
+
+    float ratio = powf(2.0f, STRUM_SEARCH_CENTS / 1200.0f);
+    float low = target / ratio;
+    float high = target * ratio;
+
+    // Harmonic sum over candidate fundamentals. The step keeps the top
+    // harmonic moving by at most half a bin.
+    float step = STRUM_BIN_HZ / (2 * STRUM_HARMONICS);
+    float best = 0.0;
+    float bestScore = -1.0;
+    int used = 0;
+    for (float f = low; f <= high; f += step) {
+        float score = 0.0;
+        int count = 0;
+        for (int k = 1; k <= STRUM_HARMONICS; k++) {
+            if (!(cleanHarmonics[s] & (1 << (k - 1)))) continue;
+            score += magnitudeAt(k * f / STRUM_BIN_HZ);
+            count++;
+        }
+        if (score > bestScore) {
+            bestScore = score;
+            best = f;
+            used = count;
+        }
+    }
+
+    out.level = (noiseFloor > 0 && used > 0) ? bestScore / (used * noiseFloor) : 0.0;
+    if (out.level < STRUM_PRESENCE_RATIO) return;
+
+    // Refine on each usable harmonic; higher harmonics resolve finer
+    float weighted = 0.0;
+    float weights = 0.0;
+    for (int k = 1; k <= STRUM_HARMONICS; k++) {
+        if (!(cleanHarmonics[s] & (1 << (k - 1)))) continue;
+        float bin, magnitude;
+        if (!refinePeak(k * best / STRUM_BIN_HZ, bin, magnitude)) continue;
+        if (magnitude < STRUM_PRESENCE_RATIO * noiseFloor) continue;
+        float weight = magnitude * k;
+        weighted += weight * bin * STRUM_BIN_HZ / k;
+        weights += weight;
+    }
+    if (weights <= 0) return;
+
+    float frequency = weighted / weights;
+    if (frequency < low || frequency > high) return;
+
+    out.frequency = frequency;
+    out.cents = fastCents(frequency, target);
+    out.detected = true;
+}
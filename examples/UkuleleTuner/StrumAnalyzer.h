@@ -0,0 +1,86 @@
+/*
+ * StrumAnalyzer.h - Every string at once from one FFT
+ *
+ * Strum mode: the player strums open strings and every string's offset
+ * is shown together. The input is decimated to ~11 kHz, and every
+ * STRUM_HOP samples the newest STRUM_WINDOW are Hann windowed, zero padded
+ * and transformed (2.7 Hz bins).
+ *
+ * Each string is then found by harmonic sum: candidate fundamentals
+ * within STRUM_SEARCH_CENTS of the target are scored by the summed
+ * magnitude at their first STRUM_HARMONICS harmonics. The winner is
+ * refined by Gaussian interpolation on each harmonic. Harmonics that land
+ * near another string's harmonic (G4 x2 and C4 x3, for example) are left
+ * out of both strings, so one string cannot pull another.
+ *
+ * Only decimation runs in the audio interrupt. The FFT runs in analyze(),
+ * called from loop().
+ */
+
+#ifndef UKULELETUNER_STRUMANALYZER_H
+#define UKULELETUNER_STRUMANALYZER_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Config.h"
+#include "Decimator.h"
+
+struct StrumString {
+    bool detected;
+    float frequency;    // Hz
+    float cents;        // Offset from the target
+    float level;        // Harmonic sum over the noise floor
+};
+
+class StrumAnalyzer : public AudioStream {
+public:
+    StrumAnalyzer();
+
+    // Target pitches, in display order. Recomputes the harmonic masks.
+    void setTargets(const float* frequencies, uint8_t count);
+    uint8_t stringCount() const { return targetCount; }
+
+    // Decimation only runs while enabled
+    void setEnabled(bool on);
+    bool isEnabled() const { return enabled; }
+
+    // Call from loop(). Returns true when new results are ready.
+    bool analyze();
+
+    const StrumString& result(uint8_t string) const { return strings[string]; }
+    uint32_t cyclesPerAnalysis() const { return lastCycles; }
+
+    virtual void update(void);
+
+private:
+    audio_block_t* inputQueueArray[1];
+    Decimator decimator;
+
+    // Decimated input, written by update()
+    int16_t ring[STRUM_RING_SIZE];
+    volatile uint32_t ringHead;
+    uint32_t analyzedHead;
+    volatile bool enabled;
+
+    // Targets
+    float targets[MAX_STRINGS];
+    uint8_t targetCount;
+    uint8_t cleanHarmonics[MAX_STRINGS];   // Bit k-1 set if harmonic k is usable
+
+    // FFT working set
+    float re[STRUM_FFT_SIZE];
+    float im[STRUM_FFT_SIZE];
+    float hann[STRUM_WINDOW];
+    float twiddleCos[STRUM_FFT_SIZE / 2];
+    float twiddleSin[STRUM_FFT_SIZE / 2];
+
+    StrumString strings[MAX_STRINGS];
+    uint32_t lastCycles;
+
+    void fft();
+    float magnitudeAt(float bin) const;
+    bool refinePeak(float bin, float& peakBin, float& peakMagnitude) const;
+    void findString(uint8_t string, float noiseFloor);
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * TuningEngine.cpp - Tuning selection and note lookup
+ */
+
+#include "TuningEngine.h"
+#include "TuningMath.h"
+
+// Built by the compiler; nothing here is computed on the Teensy
+static constexpr TuningTables TABLES = buildTuningTables();
+
+TuningEngine::TuningEngine() {
+    tuningIndex = 0;
+    temperamentIndex = 0;
+    referenceIndex = 0;
+    select();
+}
+
+void TuningEngine::select() {
+    strings = &TABLES.strings[tuningIndex][temperamentIndex][referenceIndex];
+    scale = &TABLES.scales[temperamentIndex][referenceIndex];
+
+    const TuningDescriptor& tuning = TUNINGS[tuningIndex].strings ? TUNINGS[tuningIndex] : TUNINGS[0];
+    for (int s = 0; s < strings->count; s++) {
+        names[s] = TABLES.noteNames[tuning.notes[s]];
+    }
+}
+
+void TuningEngine::nextTuning(bool fixedOnly) {
+    do {
+        tuningIndex = (tuningIndex + 1) % TUNING_COUNT;
+    } while (fixedOnly && isChromatic());
+    select();
+}
+
+void TuningEngine::nextTemperament() {
+    temperamentIndex = (temperamentIndex + 1) % TEMPERAMENT_COUNT;
+    select();
+}
+
+void TuningEngine::nextReference() {
+    referenceIndex = (referenceIndex + 1) % REFERENCE_COUNT;
+    select();
+}
+
+void TuningEngine::setTuning(uint8_t index) {
+    tuningIndex = index % TUNING_COUNT;
+    select();
+}
+
+int TuningEngine::nearestNote(float frequency, float& cents) const {
+    if (frequency <= 0) return -1;
+
+    // Cents from A4, then the nearest equal-tempered semitone and its
+    // neighbours in the current temperament
+    float fromA4 = 1200.0f * (fastLog2(frequency) - scale->referenceLog2);
+    int semitone = 69 + (int)lroundf(fromA4 / CENTS_PER_SEMITONE);
+    if (semitone < 0 || semitone >= NOTE_COUNT) return -1;
+
+    int best = -1;
+    float bestOffset = 0.0;
+    for (int note = max(semitone - 1, 0); note <= min(semitone + 1, NOTE_COUNT - 1); note++) {
+        float offset = fromA4 - (scale->cents[note % 12] + 1200.0f * (note / 12 - 5));
+        if (best < 0 || fabs(offset) < fabs(bestOffset)) {
+            best = note;
+            bestOffset = offset;
+        }
+    }
+
+    cents = bestOffset;
+    return best;
+}
+
+float TuningEngine::noteFrequency(int note) const {
+    if (note < 0 || note >= NOTE_COUNT) return 0.0;
+    return ldexpf(scale->frequency[note % 12], note / 12 - 5);
+}
+
+const char* TuningEngine::noteName(int note) const {
+    if (note < 0 || note >= NOTE_COUNT) return "--";
+    return TABLES.noteNames[note];
+}
@@ -0,0 +1,209 @@
+/*
+ * TuningEngine.h - Compile-time tuning tables and note lookup
+ *
+ * Every tuning in Tunings.h is expanded at compile time for every
+ * temperament and reference pitch: string frequencies, the search range,
+ * the cents of each pitch class from the reference A4 and all the note
+ * names. The constexpr log2/exp2 below only run in the compiler.
+ *
+ * At run time, selecting a tuning is a table index, and a detected
+ * frequency becomes a note and a cents offset with one fastLog2 and at
+ * most three compares (the nearest equal-tempered semitone and its
+ * neighbours, which covers any temperament within 50 cents of equal).
+ */
+
+#ifndef UKULELETUNER_TUNINGENGINE_H
+#define UKULELETUNER_TUNINGENGINE_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Tunings.h"
+
+#define NOTE_COUNT  128     // MIDI notes 0 (C-1) to 127 (G9)
+
+// One tuning in one temperament at one reference pitch
+struct StringTable {
+    uint8_t count;
+    float frequency[MAX_STRINGS];
+    float lowest;
+    float highest;
+};
+
+// All notes in one temperament at one reference pitch
+struct ScaleTable {
+    float cents[12];        // Pitch class (C = 0) in octave 4, cents from A4
+    float frequency[12];    // ...and in Hz
+    float referenceLog2;
+};
+
+struct TuningTables {
+    StringTable strings[TUNING_COUNT][TEMPERAMENT_COUNT][REFERENCE_COUNT];
+    ScaleTable scales[TEMPERAMENT_COUNT][REFERENCE_COUNT];
+    char noteNames[NOTE_COUNT][5];
+};
+
+class TuningEngine {
+public:
+    TuningEngine();
+
+    // Selection. nextTuning skips chromatic when fixedOnly is set (strum
+    // mode needs strings).
+    void nextTuning(bool fixedOnly);
+    void nextTemperament();
+    void nextReference();
+    void setTuning(uint8_t index);
+
+    uint8_t tuning() const { return tuningIndex; }
+    const char* name() const { return TUNINGS[tuningIndex].name; }
+    const char* temperamentName() const { return TEMPERAMENTS[temperamentIndex].name; }
+    const char* temperamentTag() const { return TEMPERAMENTS[temperamentIndex].tag; }
+    float referencePitch() const { return REFERENCE_PITCHES[referenceIndex]; }
+    bool isChromatic() const { return TUNINGS[tuningIndex].strings == 0; }
+
+    // Strings of the current tuning (chromatic: the first tuning's),
+    // left to right
+    uint8_t stringCount() const { return strings->count; }
+    const float* stringFrequencies() const { return strings->frequency; }
+    const char* const* stringNames() const { return names; }
+    float lowestString() const { return strings->lowest; }
+    float highestString() const { return strings->highest; }
+
+    // Nearest note (MIDI number) in the current temperament, and the
+    // offset from it in cents. -1 if out of range.
+    int nearestNote(float frequency, float& cents) const;
+    float noteFrequency(int note) const;
+    const char* noteName(int note) const;
+
+private:
+    uint8_t tuningIndex;
+    uint8_t temperamentIndex;
+    uint8_t referenceIndex;
+
+    const StringTable* strings;
+    const ScaleTable* scale;
+    const char* names[MAX_STRINGS];
+
+    void select();
+};
+
+// =============================================================================
+// Compile-time table generation
+// =============================================================================
+
+// 2^x: Taylor series of e^(x ln 2) on the fractional part
+constexpr double tuningExp2(double x) {
+    int whole = 0;
+    while (x >= 1.0) { x -= 1.0; whole++; }
+    while (x < 0.0) { x += 1.0; whole--; }
+
+    double y = x * 0.69314718055994531;
+    double term = 1.0;
+    double sum = 1.0;
+    for (int k = 1; k < 24; k++) {
+        term *= y / k;
+        sum += term;
+    }
+    for (; whole > 0; whole--) sum *= 2.0;
+    for (; whole < 0; whole++) sum /= 2.0;
+    return sum;
+}
+
+// log2(x), x > 0: ln(m) = 2 atanh((m - 1) / (m + 1)) on the mantissa
+constexpr double tuningLog2(double x) {
+    double exponent = 0.0;
+    while (x >= 2.0) { x /= 2.0; exponent += 1.0; }
+    while (x < 1.0) { x *= 2.0; exponent -= 1.0; }
+
+    double z = (x - 1.0) / (x + 1.0);
+    double term = z;
+    double sum = 0.0;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= z * z;
+    }
+    return exponent + 2.0 * sum / 0.69314718055994531;
+}
+
+// Cents of pitch class pc (C = 0) in octave 4 from A4. The reference
+// pitch sets A, so the temperament is shifted to leave A unchanged.
+constexpr double tuningPitchClassCents(const TemperamentDescriptor& temperament, int pc) {
+    return CENTS_PER_SEMITONE * (pc - 9)
+           + temperament.offsets[(pc - temperament.root + 12) % 12]
+           - temperament.offsets[(9 - temperament.root + 12) % 12];
+}
+
+constexpr double tuningNoteFrequency(const TemperamentDescriptor& temperament, double reference, int note) {
+    return reference * tuningExp2((1200.0 * (note / 12 - 5) + tuningPitchClassCents(temperament, note % 12)) / 1200.0);
+}
+
+constexpr TuningTables buildTuningTables() {
+    TuningTables tables{};
+    const char letters[12][3] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+    for (unsigned t = 0; t < TEMPERAMENT_COUNT; t++) {
+        for (unsigned r = 0; r < REFERENCE_COUNT; r++) {
+            ScaleTable& scale = tables.scales[t][r];
+            for (int pc = 0; pc < 12; pc++) {
+                scale.cents[pc] = (float)tuningPitchClassCents(TEMPERAMENTS[t], pc);
+                scale.frequency[pc] = (float)tuningNoteFrequency(TEMPERAMENTS[t], REFERENCE_PITCHES[r], 60 + pc);
+            }
+            scale.referenceLog2 = (float)tuningLog2(REFERENCE_PITCHES[r]);
+
+            for (unsigned i = 0; i < TUNING_COUNT; i++) {
+                // Chromatic keeps the first tuning's strings
+                const TuningDescriptor& tuning = TUNINGS[i].strings ? TUNINGS[i] : TUNINGS[0];
+                StringTable& strings = tables.strings[i][t][r];
+                strings.count = tuning.strings;
+                for (int s = 0; s < tuning.strings; s++) {
+                    float frequency = (float)tuningNoteFrequency(TEMPERAMENTS[t], REFERENCE_PITCHES[r], tuning.notes[s]);
+                    strings.frequency[s] = frequency;
+                    if (s == 0 || frequency < strings.lowest) strings.lowest = frequency;
+                    if (s == 0 || frequency > strings.highest) strings.highest = frequency;
+                }
+            }
+        }
+    }
+
+    for (int note = 0; note < NOTE_COUNT; note++) {
+        char* name = tables.noteNames[note];
+        int length = 0;
+        for (const char* c = letters[note % 12]; *c; c++) name[length++] = *c;
+        int octave = note / 12 - 1;
+        if (octave < 0) {
+            name[length++] = '-';
+            octave = -octave;
+        }
+        name[length++] = (char)('0' + octave);
+        name[length] = '\0';
+    }
+    return tables;
+}
+
+// Descriptor checks, so a bad tuning fails the build rather than the tuner
+constexpr bool tuningDescriptorsValid() {
+    if (TUNINGS[0].strings == 0) return false;
+    for (unsigned i = 0; i < TUNING_COUNT; i++) {
+        if (TUNINGS[i].strings > MAX_STRINGS) return false;
+        for (int s = 0; s < TUNINGS[i].strings; s++) {
+            if (TUNINGS[i].notes[s] >= NOTE_COUNT) return false;
+        }
+    }
+    for (unsigned t = 0; t < TEMPERAMENT_COUNT; t++) {
+        if (TEMPERAMENTS[t].root >= 12) return false;
+        // Relative to A, every note within 50 cents of equal temperament
+        for (int pc = 0; pc < 12; pc++) {
+            double offset = tuningPitchClassCents(TEMPERAMENTS[t], pc) - CENTS_PER_SEMITONE * (pc - 9);
+            if (offset <= -50.0 || offset >= 50.0) return false;
+        }
+    }
+    for (unsigned r = 0; r < REFERENCE_COUNT; r++) {
+        if (REFERENCE_PITCHES[r] <= 0) return false;
+    }
+    return true;
+}
+
+static_assert(tuningDescriptorsValid(),
+              "Tunings.h: the first tuning needs strings, none more than MAX_STRINGS; "
+              "notes 0-127; temperaments within 50 cents of equal, relative to A");
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * TuningMath.cpp - Table-driven pitch math
+ */
+
+#include "TuningMath.h"
+
+#define LOG2_TABLE_SIZE (1 << LOG2_TABLE_BITS)
+
+static float log2Table[LOG2_TABLE_SIZE + 1];   // log2(1 + i / size)
+static bool tablesReady = false;
+
+static void buildTables() {
+    for (int i = 0; i <= LOG2_TABLE_SIZE; i++) {
+        log2Table[i] = log2(1.0 + (double)i / LOG2_TABLE_SIZE);
+    }
+    tablesReady = true;
+}
+
+float fastLog2(float x) {
+    if (!tablesReady) buildTables();
+    if (x <= 0) return -128.0;
+
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+
+    int exponent = (int)((bits >> 23) & 0xFF) - 127;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    uint32_t index = mantissa >> (23 - LOG2_TABLE_BITS);
+    float fraction = (float)(mantissa & ((1 << (23 - LOG2_TABLE_BITS)) - 1))
+                     / (float)(1 << (23 - LOG2_TABLE_BITS));
+
+    return exponent + log2Table[index] + fraction * (log2Table[index + 1] - log2Table[index]);
+}
+
+float fastCents(float frequency, float reference) {
+    return 1200.0f * (fastLog2(frequency) - fastLog2(reference));
+}
@@ -0,0 +1,22 @@
+/*
+ * TuningMath.h - Table-driven pitch math for the tuner
+ *
+ * Every detection needs a log2 (cents). It comes from a small table
+ * instead of the libm call: the float exponent plus a 256-entry mantissa
+ * table with linear interpolation (error under 0.005 cents). Note
+ * frequencies are generated at compile time (TuningEngine.h).
+ */
+
+#ifndef UKULELETUNER_TUNINGMATH_H
+#define UKULELETUNER_TUNINGMATH_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// log2(x) for x > 0
+float fastLog2(float x);
+
+// 1200 * log2(frequency / reference)
+float fastCents(float frequency, float reference);
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Tunings.h - Instrument tunings, temperaments and reference pitches
+ *
+ * Descriptors only: TuningEngine builds every frequency, note name and
+ * lookup table from these at compile time. To add an instrument, add a
+ * line to TUNINGS; to add a temperament, add its cents offsets to
+ * TEMPERAMENTS. Nothing else needs to change.
+ *
+ * Notes are MIDI note numbers (A4 = 69, C4 = 60), strings listed left to
+ * right as on the instrument (string 4 first). An instrument has 1 to
+ * MAX_STRINGS strings, or none (chromatic: any note).
+ */
+
+#ifndef UKULELETUNER_TUNINGS_H
+#define UKULELETUNER_TUNINGS_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+struct TuningDescriptor {
+    const char* name;               // Shown in the header
+    uint8_t strings;                // 1 to MAX_STRINGS, or 0 for chromatic
+    uint8_t notes[MAX_STRINGS];
+};
+
+// Offsets in cents from equal temperament for each pitch class, starting
+// at the root. The reference pitch always sets A, so the offsets only
+// matter relative to A's.
+struct TemperamentDescriptor {
+    const char* name;
+    const char* tag;                // Added to the header, "" for none
+    uint8_t root;                   // Pitch class of the first offset (C = 0)
+    float offsets[12];
+};
+
+constexpr TuningDescriptor TUNINGS[] = {
+    { "STANDARD",  4, { 67, 60, 64, 69 } },     // G4 C4 E4 A4
+    { "LOW G",     4, { 55, 60, 64, 69 } },     // G3 C4 E4 A4
+    { "BARITONE",  4, { 38, 43, 47, 52 } },     // D2 G2 B2 E3
+    { "CHROMATIC", 0, {} },
+};
+
+constexpr TemperamentDescriptor TEMPERAMENTS[] = {
+    { "EQUAL", "",   0, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    // 5-limit just intonation on C: 1, 16/15, 9/8, 6/5, 5/4, 4/3, 45/32,
+    // 3/2, 8/5, 5/3, 9/5, 15/8
+    { "JUST C", "JI", 0, { 0.0, 11.73, 3.91, 15.64, -13.69, -1.96,
+                           -9.78, 1.96, 13.69, -15.64, 17.60, -11.73 } },
+};
+
+// DOWN cycles through these; the first is the default
+constexpr float REFERENCE_PITCHES[] = { 440.0, 442.0, 438.0 };
+
+#define TUNING_COUNT      (sizeof(TUNINGS) / sizeof(TUNINGS[0]))
+#define TEMPERAMENT_COUNT (sizeof(TEMPERAMENTS) / sizeof(TEMPERAMENTS[0]))
+#define REFERENCE_COUNT   (sizeof(REFERENCE_PITCHES) / sizeof(REFERENCE_PITCHES[0]))
+
+#endif
@@ -4,16 +4,23 @@
  * A chromatic tuner for ukulele using the Songbird hardware
  *
  * Features:
- * - Real-time pitch detection using AudioAnalyzeNoteFrequency
- * - Multiple tuning modes (Standard GCEA, Low G, Baritone)
+ * - Low-latency pitch detection (decimated McLeod pitch method)
+ * - Multiple tuning modes (Standard GCEA, Low G, Baritone), equal or
+ *   just temperament, tables generated at compile time (Tunings.h)
+ * - Automatic string identification
+ * - Strum mode: all four strings at once
+ * - Strobe mode: phase-tracking readout to a tenth of a cent
  * - Visual feedback on OLED display
  * - LED indicators for signal level and tuning accuracy
  *
  * Button controls:
- * - LEFT: Previous string
- * - RIGHT: Next string
+ * - LEFT: Previous string (AUTO, 4, 3, 2, 1)
+ * - RIGHT: Next string (AUTO, 1, 2, 3, 4)
  * - UP: Change tuning mode
+ * - UP (hold): Change temperament
  * - DOWN: Adjust reference pitch (A=440Hz)
+ * - DOWN (hold): Toggle strobe mode
+ * - LEFT + RIGHT (hold): Toggle strum mode
  *
  * Version: 1.0.0
  * Author: Operator Foundation
@@ -23,39 +30,19 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <Audio.h>
+#include <SongbirdTelemetry.h>
 
 // Include modules we're keeping
 #include "Config.h"
 #include "DisplayManager.h"
 #include "UIController.h"
 #include "LEDControl.h"
-
-const float STANDARD_TUNING[NUM_STRINGS] = {
-    392.00,  // String 4 (leftmost): G4
-    261.63,  // String 3: C4
-    329.63,  // String 2: E4
-    440.00   // String 1 (rightmost): A4
-};
-
-const char* STANDARD_NOTES[NUM_STRINGS] = {"G4", "C4", "E4", "A4"};
-
-// Low G tuning (only string 4 changes)
-const float LOW_G_TUNING[NUM_STRINGS] = {
-    196.00,  // String 4: G3 (low G)
-    261.63,  // String 3: C4
-    329.63,  // String 2: E4
-    440.00   // String 1: A4
-};
-
-// Baritone DGBE tuning
-const float BARITONE_TUNING[NUM_STRINGS] = {
-    73.42,   // String 4: D2
-    98.00,   // String 3: G2
-    123.47,  // String 2: B2
-    164.81   // String 1: E3
-};
-
-const char* BARITONE_NOTES[NUM_STRINGS] = {"D2", "G2", "B2", "E3"};
+#include "PitchDetector.h"
+#include "StrumAnalyzer.h"
+#include "StrobeTuner.h"
+#include "StringClassifier.h"
+#include "TuningMath.h"
+#include "TuningEngine.h"
 
 // =============================================================================
 // Audio Chain Setup
@@ -63,10 +50,14 @@ const char* BARITONE_NOTES[NUM_STRINGS] = {"D2", "G2", "B2", "E3"};
 
 // Audio objects
 AudioInputI2S            i2s_input;
-AudioAnalyzeNoteFrequency noteDetector;
+PitchDetector            pitchDetector;
 AudioAnalyzePeak         peakDetector;
-AudioConnection          patchCord1(i2s_input, 0, noteDetector, 0);
+StrumAnalyzer            strumAnalyzer;
+StrobeTuner              strobeTuner;
+AudioConnection          patchCord1(i2s_input, 0, pitchDetector, 0);
 AudioConnection          patchCord2(i2s_input, 0, peakDetector, 0);
+AudioConnection          patchCord3(i2s_input, 0, strumAnalyzer, 0);
+AudioConnection          patchCord4(i2s_input, 0, strobeTuner, 0);
 AudioControlSGTL5000     audioShield;
 
 // =============================================================================
@@ -76,41 +67,63 @@ AudioControlSGTL5000     audioShield;
 DisplayManager display;
 UIController ui;
 LEDControl leds;
+SongbirdTelemetry telemetry;
+StringClassifier classifier;
+TuningEngine tuning;
 
 // =============================================================================
 // Tuner State
 // =============================================================================
 
-TuningMode currentMode = MODE_STANDARD_GCEA;
-uint8_t currentString = 0;  // 0-3, which string we're tuning
-float referencePitch = CONCERT_A;
+uint8_t currentString = 0;  // Which string we're tuning, 0 = leftmost
+bool autoString = true;     // Identify the string from the pitch
+bool temperamentHoldLatched = false;   // The UP press that changed the temperament
 
 // Detected note info
 float detectedFreq = 0.0;
 float probability = 0.0;
-char detectedNoteName[4] = "";
+int detectedNote = -1;      // MIDI note
+char detectedNoteName[5] = "";
 float centsOffset = 0.0;
 bool inTune = false;
 
 // Signal level
 float signalLevel = 0.0;
 
+// Strum mode
+bool strumMode = false;
+bool strumComboLatched = false;   // LEFT+RIGHT must be released before the next toggle
+
+// Strobe mode
+bool strobeMode = false;
+bool strobeHoldLatched = false;   // The DOWN press that toggled strobe mode
+float strobeCents = 0.0;
+bool strobeLocked = false;
+
 // Timing
 elapsedMillis displayUpdateTimer = 0;
+elapsedMillis strobeFrameTimer = 0;
 
 // =============================================================================
 // Forward Declarations
 // =============================================================================
 
 void updateTuner();
+void updateStrum();
+void setStrumMode(bool on);
+void updateStrobe();
+void setStrobeMode(bool on);
+bool hasTarget();
 void updateDisplay();
 void handleButtons();
 void calculateTuning();
+void updateDetectorTarget();
+const char* getModeLabel();
 float getTargetFrequency();
 const char* getTargetNote();
-void frequencyToNote(float freq, char* noteName, int& octave);
 float calculateCentsOffset(float detected, float target);
 uint8_t getTuningAccuracyLED();
+uint8_t centsToLED(float cents);
 uint8_t getSignalLevelLED();
 
 // =============================================================================
@@ -150,16 +163,16 @@ void setup() {
     leds.begin();
 
     // Initialize audio system
-    AudioMemory(30);
+    AudioMemory(AUDIO_MEMORY_BLOCKS);
+    telemetry.begin(AUDIO_MEMORY_BLOCKS);
     
     audioShield.enable();
     audioShield.inputSelect(AUDIO_INPUT_LINEIN);  // Using line in for mic
     audioShield.micGain(DEFAULT_MIC_GAIN);
     audioShield.volume(0.0);  // No playback needed
     
-    // Configure AudioAnalyzeNoteFrequency
-    // threshold: minimum probability to consider valid (0.0-1.0)
-    noteDetector.begin(0.15);  // 15% confidence threshold
+    // Narrow the pitch search to the selected string
+    updateDetectorTarget();
     
     DEBUG_PRINTLN("Audio system initialized");
     DEBUG_PRINTLN("Ready to tune!\n");
@@ -170,6 +183,8 @@ void setup() {
 // =============================================================================
 
 void loop() {
+    telemetry.loopTick();
+    
     // Update UI
     ui.update();
     
@@ -180,13 +195,27 @@ void loop() {
     handleButtons();
     
     // Update tuner analysis
-    updateTuner();
+    if (strumMode) {
+        updateStrum();
+    } else {
+        updateTuner();
+        if (strobeMode) updateStrobe();
+    }
     
     // Update display
     if (displayUpdateTimer >= DISPLAY_UPDATE_MS) {
         displayUpdateTimer = 0;
+        strobeFrameTimer = 0;
         updateDisplay();
+    } else if (strobeMode && strobeFrameTimer >= STROBE_FRAME_MS) {
+        // Only the strobe band moves between full updates
+        strobeFrameTimer = 0;
+        display.drawStrobeBand(strobeTuner.phase(), strobeLocked);
+        display.updateRows(STROBE_BAND_TOP, STROBE_BAND_TOP + STROBE_BAND_HEIGHT - 1);
     }
+    
+    // Audio CPU and memory on request ("TELEMETRY" over USB serial)
+    telemetry.poll(Serial);
 }
 
 // =============================================================================
@@ -195,14 +224,15 @@ void loop() {
 
 void updateTuner() {
     // Check for new note detection
-    if (noteDetector.available()) {
-        detectedFreq = noteDetector.read();
-        probability = noteDetector.probability();
+    if (pitchDetector.available()) {
+        detectedFreq = pitchDetector.read();
+        probability = pitchDetector.probability();
         
-        DEBUG_PRINTF("Freq: %.2f Hz, Probability: %.2f\n", detectedFreq, probability);
+        DEBUG_PRINTF("Freq: %.2f Hz, Clarity: %.2f, Cycles: %lu\n", detectedFreq, probability,
+                     (unsigned long)pitchDetector.cyclesPerAnalysis());
         
         // Only process if we have decent confidence
-        if (probability > 0.9 && detectedFreq >= DETECTION_MIN_FREQ && detectedFreq <= DETECTION_MAX_FREQ) {
+        if (probability > PITCH_MIN_CLARITY && detectedFreq >= DETECTION_MIN_FREQ && detectedFreq <= DETECTION_MAX_FREQ) {
             calculateTuning();
         } else {
             // No valid signal
@@ -222,18 +252,115 @@ void updateTuner() {
     leds.setBlueLED(getSignalLevelLED() > 0);  // Just on/off for now
 }
 
+// Every string at once. The pink LED follows the worst string heard.
+void updateStrum() {
+    if (strumAnalyzer.analyze()) {
+        float worst = 0.0;
+        bool any = false;
+        for (uint8_t i = 0; i < strumAnalyzer.stringCount(); i++) {
+            const StrumString& string = strumAnalyzer.result(i);
+            if (string.detected) {
+                any = true;
+                worst = max(worst, (float)fabs(string.cents));
+            }
+        }
+        leds.setPinkLED(any ? centsToLED(worst) : LED_OFF);
+    }
+    
+    if (peakDetector.available()) {
+        signalLevel = peakDetector.read();
+    }
+    leds.setBlueLED(getSignalLevelLED() > 0);
+}
+
+void setStrumMode(bool on) {
+    // Strum mode needs fixed targets
+    if (on && tuning.isChromatic()) {
+        tuning.setTuning(0);
+    }
+    if (on && strobeMode) {
+        setStrobeMode(false);
+    }
+    
+    strumMode = on;
+    pitchDetector.setEnabled(!on);
+    strumAnalyzer.setTargets(tuning.stringFrequencies(), tuning.stringCount());
+    strumAnalyzer.setEnabled(on);
+    updateDetectorTarget();
+    
+    detectedNoteName[0] = '\0';
+    centsOffset = 0.0;
+    inTune = false;
+    
+    DEBUG_PRINTF("Strum mode: %s\n", on ? "on" : "off");
+}
+
+// The pitch detector still picks the string (or note, in chromatic mode);
+// the strobe follows it and gives the fine offset
+void updateStrobe() {
+    if (hasTarget()) {
+        float target = getTargetFrequency();
+        if (fabs(fastCents(target, strobeTuner.target())) > 1.0) {
+            strobeTuner.setTarget(target);
+        }
+    }
+    
+    strobeLocked = strobeTuner.locked();
+    strobeCents = strobeTuner.cents();
+    
+    leds.setPinkLED(strobeLocked ? centsToLED(strobeCents) : LED_OFF);
+}
+
+void setStrobeMode(bool on) {
+    if (on && strumMode) {
+        setStrumMode(false);
+    }
+    
+    strobeMode = on;
+    strobeTuner.setEnabled(on);
+    strobeTuner.setTarget(hasTarget() ? getTargetFrequency() : 0);
+    strobeLocked = false;
+    
+    DEBUG_PRINTF("Strobe mode: %s\n", on ? "on" : "off");
+}
+
+// A string is selected or identified, or chromatic mode has a note
+bool hasTarget() {
+    if (tuning.isChromatic()) {
+        return detectedNoteName[0] != '\0';
+    }
+    return !autoString || classifier.current() >= 0;
+}
+
 void calculateTuning() {
-    // Convert frequency to note name
-    int octave;
-    char noteName[3];
-    frequencyToNote(detectedFreq, noteName, octave);
-    snprintf(detectedNoteName, sizeof(detectedNoteName), "%s%d", noteName, octave);
+    // Nearest note in the current temperament. In chromatic mode that
+    // is the target, and its offset is the reading.
+    float cents = 0.0;
+    detectedNote = tuning.nearestNote(detectedFreq, cents);
+    strcpy(detectedNoteName, tuning.noteName(detectedNote));
+    
+    // Work out which string this is. The classifier also gives the offset,
+    // from the fundamental even when the reading is the 2nd harmonic.
+    bool identified = autoString && !tuning.isChromatic();
+    if (identified) {
+        int string = classifier.classify(detectedFreq, cents);
+        if (string < 0) {
+            detectedNoteName[0] = '\0';
+            centsOffset = 0.0;
+            inTune = false;
+            return;
+        }
+        currentString = string;
+    }
     
     // Get target frequency for current string
     float targetFreq = getTargetFrequency();
     
     // Calculate cents offset
-    centsOffset = calculateCentsOffset(detectedFreq, targetFreq);
+    if (!identified && !tuning.isChromatic()) {
+        cents = calculateCentsOffset(detectedFreq, targetFreq);
+    }
+    centsOffset = cents;
     
     // Check if in tune
     inTune = (fabs(centsOffset) <= TUNING_TOLERANCE_CENTS);
@@ -246,70 +373,55 @@ void calculateTuning() {
 // Helper Functions
 // =============================================================================
 
-float getTargetFrequency() {
-    const float* tuning;
-    
-    switch (currentMode) {
-        case MODE_STANDARD_GCEA:
-            tuning = STANDARD_TUNING;
-            break;
-        case MODE_LOW_G:
-            tuning = LOW_G_TUNING;
-            break;
-        case MODE_BARITONE:
-            tuning = BARITONE_TUNING;
-            break;
-        case MODE_CHROMATIC:
-            // In chromatic mode, snap to nearest semitone
-            {
-                float semitones = 12.0 * log2(detectedFreq / referencePitch);
-                int nearestSemitone = round(semitones);
-                return referencePitch * pow(2.0, nearestSemitone / 12.0);
-            }
-        default:
-            tuning = STANDARD_TUNING;
+// Chromatic mode searches the whole range and automatic mode the span
+// of the preset. A selected string only searches around itself, which is
+// faster and cannot jump an octave.
+void updateDetectorTarget() {
+    // A tuning with fewer strings keeps the selection on the instrument
+    if (currentString >= tuning.stringCount()) {
+        currentString = tuning.stringCount() - 1;
     }
+    classifier.setStrings(tuning.stringFrequencies(), tuning.stringCount());
     
-    return tuning[currentString];
+    if (tuning.isChromatic()) {
+        pitchDetector.setTarget(0);
+    } else if (autoString) {
+        pitchDetector.setRange(tuning.lowestString() / PITCH_SEARCH_RATIO,
+                               tuning.highestString() * PITCH_SEARCH_RATIO);
+    } else {
+        pitchDetector.setTarget(getTargetFrequency());
+    }
 }
 
-const char* getTargetNote() {
-    if (currentMode == MODE_CHROMATIC) {
-        return detectedNoteName;
+// Tuning name, with the temperament when it is not equal
+const char* getModeLabel() {
+    static char label[24];
+    if (tuning.temperamentTag()[0] == '\0') {
+        return tuning.name();
     }
-    
-    if (currentMode == MODE_BARITONE) {
-        return BARITONE_NOTES[currentString];
+    snprintf(label, sizeof(label), "%s %s", tuning.name(), tuning.temperamentTag());
+    return label;
+}
+
+float getTargetFrequency() {
+    if (tuning.isChromatic()) {
+        // In chromatic mode, the nearest note
+        return tuning.noteFrequency(detectedNote);
     }
     
-    return STANDARD_NOTES[currentString];
+    return tuning.stringFrequencies()[currentString];
 }
 
-void frequencyToNote(float freq, char* noteName, int& octave) {
-    const char* NOTE_NAMES[12] = {
-        "C", "C#", "D", "D#", "E", "F", 
-        "F#", "G", "G#", "A", "A#", "B"
-    };
-    
-    // Calculate semitones from A4 (440 Hz)
-    float semitones = 12.0 * log2(freq / referencePitch);
-    int semitonesFromA4 = round(semitones);
-    
-    // Calculate note index (0-11 where 0=C, 9=A)
-    int noteIndex = (semitonesFromA4 + 9) % 12;
-    if (noteIndex < 0) noteIndex += 12;
-    
-    // Calculate octave
-    octave = 4 + (semitonesFromA4 + 9) / 12;
-    if (semitonesFromA4 + 9 < 0 && (semitonesFromA4 + 9) % 12 != 0) {
-        octave--;
+const char* getTargetNote() {
+    if (tuning.isChromatic()) {
+        return detectedNoteName;
     }
     
-    strcpy(noteName, NOTE_NAMES[noteIndex]);
+    return tuning.stringNames()[currentString];
 }
 
 float calculateCentsOffset(float detected, float target) {
-    return 1200.0 * log2(detected / target);
+    return fastCents(detected, target);
 }
 
 uint8_t getTuningAccuracyLED() {
@@ -317,7 +429,11 @@ uint8_t getTuningAccuracyLED() {
         return LED_OFF;
     }
     
-    float absCents = fabs(centsOffset);
+    return centsToLED(centsOffset);
+}
+
+uint8_t centsToLED(float cents) {
+    float absCents = fabs(cents);
     
     if (absCents > 20.0) return LED_OFF;
     if (absCents > 10.0) return LED_DIM;
@@ -337,32 +453,82 @@ uint8_t getSignalLevelLED() {
 // =============================================================================
 
 void handleButtons() {
-    // LEFT - Previous string
+    // LEFT + RIGHT held - Toggle strum mode. The two presses that start the
+    // combo move the string one way and back, so the selection is kept.
+    if (ui.isComboLongPressed(BTN_LEFT, BTN_RIGHT)) {
+        if (!strumComboLatched) {
+            strumComboLatched = true;
+            setStrumMode(!strumMode);
+        }
+    } else if (!ui.isPressed(BTN_LEFT) && !ui.isPressed(BTN_RIGHT)) {
+        strumComboLatched = false;
+    }
+    
+    // LEFT - Previous string, with AUTO between the first and last strings
     if (ui.wasJustPressed(BTN_LEFT)) {
-        currentString = (currentString == 0) ? (NUM_STRINGS - 1) : (currentString - 1);
-        DEBUG_PRINTF("String: %d\n", currentString);
+        if (autoString) {
+            autoString = false;
+            currentString = tuning.stringCount() - 1;
+        } else if (currentString == 0) {
+            autoString = true;
+        } else {
+            currentString--;
+        }
+        updateDetectorTarget();
+        DEBUG_PRINTF("String: %s%d\n", autoString ? "auto " : "", currentString);
     }
     
     // RIGHT - Next string
     if (ui.wasJustPressed(BTN_RIGHT)) {
-        currentString = (currentString + 1) % NUM_STRINGS;
-        DEBUG_PRINTF("String: %d\n", currentString);
+        if (autoString) {
+            autoString = false;
+            currentString = 0;
+        } else if (currentString >= tuning.stringCount() - 1) {
+            autoString = true;
+        } else {
+            currentString++;
+        }
+        updateDetectorTarget();
+        DEBUG_PRINTF("String: %s%d\n", autoString ? "auto " : "", currentString);
+    }
+    
+    // UP held - Change temperament
+    if (ui.isLongPressed(BTN_UP)) {
+        temperamentHoldLatched = true;
+        tuning.nextTemperament();
+        strumAnalyzer.setTargets(tuning.stringFrequencies(), tuning.stringCount());
+        updateDetectorTarget();
+        DEBUG_PRINTF("Temperament: %s\n", tuning.temperamentName());
+    }
+    
+    // UP - Change tuning mode. Acts on release, like DOWN. Strum mode
+    // only cycles the presets.
+    if (ui.wasJustReleased(BTN_UP) && temperamentHoldLatched) {
+        temperamentHoldLatched = false;
+    } else if (ui.wasJustReleased(BTN_UP)) {
+        tuning.nextTuning(strumMode);
+        strumAnalyzer.setTargets(tuning.stringFrequencies(), tuning.stringCount());
+        updateDetectorTarget();
+        DEBUG_PRINTF("Mode: %s\n", tuning.name());
     }
     
-    // UP - Change tuning mode
-    if (ui.wasJustPressed(BTN_UP)) {
-        currentMode = (TuningMode)((currentMode + 1) % MODE_COUNT);
-        DEBUG_PRINTF("Mode: %d\n", currentMode);
+    // DOWN held - Toggle strobe mode
+    if (ui.isLongPressed(BTN_DOWN)) {
+        strobeHoldLatched = true;
+        setStrobeMode(!strobeMode);
     }
     
-    // DOWN - Adjust reference pitch (cycles through common values)
-    if (ui.wasJustPressed(BTN_DOWN)) {
-        // Cycle: 440 -> 442 -> 438 -> 440
-        if (referencePitch == 440.0) referencePitch = 442.0;
-        else if (referencePitch == 442.0) referencePitch = 438.0;
-        else referencePitch = 440.0;
+    // DOWN - Adjust reference pitch (cycles through common values). Acts on
+    // release, so holding DOWN for strobe mode leaves the pitch alone.
+    if (ui.wasJustReleased(BTN_DOWN) && strobeHoldLatched) {
+        strobeHoldLatched = false;
+    } else if (ui.wasJustReleased(BTN_DOWN)) {
+        // Cycle: 440 -> 442 -> 438 -> 440 (REFERENCE_PITCHES)
+        tuning.nextReference();
+        strumAnalyzer.setTargets(tuning.stringFrequencies(), tuning.stringCount());
+        updateDetectorTarget();
         
-        DEBUG_PRINTF("Reference pitch: %.1f Hz\n", referencePitch);
+        DEBUG_PRINTF("Reference pitch: %.1f Hz\n", tuning.referencePitch());
     }
 }
 
@@ -371,13 +537,38 @@ void handleButtons() {
 // =============================================================================
 
 void updateDisplay() {
-    const char* modeNames[] = {"STANDARD", "LOW G", "BARITONE", "CHROMATIC"};
+    if (strumMode) {
+        uint8_t strings = strumAnalyzer.stringCount();
+        float cents[MAX_STRINGS];
+        bool detected[MAX_STRINGS];
+        for (uint8_t i = 0; i < strings; i++) {
+            cents[i] = strumAnalyzer.result(i).cents;
+            detected[i] = strumAnalyzer.result(i).detected;
+        }
+        display.showStrumScreen(getModeLabel(), tuning.stringNames(), cents, detected, strings);
+        display.update();
+        return;
+    }
+    
+    if (strobeMode) {
+        display.showStrobeScreen(
+            getModeLabel(),
+            hasTarget() ? getTargetNote() : "--",
+            strobeCents,
+            strobeTuner.phase(),
+            fabs(strobeCents) <= STROBE_IN_TUNE_CENTS,
+            strobeLocked
+        );
+        display.update();
+        return;
+    }
     
     bool hasSignal = (detectedNoteName[0] != '\0');
     
     display.showTunerScreen(
-        modeNames[currentMode],
-        currentString + 1,
+        getModeLabel(),
+        (autoString && classifier.current() < 0) ? 0 : currentString + 1,
+        autoString,
         detectedNoteName,
         getTargetNote(),
         centsOffset,
@@ -11,29 +11,48 @@ AudioInputI2S AudioSystem::audioInput;
 AudioOutputI2S AudioSystem::audioOutput;
 AudioRecordQueue AudioSystem::recordQueue;
 AudioPlayQueue AudioSystem::playQueue;
-AudioPlaySdWav AudioSystem::playWav;
+AudioEchoReference AudioSystem::echoReference;     // After playQueue: updates in the same cycle
+AudioRecordQueue AudioSystem::referenceQueue;
 AudioAnalyzePeak AudioSystem::peakAnalyzer;
 AudioFilterBiquad AudioSystem::windCutFilter;
 AudioMixer4 AudioSystem::inputMixer;
 AudioMixer4 AudioSystem::outputMixer;
 AudioControlSGTL5000 AudioSystem::audioShield;
 
-// Audio connections - created once at program initialization
-static bool initializeAudioConnections()
+// Audio connections - created once at program initialization, all
+// connected; begin() trims the graph to the idle branches
+static AudioConnection patchCord1(AudioSystem::audioInput, 0, AudioSystem::windCutFilter, 0);
+static AudioConnection patchCord2(AudioSystem::windCutFilter, 0, AudioSystem::recordQueue, 0);
+static AudioConnection patchCord3(AudioSystem::windCutFilter, 0, AudioSystem::peakAnalyzer, 0);
+static AudioConnection patchCord4(AudioSystem::windCutFilter, 0, AudioSystem::inputMixer, 0);
+static AudioConnection patchCord5(AudioSystem::playQueue, 0, AudioSystem::outputMixer, 0);
+static AudioConnection patchCord6(AudioSystem::inputMixer, 0, AudioSystem::outputMixer, 1);
+static AudioConnection patchCord7(AudioSystem::outputMixer, 0, AudioSystem::audioOutput, 0);
+static AudioConnection patchCord8(AudioSystem::outputMixer, 0, AudioSystem::audioOutput, 1);
+static AudioConnection patchCord9(AudioSystem::playQueue, 0, AudioSystem::echoReference, 0);
+static AudioConnection patchCord10(AudioSystem::echoReference, 0, AudioSystem::referenceQueue, 0);
+
+// Takes patchCord2's place while the input branch is off. The I2S input
+// keeps the block it was filling when its update stopped and sends it
+// on the first update after, so the input stays connected to the (not
+// started) record queue, which frees its blocks, and recordings never
+// start with a stale block.
+static AudioConnection inputKeepalive;
+
+// Cords of each branch, indexed by the branch's bit
+struct GraphBranchCords
 {
-    static AudioConnection patchCord1(AudioSystem::audioInput, 0, AudioSystem::windCutFilter, 0);
-    static AudioConnection patchCord2(AudioSystem::windCutFilter, 0, AudioSystem::recordQueue, 0);
-    static AudioConnection patchCord3(AudioSystem::windCutFilter, 0, AudioSystem::peakAnalyzer, 0);
-    static AudioConnection patchCord4(AudioSystem::windCutFilter, 0, AudioSystem::inputMixer, 0);
-    static AudioConnection patchCord5(AudioSystem::playWav, 0, AudioSystem::outputMixer, 0);
-    static AudioConnection patchCord6(AudioSystem::inputMixer, 0, AudioSystem::outputMixer, 1);
-    static AudioConnection patchCord7(AudioSystem::outputMixer, 0, AudioSystem::audioOutput, 0);
-    static AudioConnection patchCord8(AudioSystem::outputMixer, 0, AudioSystem::audioOutput, 1);
-    return true;
-}
-
-// Initialize audio connections at program startup
-static bool audioConnectionsInitialized = initializeAudioConnections();
+    AudioConnection* cords[3];
+    uint8_t count;
+};
+
+static const GraphBranchCords branchCords[GRAPH_BRANCH_COUNT] = {
+    { { &patchCord1, &patchCord2, &patchCord3 }, 3 },   // GRAPH_INPUT
+    { { &patchCord4, &patchCord6 }, 2 },                // GRAPH_MONITOR
+    { { &patchCord5 }, 1 },                             // GRAPH_PLAYBACK
+    { { &patchCord9, &patchCord10 }, 2 },               // GRAPH_REFERENCE
+    { { &patchCord7, &patchCord8 }, 2 },                // GRAPH_OUTPUT
+};
 
 AudioSystem::AudioSystem()
 {
@@ -44,6 +63,13 @@ AudioSystem::AudioSystem()
     windCutEnabled = false;
     monitoringEnabled = false;
     lastClipTime = 0;
+
+    graphState = GRAPH_IDLE;
+    graphBranches = GRAPH_ALL;
+    drainPending = false;
+    drainStartTime = 0;
+    lastCpuSampleTime = 0;
+    resetGraphCpu();
 }
 
 bool AudioSystem::begin()
@@ -93,12 +119,149 @@ bool AudioSystem::begin()
     inputMixer.gain(2, 0.0);                 // Unused
     inputMixer.gain(3, 0.0);                 // Unused
 
-    recordQueue.begin();
+    // Nothing runs until a recording or a message starts
+    setGraphState(GRAPH_IDLE);
 
     DEBUG_PRINTLN("Audio system initialized");
     return true;
 }
 
+uint8_t AudioSystem::branchesFor(AudioGraphState state)
+{
+#ifdef AUDIO_GRAPH_GATING
+    switch (state)
+    {
+        case GRAPH_RECORDING:
+            // Playback too: the queue may still be draining, and it is
+            // the echo canceller's reference
+            return GRAPH_INPUT | GRAPH_MONITOR | GRAPH_PLAYBACK | GRAPH_REFERENCE | GRAPH_OUTPUT;
+        case GRAPH_PLAYING:
+            return GRAPH_PLAYBACK | GRAPH_OUTPUT;
+        default:
+            return 0;
+    }
+#else
+    (void)state;
+    return GRAPH_ALL;
+#endif
+}
+
+void AudioSystem::setGraphState(AudioGraphState state)
+{
+    graphState = state;
+
+    // What the play queue still holds has to play out: the branches that
+    // carry it to the output stay until updateGraph() sees it drained.
+    // Disconnecting them early would cut the message and leave its end
+    // in the queue for the next one.
+    uint8_t wanted = branchesFor(state);
+    uint8_t draining = graphBranches & ~wanted & (GRAPH_PLAYBACK | GRAPH_OUTPUT);
+    applyBranches(wanted | draining);
+
+    drainPending = draining != 0;
+    drainStartTime = millis();
+}
+
+void AudioSystem::updateGraph()
+{
+    if (drainPending && millis() - drainStartTime >= GRAPH_DRAIN_MS)
+    {
+        drainPending = false;
+        applyBranches(branchesFor(graphState));
+    }
+
+    // Audio CPU of the state, one sample per millisecond
+    uint32_t now = millis();
+    if (now != lastCpuSampleTime)
+    {
+        lastCpuSampleTime = now;
+        float usage = AudioProcessorUsage();
+        cpuSum[graphState] += usage;
+        cpuSamples[graphState]++;
+        if (usage > cpuMax[graphState])
+        {
+            cpuMax[graphState] = usage;
+        }
+    }
+}
+
+void AudioSystem::applyBranches(uint8_t branches)
+{
+    uint8_t off = graphBranches & ~branches;
+    uint8_t on = branches & ~graphBranches;
+    if (!off && !on) return;
+
+    // One audio update sees the whole change: disconnected objects are
+    // skipped from the next block on, connected ones start with it
+    AudioNoInterrupts();
+
+    if (on & GRAPH_INPUT)
+    {
+        inputKeepalive.disconnect();
+    }
+
+    for (uint8_t i = 0; i < GRAPH_BRANCH_COUNT; i++)
+    {
+        if (!(off & (1 << i))) continue;
+        for (uint8_t c = 0; c < branchCords[i].count; c++)
+        {
+            branchCords[i].cords[c]->disconnect();
+        }
+    }
+
+    for (uint8_t i = 0; i < GRAPH_BRANCH_COUNT; i++)
+    {
+        if (!(on & (1 << i))) continue;
+        for (uint8_t c = 0; c < branchCords[i].count; c++)
+        {
+            branchCords[i].cords[c]->connect();
+        }
+    }
+
+    if (off & GRAPH_INPUT)
+    {
+        inputKeepalive.connect(audioInput, 0, recordQueue, 0);
+    }
+
+    AudioInterrupts();
+
+    graphBranches = branches;
+    DEBUG_PRINTF("Audio graph branches: 0x%02X\n", branches);
+}
+
+float AudioSystem::getGraphCpu(AudioGraphState state) const
+{
+    if (cpuSamples[state] == 0) return 0.0f;
+    return cpuSum[state] / cpuSamples[state];
+}
+
+void AudioSystem::resetGraphCpu()
+{
+    for (uint8_t i = 0; i < GRAPH_STATE_COUNT; i++)
+    {
+        cpuSum[i] = 0.0f;
+        cpuSamples[i] = 0;
+        cpuMax[i] = 0.0f;
+    }
+}
+
+void AudioSystem::beginRecordQueues()
+{
+    // The echo canceller pairs the blocks of the two queues one to one
+    AudioNoInterrupts();
+    recordQueue.begin();
+    referenceQueue.begin();
+    AudioInterrupts();
+}
+
+void AudioSystem::endRecordQueues()
+{
+    AudioNoInterrupts();
+    recordQueue.end();
+    referenceQueue.end();
+    AudioInterrupts();
+}
+
 void AudioSystem::configureCodec()
 {
     // Configure for headset microphone input
@@ -9,6 +9,26 @@
 
 #include <Arduino.h>
 #include <Audio.h>
+#include "EchoCanceller.h"
+
+// What the audio graph is doing; each state connects only the branches
+// it uses (see AUDIO_GRAPH_GATING in Config.h)
+enum AudioGraphState
+{
+    GRAPH_IDLE,
+    GRAPH_RECORDING,
+    GRAPH_PLAYING,
+    GRAPH_STATE_COUNT
+};
+
+// Graph branches, as bits
+#define GRAPH_INPUT         0x01    // I2S in -> wind cut -> record queue, peak
+#define GRAPH_MONITOR       0x02    // Wind cut -> input mixer -> output mixer
+#define GRAPH_PLAYBACK      0x04    // Play queue -> output mixer
+#define GRAPH_REFERENCE     0x08    // Play queue -> echo reference -> reference queue
+#define GRAPH_OUTPUT        0x10    // Output mixer -> I2S out
+#define GRAPH_ALL           0x1F
+#define GRAPH_BRANCH_COUNT  5
 
 class AudioSystem
 {
@@ -49,12 +69,36 @@ public:
     AudioRecordQueue* getRecordQueue() { return &recordQueue; }
     AudioPlayQueue* getPlayQueue() { return &playQueue; }
 
+    // Playback as it went to the output, one block per record queue block
+    AudioRecordQueue* getReferenceQueue() { return &referenceQueue; }
+
+    // Start/stop the record and reference queues in the same audio update
+    void beginRecordQueues();
+    void endRecordQueues();
+
+    // Audio graph gating. Objects on a disconnected branch are skipped by
+    // the audio update. A new state's branches connect at once; branches
+    // it drops disconnect at the same block boundary, except playback,
+    // which stays until the play queue has drained (call updateGraph()
+    // from loop()).
+    void setGraphState(AudioGraphState state);
+    AudioGraphState getGraphState() const { return graphState; }
+    uint8_t getGraphBranches() const { return graphBranches; }
+    void updateGraph();
+
+    // Mean and peak audio CPU (AudioProcessorUsage(), percent) in each
+    // state, sampled by updateGraph()
+    float getGraphCpu(AudioGraphState state) const;
+    float getGraphCpuMax(AudioGraphState state) const { return cpuMax[state]; }
+    void resetGraphCpu();
+
     // Audio Objects
     static AudioInputI2S audioInput;
     static AudioOutputI2S audioOutput;
     static AudioRecordQueue recordQueue;
     static AudioPlayQueue playQueue;
-    static AudioPlaySdWav playWav;
+    static AudioEchoReference echoReference;
+    static AudioRecordQueue referenceQueue;
     static AudioAnalyzePeak peakAnalyzer;
     static AudioFilterBiquad windCutFilter;
     static AudioMixer4 inputMixer;
@@ -75,8 +119,20 @@ private:
     // Clipping Detection
     uint32_t lastClipTime;
 
+    // Graph gating
+    AudioGraphState graphState;
+    uint8_t graphBranches;
+    bool drainPending;
+    uint32_t drainStartTime;
+    uint32_t lastCpuSampleTime;
+    float cpuSum[GRAPH_STATE_COUNT];
+    uint32_t cpuSamples[GRAPH_STATE_COUNT];
+    float cpuMax[GRAPH_STATE_COUNT];
+
     void configureCodec();
     void updateWindCutFilter();
+    static uint8_t branchesFor(AudioGraphState state);
+    void applyBranches(uint8_t branches);
 };
 
 
@@ -87,6 +87,19 @@
 #define CLIPPING_THRESHOLD     0.9      // Peak level that triggers clipping indicator
 #define CLIPPING_HOLD_MS       500      // How long to show clipping indicator
 
+// Echo cancellation: removes playback that bleeds from the headset into the
+// mic before encoding (EchoCanceller.h, tuning AEC_*). Comment out to record
+// the raw mic.
+#define ECHO_CANCELLER
+#define REFERENCE_WAIT_US      6000     // Mic block held for its reference (two blocks) before going without
+
+// Audio graph gating: each state (idle, recording, playing) connects only
+// the graph branches it uses, and the audio update skips the rest
+// (AudioSystem::setGraphState). Comment out to run the whole graph all
+// the time, e.g. to compare the audio CPU the profile report shows.
+#define AUDIO_GRAPH_GATING
+#define GRAPH_DRAIN_MS         100      // Playback branch outlives playback: a full play queue
+
 // ============================================================================
 // Opus Codec Configuration
 // ============================================================================
@@ -185,6 +198,11 @@ struct Settings {
   #define DEBUG_PRINTF(...)
 #endif
 
+// Uncomment to time loop() by subsystem; the report goes out as log
+// messages (see SongbirdProfiler.h)
+// #define SONGBIRD_PROFILE
+#define PROFILE_REPORT_MS      10000    // Profile report interval
+
 // ============================================================================
 // VoiceChat Configuration
 // ============================================================================
@@ -3,6 +3,7 @@
  */
 
 #include "DisplayManager.h"
+#include <SongbirdProfiler.h>
 
 DisplayManager::DisplayManager() :
     display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire1, -1),
@@ -231,6 +232,7 @@ void DisplayManager::clear()
 
 void DisplayManager::update()
 {
+    PROFILE_ZONE("i2c_flush");
     display.display();
     lastUpdateTime = millis();
 }
@@ -0,0 +1,211 @@
+/*
+ * EchoCanceller.cpp - Fixed-point NLMS echo canceller implementation
+ */
+
+#include "EchoCanceller.h"
+#include "Config.h"
+#include <SongbirdProfiler.h>
+
+// Added to the reference energy so the step stays bounded when the
+// playback is quiet
+#define AEC_REGULARIZATION  ((int64_t)AEC_TAPS * AEC_REFERENCE_FLOOR * AEC_REFERENCE_FLOOR)
+
+static inline int16_t saturate16(int32_t x)
+{
+    if (x > 32767) return 32767;
+    if (x < -32768) return -32768;
+    return (int16_t)x;
+}
+
+static inline int32_t saturate32(int64_t x)
+{
+    if (x > INT32_MAX) return INT32_MAX;
+    if (x < INT32_MIN) return INT32_MIN;
+    return (int32_t)x;
+}
+
+EchoCanceller::EchoCanceller()
+{
+    setStepSize(AEC_STEP_SIZE);
+    setDoubleTalkThreshold(AEC_DTD_THRESHOLD);
+    dtdEnabled = true;
+    reset();
+}
+
+void EchoCanceller::reset()
+{
+    memset(taps, 0, sizeof(taps));
+    echoRatio = dtdThreshold / AEC_DTD_MARGIN;
+    restart();
+    micEnergy = 0;
+    errorEnergy = 0;
+    adaptedBlocks = 0;
+    doubleTalkBlocks = 0;
+}
+
+void EchoCanceller::restart()
+{
+    memset(history, 0, sizeof(history));
+    energy = 0;
+    holdSamples = 0;
+}
+
+void EchoCanceller::setStepSize(float mu)
+{
+    step = (int32_t)(constrain(mu, 0.0f, 1.0f) * 32767.0f);
+}
+
+void EchoCanceller::setDoubleTalkThreshold(float threshold)
+{
+    dtdThreshold = (int32_t)(constrain(threshold, 0.0f, 1.0f) * 32767.0f);
+    echoRatio = dtdThreshold / AEC_DTD_MARGIN;
+}
+
+float EchoCanceller::getDoubleTalkThreshold() const
+{
+    return min(dtdThreshold, echoRatio * AEC_DTD_MARGIN) / 32768.0f;
+}
+
+void EchoCanceller::process(int16_t* mic, const int16_t* reference, size_t count)
+{
+    PROFILE_ZONE("aec");
+
+    for (size_t i = 0; i + AEC_SUBBLOCK <= count; i += AEC_SUBBLOCK)
+    {
+        int16_t* incoming = &history[AEC_TAPS];
+        if (reference)
+        {
+            memcpy(incoming, &reference[i], AEC_SUBBLOCK * sizeof(int16_t));
+        }
+        else
+        {
+            memset(incoming, 0, AEC_SUBBLOCK * sizeof(int16_t));
+        }
+
+        processSubblock(&mic[i]);
+
+        memmove(history, &history[AEC_SUBBLOCK], AEC_TAPS * sizeof(int16_t));
+    }
+}
+
+void EchoCanceller::processSubblock(int16_t* mic)
+{
+    // Loudest reference sample the echo in this sub-block can come from
+    int32_t referencePeak = 0;
+    for (size_t j = 0; j < AEC_TAPS + AEC_SUBBLOCK; j++)
+    {
+        int32_t x = abs(history[j]);
+        if (x > referencePeak) referencePeak = x;
+    }
+
+    int32_t micPeak = 0;
+    for (size_t n = 0; n < AEC_SUBBLOCK; n++)
+    {
+        int32_t d = abs(mic[n]);
+        if (d > micPeak) micPeak = d;
+    }
+
+    // Geigel: the echo stays below threshold x the reference peak, so a
+    // louder mic means a near-end talker. Without playback there is no
+    // double talk, only the near end.
+    int32_t threshold = min(dtdThreshold, echoRatio * AEC_DTD_MARGIN);
+    if (dtdEnabled && referencePeak >= AEC_REFERENCE_FLOOR &&
+        ((int64_t)micPeak << 15) > (int64_t)threshold * referencePeak)
+    {
+        holdSamples = AEC_DTD_HOLD_MS * (AEC_SAMPLE_RATE / 1000);
+    }
+    else if (holdSamples > 0)
+    {
+        holdSamples -= AEC_SUBBLOCK;
+    }
+
+    if (referencePeak == 0)
+    {
+        // Nothing played within the filter's reach: no echo to remove
+        return;
+    }
+
+    bool adapt = holdSamples <= 0 && referencePeak >= AEC_REFERENCE_FLOOR;
+    if (referencePeak >= AEC_REFERENCE_FLOOR)
+    {
+        if (adapt) adaptedBlocks++;
+        else doubleTalkBlocks++;
+    }
+
+    if (adapt)
+    {
+        // Echo level, over about 64 sub-blocks of playback
+        int32_t ratio = (int32_t)(((int64_t)micPeak << 15) / referencePeak);
+        echoRatio += (ratio - echoRatio) / 64;
+    }
+
+    uint64_t blockMic = 0;
+    uint64_t blockError = 0;
+
+    for (size_t n = 0; n < AEC_SUBBLOCK; n++)
+    {
+        // Window of the AEC_TAPS newest reference samples, oldest first
+        const int16_t* x = &history[n + 1];
+        int32_t newest = x[AEC_TAPS - 1];
+        energy += newest * newest - history[n] * history[n];
+
+        int64_t acc = 0;
+        for (size_t j = 0; j < AEC_TAPS; j++)
+        {
+            acc += (int64_t)taps[j] * x[j];
+        }
+
+        int32_t d = mic[n];
+        int16_t e = saturate16(d - (int32_t)(acc >> 27));
+        mic[n] = e;
+
+        blockMic += (int64_t)d * d;
+        blockError += (int64_t)e * e;
+
+        if (!adapt || e == 0) continue;
+
+        // Step mu * e / |x|^2: normalize |x|^2 to 16 bits, take one
+        // reciprocal and fold the exponent into the shift
+        uint64_t norm = (uint64_t)energy + AEC_REGULARIZATION;
+        int32_t z = 63 - __builtin_clzll(norm);
+        uint32_t norm16 = (uint32_t)(norm >> (z - 15));
+        int32_t reciprocal = (int32_t)(0x80000000u / norm16);
+        int32_t k = saturate32(((int64_t)step * e * reciprocal) >> (z - 12));
+
+        for (size_t j = 0; j < AEC_TAPS; j++)
+        {
+            taps[j] += (int32_t)(((int64_t)k * x[j]) >> 16);
+        }
+    }
+
+    if (adapt)
+    {
+        // Smoothed over about 16 sub-blocks (16 ms)
+        micEnergy += ((int64_t)blockMic - (int64_t)micEnergy) / 16;
+        errorEnergy += ((int64_t)blockError - (int64_t)errorEnergy) / 16;
+    }
+}
+
+float EchoCanceller::getErle() const
+{
+    if (errorEnergy == 0 || micEnergy == 0) return 0.0f;
+    return 10.0f * log10f((float)micEnergy / (float)errorEnergy);
+}
+
+void AudioEchoReference::update(void)
+{
+    audio_block_t* block = receiveReadOnly(0);
+    if (block)
+    {
+        transmit(block);
+        release(block);
+        return;
+    }
+
+    // Keep the reference queue in step with the record queue
+    block = allocate();
+    if (!block) return;
+    memset(block->data, 0, sizeof(block->data));
+    transmit(block);
+    release(block);
+}
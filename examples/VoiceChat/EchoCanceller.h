@@ -0,0 +1,103 @@
+/*
+ * EchoCanceller.h - Acoustic echo cancellation for VoiceChat recordings
+ *
+ * Messages playing in the headset bleed back into its microphone and
+ * would go out again in the next recording. The canceller sits in front
+ * of the Opus encoder, on the 16 kHz frames OpusCodec has already
+ * downsampled, with the playback signal (playQueue's output, downsampled
+ * the same way) as the reference:
+ *
+ *   - an NLMS filter of AEC_TAPS taps models the path from the play
+ *     queue to the mic (two audio blocks of graph delay plus the
+ *     headset) and its estimate is subtracted from the mic
+ *   - double-talk detection (Geigel): while the mic is louder than the
+ *     echo could be, someone is talking over the playback and the filter
+ *     stops adapting, so it does not learn to cancel the talker. "Could
+ *     be" starts at AEC_DTD_THRESHOLD and comes down to AEC_DTD_MARGIN
+ *     times the echo level measured while adapting: a headset that
+ *     bleeds 26 dB down notices a talker well below the playback level.
+ *   - with no playback the filter is skipped: the mic passes through
+ *
+ * Fixed point: samples Q15, taps Q27 (an echo path up to +24 dB), 64-bit
+ * accumulation. The step is normalized by the reference energy with a
+ * single 32-bit division per sample. Work goes in 16-sample sub-blocks
+ * over a contiguous reference history, so the per-tap loops are straight
+ * multiply-accumulates.
+ */
+
+#ifndef VOICECHAT_ECHOCANCELLER_H
+#define VOICECHAT_ECHOCANCELLER_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#define AEC_TAPS                256     // 16 ms at 16 kHz
+#define AEC_SUBBLOCK            16      // Samples per double-talk decision
+#define AEC_SAMPLE_RATE         16000
+#define AEC_STEP_SIZE           0.25f   // NLMS mu, 0-1
+#define AEC_DTD_THRESHOLD       0.5f    // Near end when |mic| > this x max |reference|
+#define AEC_DTD_MARGIN          4       // Or this x the echo level measured so far
+#define AEC_DTD_HOLD_MS         40      // Keep adaptation off this long after
+#define AEC_REFERENCE_FLOOR     32      // Quieter playback (-60 dBFS) is not learned from
+
+class EchoCanceller
+{
+public:
+    EchoCanceller();
+
+    // Forget the echo path
+    void reset();
+
+    // Start a new recording: drop the old reference but keep the learned
+    // path, which a headset does not change between messages
+    void restart();
+
+    // mic becomes mic minus the echo of reference. count is a multiple
+    // of AEC_SUBBLOCK (an Opus frame is 20 of them); a NULL reference is
+    // silence.
+    void process(int16_t* mic, const int16_t* reference, size_t count);
+
+    void setStepSize(float mu);
+    void setDoubleTalkThreshold(float threshold);
+    void enableDoubleTalkDetection(bool enable) { dtdEnabled = enable; }
+
+    // Status
+    bool isDoubleTalk() const { return holdSamples > 0; }
+    float getDoubleTalkThreshold() const;   // In use, after the echo level
+    float getErle() const;      // dB, echo return loss enhancement while adapting
+    uint32_t getAdaptedBlocks() const { return adaptedBlocks; }
+    uint32_t getDoubleTalkBlocks() const { return doubleTalkBlocks; }
+
+private:
+    int32_t taps[AEC_TAPS];                         // Q27, oldest sample first
+    int16_t history[AEC_TAPS + AEC_SUBBLOCK];       // Reference, oldest first
+    int64_t energy;                                 // Of the last AEC_TAPS reference samples
+
+    int32_t step;                                   // Q15
+    int32_t dtdThreshold;                           // Q15
+    int32_t echoRatio;                              // Mean |mic| / |reference| peak, Q15
+    bool dtdEnabled;
+    int32_t holdSamples;
+
+    uint64_t micEnergy;                             // Smoothed, while adapting
+    uint64_t errorEnergy;
+    uint32_t adaptedBlocks;
+    uint32_t doubleTalkBlocks;
+
+    void processSubblock(int16_t* mic);
+};
+
+// Playback reference for the canceller: passes the play queue's blocks
+// through and sends silence when nothing plays, so the record queue
+// behind it gets one block per audio update, in step with the mic's
+class AudioEchoReference : public AudioStream
+{
+public:
+    AudioEchoReference() : AudioStream(1, inputQueueArray) {}
+    virtual void update(void);
+
+private:
+    audio_block_t* inputQueueArray[1];
+};
+
+#endif // VOICECHAT_ECHOCANCELLER_H
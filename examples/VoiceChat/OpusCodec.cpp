@@ -4,9 +4,10 @@
 
 #include "OpusCodec.h"
 #include "Config.h"
+#include <SongbirdProfiler.h>
 
 OpusCodec::OpusCodec()
-    : encoder(nullptr), decoder(nullptr), accumulatorCount(0),
+    : encoder(nullptr), decoder(nullptr), accumulatorCount(0), echoCanceller(nullptr),
       encodedPacketSize(0), packetReady(false),
       encodedPacketCount(0), decodedPacketCount(0),
       lastError(0), lastSample(0)
@@ -72,6 +73,11 @@ void OpusCodec::end()
 }
 
 int OpusCodec::addSamples(const int16_t* samples, size_t count)
+{
+    return addSamples(samples, NULL, count);
+}
+
+int OpusCodec::addSamples(const int16_t* samples, const int16_t* reference, size_t count)
 {
     if (!encoder) return -1;
 
@@ -80,6 +86,17 @@ int OpusCodec::addSamples(const int16_t* samples, size_t count)
     size_t toCopy = min(count, spaceAvailable);
 
     memcpy(&accumulator[accumulatorCount], samples, toCopy * sizeof(int16_t));
+    if (echoCanceller)
+    {
+        if (reference)
+        {
+            memcpy(&referenceAccumulator[accumulatorCount], reference, toCopy * sizeof(int16_t));
+        }
+        else
+        {
+            memset(&referenceAccumulator[accumulatorCount], 0, toCopy * sizeof(int16_t));
+        }
+    }
     accumulatorCount += toCopy;
 
     // Check if we have enough samples for a frame
@@ -90,6 +107,13 @@ int OpusCodec::addSamples(const int16_t* samples, size_t count)
         // Downsample to 16kHz
         downsample(accumulator, RESAMPLE_INPUT_SAMPLES, resampleBuffer, OPUS_FRAME_SAMPLES);
 
+        // Remove the playback that bled into the mic
+        if (echoCanceller)
+        {
+            downsample(referenceAccumulator, RESAMPLE_INPUT_SAMPLES, referenceBuffer, OPUS_FRAME_SAMPLES);
+            echoCanceller->process(resampleBuffer, referenceBuffer, OPUS_FRAME_SAMPLES);
+        }
+
         // Encode the frame
         if (encodeFrame())
         {
@@ -101,6 +125,11 @@ int OpusCodec::addSamples(const int16_t* samples, size_t count)
         if (remaining > 0)
         {
             memmove(accumulator, &accumulator[RESAMPLE_INPUT_SAMPLES], remaining * sizeof(int16_t));
+            if (echoCanceller)
+            {
+                memmove(referenceAccumulator, &referenceAccumulator[RESAMPLE_INPUT_SAMPLES],
+                        remaining * sizeof(int16_t));
+            }
         }
         accumulatorCount = remaining;
     }
@@ -110,6 +139,7 @@ int OpusCodec::addSamples(const int16_t* samples, size_t count)
 
 bool OpusCodec::encodeFrame()
 {
+    PROFILE_ZONE("opus_enc");
     int bytes = opus_encode(encoder, resampleBuffer, OPUS_FRAME_SAMPLES,
                            encodedPacket, OPUS_MAX_PACKET_SIZE);
     if (bytes < 0)
@@ -157,11 +187,17 @@ void OpusCodec::resetEncoder()
     packetReady = false;
     encodedPacketSize = 0;
     lastSample = 0;
+
+    if (echoCanceller)
+    {
+        echoCanceller->restart();
+    }
 }
 
 int OpusCodec::decode(const uint8_t* packet, size_t packetSize,
                       int16_t* outputSamples, size_t maxSamples)
 {
+    PROFILE_ZONE("opus_dec");
     if (!decoder) return -1;
 
     // Decode to 16kHz
@@ -182,6 +218,15 @@ int OpusCodec::decode(const uint8_t* packet, size_t packetSize,
     return outputCount;
 }
 
+void OpusCodec::resetDecoder()
+{
+    if (decoder)
+    {
+        opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+    }
+    lastSample = 0;
+}
+
 void OpusCodec::downsample(const int16_t* input, size_t inputCount,
                            int16_t* output, size_t outputCount)
 {
@@ -10,6 +10,7 @@
 
 #include <Arduino.h>
 #include <opus.h>
+#include "EchoCanceller.h"
 
 // Opus configuration
 #define OPUS_SAMPLE_RATE      16000   // 16kHz for voice (wideband)
@@ -45,6 +46,9 @@ public:
     // Feed 44.1kHz samples, get Opus packets out
     // Returns: number of bytes written to outputPacket, or 0 if no packet ready, -1 on error
     int addSamples(const int16_t* samples, size_t count);
+    // Same, with the playback that was heard while recording, for the
+    // echo canceller (NULL = silence)
+    int addSamples(const int16_t* samples, const int16_t* reference, size_t count);
     int getEncodedPacket(uint8_t* outputPacket, size_t maxSize);
     bool hasEncodedPacket() const { return packetReady; }
     void resetEncoder();
@@ -53,6 +57,7 @@ public:
     // Feed Opus packets, get 44.1kHz samples out
     // Returns: number of samples written to outputSamples, or -1 on error
     int decode(const uint8_t* packet, size_t packetSize, int16_t* outputSamples, size_t maxSamples);
+    void resetDecoder();
 
     // Statistics
     uint32_t getEncodedPackets() const { return encodedPacketCount; }
@@ -62,6 +67,7 @@ public:
     // Configuration
     void setBitrate(int bps);
     void setComplexity(int complexity);  // 0-10, higher = better quality, more CPU
+    void setEchoCanceller(EchoCanceller* canceller) { echoCanceller = canceller; }
 
 private:
     OpusEncoder* encoder;
@@ -74,6 +80,11 @@ private:
     // Resampled buffer (16kHz)
     int16_t resampleBuffer[OPUS_FRAME_SAMPLES];
 
+    // Echo cancellation: playback reference, kept in step with the accumulator
+    EchoCanceller* echoCanceller;
+    int16_t referenceAccumulator[ACCUMULATOR_SIZE];
+    int16_t referenceBuffer[OPUS_FRAME_SAMPLES];
+
     // Encoded packet buffer
     uint8_t encodedPacket[OPUS_MAX_PACKET_SIZE];
     size_t encodedPacketSize;
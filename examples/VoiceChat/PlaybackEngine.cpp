@@ -352,43 +352,50 @@ bool PlaybackEngine::processPlayback(AudioPlayQueue* playQueue)
     while (playQueue->available() && loopCount < 10)  // Limit iterations to prevent lockup
     {
         loopCount++;
-        
-        // If we have buffered samples, send them
-        if (outputBufferPos < outputBufferCount)
-        {
-            int16_t* dest = playQueue->getBuffer();
-            size_t toCopy = min((size_t)AUDIO_BLOCK_SAMPLES,
-                               outputBufferCount - outputBufferPos);
-
-            memcpy(dest, &outputBuffer[outputBufferPos], toCopy * sizeof(int16_t));
-
-            // Pad with zeros if needed
-            if (toCopy < AUDIO_BLOCK_SAMPLES)
-            {
-                memset(&dest[toCopy], 0, (AUDIO_BLOCK_SAMPLES - toCopy) * sizeof(int16_t));
-            }
-
-            playQueue->playBuffer();
-            outputBufferPos += toCopy;
-            continue;
-        }
 
         // Need more samples - decode next packet
-        if (!decodeAndBuffer())
+        if (outputBufferPos >= outputBufferCount && !decodeAndBuffer())
         {
             // End of file - try to move to next message
             DEBUG_PRINTLN("File complete, checking for next message");
-            
+
             if (!skipToNext())
             {
                 // No more messages
                 DEBUG_PRINTLN("No more messages in queue");
                 return false;  // Signal that playback is done
             }
-            
+
             // Successfully moved to next file, continue playback
             continue;
         }
+
+        // A decoded frame (882 samples) is not a whole number of blocks, so
+        // the block is topped up from the next packet; padding it would put
+        // a gap in every frame and stretch the message
+        int16_t* dest = playQueue->getBuffer();
+        size_t filled = 0;
+        while (filled < AUDIO_BLOCK_SAMPLES)
+        {
+            if (outputBufferPos >= outputBufferCount && !decodeAndBuffer())
+            {
+                break;
+            }
+            size_t toCopy = min((size_t)AUDIO_BLOCK_SAMPLES - filled,
+                               outputBufferCount - outputBufferPos);
+
+            memcpy(&dest[filled], &outputBuffer[outputBufferPos], toCopy * sizeof(int16_t));
+            filled += toCopy;
+            outputBufferPos += toCopy;
+        }
+
+        // Pad the last block of a file with zeros
+        if (filled < AUDIO_BLOCK_SAMPLES)
+        {
+            memset(&dest[filled], 0, (AUDIO_BLOCK_SAMPLES - filled) * sizeof(int16_t));
+        }
+
+        playQueue->playBuffer();
     }
 
     return true;  // Still playing
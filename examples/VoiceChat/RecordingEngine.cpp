@@ -7,7 +7,7 @@
 RecordingEngine::RecordingEngine()
     : recording(false), sdCardPresent(false), lastError(ERROR_NONE),
       recordingStartTime(0), bytesWritten(0), packetCount(0),
-      nextSequenceNumber(1)
+      referenceWaiting(false), referenceWaitStart(0), nextSequenceNumber(1)
 {
 }
 
@@ -33,6 +33,10 @@ bool RecordingEngine::begin()
         return false;
     }
 
+#ifdef ECHO_CANCELLER
+    codec.setEchoCanceller(&echoCanceller);
+#endif
+
     // Scan for highest sequence number in TX directory
     File txDir = SD.open(TX_DIR);
     if (txDir)
@@ -162,13 +166,14 @@ bool RecordingEngine::startRecording(uint8_t channel)
     // Reset counters
     recordingStartTime = millis();
     packetCount = 0;
+    referenceWaiting = false;
     recording = true;
 
     DEBUG_PRINTLN("Recording started successfully");
     return true;
 }
 
-bool RecordingEngine::processRecording(AudioRecordQueue* queue)
+bool RecordingEngine::processRecording(AudioRecordQueue* queue, AudioRecordQueue* reference)
 {
     if (!recording || !queue) return false;
 
@@ -176,10 +181,54 @@ bool RecordingEngine::processRecording(AudioRecordQueue* queue)
 
     while (queue->available() > 0)
     {
+        // Both queues are started together and get a block in each audio
+        // update, so with as many blocks in each the heads are from the
+        // same update. The reference is counted first: an update in
+        // between then only makes the mic look ahead.
+        int16_t* referenceBuffer = NULL;
+        if (reference)
+        {
+            int referenceCount = reference->available();
+            int micCount = queue->available();
+
+            // The mic queue lost blocks (it was full): the oldest
+            // references have no mic block left
+            for (; referenceCount > micCount; referenceCount--)
+            {
+                reference->readBuffer();
+                reference->freeBuffer();
+            }
+
+            if (referenceCount == micCount)
+            {
+                referenceWaiting = false;
+                referenceBuffer = reference->readBuffer();
+            }
+            else
+            {
+                // Its reference is due in the next update; pairing this
+                // block with silence would put every later pair one off.
+                // If it has not come by REFERENCE_WAIT_US it was lost (no
+                // memory for one), and the oldest mic blocks go without
+                // until the counts meet.
+                if (!referenceWaiting)
+                {
+                    referenceWaiting = true;
+                    referenceWaitStart = micros();
+                }
+                if (micros() - referenceWaitStart < REFERENCE_WAIT_US) break;
+            }
+        }
+
         int16_t* buffer = queue->readBuffer();
 
         // Feed samples to Opus encoder
-        int result = codec.addSamples(buffer, AUDIO_BLOCK_SAMPLES);
+        int result = codec.addSamples(buffer, referenceBuffer, AUDIO_BLOCK_SAMPLES);
+
+        if (referenceBuffer)
+        {
+            reference->freeBuffer();
+        }
 
         if (result < 0)
         {
@@ -265,6 +314,11 @@ bool RecordingEngine::stopRecording()
     DEBUG_PRINTF("  Duration: %lu ms\n", getRecordingDuration());
     DEBUG_PRINTF("  Size: %lu bytes\n", bytesWritten);
     DEBUG_PRINTF("  Packets: %lu\n", packetCount);
+#ifdef ECHO_CANCELLER
+    DEBUG_PRINTF("  Echo canceller: ERLE %.1f dB, %lu ms adapted, %lu ms double talk\n",
+                 echoCanceller.getErle(), echoCanceller.getAdaptedBlocks(),
+                 echoCanceller.getDoubleTalkBlocks());
+#endif
 
     return true;
 }
@@ -12,6 +12,7 @@
 #include <Audio.h>
 #include "Config.h"
 #include "OpusCodec.h"
+#include "EchoCanceller.h"
 
 // Opus file format: simple packet container
 // File structure: [packet_size:uint16][packet_data:bytes]...
@@ -27,7 +28,9 @@ public:
 
     // Recording control
     bool startRecording(uint8_t channel);
-    bool processRecording(AudioRecordQueue* queue);
+    // reference: the playback heard while recording (AudioSystem's
+    // reference queue), for the echo canceller; may be NULL
+    bool processRecording(AudioRecordQueue* queue, AudioRecordQueue* reference = NULL);
     bool stopRecording();
     bool isRecording() const { return recording; }
 
@@ -39,6 +42,7 @@ public:
     uint32_t getRecordingDuration() const;  // In milliseconds
     uint32_t getRecordingSize() const;      // In bytes (compressed)
     uint32_t getPacketCount() const { return packetCount; }
+    const EchoCanceller& getEchoCanceller() const { return echoCanceller; }
 
     // Error handling
     bool hasError() const { return lastError != ERROR_NONE; }
@@ -53,6 +57,7 @@ private:
 
     // Opus codec
     OpusCodec codec;
+    EchoCanceller echoCanceller;
 
     // Current recording
     File currentFile;
@@ -61,6 +66,10 @@ private:
     uint32_t bytesWritten;
     uint32_t packetCount;
 
+    // Mic blocks waiting for their echo reference since (micros)
+    bool referenceWaiting;
+    uint32_t referenceWaitStart;
+
     // File management
     uint32_t nextSequenceNumber;
 
@@ -3,18 +3,19 @@
  *
  * TX: Simple header without username
  * RX: Header includes username from bridge
- * Control messages: Join/Part notifications
+ * Control messages: Join/Part notifications, telemetry requests
  */
 
 #include "SerialProtocol.h"
 #include <stdarg.h>
+#include <SongbirdProfiler.h>
 
 SerialProtocol::SerialProtocol()
     : serial(nullptr), rxState(RX_WAIT_SYNC1), rxFileLength(0),
       rxBytesReceived(0), rxChannel(0), rxLengthPos(0),
       rxMsgType(0), rxUsernameLen(0), rxUsernamePos(0),
       rxFileReady(false), rxSequence(0), lastActivityTime(0),
-      userCount(0), userListChanged(false)
+      userCount(0), userListChanged(false), telemetryRequested(false)
 {
     rxUsername[0] = '\0';
     rxFilePath[0] = '\0';
@@ -106,6 +107,7 @@ void SerialProtocol::removeUser(const char* username)
 
 bool SerialProtocol::sendFile(const char* filepath, uint8_t channel)
 {
+    PROFILE_ZONE("serial_tx");
     if (!serial) return false;
 
     File file = SD.open(filepath, FILE_READ);
@@ -168,6 +170,26 @@ void SerialProtocol::sendLog(const char* message)
     serial->write((const uint8_t*)message, len);
 }
 
+void SerialProtocol::sendTelemetry(const TelemetryFrame& frame)
+{
+    if (!serial) return;
+    
+    uint32_t len = sizeof(frame);
+    
+    // Header: sync(2) + length(4) + channel(1=0xFD)
+    uint8_t header[TX_HEADER_SIZE];
+    header[0] = SYNC_BYTE_1;
+    header[1] = SYNC_BYTE_2;
+    header[2] = len & 0xFF;
+    header[3] = (len >> 8) & 0xFF;
+    header[4] = (len >> 16) & 0xFF;
+    header[5] = (len >> 24) & 0xFF;
+    header[6] = TELEMETRY_CHANNEL;
+    
+    serial->write(header, TX_HEADER_SIZE);
+    serial->write((const uint8_t*)&frame, len);
+}
+
 void SerialProtocol::sendLogf(const char* format, ...)
 {
     char buffer[256];
@@ -278,6 +300,10 @@ bool SerialProtocol::processIncoming()
                 } else if (rxMsgType == MSG_TYPE_PING) {
                     // Ping received - just reset state, lastActivityTime already updated
                     resetRxState();
+                } else if (rxMsgType == MSG_TYPE_TELEMETRY) {
+                    // Answered from loop(), which owns the telemetry
+                    telemetryRequested = true;
+                    resetRxState();
                 } else {
                     // Unknown control message type
                     sendLogf("Unknown msg type: 0x%02X", rxMsgType);
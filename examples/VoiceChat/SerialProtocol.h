@@ -7,6 +7,10 @@
  * Control messages (Bridge -> Songbird):
  *   Join:  [SYNC:2][LENGTH:4=0][CHANNEL:0xFF][MSG_TYPE:1=0x01][USERNAME_LEN:1][USERNAME...]
  *   Part:  [SYNC:2][LENGTH:4=0][CHANNEL:0xFF][MSG_TYPE:1=0x02][USERNAME_LEN:1][USERNAME...]
+ *   Telemetry request: [SYNC:2][LENGTH:4=0][CHANNEL:0xFF][MSG_TYPE:1=0x04]
+ *
+ * Telemetry reply (Songbird -> Bridge):
+ *   [SYNC:2][LENGTH:4=46][CHANNEL:0xFD][TelemetryFrame, see SongbirdTelemetry.h]
  *
  * The bridge injects the sender's username into incoming messages.
  * Received files are saved as: /RX/CHx/MSG_NNNNN_from_Username.opus
@@ -17,6 +21,7 @@
 
 #include <Arduino.h>
 #include <SD.h>
+#include <SongbirdTelemetry.h>
 #include "Config.h"
 
 // Protocol constants
@@ -32,10 +37,14 @@
 #define MSG_TYPE_JOIN       0x01
 #define MSG_TYPE_PART       0x02
 #define MSG_TYPE_PING       0x03
+#define MSG_TYPE_TELEMETRY  0x04
 
 // Log message (sent with channel=0xFE, length=log string length)
 #define LOG_CHANNEL         0xFE
 
+// Telemetry frame (sent with channel=0xFD, length=sizeof(TelemetryFrame))
+#define TELEMETRY_CHANNEL   0xFD
+
 class SerialProtocol
 {
 public:
@@ -51,6 +60,9 @@ public:
     void sendLog(const char* message);
     void sendLogf(const char* format, ...);
 
+    // Send an audio CPU/memory report, in answer to a telemetry request
+    void sendTelemetry(const TelemetryFrame& frame);
+
     // Receive - call in loop
     // Returns true if a complete file is ready
     bool processIncoming();
@@ -68,6 +80,10 @@ public:
     bool hasUserListChanged() const { return userListChanged; }
     void clearUserListChanged() { userListChanged = false; }
 
+    // The bridge asked for a telemetry frame
+    bool hasTelemetryRequest() const { return telemetryRequested; }
+    void clearTelemetryRequest() { telemetryRequested = false; }
+
     // Connection status (based on recent activity)
     bool isConnected() const;
 
@@ -108,6 +124,7 @@ private:
     char users[MAX_USERS][MAX_USERNAME_LEN + 1];
     uint8_t userCount;
     bool userListChanged;
+    bool telemetryRequested;
 
     // Helper
     void resetRxState();
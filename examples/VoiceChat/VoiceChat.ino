@@ -13,6 +13,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <Audio.h>
+#include <SongbirdTelemetry.h>
 
 #include "Config.h"
 #include "AudioSystem.h"
@@ -23,6 +24,7 @@
 #include "SerialProtocol.h"
 #include "RecordingEngine.h"
 #include "PlaybackEngine.h"
+#include <SongbirdProfiler.h>      // After Config.h: SONGBIRD_PROFILE
 
 // =============================================================================
 // Global Objects
@@ -36,6 +38,7 @@ StorageManager storage;
 SerialProtocol protocol;
 RecordingEngine recorder;
 PlaybackEngine player;
+SongbirdTelemetry telemetry;
 
 // System state
 SystemState currentState = STATE_IDLE;
@@ -48,6 +51,9 @@ Settings currentSettings;
 // Timing
 elapsedMillis displayUpdateTimer = 0;
 elapsedMillis playbackCheckTimer = 0;
+#ifdef SONGBIRD_PROFILE
+elapsedMillis profileReportTimer = 0;
+#endif
 
 // State variables
 bool isConnected = false;
@@ -82,6 +88,9 @@ void updateDisplay();
 void handleButtonEvents();
 void processProtocol();
 void updateQueueCounts();
+#ifdef SONGBIRD_PROFILE
+void sendProfile();
+#endif
 
 // =============================================================================
 // Setup
@@ -131,6 +140,8 @@ void setup()
         audioSystem.setPlaybackVolume(currentSettings.playbackVolume);
     }
 
+    telemetry.begin(AUDIO_MEMORY_BLOCKS);
+
     // Initialize recording engine
     if (!recorder.begin())
     {
@@ -156,6 +167,9 @@ void setup()
 
 void loop()
 {
+    PROFILE_LOOP();
+    telemetry.loopTick();
+    audioSystem.updateGraph();
     ui.update();
     leds.update();
 
@@ -203,6 +217,10 @@ void loop()
 
     // Update display
     updateDisplay();
+
+#ifdef SONGBIRD_PROFILE
+    sendProfile();
+#endif
 }
 
 // =============================================================================
@@ -211,6 +229,8 @@ void loop()
 
 void processProtocol()
 {
+    PROFILE_ZONE("serial_rx");
+
     if (protocol.processIncoming())
     {
         // A complete file was received
@@ -233,8 +253,42 @@ void processProtocol()
             startPlayback();
         }
     }
+
+    if (protocol.hasTelemetryRequest())
+    {
+        TelemetryFrame frame;
+        telemetry.frame(frame);
+        protocol.sendTelemetry(frame);
+        protocol.clearTelemetryRequest();
+    }
 }
 
+#ifdef SONGBIRD_PROFILE
+// Serial carries the binary protocol, so the profile goes out as log
+// messages, one per line
+void sendProfile()
+{
+    if (profileReportTimer < PROFILE_REPORT_MS) return;
+    profileReportTimer = 0;
+
+    char line[PROFILER_LINE_MAX];
+    for (uint8_t i = 0; i < SongbirdProfiler::lineCount(); i++)
+    {
+        SongbirdProfiler::formatLine(i, line, sizeof(line));
+        protocol.sendLog(line);
+    }
+    SongbirdProfiler::discardIteration();
+
+    // Audio CPU by graph state, mean/peak percent
+    protocol.sendLogf("audio_cpu idle=%.2f/%.2f recording=%.2f/%.2f playing=%.2f/%.2f branches=0x%02X",
+                      audioSystem.getGraphCpu(GRAPH_IDLE), audioSystem.getGraphCpuMax(GRAPH_IDLE),
+                      audioSystem.getGraphCpu(GRAPH_RECORDING), audioSystem.getGraphCpuMax(GRAPH_RECORDING),
+                      audioSystem.getGraphCpu(GRAPH_PLAYING), audioSystem.getGraphCpuMax(GRAPH_PLAYING),
+                      audioSystem.getGraphBranches());
+    audioSystem.resetGraphCpu();
+}
+#endif
+
 // =============================================================================
 // State Processing
 // =============================================================================
@@ -255,13 +309,25 @@ void processIdleState()
 
 void processRecordingState()
 {
+    PROFILE_ZONE("record");
+
     // Process audio from record queue
     AudioRecordQueue* queue = audioSystem.getRecordQueue();
     
     if (queue->available() > 0)
     {
-        recorder.processRecording(queue);
+        recorder.processRecording(queue, audioSystem.getReferenceQueue());
     }
+
+#ifdef ECHO_CANCELLER
+    // The message that was playing when PTT went down carries on
+    if (wasPlayingBeforePTT && !player.processPlayback(audioSystem.getPlayQueue()))
+    {
+        player.stopPlayback();
+        updateQueueCounts();
+        wasPlayingBeforePTT = false;
+    }
+#endif
     
     // Update LED with audio level
     float level = audioSystem.getPeakLevel();
@@ -275,6 +341,8 @@ void processRecordingState()
 
 void processPlayingState()
 {
+    PROFILE_ZONE("playback");
+
     // Feed audio to play queue
     if (!player.processPlayback(audioSystem.getPlayQueue()))
     {
@@ -308,7 +376,11 @@ void startRecording()
     if (currentState == STATE_PLAYING)
     {
         wasPlayingBeforePTT = true;
+#ifndef ECHO_CANCELLER
         player.pausePlayback();
+#endif
+        // With the echo canceller the message plays on under PTT: it is
+        // the canceller's reference, and what it takes out of the mic
     }
 
     protocol.sendLog("Starting recording");
@@ -321,13 +393,15 @@ void startRecording()
         return;
     }
     
-    queue->begin();
+    audioSystem.setGraphState(GRAPH_RECORDING);
+    audioSystem.beginRecordQueues();
     
     // Start recording to file (channel is 0-indexed here, will be converted)
     if (!recorder.startRecording(currentSettings.currentChannel))
     {
         protocol.sendLog("Failed to start recording");
-        queue->end();
+        audioSystem.endRecordQueues();
+        audioSystem.setGraphState(currentState == STATE_PLAYING ? GRAPH_PLAYING : GRAPH_IDLE);
         return;
     }
 
@@ -343,20 +417,30 @@ void stopRecording()
     uint32_t duration = recorder.getRecordingDuration();
     protocol.sendLogf("Stopping recording: %lu ms", duration);
 
-    // Stop the audio record queue
-    audioSystem.getRecordQueue()->end();
+    // Stop the audio record queues
+    audioSystem.endRecordQueues();
+
+#ifdef ECHO_CANCELLER
+    // Sending blocks the loop; hold the message until it is done
+    if (wasPlayingBeforePTT)
+    {
+        player.pausePlayback();
+    }
+#endif
     
     // Stop recording (closes file, returns filename)
     if (!recorder.stopRecording())
     {
         protocol.sendLog("Failed to stop recording");
         audioSystem.enableInputMonitoring(false);
+        audioSystem.setGraphState(GRAPH_IDLE);
         leds.setRecording(false);
         currentState = STATE_IDLE;
         return;
     }
 
     audioSystem.enableInputMonitoring(false);
+    audioSystem.setGraphState(wasPlayingBeforePTT ? GRAPH_PLAYING : GRAPH_IDLE);
     leds.setRecording(false);
 
     // Send the recorded file (channel is 1-indexed for protocol)
@@ -410,9 +494,11 @@ void startPlayback()
         return;
     }
 
+    audioSystem.setGraphState(GRAPH_PLAYING);
     if (!player.startPlayback(audioSystem.getPlayQueue()))
     {
         protocol.sendLog("Failed to start playback");
+        audioSystem.setGraphState(GRAPH_IDLE);
         return;
     }
 
@@ -431,6 +517,7 @@ void stopPlayback()
     protocol.sendLog("Stopping playback");
     
     player.stopPlayback();
+    audioSystem.setGraphState(GRAPH_IDLE);
     audioSystem.enableHeadphoneAmp(false);
     
     // Update queue count
@@ -492,6 +579,8 @@ void updateDisplay()
     if (displayUpdateTimer < interval) return;
     displayUpdateTimer = 0;
 
+    PROFILE_ZONE("display");
+
     switch (currentState)
     {
         case STATE_IDLE:
@@ -558,6 +647,8 @@ void updateDisplay()
 
 void handleButtonEvents()
 {
+    PROFILE_ZONE("buttons");
+
     // PTT (TOP/UP button)
     if (ui.wasJustPressed(BTN_UP))
     {
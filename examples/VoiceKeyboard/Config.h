@@ -130,6 +130,7 @@ enum ErrorType {
 
 // Serial communication
 #define SERIAL_BAUD_RATE       115200
+#define TELEMETRY_LOG_MS       10000    // Audio CPU/memory report as a log message (0 = off)
 
 // File system
 #define TX_DIR                "/TX"      // Outgoing messages
@@ -182,6 +182,15 @@ int OpusCodec::decode(const uint8_t* packet, size_t packetSize,
     return outputCount;
 }
 
+void OpusCodec::resetDecoder()
+{
+    if (decoder)
+    {
+        opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+    }
+    lastSample = 0;
+}
+
 void OpusCodec::downsample(const int16_t* input, size_t inputCount,
                            int16_t* output, size_t outputCount)
 {
@@ -53,6 +53,7 @@ public:
     // Feed Opus packets, get 44.1kHz samples out
     // Returns: number of samples written to outputSamples, or -1 on error
     int decode(const uint8_t* packet, size_t packetSize, int16_t* outputSamples, size_t maxSamples);
+    void resetDecoder();
 
     // Statistics
     uint32_t getEncodedPackets() const { return encodedPacketCount; }
@@ -11,6 +11,7 @@
 #include <Wire.h>
 #include <Audio.h>
 #include <SD.h>
+#include <SongbirdTelemetry.h>
 
 #include "Config.h"
 #include "AudioSystem.h"
@@ -34,6 +35,7 @@ StorageManager storage;
 SerialProtocol protocol;
 RecordingEngine recorder;
 PlaybackEngine player;
+SongbirdTelemetry telemetry;
 
 // System state
 SystemState currentState = STATE_IDLE;
@@ -41,6 +43,7 @@ ErrorType currentError = ERROR_NONE;
 
 // Timing
 elapsedMillis playbackCheckTimer = 0;
+elapsedMillis telemetryTimer = 0;
 
 // State variables
 bool isConnected = false;
@@ -96,6 +99,7 @@ void setup()
         audioSystem.setMicGain(DEFAULT_MIC_GAIN);
         audioSystem.setPlaybackVolume(DEFAULT_PLAYBACK_VOLUME);
     }
+    telemetry.begin(AUDIO_MEMORY_BLOCKS);
 
     // Initialize recording engine
     if (!recorder.begin())
@@ -136,6 +140,7 @@ void setup()
 
 void loop()
 {
+    telemetry.loopTick();
     ui.update();
     leds.update();
 
@@ -197,6 +202,16 @@ void loop()
 
     // Update display
     display.update();
+
+    // The serial port carries the file protocol, so telemetry goes out as
+    // a log message
+    if (TELEMETRY_LOG_MS > 0 && telemetryTimer >= TELEMETRY_LOG_MS)
+    {
+        telemetryTimer = 0;
+        char line[TELEMETRY_LINE_MAX];
+        telemetry.format(line, sizeof(line));
+        protocol.sendLog(line);
+    }
 }
 
 // =============================================================================
@@ -0,0 +1,480 @@
+/**
+ * Cabin EQ for Roadtrip
+ *
+ * A stereo parametric EQ between the mixers and the outputs, plus optional
+ * noise-adaptive loudness: a microphone in the cabin measures road noise
+ * during quiet passages, and the bass and presence shelves are raised as
+ * the noise rises so the low end is not lost at highway speed.
+ *
+ * Filters are fixed point: Q28 coefficients, samples carried with 8 bits
+ * of extra precision and 64-bit accumulation (one SMLAL per tap on the
+ * Cortex-M7). Each stage runs over the whole block, left and right
+ * interleaved, before the next one starts, so its coefficients stay in
+ * registers. Flat bands cost nothing.
+ *
+ * CPU budget:
+ *   update() counts its own cycles. If the average goes over
+ *   CABIN_EQ_BUDGET_PCT of the block period, bands are dropped from the
+ *   end of the list (lowest priority) until it fits again, and restored
+ *   once there is room. A band on its way out or back in is cross-faded
+ *   with its own input over CABIN_EQ_FADE_BITS samples, so the curve
+ *   never changes in one step.
+ */
+
+#ifndef CABIN_EQ_H
+#define CABIN_EQ_H
+
+#include <Arduino.h>
+#include <Audio.h>
+#include <math.h>
+
+#define CABIN_EQ_BANDS          5
+#define CABIN_EQ_MAX_GAIN_DB    12.0f
+#define CABIN_EQ_BUDGET_PCT     5.0f     // Of one core, per block period
+#define CABIN_EQ_COEF_BITS      28       // Q28 coefficients, range +/-8
+#define CABIN_EQ_EXTRA_BITS     8        // Fraction bits below the int16 LSB
+#define CABIN_EQ_HOLD_BLOCKS    64       // Blocks between budget adjustments
+#define CABIN_EQ_FADE_BITS      10       // Budget cross-fade, 1024 samples (23 ms)
+
+enum CabinEqType {
+  CABIN_EQ_LOW_SHELF,
+  CABIN_EQ_HIGH_SHELF,
+  CABIN_EQ_PEAK
+};
+
+struct CabinEqBand {
+  CabinEqType type;
+  float frequency;
+  float gainDb;
+  float q;
+};
+
+// Default curve, in priority order. Bands 0 and 1 also carry the
+// noise-adaptive boost.
+const CabinEqBand cabinEqPreset[CABIN_EQ_BANDS] = {
+  { CABIN_EQ_LOW_SHELF,    120.0f,  2.0f, 0.707f },
+  { CABIN_EQ_HIGH_SHELF,  6000.0f,  1.0f, 0.707f },
+  { CABIN_EQ_PEAK,         250.0f, -1.5f, 1.0f },    // Cabin boom
+  { CABIN_EQ_PEAK,        2500.0f,  1.0f, 1.0f },    // Vocal presence
+  { CABIN_EQ_PEAK,        1000.0f,  0.0f, 1.0f },    // Spare
+};
+
+// RBJ cookbook biquad, normalized: c = b0 b1 b2 a1 a2
+void cabinEqDesign(CabinEqType type, float frequency, float gainDb, float q, float c[5]) {
+  float fs = AUDIO_SAMPLE_RATE_EXACT;
+  frequency = constrain(frequency, 10.0f, fs * 0.45f);
+
+  float A = powf(10.0f, gainDb / 40.0f);
+  float w0 = 2.0f * (float)M_PI * frequency / fs;
+  float cosw = cosf(w0);
+  float alpha = sinf(w0) / (2.0f * q);
+  float beta = 2.0f * sqrtf(A) * alpha;
+  float b0, b1, b2, a0, a1, a2;
+
+  switch (type) {
+    case CABIN_EQ_LOW_SHELF:
+      b0 = A * ((A + 1) - (A - 1) * cosw + beta);
+      b1 = 2 * A * ((A - 1) - (A + 1) * cosw);
+      b2 = A * ((A + 1) - (A - 1) * cosw - beta);
+      a0 = (A + 1) + (A - 1) * cosw + beta;
+      a1 = -2 * ((A - 1) + (A + 1) * cosw);
+      a2 = (A + 1) + (A - 1) * cosw - beta;
+      break;
+    case CABIN_EQ_HIGH_SHELF:
+      b0 = A * ((A + 1) + (A - 1) * cosw + beta);
+      b1 = -2 * A * ((A - 1) + (A + 1) * cosw);
+      b2 = A * ((A + 1) + (A - 1) * cosw - beta);
+      a0 = (A + 1) - (A - 1) * cosw + beta;
+      a1 = 2 * ((A - 1) - (A + 1) * cosw);
+      a2 = (A + 1) - (A - 1) * cosw - beta;
+      break;
+    default:
+      b0 = 1 + alpha * A;
+      b1 = -2 * cosw;
+      b2 = 1 - alpha * A;
+      a0 = 1 + alpha / A;
+      a1 = -2 * cosw;
+      a2 = 1 - alpha / A;
+      break;
+  }
+
+  c[0] = b0 / a0;
+  c[1] = b1 / a0;
+  c[2] = b2 / a0;
+  c[3] = a1 / a0;
+  c[4] = a2 / a0;
+}
+
+// Magnitude response of one normalized biquad, in dB
+float cabinEqResponseDb(const float c[5], float frequency) {
+  float w = 2.0f * (float)M_PI * frequency / AUDIO_SAMPLE_RATE_EXACT;
+  float c1 = cosf(w), s1 = sinf(w);
+  float c2 = cosf(2 * w), s2 = sinf(2 * w);
+
+  float nr = c[0] + c[1] * c1 + c[2] * c2;
+  float ni = -(c[1] * s1 + c[2] * s2);
+  float dr = 1.0f + c[3] * c1 + c[4] * c2;
+  float di = -(c[3] * s1 + c[4] * s2);
+
+  return 10.0f * log10f((nr * nr + ni * ni) / (dr * dr + di * di));
+}
+
+// ============================================================
+// EQ Stage
+// ============================================================
+class AudioFilterCabinEq : public AudioStream
+{
+public:
+  AudioFilterCabinEq() : AudioStream(2, inputQueueArray) {
+    stageCount = 0;
+    stageLimit = CABIN_EQ_BANDS;
+    preamp = 32767;
+    bassBoostDb = 0;
+    presenceBoostDb = 0;
+    cycleAverage = 0;
+    cycleMax = 0;
+    budgetHold = 0;
+    budgetCycles = 0;
+    fadeRemaining = 0;
+    fadeIn = false;
+    memset(state, 0, sizeof(state));
+    memset(bandActive, 0, sizeof(bandActive));
+  }
+
+  // Load the preset. Call from setup(), after the CPU clock is set.
+  void begin() {
+    setBudget(CABIN_EQ_BUDGET_PCT);
+    for (int i = 0; i < CABIN_EQ_BANDS; i++) {
+      bands[i] = cabinEqPreset[i];
+    }
+    applyBands();
+  }
+
+  void setBand(int band, CabinEqType type, float frequency, float gainDb, float q) {
+    if (band < 0 || band >= CABIN_EQ_BANDS) return;
+    bands[band].type = type;
+    bands[band].frequency = frequency;
+    bands[band].gainDb = gainDb;
+    bands[band].q = q;
+    applyBands();
+  }
+
+  // Extra gain on top of the preset for the low shelf (band 0) and
+  // high shelf (band 1), used by the noise-adaptive loudness
+  void setBoost(float bassDb, float presenceDb) {
+    bassBoostDb = bassDb;
+    presenceBoostDb = presenceDb;
+    applyBands();
+  }
+
+  void setBudget(float percent) {
+    float blockCycles = (float)F_CPU_ACTUAL * AUDIO_BLOCK_SAMPLES / AUDIO_SAMPLE_RATE_EXACT;
+    budgetCycles = (uint32_t)(blockCycles * percent / 100.0f);
+  }
+
+  // ---- Reporting ---------------------------------------------
+  uint32_t cyclesPerBlock() { return cycleAverage >> 4; }
+  uint32_t cyclesPerBlockMax() { return cycleMax; }
+  uint32_t budget() { return budgetCycles; }
+  int stagesActive() { return min(stageCount, stageLimit); }
+  int stagesConfigured() { return stageCount; }
+  void resetCycleMax() { cycleMax = 0; }
+
+  virtual void update(void) {
+    audio_block_t *left = receiveWritable(0);
+    audio_block_t *right = receiveWritable(1);
+
+    // Nothing playing: the mixers send no blocks
+    if (!left || !right) {
+      if (left) {
+        transmit(left, 0);
+        release(left);
+      }
+      if (right) {
+        transmit(right, 1);
+        release(right);
+      }
+      return;
+    }
+
+    uint32_t start = ARM_DWT_CYCCNT;
+
+    int32_t bufL[AUDIO_BLOCK_SAMPLES];
+    int32_t bufR[AUDIO_BLOCK_SAMPLES];
+    int32_t gain = preamp;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      bufL[i] = (left->data[i] * gain) >> (15 - CABIN_EQ_EXTRA_BITS);
+      bufR[i] = (right->data[i] * gain) >> (15 - CABIN_EQ_EXTRA_BITS);
+    }
+
+    int count = min(stageCount, stageLimit);
+    for (int s = 0; s < count; s++) {
+      if (fadeRemaining > 0 && s == count - 1) {
+        runFade(stages[s], state[stages[s].band], bufL, bufR);
+      } else {
+        runStage(stages[s], state[stages[s].band], bufL, bufR);
+      }
+    }
+
+    const int32_t round = 1 << (CABIN_EQ_EXTRA_BITS - 1);
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      left->data[i] = saturate16((bufL[i] + round) >> CABIN_EQ_EXTRA_BITS);
+      right->data[i] = saturate16((bufR[i] + round) >> CABIN_EQ_EXTRA_BITS);
+    }
+
+    transmit(left, 0);
+    transmit(right, 1);
+    release(left);
+    release(right);
+
+    enforceBudget(ARM_DWT_CYCCNT - start, count);
+  }
+
+private:
+  struct Stage {
+    int32_t b0, b1, b2, a1, a2;   // Q28, a1/a2 negated
+    uint8_t band;
+  };
+
+  audio_block_t *inputQueueArray[2];
+  CabinEqBand bands[CABIN_EQ_BANDS];
+  bool bandActive[CABIN_EQ_BANDS];
+  float bassBoostDb;
+  float presenceBoostDb;
+
+  // Shared with update()
+  Stage stages[CABIN_EQ_BANDS];
+  int32_t state[CABIN_EQ_BANDS][2][4];   // [band][channel] x1 x2 y1 y2
+  volatile int stageCount;
+  volatile int stageLimit;
+  volatile int32_t preamp;                // Q15
+
+  volatile uint32_t cycleAverage;         // x16
+  volatile uint32_t cycleMax;
+  uint32_t budgetCycles;
+  int budgetHold;
+  int fadeRemaining;                      // Samples left in a budget cross-fade
+  bool fadeIn;                            // Last stage fading in rather than out
+
+  static int16_t saturate16(int32_t x) {
+    if (x > 32767) return 32767;
+    if (x < -32768) return -32768;
+    return x;
+  }
+
+  static int32_t toFixed(float c) {
+    return (int32_t)lroundf(c * (float)(1 << CABIN_EQ_COEF_BITS));
+  }
+
+  float bandGain(int band) {
+    float gain = bands[band].gainDb;
+    if (band == 0) gain += bassBoostDb;
+    if (band == 1) gain += presenceBoostDb;
+    return constrain(gain, -CABIN_EQ_MAX_GAIN_DB, CABIN_EQ_MAX_GAIN_DB);
+  }
+
+  // Recompute the stage list and hand it to update() in one step
+  void applyBands() {
+    Stage next[CABIN_EQ_BANDS];
+    bool active[CABIN_EQ_BANDS];
+    int count = 0;
+    float design[CABIN_EQ_BANDS][5];
+
+    for (int b = 0; b < CABIN_EQ_BANDS; b++) {
+      float gain = bandGain(b);
+      active[b] = fabsf(gain) >= 0.05f;
+      if (!active[b]) continue;
+
+      float *c = design[b];
+      cabinEqDesign(bands[b].type, bands[b].frequency, gain, bands[b].q, c);
+      next[count].b0 = toFixed(c[0]);
+      next[count].b1 = toFixed(c[1]);
+      next[count].b2 = toFixed(c[2]);
+      next[count].a1 = toFixed(-c[3]);
+      next[count].a2 = toFixed(-c[4]);
+      next[count].band = b;
+      count++;
+    }
+
+    // Headroom for the preset curve only. The noise boost is meant to
+    // make things louder; clipping on its rare peaks is masked by the
+    // very noise that caused it.
+    float peakDb = 0;
+    for (int i = 0; i < 48; i++) {
+      float f = 20.0f * powf(1000.0f, i / 47.0f);
+      float db = 0;
+      for (int b = 0; b < CABIN_EQ_BANDS; b++) {
+        float gain = constrain(bands[b].gainDb, -CABIN_EQ_MAX_GAIN_DB, CABIN_EQ_MAX_GAIN_DB);
+        if (fabsf(gain) < 0.05f) continue;
+        float c[5];
+        cabinEqDesign(bands[b].type, bands[b].frequency, gain, bands[b].q, c);
+        db += cabinEqResponseDb(c, f);
+      }
+      if (db > peakDb) peakDb = db;
+    }
+    int32_t gain = (int32_t)(32767.0f * powf(10.0f, -peakDb / 20.0f));
+
+    AudioNoInterrupts();
+    for (int b = 0; b < CABIN_EQ_BANDS; b++) {
+      // A band coming back from flat starts from silence, not stale state
+      if (active[b] && !bandActive[b]) memset(state[b], 0, sizeof(state[b]));
+      bandActive[b] = active[b];
+    }
+    memcpy(stages, next, sizeof(Stage) * count);
+    stageCount = count;
+    preamp = gain;
+    AudioInterrupts();
+  }
+
+  static void runStage(const Stage &st, int32_t z[2][4], int32_t *left, int32_t *right) {
+    const int32_t b0 = st.b0, b1 = st.b1, b2 = st.b2, a1 = st.a1, a2 = st.a2;
+    const int64_t round = (int64_t)1 << (CABIN_EQ_COEF_BITS - 1);
+
+    int32_t lx1 = z[0][0], lx2 = z[0][1], ly1 = z[0][2], ly2 = z[0][3];
+    int32_t rx1 = z[1][0], rx2 = z[1][1], ry1 = z[1][2], ry2 = z[1][3];
+
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      int32_t lx = left[i];
+      int32_t rx = right[i];
+
+      int64_t la = round + (int64_t)b0 * lx + (int64_t)b1 * lx1 + (int64_t)b2 * lx2
+                 + (int64_t)a1 * ly1 + (int64_t)a2 * ly2;
+      int64_t ra = round + (int64_t)b0 * rx + (int64_t)b1 * rx1 + (int64_t)b2 * rx2
+                 + (int64_t)a1 * ry1 + (int64_t)a2 * ry2;
+
+      int32_t ly = (int32_t)(la >> CABIN_EQ_COEF_BITS);
+      int32_t ry = (int32_t)(ra >> CABIN_EQ_COEF_BITS);
+
+      lx2 = lx1; lx1 = lx; ly2 = ly1; ly1 = ly;
+      rx2 = rx1; rx1 = rx; ry2 = ry1; ry1 = ry;
+      left[i] = ly;
+      right[i] = ry;
+    }
+
+    z[0][0] = lx1; z[0][1] = lx2; z[0][2] = ly1; z[0][3] = ly2;
+    z[1][0] = rx1; z[1][1] = rx2; z[1][2] = ry1; z[1][3] = ry2;
+  }
+
+  // The last active stage while it is being dropped or restored: its
+  // output blended with its input, the stage's share moving linearly
+  // across the block toward 0 (out) or 1 (in)
+  void runFade(const Stage &st, int32_t z[2][4], int32_t *left, int32_t *right) {
+    int32_t dryL[AUDIO_BLOCK_SAMPLES];
+    int32_t dryR[AUDIO_BLOCK_SAMPLES];
+    memcpy(dryL, left, sizeof(dryL));
+    memcpy(dryR, right, sizeof(dryR));
+
+    runStage(st, z, left, right);
+
+    const int32_t total = 1 << CABIN_EQ_FADE_BITS;
+    int32_t position = total - fadeRemaining;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      int32_t wet = fadeIn ? position + i : total - position - i;
+      left[i] = dryL[i] + (int32_t)(((int64_t)(left[i] - dryL[i]) * wet) >> CABIN_EQ_FADE_BITS);
+      right[i] = dryR[i] + (int32_t)(((int64_t)(right[i] - dryR[i]) * wet) >> CABIN_EQ_FADE_BITS);
+    }
+  }
+
+  // Called at the end of update() with that block's cost and the number
+  // of stages it ran
+  void enforceBudget(uint32_t cycles, int active) {
+    cycleAverage = cycleAverage - (cycleAverage >> 4) + cycles;
+    if (cycles > cycleMax) cycleMax = cycles;
+
+    if (fadeRemaining > 0) {
+      fadeRemaining -= AUDIO_BLOCK_SAMPLES;
+      // A stage faded out is only now taken off the list
+      if (fadeRemaining <= 0 && !fadeIn) stageLimit = active - 1;
+      return;
+    }
+
+    if (budgetHold > 0) {
+      budgetHold--;
+      return;
+    }
+
+    uint32_t average = cycleAverage >> 4;
+
+    if (average > budgetCycles && active > 1) {
+      fadeIn = false;
+      fadeRemaining = 1 << CABIN_EQ_FADE_BITS;
+      budgetHold = CABIN_EQ_HOLD_BLOCKS;
+    } else if (stageLimit < stageCount && active > 0) {
+      // Restore a band if the estimate with it fits comfortably
+      uint32_t withOne = average + average / active;
+      if (withOne < budgetCycles - budgetCycles / 4) {
+        // Its state went stale while it was skipped; start from silence,
+        // as applyBands() does for a band coming back from flat
+        memset(state[stages[active].band], 0, sizeof(state[0]));
+        stageLimit = active + 1;
+        fadeIn = true;
+        fadeRemaining = 1 << CABIN_EQ_FADE_BITS;
+        budgetHold = CABIN_EQ_HOLD_BLOCKS;
+      }
+    }
+  }
+};
+
+// ============================================================
+// Noise-Adaptive Loudness
+// ============================================================
+#define CABIN_NOISE_MIC_GAIN        30       // SGTL5000 mic gain, dB
+#define CABIN_NOISE_QUIET_DB       -45.0f    // Program below this is a quiet passage
+#define CABIN_NOISE_FLOOR_DB       -55.0f    // Mic level that gets no boost
+#define CABIN_NOISE_BASS_SLOPE       0.4f    // dB of bass per dB of noise
+#define CABIN_NOISE_PRESENCE_SLOPE   0.15f
+#define CABIN_NOISE_MAX_BASS_DB      9.0f
+#define CABIN_NOISE_MAX_PRESENCE_DB  4.0f
+#define CABIN_NOISE_SMOOTHING        0.05f   // Per quiet reading (~30 per second)
+#define CABIN_NOISE_UPDATE_MS      250       // Boost step interval
+#define CABIN_NOISE_STEP_DB          0.5f    // Max boost change per step
+
+float cabinNoiseDb = CABIN_NOISE_FLOOR_DB;
+float cabinBassBoostDb = 0;
+float cabinPresenceBoostDb = 0;
+uint32_t cabinNoiseLastStep = 0;
+
+float cabinLevelDb(float rms) {
+  return 20.0f * log10f(max(rms, 1.0e-6f));
+}
+
+float cabinStepToward(float current, float target) {
+  return current + constrain(target - current, -CABIN_NOISE_STEP_DB, CABIN_NOISE_STEP_DB);
+}
+
+// Call from loop(). program is measured after the EQ, mic on the codec
+// mic input. The mic also hears the music, so the noise estimate only
+// moves while the program is quiet (gaps, fades, pauses) and holds
+// between them. A mic reading waits for a program reading over the same
+// blocks; without one there is no telling music from road noise. (The
+// analyzer counts a block that never arrived as silence, so pauses still
+// produce program readings.)
+void cabinNoiseService(AudioFilterCabinEq &eq, AudioAnalyzeRMS &program, AudioAnalyzeRMS &mic) {
+  if (mic.available() && program.available()) {
+    float micDb = cabinLevelDb(mic.read());
+    float programDb = cabinLevelDb(program.read());
+    if (programDb < CABIN_NOISE_QUIET_DB) {
+      cabinNoiseDb += (micDb - cabinNoiseDb) * CABIN_NOISE_SMOOTHING;
+    }
+  }
+
+  if (millis() - cabinNoiseLastStep < CABIN_NOISE_UPDATE_MS) return;
+  cabinNoiseLastStep = millis();
+
+  float excess = max(cabinNoiseDb - CABIN_NOISE_FLOOR_DB, 0.0f);
+  float bass = min(excess * CABIN_NOISE_BASS_SLOPE, CABIN_NOISE_MAX_BASS_DB);
+  float presence = min(excess * CABIN_NOISE_PRESENCE_SLOPE, CABIN_NOISE_MAX_PRESENCE_DB);
+
+  float nextBass = cabinStepToward(cabinBassBoostDb, bass);
+  float nextPresence = cabinStepToward(cabinPresenceBoostDb, presence);
+
+  // Redesigning the filters is loop work; skip changes too small to hear
+  if (fabsf(nextBass - cabinBassBoostDb) < 0.25f &&
+      fabsf(nextPresence - cabinPresenceBoostDb) < 0.25f) return;
+
+  cabinBassBoostDb = nextBass;
+  cabinPresenceBoostDb = nextPresence;
+  eq.setBoost(cabinBassBoostDb, cabinPresenceBoostDb);
+}
+
+#endif
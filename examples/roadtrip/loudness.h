@@ -0,0 +1,781 @@
+/**
+ * Loudness Normalization for Roadtrip
+ *
+ * Albums are mastered at very different levels, so every track gets a gain
+ * that brings it to a common loudness (ReplayGain reference, -18 LUFS).
+ *
+ * Where the gain comes from:
+ *   1. ReplayGain or R128 TXXX frames in the track's ID3v2 tag
+ *   2. Our own measurement (simplified EBU R128 / BS.1770: K-weighting,
+ *      400 ms blocks, absolute and relative gating). MP3s are measured in
+ *      the background while something else plays. FLAC and Opus would
+ *      need a second stream decoder, and its buffers do not fit next to
+ *      the player's, so they are metered from the player's own output
+ *      the first time they play from start to end.
+ *
+ * Results are kept in a library index on the SD card (/.roadtrip/gain.idx)
+ * keyed by album name, track name and file size, so each track is only
+ * ever measured once. The whole index is cached in RAM.
+ *
+ * CPU budget:
+ *   The playing track is decoded in an audio interrupt, so background work
+ *   in loop() can never starve it of CPU, only of the SD card. Analysis
+ *   runs in short slices (LOUDNESS_SLICE_US) with idle gaps between them,
+ *   backs off entirely while the audio CPU is busy, and holds the audio
+ *   interrupts only for the duration of each small SD read. The library
+ *   walk steps one directory entry at a time and tags are read a chunk at
+ *   a time, so neither can run past a slice and hold up the FLAC and Opus
+ *   pump() in loop(). Index writes are deferred to track changes, when the
+ *   decoder is already stopped.
+ */
+
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <SD.h>
+#include <play_sd_mp3.h>
+#include "resume.h"
+
+// Target and limits
+#define LOUDNESS_TARGET_LUFS    -18.0f
+#define LOUDNESS_MAX_BOOST_DB    12.0f
+#define LOUDNESS_MAX_CUT_DB     -18.0f
+#define LOUDNESS_RAMP_MS          400     // Gain glide for changes mid-track
+
+// Background analysis budget
+#define LOUDNESS_SLICE_US        2000     // Max work per loop() pass
+#define LOUDNESS_IDLE_MS            8     // Gap between slices
+#define LOUDNESS_MAX_AUDIO_CPU     50     // Skip slices above this audio CPU %
+#define LOUDNESS_READ_CHUNK       512     // Bytes per locked SD read
+#define LOUDNESS_RESCAN_MS      30000     // Wait before looking for new work
+
+// Library index
+#define LOUDNESS_INDEX_DIR   "/.roadtrip"
+#define LOUDNESS_INDEX_PATH  "/.roadtrip/gain.idx"
+#define LOUDNESS_MAX_ENTRIES     2048
+#define LOUDNESS_ID3_SCAN       16384     // Tag bytes searched for gain frames
+
+enum LoudnessSource {
+  LOUDNESS_SOURCE_NONE = 0,
+  LOUDNESS_SOURCE_TAG = 1,
+  LOUDNESS_SOURCE_MEASURED = 2
+};
+
+struct LoudnessEntry {
+  uint32_t albumHash;
+  uint32_t trackHash;
+  uint32_t fileSize;      // Re-encoded files get measured again
+  int16_t  gainCentiDb;   // Gain to apply, already limited by the peak
+  uint8_t  source;
+  uint8_t  check;         // Byte sum, rejects a record torn by power loss
+};
+
+// ============================================================
+// Library Index
+// ============================================================
+LoudnessEntry loudnessIndex[LOUDNESS_MAX_ENTRIES];
+int loudnessIndexCount = 0;
+int loudnessIndexSaved = 0;      // Entries past this are not on the card yet
+
+uint8_t loudnessEntryCheck(const LoudnessEntry &entry) {
+  const uint8_t *bytes = (const uint8_t *)&entry;
+  uint8_t sum = 0xA5;
+  for (size_t i = 0; i < offsetof(LoudnessEntry, check); i++) sum += bytes[i];
+  return sum;
+}
+
+void loudnessLoadIndex() {
+  loudnessIndexCount = 0;
+  loudnessIndexSaved = 0;
+
+  File f = SD.open(LOUDNESS_INDEX_PATH);
+  if (!f) return;
+
+  LoudnessEntry entry;
+  while (loudnessIndexCount < LOUDNESS_MAX_ENTRIES &&
+         f.read(&entry, sizeof(entry)) == sizeof(entry)) {
+    if (entry.check != loudnessEntryCheck(entry)) break;
+    loudnessIndex[loudnessIndexCount++] = entry;
+  }
+  f.close();
+
+  loudnessIndexSaved = loudnessIndexCount;
+  Serial.printf("Loudness index: %d tracks\n", loudnessIndexCount);
+}
+
+// Newest entry wins, so search from the end
+const LoudnessEntry *loudnessLookup(uint32_t albumHash, uint32_t trackHash, uint32_t fileSize) {
+  for (int i = loudnessIndexCount - 1; i >= 0; i--) {
+    const LoudnessEntry &entry = loudnessIndex[i];
+    if (entry.trackHash == trackHash && entry.albumHash == albumHash && entry.fileSize == fileSize) {
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+bool loudnessStore(uint32_t albumHash, uint32_t trackHash, uint32_t fileSize,
+                   float gainDb, LoudnessSource source) {
+  if (loudnessIndexCount >= LOUDNESS_MAX_ENTRIES) return false;
+
+  LoudnessEntry &entry = loudnessIndex[loudnessIndexCount++];
+  entry.albumHash = albumHash;
+  entry.trackHash = trackHash;
+  entry.fileSize = fileSize;
+  entry.gainCentiDb = (int16_t)lroundf(gainDb * 100.0f);
+  entry.source = source;
+  entry.check = loudnessEntryCheck(entry);
+  return true;
+}
+
+// Append unsaved entries. Only call this while the decoder is stopped or
+// paused: a FAT update can hold the card for longer than one audio block.
+void loudnessFlushIndex() {
+  if (loudnessIndexSaved >= loudnessIndexCount) return;
+
+  if (!SD.exists(LOUDNESS_INDEX_DIR)) SD.mkdir(LOUDNESS_INDEX_DIR);
+
+  File f = SD.open(LOUDNESS_INDEX_PATH, FILE_WRITE);
+  if (!f) return;
+
+  // Overwrite any torn record left at the end by a power cut
+  f.seek((uint32_t)loudnessIndexSaved * sizeof(LoudnessEntry));
+  f.write((const uint8_t *)&loudnessIndex[loudnessIndexSaved],
+          (loudnessIndexCount - loudnessIndexSaved) * sizeof(LoudnessEntry));
+  f.close();
+
+  loudnessIndexSaved = loudnessIndexCount;
+}
+
+// Typical gain of what we already know, used until a track is measured
+float loudnessDefaultGainDb() {
+  if (loudnessIndexCount == 0) return 0.0f;
+
+  int32_t sum = 0;
+  for (int i = 0; i < loudnessIndexCount; i++) sum += loudnessIndex[i].gainCentiDb;
+  return (sum / loudnessIndexCount) / 100.0f;
+}
+
+float loudnessClampGain(float gainDb, float peak) {
+  gainDb = constrain(gainDb, LOUDNESS_MAX_CUT_DB, LOUDNESS_MAX_BOOST_DB);
+
+  // Never boost a track into clipping
+  if (peak > 0.0f) {
+    float headroomDb = -20.0f * log10f(peak);
+    if (gainDb > headroomDb) gainDb = headroomDb;
+  }
+  return gainDb;
+}
+
+// ============================================================
+// SD Access From loop()
+// ============================================================
+
+// The playing decoder reads the card from its own interrupt. Hold it (and
+// the audio update) off for the duration of one small read.
+void loudnessLockSd() {
+  AudioNoInterrupts();
+#ifdef IRQ_AUDIOCODEC
+  NVIC_DISABLE_IRQ(IRQ_AUDIOCODEC);
+#endif
+}
+
+void loudnessUnlockSd() {
+#ifdef IRQ_AUDIOCODEC
+  NVIC_ENABLE_IRQ(IRQ_AUDIOCODEC);
+#endif
+  AudioInterrupts();
+}
+
+int loudnessRead(File &f, uint8_t *buffer, int length) {
+  int total = 0;
+  while (total < length) {
+    int chunk = min(length - total, LOUDNESS_READ_CHUNK);
+    loudnessLockSd();
+    int got = f.read(buffer + total, chunk);
+    loudnessUnlockSd();
+    if (got <= 0) break;
+    total += got;
+  }
+  return total;
+}
+
+void loudnessSeek(File &f, uint32_t position) {
+  loudnessLockSd();
+  f.seek(position);
+  loudnessUnlockSd();
+}
+
+// ============================================================
+// ID3v2 Gain Tags
+// ============================================================
+uint32_t loudnessSyncsafe(const uint8_t *b) {
+  return ((uint32_t)(b[0] & 0x7F) << 21) | ((uint32_t)(b[1] & 0x7F) << 14) |
+         ((uint32_t)(b[2] & 0x7F) << 7) | (b[3] & 0x7F);
+}
+
+// Size of the ID3v2 tag at the start of the file (0 if there is none)
+uint32_t loudnessId3Size(const uint8_t *header) {
+  if (header[0] != 'I' || header[1] != 'D' || header[2] != '3') return 0;
+  uint32_t size = 10 + loudnessSyncsafe(&header[6]);
+  if (header[5] & 0x10) size += 10;   // Footer
+  return size;
+}
+
+// Copy a TXXX text field as plain ASCII. UTF-16 text is reduced to its low
+// bytes, which is all a gain value ever needs.
+int loudnessTagText(const uint8_t *src, int length, uint8_t encoding, char *dst, int dstSize) {
+  int n = 0;
+  int i = 0;
+  bool wide = (encoding == 1 || encoding == 2);
+
+  if (encoding == 1 && length >= 2 && ((src[0] == 0xFF && src[1] == 0xFE) || (src[0] == 0xFE && src[1] == 0xFF))) {
+    i = 2;
+  }
+
+  for (; i < length; i += wide ? 2 : 1) {
+    uint8_t c = src[i];
+    if (wide && c == 0 && i + 1 < length) c = src[i + 1];
+    if (c == 0) {
+      i += wide ? 2 : 1;
+      break;
+    }
+    if (n < dstSize - 1) dst[n++] = (char)c;
+  }
+  dst[n] = 0;
+  return i;
+}
+
+// Tag bytes worth searching after a 10-byte ID3v2 header, 0 if there is
+// no tag we can read
+uint32_t loudnessTagScanLength(const uint8_t *header) {
+  uint32_t tagSize = loudnessId3Size(header);
+  uint8_t version = header[3];
+  if (tagSize == 0 || version < 3 || version > 4) return 0;
+  if (header[5] & 0x80) return 0;   // Whole-tag unsynchronisation, rare
+  return min(tagSize - 10, (uint32_t)LOUDNESS_ID3_SCAN);
+}
+
+// Look for REPLAYGAIN_TRACK_GAIN / R128_TRACK_GAIN in the tag body that
+// follows header. Returns true and the gain to reach -18 LUFS if one was
+// found.
+bool loudnessParseTagGain(const uint8_t *header, const uint8_t *tag, int length, float &gainDb) {
+  uint8_t version = header[3];
+  int pos = 0;
+  if (header[5] & 0x40) {   // Extended header
+    uint32_t extSize = (version == 4) ? loudnessSyncsafe(tag)
+                                      : (((uint32_t)tag[0] << 24) | ((uint32_t)tag[1] << 16) | ((uint32_t)tag[2] << 8) | tag[3]) + 4;
+    pos += extSize;
+  }
+
+  bool found = false;
+  float peak = 0.0f;
+  float trackGain = 0.0f;
+
+  while (pos + 10 <= length && tag[pos] != 0) {
+    const uint8_t *frame = &tag[pos];
+    uint32_t frameSize = (version == 4) ? loudnessSyncsafe(&frame[4])
+                                        : (((uint32_t)frame[4] << 24) | ((uint32_t)frame[5] << 16) | ((uint32_t)frame[6] << 8) | frame[7]);
+    if (frameSize == 0 || pos + 10 + (int)frameSize > length) break;
+
+    if (memcmp(frame, "TXXX", 4) == 0 && frameSize > 1) {
+      const uint8_t *body = &frame[10];
+      char description[32];
+      char value[32];
+      int used = loudnessTagText(&body[1], frameSize - 1, body[0], description, sizeof(description));
+      loudnessTagText(&body[1 + used], frameSize - 1 - used, body[0], value, sizeof(value));
+
+      if (strcasecmp(description, "REPLAYGAIN_TRACK_GAIN") == 0) {
+        trackGain = atof(value);
+        found = true;
+      }
+      else if (strcasecmp(description, "REPLAYGAIN_TRACK_PEAK") == 0) {
+        peak = atof(value);
+      }
+      else if (strcasecmp(description, "R128_TRACK_GAIN") == 0 && !found) {
+        // Q7.8 dB relative to -23 LUFS
+        trackGain = atoi(value) / 256.0f + (LOUDNESS_TARGET_LUFS + 23.0f);
+        found = true;
+      }
+    }
+
+    pos += 10 + frameSize;
+  }
+
+  if (found) gainDb = loudnessClampGain(trackGain, peak);
+  return found;
+}
+
+// Tag being searched. Shared by the blocking read at track start and the
+// background analyzer, which starts its read over if the count moved.
+uint8_t loudnessTag[LOUDNESS_ID3_SCAN];
+uint32_t loudnessTagReads = 0;
+
+// Read the whole tag in one go. Only for when the decoder is stopped.
+bool loudnessReadTagGain(File &f, float &gainDb) {
+  uint8_t header[10];
+  loudnessSeek(f, 0);
+  if (loudnessRead(f, header, 10) != 10) return false;
+
+  uint32_t length = loudnessTagScanLength(header);
+  if (length == 0) return false;
+
+  loudnessTagReads++;
+  length = loudnessRead(f, loudnessTag, length);
+  return loudnessParseTagGain(header, loudnessTag, length, gainDb);
+}
+
+// ============================================================
+// Loudness Meter (simplified BS.1770)
+// ============================================================
+#define LOUDNESS_HIST_MIN   -70.0f
+#define LOUDNESS_HIST_STEP    0.25f
+#define LOUDNESS_HIST_BINS     300
+
+struct LoudnessBiquad {
+  float b0, b1, b2, a1, a2;
+  float z1[2], z2[2];
+
+  float process(float x, int ch) {
+    float y = b0 * x + z1[ch];
+    z1[ch] = b1 * x - a1 * y + z2[ch];
+    z2[ch] = b2 * x - a2 * y;
+    return y;
+  }
+};
+
+struct LoudnessMeter {
+  LoudnessBiquad shelf;
+  LoudnessBiquad highpass;
+
+  uint32_t subBlockLength;    // 100 ms in samples
+  uint32_t subBlockCount;
+  float subBlockSum;
+  float subBlocks[4];         // Last four 100 ms energies = one 400 ms block
+  uint32_t blocks;
+  float peak;
+
+  uint32_t histCount[LOUDNESS_HIST_BINS];
+  float histEnergy[LOUDNESS_HIST_BINS];
+
+  // K-weighting coefficients for any sample rate (the BS.1770 tables are
+  // for 48 kHz only)
+  void begin(uint32_t sampleRate) {
+    double K = tan(M_PI * 1681.974450955533 / sampleRate);
+    double Q = 0.7071752369554196;
+    double Vh = pow(10.0, 3.999843853973347 / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    shelf.b1 = 2.0 * (K * K - Vh) / a0;
+    shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+    shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+    K = tan(M_PI * 38.13547087602444 / sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1.0 + K / Q + K * K;
+    highpass.b0 = 1.0;
+    highpass.b1 = -2.0;
+    highpass.b2 = 1.0;
+    highpass.a1 = 2.0 * (K * K - 1.0) / a0;
+    highpass.a2 = (1.0 - K / Q + K * K) / a0;
+
+    memset(shelf.z1, 0, sizeof(shelf.z1));
+    memset(shelf.z2, 0, sizeof(shelf.z2));
+    memset(highpass.z1, 0, sizeof(highpass.z1));
+    memset(highpass.z2, 0, sizeof(highpass.z2));
+
+    subBlockLength = sampleRate / 10;
+    subBlockCount = 0;
+    subBlockSum = 0.0f;
+    blocks = 0;
+    peak = 0.0f;
+    memset(histCount, 0, sizeof(histCount));
+    memset(histEnergy, 0, sizeof(histEnergy));
+  }
+
+  void addBlock(float energy) {
+    if (energy <= 0.0f) return;
+    float lufs = -0.691f + 10.0f * log10f(energy);
+    if (lufs < LOUDNESS_HIST_MIN) return;   // Absolute gate
+
+    int bin = (int)((lufs - LOUDNESS_HIST_MIN) / LOUDNESS_HIST_STEP);
+    if (bin >= LOUDNESS_HIST_BINS) bin = LOUDNESS_HIST_BINS - 1;
+    histCount[bin]++;
+    histEnergy[bin] += energy;
+  }
+
+  // Interleaved 16-bit PCM straight from the decoder
+  void process(const int16_t *pcm, int frames, int channels) {
+    for (int i = 0; i < frames; i++) {
+      float sum = 0.0f;
+      for (int ch = 0; ch < channels && ch < 2; ch++) {
+        float x = pcm[i * channels + ch] * (1.0f / 32768.0f);
+        float ax = fabsf(x);
+        if (ax > peak) peak = ax;
+        float y = highpass.process(shelf.process(x, ch), ch);
+        sum += y * y;
+      }
+      // Mono counts as both channels of a stereo pair
+      subBlockSum += (channels == 1) ? 2.0f * sum : sum;
+
+      if (++subBlockCount >= subBlockLength) {
+        subBlocks[blocks % 4] = subBlockSum / subBlockLength;
+        blocks++;
+        if (blocks >= 4) {
+          addBlock(0.25f * (subBlocks[0] + subBlocks[1] + subBlocks[2] + subBlocks[3]));
+        }
+        subBlockCount = 0;
+        subBlockSum = 0.0f;
+      }
+    }
+  }
+
+  // Integrated loudness with the -10 LU relative gate. Returns false for
+  // silence.
+  bool integrated(float &lufs) {
+    double energy = 0.0;
+    uint32_t count = 0;
+    for (int i = 0; i < LOUDNESS_HIST_BINS; i++) {
+      energy += histEnergy[i];
+      count += histCount[i];
+    }
+    if (count == 0) return false;
+
+    float gate = -0.691f + 10.0f * log10f(energy / count) - 10.0f;
+
+    energy = 0.0;
+    count = 0;
+    for (int i = 0; i < LOUDNESS_HIST_BINS; i++) {
+      if (LOUDNESS_HIST_MIN + i * LOUDNESS_HIST_STEP < gate) continue;
+      energy += histEnergy[i];
+      count += histCount[i];
+    }
+    if (count == 0) return false;
+
+    lufs = -0.691f + 10.0f * log10f(energy / count);
+    return true;
+  }
+};
+
+// ============================================================
+// Background Analyzer
+// ============================================================
+#define LOUDNESS_INPUT_SIZE  (MAINBUF_SIZE * 2)
+
+enum LoudnessState {
+  LOUDNESS_IDLE,
+  LOUDNESS_READING_TAG,
+  LOUDNESS_DECODING
+};
+
+// What one step of the library walk turned up
+enum LoudnessWork {
+  LOUDNESS_WORK_DONE,       // Whole library measured
+  LOUDNESS_WORK_PENDING,    // Looked at one entry, call again
+  LOUDNESS_WORK_FOUND       // filepath needs measuring
+};
+
+struct LoudnessAnalyzer {
+  LoudnessState state;
+  HMP3Decoder decoder;
+  LoudnessMeter meter;
+  File file;
+  uint32_t albumHash;
+  uint32_t trackHash;
+  uint32_t fileSize;
+  bool meterReady;
+  bool endOfFile;
+
+  uint8_t tagHeader[10];
+  uint32_t tagLength;       // Bytes of loudnessTag to fill
+  uint32_t tagRead;
+  uint32_t tagReads;        // loudnessTagReads when the read started
+  uint32_t audioStart;      // First byte after the tag
+
+  uint8_t input[LOUDNESS_INPUT_SIZE];
+  uint8_t *readPtr;
+  int bytesLeft;
+  int16_t pcm[MAX_NSAMP * MAX_NGRAN * MAX_NCHAN];
+
+  unsigned long lastSlice;
+  unsigned long lastSearch;
+  bool libraryDone;
+  uint32_t tracksMeasured;
+};
+
+LoudnessAnalyzer loudnessAnalyzer;
+
+// Start on a track: the tag header now, the rest of the tag over the
+// next slices. Returns false if the file cannot be opened.
+bool loudnessBegin(const char *filepath, uint32_t albumHash, uint32_t trackHash) {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+
+  loudnessLockSd();
+  a.file = SD.open(filepath);
+  loudnessUnlockSd();
+  if (!a.file) return false;
+
+  a.albumHash = albumHash;
+  a.trackHash = trackHash;
+  a.fileSize = a.file.size();
+
+  a.audioStart = 0;
+  a.tagLength = 0;
+  if (loudnessRead(a.file, a.tagHeader, 10) == 10) {
+    a.audioStart = loudnessId3Size(a.tagHeader);
+    a.tagLength = loudnessTagScanLength(a.tagHeader);
+  }
+  a.tagRead = 0;
+  a.tagReads = loudnessTagReads;
+  a.state = LOUDNESS_READING_TAG;
+  return true;
+}
+
+void loudnessFinish() {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+
+  float lufs;
+  float gainDb = 0.0f;
+  if (a.meterReady && a.meter.integrated(lufs)) {
+    gainDb = loudnessClampGain(LOUDNESS_TARGET_LUFS - lufs, a.meter.peak);
+  }
+
+  loudnessStore(a.albumHash, a.trackHash, a.fileSize, gainDb, LOUDNESS_SOURCE_MEASURED);
+  a.tracksMeasured++;
+
+  Serial.printf("Loudness: measured track %08lx, gain %.1f dB\n", (unsigned long)a.trackHash, gainDb);
+
+  loudnessLockSd();
+  a.file.close();
+  loudnessUnlockSd();
+  a.state = LOUDNESS_IDLE;
+}
+
+void loudnessCancel() {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+  if (a.state == LOUDNESS_IDLE) return;
+
+  loudnessLockSd();
+  a.file.close();
+  loudnessUnlockSd();
+  a.state = LOUDNESS_IDLE;
+}
+
+// No gain tag: set up to measure the track
+void loudnessStartDecoding() {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+
+  if (!a.decoder) a.decoder = MP3InitDecoder();
+  if (!a.decoder) {
+    loudnessCancel();
+    return;
+  }
+
+  // Skip any tag so the decoder starts on audio
+  loudnessSeek(a.file, a.audioStart);
+
+  a.readPtr = a.input;
+  a.bytesLeft = 0;
+  a.meterReady = false;
+  a.endOfFile = false;
+  a.state = LOUDNESS_DECODING;
+}
+
+// Read the tag a chunk at a time until the slice deadline. Once it is all
+// in, store its gain or go on to measuring.
+void loudnessTagSlice(uint32_t startMicros) {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+
+  if (a.tagReads != loudnessTagReads) {
+    // A track change read a tag into the buffer: start over
+    loudnessSeek(a.file, 10);
+    a.tagRead = 0;
+    a.tagReads = loudnessTagReads;
+  }
+
+  while (a.tagRead < a.tagLength) {
+    if (micros() - startMicros >= LOUDNESS_SLICE_US) return;
+    int chunk = min(a.tagLength - a.tagRead, (uint32_t)LOUDNESS_READ_CHUNK);
+    int got = loudnessRead(a.file, loudnessTag + a.tagRead, chunk);
+    if (got <= 0) {
+      a.tagLength = a.tagRead;
+      break;
+    }
+    a.tagRead += got;
+  }
+
+  float gainDb;
+  if (a.tagLength > 0 && loudnessParseTagGain(a.tagHeader, loudnessTag, a.tagLength, gainDb)) {
+    loudnessStore(a.albumHash, a.trackHash, a.fileSize, gainDb, LOUDNESS_SOURCE_TAG);
+    loudnessCancel();
+    return;
+  }
+
+  loudnessStartDecoding();
+}
+
+// Decode frames until the slice deadline. Returns false at end of file.
+bool loudnessDecodeSlice(uint32_t startMicros) {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+
+  while (micros() - startMicros < LOUDNESS_SLICE_US) {
+    // Keep at least one full frame in the input buffer
+    if (a.bytesLeft < MAINBUF_SIZE && !a.endOfFile) {
+      memmove(a.input, a.readPtr, a.bytesLeft);
+      a.readPtr = a.input;
+      int got = loudnessRead(a.file, a.input + a.bytesLeft, LOUDNESS_INPUT_SIZE - a.bytesLeft);
+      if (got <= 0) a.endOfFile = true;
+      a.bytesLeft += got;
+    }
+
+    int offset = MP3FindSyncWord(a.readPtr, a.bytesLeft);
+    if (offset < 0) {
+      a.bytesLeft = 0;
+      if (a.endOfFile) return false;
+      continue;
+    }
+    a.readPtr += offset;
+    a.bytesLeft -= offset;
+
+    int err = MP3Decode(a.decoder, &a.readPtr, &a.bytesLeft, a.pcm, 0);
+    if (err == ERR_MP3_INDATA_UNDERFLOW || err == ERR_MP3_MAINDATA_UNDERFLOW) {
+      if (a.endOfFile) return false;
+      continue;
+    }
+    if (err != ERR_MP3_NONE) {
+      // Corrupt frame: step past this sync word and look again
+      if (a.bytesLeft > 0) {
+        a.readPtr++;
+        a.bytesLeft--;
+      }
+      continue;
+    }
+
+    MP3FrameInfo info;
+    MP3GetLastFrameInfo(a.decoder, &info);
+    if (!a.meterReady) {
+      a.meter.begin(info.samprate);
+      a.meterReady = true;
+    }
+    a.meter.process(a.pcm, info.outputSamps / info.nChans, info.nChans);
+  }
+
+  return true;
+}
+
+// Call from loop(). findWork takes one step of the library walk per call
+// and fills in the next unmeasured track when it comes to one.
+typedef LoudnessWork (*LoudnessWorkFn)(char *filepath, size_t size, uint32_t &albumHash, uint32_t &trackHash);
+
+void loudnessService(LoudnessWorkFn findWork) {
+  LoudnessAnalyzer &a = loudnessAnalyzer;
+
+  if (millis() - a.lastSlice < LOUDNESS_IDLE_MS) return;
+  if (AudioProcessorUsage() > LOUDNESS_MAX_AUDIO_CPU) return;
+  if (loudnessIndexCount >= LOUDNESS_MAX_ENTRIES) return;
+
+  uint32_t start = micros();
+  a.lastSlice = millis();
+
+  if (a.state == LOUDNESS_IDLE) {
+    if (a.libraryDone && millis() - a.lastSearch < LOUDNESS_RESCAN_MS) return;
+
+    char filepath[160];
+    uint32_t albumHash, trackHash;
+    LoudnessWork work = LOUDNESS_WORK_PENDING;
+    a.libraryDone = false;
+    while (work == LOUDNESS_WORK_PENDING && micros() - start < LOUDNESS_SLICE_US) {
+      work = findWork(filepath, sizeof(filepath), albumHash, trackHash);
+    }
+    if (work == LOUDNESS_WORK_DONE) {
+      a.libraryDone = true;
+      a.lastSearch = millis();
+      return;
+    }
+    if (work == LOUDNESS_WORK_PENDING) return;
+    if (!loudnessBegin(filepath, albumHash, trackHash)) return;
+  }
+
+  if (a.state == LOUDNESS_READING_TAG) loudnessTagSlice(start);
+  if (a.state == LOUDNESS_DECODING && !loudnessDecodeSlice(start)) loudnessFinish();
+}
+
+// ============================================================
+// Metering The Playing Track
+// ============================================================
+// FLAC and Opus output, tapped from the stream player's pump()
+LoudnessMeter loudnessPlayMeter;
+bool loudnessPlayMetering = false;
+uint32_t loudnessPlayAlbumHash;
+uint32_t loudnessPlayTrackHash;
+uint32_t loudnessPlayFileSize;
+
+void loudnessPlayTap(const int16_t *stereo, int frames) {
+  if (loudnessPlayMetering) loudnessPlayMeter.process(stereo, frames, 2);
+}
+
+// A track with no stored gain starts from its beginning
+void loudnessPlayBegin(uint32_t albumHash, uint32_t trackHash, uint32_t fileSize) {
+  loudnessPlayMeter.begin(44100);
+  loudnessPlayAlbumHash = albumHash;
+  loudnessPlayTrackHash = trackHash;
+  loudnessPlayFileSize = fileSize;
+  loudnessPlayMetering = true;
+}
+
+// The track stopped. Only a play to the end is a measurement; the gain is
+// used from the next time the track starts.
+void loudnessPlayEnd(bool complete) {
+  if (!loudnessPlayMetering) return;
+  loudnessPlayMetering = false;
+  if (!complete) return;
+  if (loudnessLookup(loudnessPlayAlbumHash, loudnessPlayTrackHash, loudnessPlayFileSize)) return;
+
+  float lufs;
+  float gainDb = 0.0f;
+  if (loudnessPlayMeter.integrated(lufs)) {
+    gainDb = loudnessClampGain(LOUDNESS_TARGET_LUFS - lufs, loudnessPlayMeter.peak);
+  }
+  loudnessStore(loudnessPlayAlbumHash, loudnessPlayTrackHash, loudnessPlayFileSize, gainDb, LOUDNESS_SOURCE_MEASURED);
+
+  Serial.printf("Loudness: measured track %08lx while playing, gain %.1f dB\n",
+                (unsigned long)loudnessPlayTrackHash, gainDb);
+}
+
+// ============================================================
+// Gain Ramp
+// ============================================================
+float loudnessCurrentGain = 1.0f;    // Linear, applied on top of volume
+float loudnessTargetGain = 1.0f;
+float loudnessRampStep = 0.0f;
+
+// Gain for a new track, set before its decoder starts: nothing is playing
+// to glide from
+void loudnessSetGain(float gainDb) {
+  loudnessTargetGain = powf(10.0f, gainDb / 20.0f);
+  loudnessCurrentGain = loudnessTargetGain;
+  loudnessRampStep = 0.0f;
+}
+
+// Gain change once the track is playing, glides over LOUDNESS_RAMP_MS
+void loudnessSetTarget(float gainDb) {
+  loudnessTargetGain = powf(10.0f, gainDb / 20.0f);
+  loudnessRampStep = (loudnessTargetGain - loudnessCurrentGain) / LOUDNESS_RAMP_MS;
+}
+
+// Advance the ramp by elapsed ms. Returns true if the gain changed.
+bool loudnessUpdateRamp(unsigned long elapsedMs) {
+  if (loudnessCurrentGain == loudnessTargetGain) return false;
+
+  loudnessCurrentGain += loudnessRampStep * elapsedMs;
+  if ((loudnessRampStep > 0.0f && loudnessCurrentGain > loudnessTargetGain) ||
+      (loudnessRampStep < 0.0f && loudnessCurrentGain < loudnessTargetGain) ||
+      loudnessRampStep == 0.0f) {
+    loudnessCurrentGain = loudnessTargetGain;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,418 @@
+/**
+ * FLAC Player for Roadtrip
+ *
+ * A small integer-only FLAC decoder on top of AudioPlaySdStream. Handles
+ * what rippers actually produce: 1-2 channels, 16 or 24 bit, 44.1 or
+ * 48 kHz, block sizes up to 4608, CONSTANT/VERBATIM/FIXED/LPC subframes
+ * with Rice-coded residuals. 24-bit audio is reduced to 16 bits and
+ * 48 kHz is resampled to the 44.1 kHz audio clock.
+ *
+ * Each frame is decoded only once it is entirely in the read-ahead
+ * buffer, so the bit reader never has to wait for the card.
+ */
+
+#ifndef PLAY_SD_FLAC_H
+#define PLAY_SD_FLAC_H
+
+#include "play_sd_stream.h"
+
+#define FLAC_MAX_BLOCK      4608
+#define FLAC_MAX_CHANNELS      2
+#define FLAC_MAX_ORDER        32
+
+class AudioPlaySdFlac : public AudioPlaySdStream
+{
+public:
+  AudioPlaySdFlac() : samples(NULL), stereo(NULL), resampled(NULL) {}
+
+protected:
+  // ---- Bit reader --------------------------------------------
+  const uint8_t *bits;
+  int bitsLength;
+  int bitPos;
+  bool bitsOverrun;
+
+  void bitsBegin(const uint8_t *buffer, int length) {
+    bits = buffer;
+    bitsLength = length;
+    bitPos = 0;
+    bitsOverrun = false;
+  }
+
+  uint32_t readBits(int n) {
+    if (n == 0) return 0;
+    if (((bitPos + n + 7) >> 3) > bitsLength) {
+      bitsOverrun = true;
+      return 0;
+    }
+
+    uint32_t value = 0;
+    int byte = bitPos >> 3;
+    int offset = bitPos & 7;
+
+    // Up to 32 bits spread over at most 5 bytes
+    uint64_t window = 0;
+    for (int i = 0; i < 5 && byte + i < bitsLength; i++) {
+      window |= (uint64_t)bits[byte + i] << (32 - 8 * i);
+    }
+    value = (uint32_t)((window << offset) >> (40 - n)) & (n == 32 ? 0xFFFFFFFFUL : ((1UL << n) - 1));
+
+    bitPos += n;
+    return value;
+  }
+
+  int32_t readSigned(int n) {
+    if (n == 0) return 0;
+    uint32_t value = readBits(n);
+    if (n < 32 && (value & (1UL << (n - 1)))) value |= ~((1UL << n) - 1);
+    return (int32_t)value;
+  }
+
+  uint32_t readUnary() {
+    uint32_t count = 0;
+    while (true) {
+      int byte = bitPos >> 3;
+      if (byte >= bitsLength) {
+        bitsOverrun = true;
+        return count;
+      }
+      // Count leading zeros of what is left of this byte in one go
+      uint8_t rest = (uint8_t)(bits[byte] << (bitPos & 7));
+      if (rest) {
+        int zeros = __builtin_clz((uint32_t)rest << 24);
+        bitPos += zeros + 1;
+        return count + zeros;
+      }
+      count += 8 - (bitPos & 7);
+      bitPos = (byte + 1) << 3;
+    }
+  }
+
+  void alignByte() { bitPos = (bitPos + 7) & ~7; }
+
+  // ---- Stream ------------------------------------------------
+  uint32_t sampleRate;
+  uint8_t channels;
+  uint8_t bitsPerSample;
+  uint16_t maxBlockSize;
+  uint32_t maxFrameSize;
+  Resampler48To44 resampler;
+
+  int32_t *samples;     // [FLAC_MAX_CHANNELS][FLAC_MAX_BLOCK]
+  int16_t *stereo;      // Interleaved 16-bit output of one block
+  int16_t *resampled;
+
+  bool openStream() {
+    if (!samples) samples = (int32_t *)malloc(FLAC_MAX_CHANNELS * FLAC_MAX_BLOCK * sizeof(int32_t));
+    if (!stereo) stereo = (int16_t *)malloc(FLAC_MAX_BLOCK * 2 * sizeof(int16_t));
+    if (!resampled) resampled = (int16_t *)malloc(Resampler48To44::outputFrames(FLAC_MAX_BLOCK) * 2 * sizeof(int16_t));
+    if (!samples || !stereo || !resampled) return false;
+
+    // Some taggers put an ID3v2 tag in front of the FLAC stream
+    if (!ensure(10)) return false;
+    if (memcmp(data(), "ID3", 3) == 0) {
+      const uint8_t *h = data();
+      uint32_t size = 10 + (((uint32_t)(h[6] & 0x7F) << 21) | ((h[7] & 0x7F) << 14) | ((h[8] & 0x7F) << 7) | (h[9] & 0x7F));
+      skip(size);
+    }
+
+    if (!ensure(4) || memcmp(data(), "fLaC", 4) != 0) return false;
+    consume(4);
+
+    bool haveInfo = false;
+    bool last = false;
+    while (!last) {
+      if (!ensure(4)) return false;
+      const uint8_t *h = data();
+      last = h[0] & 0x80;
+      uint8_t type = h[0] & 0x7F;
+      uint32_t length = ((uint32_t)h[1] << 16) | (h[2] << 8) | h[3];
+      consume(4);
+
+      if (type == 0 && length >= 34) {
+        if (!ensure(34)) return false;
+        const uint8_t *s = data();
+        maxBlockSize = (s[2] << 8) | s[3];
+        maxFrameSize = ((uint32_t)s[7] << 16) | (s[8] << 8) | s[9];
+        sampleRate = ((uint32_t)s[10] << 12) | (s[11] << 4) | (s[12] >> 4);
+        channels = ((s[12] >> 1) & 0x07) + 1;
+        bitsPerSample = (((s[12] & 0x01) << 4) | (s[13] >> 4)) + 1;
+        haveInfo = true;
+      }
+      else if (type == 4 && length <= STREAM_READ_AHEAD / 2 && ensure(length)) {
+        float gainDb;
+        if (streamCommentGain(data(), length, gainDb)) {
+          tagGainDb = gainDb;
+          tagGainValid = true;
+        }
+      }
+
+      // Pictures and padding can be large; skip() seeks past them
+      skip(length);
+    }
+
+    if (!haveInfo) return false;
+    if (channels > FLAC_MAX_CHANNELS || maxBlockSize > FLAC_MAX_BLOCK) return false;
+    if (sampleRate != 44100 && sampleRate != 48000) return false;
+    if (bitsPerSample < 8 || bitsPerSample > 24) return false;
+
+    if (sampleRate == 48000) resampler.begin();
+    return true;
+  }
+
+  // ---- Frame header ------------------------------------------
+  static uint8_t crc8(const uint8_t *p, int n) {
+    uint8_t crc = 0;
+    while (n--) {
+      crc ^= *p++;
+      for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+    return crc;
+  }
+
+  struct FrameHeader {
+    uint32_t blockSize;
+    uint8_t channelAssignment;
+    int headerLength;
+  };
+
+  // Parse and CRC-check the frame header at p. False if this is not one.
+  bool parseHeader(const uint8_t *frame, int length, FrameHeader &header) {
+    // Headers are at most 16 bytes; pad so a short tail frame parses too
+    uint8_t p[16] = {0};
+    memcpy(p, frame, min(length, 16));
+
+    if (p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) return false;
+
+    uint8_t blockCode = p[2] >> 4;
+    uint8_t rateCode = p[2] & 0x0F;
+    uint8_t channelCode = p[3] >> 4;
+    uint8_t sizeCode = (p[3] >> 1) & 0x07;
+    if (rateCode == 0x0F || channelCode > 10 || sizeCode == 3 || sizeCode == 7 || blockCode == 0) return false;
+
+    // UTF-8 style frame/sample number
+    int pos = 4;
+    uint8_t first = p[pos++];
+    int extra = 0;
+    if (first >= 0xFE) extra = 6;
+    else if (first >= 0xFC) extra = 5;
+    else if (first >= 0xF8) extra = 4;
+    else if (first >= 0xF0) extra = 3;
+    else if (first >= 0xE0) extra = 2;
+    else if (first >= 0xC0) extra = 1;
+    else if (first >= 0x80) return false;
+    pos += extra;
+
+    uint32_t blockSize;
+    if (blockCode == 1) blockSize = 192;
+    else if (blockCode <= 5) blockSize = 576 << (blockCode - 2);
+    else if (blockCode == 6) blockSize = p[pos++] + 1;
+    else if (blockCode == 7) {
+      blockSize = ((p[pos] << 8) | p[pos + 1]) + 1;
+      pos += 2;
+    }
+    else blockSize = 256 << (blockCode - 8);
+
+    if (rateCode == 0x0C) pos += 1;
+    else if (rateCode == 0x0D || rateCode == 0x0E) pos += 2;
+
+    if (pos >= length || crc8(p, pos) != p[pos]) return false;
+
+    header.blockSize = blockSize;
+    header.channelAssignment = channelCode;
+    header.headerLength = pos + 1;
+    return true;
+  }
+
+  bool resync() {
+    while (true) {
+      if (!ensure(16)) return false;
+      const uint8_t *p = data();
+      int n = available();
+      for (int i = 0; i + 16 <= n; i++) {
+        FrameHeader header;
+        if (p[i] == 0xFF && parseHeader(p + i, n - i, header)) {
+          consume(i);
+          return true;
+        }
+      }
+      consume(n - 15);
+    }
+  }
+
+  // ---- Subframes ---------------------------------------------
+  bool decodeResidual(int32_t *out, uint32_t blockSize, int order) {
+    uint8_t method = readBits(2);
+    if (method > 1) return false;
+    int paramBits = method == 0 ? 4 : 5;
+    uint32_t escape = method == 0 ? 15 : 31;
+
+    int partitionOrder = readBits(4);
+    uint32_t partitions = 1UL << partitionOrder;
+    uint32_t perPartition = blockSize >> partitionOrder;
+    if (perPartition < (uint32_t)order) return false;
+
+    int32_t *p = out + order;
+    for (uint32_t part = 0; part < partitions; part++) {
+      uint32_t count = (part == 0) ? perPartition - order : perPartition;
+      uint32_t param = readBits(paramBits);
+
+      if (param == escape) {
+        int raw = readBits(5);
+        for (uint32_t i = 0; i < count; i++) *p++ = readSigned(raw);
+      } else {
+        for (uint32_t i = 0; i < count; i++) {
+          uint32_t value = (readUnary() << param) | readBits(param);
+          *p++ = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        }
+      }
+      if (bitsOverrun) return false;
+    }
+    return true;
+  }
+
+  bool decodeSubframe(int32_t *out, uint32_t blockSize, int sampleBits) {
+    if (readBits(1) != 0) return false;
+    uint8_t type = readBits(6);
+
+    int wasted = 0;
+    if (readBits(1)) {
+      wasted = readUnary() + 1;
+      sampleBits -= wasted;
+    }
+
+    if (type == 0) {
+      int32_t value = readSigned(sampleBits);
+      for (uint32_t i = 0; i < blockSize; i++) out[i] = value;
+    }
+    else if (type == 1) {
+      for (uint32_t i = 0; i < blockSize; i++) out[i] = readSigned(sampleBits);
+    }
+    else if (type >= 8 && type <= 12) {
+      int order = type - 8;
+      for (int i = 0; i < order; i++) out[i] = readSigned(sampleBits);
+      if (!decodeResidual(out, blockSize, order)) return false;
+
+      // Fixed polynomial predictors
+      for (uint32_t i = order; i < blockSize; i++) {
+        switch (order) {
+          case 1: out[i] += out[i - 1]; break;
+          case 2: out[i] += 2 * out[i - 1] - out[i - 2]; break;
+          case 3: out[i] += 3 * out[i - 1] - 3 * out[i - 2] + out[i - 3]; break;
+          case 4: out[i] += 4 * out[i - 1] - 6 * out[i - 2] + 4 * out[i - 3] - out[i - 4]; break;
+          default: break;
+        }
+      }
+    }
+    else if (type >= 32) {
+      int order = (type & 0x1F) + 1;
+      for (int i = 0; i < order; i++) out[i] = readSigned(sampleBits);
+
+      int precision = readBits(4) + 1;
+      if (precision == 16) return false;
+      int shift = readSigned(5);
+      if (shift < 0) return false;
+
+      int32_t coefs[FLAC_MAX_ORDER];
+      for (int i = 0; i < order; i++) coefs[i] = readSigned(precision);
+      if (!decodeResidual(out, blockSize, order)) return false;
+
+      // 64-bit sums keep 24-bit audio exact
+      for (uint32_t i = order; i < blockSize; i++) {
+        int64_t sum = 0;
+        for (int j = 0; j < order; j++) sum += (int64_t)coefs[j] * out[i - 1 - j];
+        out[i] += (int32_t)(sum >> shift);
+      }
+    }
+    else {
+      return false;
+    }
+
+    if (wasted) {
+      for (uint32_t i = 0; i < blockSize; i++) out[i] *= (1 << wasted);
+    }
+    return !bitsOverrun;
+  }
+
+  // ---- Frame -------------------------------------------------
+  int decodeFrame() {
+    // The whole frame has to be buffered; STREAMINFO says how big it gets.
+    // At the end of the file this just buffers whatever is left.
+    uint32_t need = (maxFrameSize > 0) ? maxFrameSize + 16 : STREAM_READ_AHEAD;
+    if (need > STREAM_READ_AHEAD) need = STREAM_READ_AHEAD;
+    ensure(need);
+    if (available() < 6) return -1;
+
+    FrameHeader header;
+    if (!parseHeader(data(), available(), header)) {
+      // Lost sync (corrupt data): step forward and find the next frame
+      consume(1);
+      return resync() ? 1 : -1;
+    }
+
+    if (header.blockSize > FLAC_MAX_BLOCK) return -1;
+
+    int outFrames = (sampleRate == 48000) ? Resampler48To44::outputFrames(header.blockSize) : header.blockSize;
+    if (pcmSpace() < outFrames) return 0;
+
+    bitsBegin(data(), available());
+    bitPos = header.headerLength * 8;
+
+    int frameChannels = (header.channelAssignment <= 7) ? header.channelAssignment + 1 : 2;
+    int32_t *ch0 = samples;
+    int32_t *ch1 = samples + FLAC_MAX_BLOCK;
+
+    for (int ch = 0; ch < frameChannels; ch++) {
+      // The side channel carries one extra bit
+      int sampleBits = bitsPerSample;
+      if ((header.channelAssignment == 8 && ch == 1) ||
+          (header.channelAssignment == 9 && ch == 0) ||
+          (header.channelAssignment == 10 && ch == 1)) {
+        sampleBits++;
+      }
+
+      if (ch >= FLAC_MAX_CHANNELS || !decodeSubframe(samples + ch * FLAC_MAX_BLOCK, header.blockSize, sampleBits)) {
+        consume(1);
+        return resync() ? 1 : -1;
+      }
+    }
+
+    // Footer: pad to a byte, then CRC-16
+    alignByte();
+    consume((bitPos >> 3) + 2);
+
+    // Undo inter-channel decorrelation
+    uint32_t n = header.blockSize;
+    if (header.channelAssignment == 8) {
+      for (uint32_t i = 0; i < n; i++) ch1[i] = ch0[i] - ch1[i];
+    }
+    else if (header.channelAssignment == 9) {
+      for (uint32_t i = 0; i < n; i++) ch0[i] += ch1[i];
+    }
+    else if (header.channelAssignment == 10) {
+      for (uint32_t i = 0; i < n; i++) {
+        int32_t mid = (ch0[i] * 2) | (ch1[i] & 1);
+        int32_t side = ch1[i];
+        ch0[i] = (mid + side) >> 1;
+        ch1[i] = (mid - side) >> 1;
+      }
+    }
+    if (frameChannels == 1) ch1 = ch0;
+
+    int shift = bitsPerSample - 16;
+    for (uint32_t i = 0; i < n; i++) {
+      stereo[2 * i] = (shift >= 0) ? ch0[i] >> shift : ch0[i] * (1 << -shift);
+      stereo[2 * i + 1] = (shift >= 0) ? ch1[i] >> shift : ch1[i] * (1 << -shift);
+    }
+
+    if (sampleRate == 48000) {
+      int frames = resampler.process(stereo, n, resampled);
+      pushPcm(resampled, frames);
+    } else {
+      pushPcm(stereo, n);
+    }
+    return 1;
+  }
+};
+
+#endif
@@ -0,0 +1,201 @@
+/**
+ * Ogg Opus Player for Roadtrip
+ *
+ * Demuxes Ogg pages on top of AudioPlaySdStream, decodes with libopus at
+ * 48 kHz stereo (mono files are upmixed by the decoder) and resamples to
+ * the 44.1 kHz audio clock. Only channel mapping family 0 (mono/stereo)
+ * is supported, which covers every music encoder in common use.
+ *
+ * The OpusHead output gain is applied by the decoder; R128_TRACK_GAIN in
+ * OpusTags is reported through tagGain() for loudness normalization.
+ */
+
+#ifndef PLAY_SD_OPUS_H
+#define PLAY_SD_OPUS_H
+
+#include <opus.h>
+#include "play_sd_stream.h"
+
+#define OGG_MAX_PACKET      8192     // Larger header packets are truncated
+#define OGG_OPUS_MAX_FRAME  5760     // 120 ms at 48 kHz
+
+class AudioPlaySdOpus : public AudioPlaySdStream
+{
+public:
+  AudioPlaySdOpus() : decoder(NULL), packet(NULL), decoded(NULL), resampled(NULL) {}
+
+protected:
+  OpusDecoder *decoder;
+  Resampler48To44 resampler;
+  uint16_t preSkip;           // 48 kHz samples to drop at the start
+  uint32_t skipRemaining;
+
+  // ---- Ogg demux ---------------------------------------------
+  uint8_t lacing[255];
+  int segmentCount;
+  int segmentIndex;
+  bool continuedPage;         // First packet on the page started earlier
+
+  uint8_t *packet;
+  int packetLength;
+  bool packetTruncated;
+  bool packetReady;
+
+  int16_t *decoded;
+  int16_t *resampled;
+
+  // Read the next page header. False at end of file or on garbage.
+  bool readPage() {
+    if (!ensure(27)) return false;
+    const uint8_t *h = data();
+    if (memcmp(h, "OggS", 4) != 0 || h[4] != 0) return false;
+
+    int count = h[26];
+    if (!ensure(27 + count)) return false;
+    h = data();
+
+    continuedPage = h[5] & 0x01;
+    segmentCount = count;
+    segmentIndex = 0;
+    memcpy(lacing, h + 27, count);
+    consume(27 + count);
+    return true;
+  }
+
+  // Assemble the next complete packet into packet[]. Packets may span
+  // pages. Returns false at end of stream.
+  bool nextPacket() {
+    packetLength = 0;
+    packetTruncated = false;
+
+    while (true) {
+      if (segmentIndex >= segmentCount) {
+        if (!readPage()) return false;
+        continue;
+      }
+
+      int length = lacing[segmentIndex++];
+      if (!ensure(length)) return false;
+
+      int room = OGG_MAX_PACKET - packetLength;
+      if (length > room) packetTruncated = true;
+      memcpy(packet + packetLength, data(), min(length, room));
+      packetLength += min(length, room);
+      consume(length);
+
+      // A lacing value under 255 ends the packet
+      if (length < 255) return true;
+    }
+  }
+
+  bool openStream() {
+    if (!packet) packet = (uint8_t *)malloc(OGG_MAX_PACKET);
+    if (!decoded) decoded = (int16_t *)malloc(OGG_OPUS_MAX_FRAME * 2 * sizeof(int16_t));
+    if (!resampled) resampled = (int16_t *)malloc(Resampler48To44::outputFrames(OGG_OPUS_MAX_FRAME) * 2 * sizeof(int16_t));
+    if (!packet || !decoded || !resampled) return false;
+
+    segmentCount = 0;
+    segmentIndex = 0;
+    packetReady = false;
+
+    // OpusHead
+    if (!nextPacket() || packetLength < 19 || memcmp(packet, "OpusHead", 8) != 0) return false;
+    uint8_t channelCount = packet[9];
+    preSkip = packet[10] | (packet[11] << 8);
+    int16_t outputGain = (int16_t)(packet[16] | (packet[17] << 8));
+    uint8_t mapping = packet[18];
+    if (mapping != 0 || channelCount < 1 || channelCount > 2) return false;
+
+    // OpusTags
+    if (!nextPacket() || packetLength < 8 || memcmp(packet, "OpusTags", 8) != 0) return false;
+    float gainDb;
+    if (streamCommentGain(packet + 8, packetLength - 8, gainDb)) {
+      tagGainDb = gainDb;
+      tagGainValid = true;
+    }
+
+    if (!decoder) {
+      int err;
+      decoder = opus_decoder_create(48000, 2, &err);
+      if (err != OPUS_OK) {
+        decoder = NULL;
+        return false;
+      }
+    }
+    opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+    opus_decoder_ctl(decoder, OPUS_SET_GAIN(outputGain));
+
+    resampler.begin();
+    skipRemaining = preSkip;
+    return true;
+  }
+
+  // After a seek: find the next page and drop the packet tail it may
+  // start with. The decoder settles within a frame or two.
+  bool resync() {
+    while (true) {
+      if (!ensure(27)) return false;
+      const uint8_t *p = data();
+      int n = available();
+      for (int i = 0; i + 27 <= n; i++) {
+        if (p[i] == 'O' && memcmp(p + i, "OggS", 4) == 0 && p[i + 4] == 0) {
+          consume(i);
+          if (!readPage()) return false;
+          if (continuedPage) {
+            // Skip the segments belonging to a packet from the previous page
+            while (segmentIndex < segmentCount) {
+              int length = lacing[segmentIndex++];
+              skip(length);
+              if (length < 255) break;
+            }
+          }
+          opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+          skipRemaining = 0;
+          packetReady = false;
+          return true;
+        }
+      }
+      consume(n - 26);
+    }
+  }
+
+  int decodeFrame() {
+    if (!packetReady) {
+      if (!nextPacket()) return -1;
+      packetReady = true;
+    }
+
+    if (packetTruncated) {
+      packetReady = false;
+      return 1;
+    }
+
+    // Check there is room before decoding so nothing has to be held back
+    int samples = opus_packet_get_nb_samples(packet, packetLength, 48000);
+    if (samples <= 0 || samples > OGG_OPUS_MAX_FRAME) {
+      packetReady = false;
+      return 1;
+    }
+    if (pcmSpace() < Resampler48To44::outputFrames(samples)) return 0;
+    packetReady = false;
+
+    int frames = opus_decode(decoder, packet, packetLength, decoded, OGG_OPUS_MAX_FRAME, 0);
+    if (frames <= 0) return 1;
+
+    int16_t *start = decoded;
+    if (skipRemaining > 0) {
+      int drop = min((uint32_t)frames, skipRemaining);
+      skipRemaining -= drop;
+      start += drop * 2;
+      frames -= drop;
+    }
+
+    if (frames > 0) {
+      int out = resampler.process(start, frames, resampled);
+      pushPcm(resampled, out);
+    }
+    return 1;
+  }
+};
+
+#endif
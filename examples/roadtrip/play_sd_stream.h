@@ -0,0 +1,440 @@
+/**
+ * Streaming SD Player Base for Roadtrip
+ *
+ * Shared plumbing for the decoders that are not built into the codec
+ * library (Ogg Opus, FLAC):
+ *
+ *   SD card --> read-ahead buffer --> decoder --> PCM FIFO --> update()
+ *               (loop, pump())        (loop)      (lock-free)  (audio ISR)
+ *
+ * Decoding happens in pump(), called from loop(), never in the audio
+ * interrupt. The PCM FIFO holds ~186 ms of stereo audio, which rides out
+ * slow SD reads and display refreshes. update() only copies samples out.
+ *
+ * Also here: a fixed-point polyphase resampler for 48 kHz sources
+ * (Opus always decodes at 48 kHz) down to the 44.1 kHz audio clock.
+ */
+
+#ifndef PLAY_SD_STREAM_H
+#define PLAY_SD_STREAM_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <SD.h>
+
+#define STREAM_READ_AHEAD     32768   // Must hold the largest compressed frame
+#define STREAM_READ_CHUNK      4096   // Bytes per SD read (8 sectors)
+#define STREAM_PCM_FRAMES      8192   // Stereo frames between decoder and ISR
+#define STREAM_PUMP_US         3000   // Max decode time per pump() call
+
+// ============================================================
+// 48 kHz -> 44.1 kHz Resampler
+// ============================================================
+// 44100 / 48000 = 147 / 160: upsample by 147, low-pass, keep every 160th.
+// Only the taps that land on real input samples are ever computed, so
+// each output sample costs RESAMPLE_TAPS multiply-accumulates per channel.
+#define RESAMPLE_L          147
+#define RESAMPLE_M          160
+#define RESAMPLE_TAPS        32
+#define RESAMPLE_CUTOFF_HZ  19500.0
+
+class Resampler48To44
+{
+public:
+  void begin() {
+    buildTable();
+    memset(history, 0, sizeof(history));
+    pos = 0;
+    phase = 0;
+  }
+
+  // Stereo interleaved in, stereo interleaved out. out must hold
+  // frames * 147 / 160 + 2 frames. Returns frames written.
+  int process(const int16_t *in, int frames, int16_t *out) {
+    int written = 0;
+
+    for (int i = 0; i < frames; i++) {
+      // Each channel's window is stored twice so it is always contiguous
+      history[0][pos] = history[0][pos + RESAMPLE_TAPS] = in[2 * i];
+      history[1][pos] = history[1][pos + RESAMPLE_TAPS] = in[2 * i + 1];
+      pos = (pos + 1) % RESAMPLE_TAPS;
+
+      const int16_t *left = &history[0][pos];
+      const int16_t *right = &history[1][pos];
+
+      while (phase < RESAMPLE_L) {
+        const int16_t *c = coefficients[phase];
+        int32_t accL = 0;
+        int32_t accR = 0;
+        for (int k = 0; k < RESAMPLE_TAPS; k++) {
+          accL += c[k] * left[k];
+          accR += c[k] * right[k];
+        }
+        out[2 * written] = saturate16((accL + 16384) >> 15);
+        out[2 * written + 1] = saturate16((accR + 16384) >> 15);
+        written++;
+        phase += RESAMPLE_M;
+      }
+      phase -= RESAMPLE_L;
+    }
+
+    return written;
+  }
+
+  static int outputFrames(int inputFrames) {
+    return (int)(((int32_t)inputFrames * RESAMPLE_L) / RESAMPLE_M) + 2;
+  }
+
+private:
+  static int16_t coefficients[RESAMPLE_L][RESAMPLE_TAPS];
+  static bool tableBuilt;
+
+  int16_t history[2][RESAMPLE_TAPS * 2];
+  int pos;
+  int phase;
+
+  static int16_t saturate16(int32_t x) {
+    if (x > 32767) return 32767;
+    if (x < -32768) return -32768;
+    return (int16_t)x;
+  }
+
+  static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 25; k++) {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+    }
+    return sum;
+  }
+
+  // Kaiser-windowed sinc prototype at 48 kHz * 147, split into phases.
+  // Stored oldest-tap-first to match the history window.
+  static void buildTable() {
+    if (tableBuilt) return;
+
+    const int length = RESAMPLE_L * RESAMPLE_TAPS;
+    const double upRate = 48000.0 * RESAMPLE_L;
+    const double fc = RESAMPLE_CUTOFF_HZ / upRate;
+    const double beta = 5.65;   // ~60 dB stopband
+    const double center = (length - 1) / 2.0;
+    const double norm = besselI0(beta);
+
+    for (int j = 0; j < length; j++) {
+      double t = j - center;
+      double sinc = (t == 0.0) ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+      double r = t / center;
+      double window = besselI0(beta * sqrt(fmax(0.0, 1.0 - r * r))) / norm;
+      // Gain of L makes up for the zeros stuffed in by upsampling
+      double h = sinc * window * RESAMPLE_L;
+
+      int p = j % RESAMPLE_L;
+      int k = j / RESAMPLE_L;
+      coefficients[p][RESAMPLE_TAPS - 1 - k] = (int16_t)lround(h * 32768.0);
+    }
+
+    tableBuilt = true;
+  }
+};
+
+int16_t Resampler48To44::coefficients[RESAMPLE_L][RESAMPLE_TAPS];
+bool Resampler48To44::tableBuilt = false;
+
+// ============================================================
+// Streaming Player Base
+// ============================================================
+class AudioPlaySdStream : public AudioStream
+{
+public:
+  AudioPlaySdStream() : AudioStream(0, NULL) {}
+
+  bool play(const char *filename) { return playFrom(filename, 0); }
+
+  // Parse the stream headers, then start decoding at the first frame at
+  // or after byteOffset
+  bool playFrom(const char *filename, uint32_t byteOffset) {
+    stop();
+    if (!allocateBuffers()) return false;
+
+    file = SD.open(filename);
+    if (!file) return false;
+
+    fileSize = file.size();
+    bufferOffset = 0;
+    inputStart = 0;
+    inputEnd = 0;
+    endOfFile = false;
+    finished = false;
+    tagGainValid = false;
+    framesOut = 0;
+    pcmHead = 0;
+    pcmTail = 0;
+
+    if (!openStream()) {
+      file.close();
+      return false;
+    }
+
+    if (byteOffset > position()) {
+      seekInput(byteOffset);
+      if (!resync()) {
+        file.close();
+        return false;
+      }
+    }
+
+    paused = false;
+    playing = true;
+    return true;
+  }
+
+  void stop() {
+    playing = false;
+    if (file) file.close();
+  }
+
+  void pause(bool state) { paused = state; }
+
+  bool isPlaying() { return playing; }
+
+  uint32_t positionMillis() { return (uint32_t)((uint64_t)framesOut * 1000 / AUDIO_SAMPLE_RATE_EXACT); }
+
+  // File offset of the next frame to be decoded
+  uint32_t filePosition() { return position(); }
+
+  // Gain from ReplayGain/R128 metadata, valid after play()
+  bool tagGain(float &gainDb) {
+    gainDb = tagGainDb;
+    return tagGainValid;
+  }
+
+  // Decoder cost: microseconds of CPU per second of audio produced
+  uint32_t decodeMicrosPerSecond() {
+    if (statFrames == 0) return 0;
+    return (uint32_t)((uint64_t)statMicros * 44100 / statFrames);
+  }
+
+  uint32_t underruns() { return underrunCount; }
+
+  // Called from pump() with each run of decoded output (interleaved
+  // stereo at 44.1 kHz, as it goes into the FIFO), e.g. to meter it
+  typedef void (*PcmTap)(const int16_t *stereo, int frames);
+  void setPcmTap(PcmTap tap) { pcmTap = tap; }
+
+  // Call from loop(): top up the read-ahead and decode into the FIFO
+  void pump() {
+    if (!playing || finished) return;
+
+    refill();
+
+    uint32_t start = micros();
+    while (micros() - start < STREAM_PUMP_US) {
+      int result = decodeFrame();
+      if (result < 0) {
+        finished = true;
+        break;
+      }
+      if (result == 0) break;
+      refill();
+    }
+    statMicros += micros() - start;
+  }
+
+  virtual void update(void) {
+    if (!playing || paused) return;
+
+    uint32_t available = pcmHead - pcmTail;
+    uint32_t count = AUDIO_BLOCK_SAMPLES;
+    if (available < AUDIO_BLOCK_SAMPLES) {
+      if (!finished) {
+        underrunCount++;
+        return;
+      }
+      if (available == 0) {
+        playing = false;
+        return;
+      }
+      // Last partial block: pad with silence
+      count = available;
+    }
+
+    audio_block_t *left = allocate();
+    audio_block_t *right = allocate();
+    if (left && right) {
+      for (uint32_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        if (i < count) {
+          uint32_t index = ((pcmTail + i) % STREAM_PCM_FRAMES) * 2;
+          left->data[i] = pcm[index];
+          right->data[i] = pcm[index + 1];
+        } else {
+          left->data[i] = 0;
+          right->data[i] = 0;
+        }
+      }
+      transmit(left, 0);
+      transmit(right, 1);
+    }
+    if (left) release(left);
+    if (right) release(right);
+
+    pcmTail += count;
+    framesOut += count;
+  }
+
+protected:
+  File file;
+  uint32_t fileSize;
+  bool tagGainValid;
+  float tagGainDb;
+
+  // Format hooks, all called from pump()/playFrom() in loop context
+  virtual bool openStream() = 0;   // Parse headers at the start of the file
+  virtual bool resync() = 0;       // Find the next frame after a seek
+  virtual int decodeFrame() = 0;   // >0 decoded, 0 blocked (input/room), <0 end
+
+  // ---- Input -------------------------------------------------
+  uint8_t *input;
+  int inputStart;
+  int inputEnd;
+  uint32_t bufferOffset;   // File offset of input[0]
+  bool endOfFile;
+
+  int available() { return inputEnd - inputStart; }
+  const uint8_t *data() { return input + inputStart; }
+  void consume(int n) { inputStart += n; }
+  uint32_t position() { return bufferOffset + inputStart; }
+
+  // Make n contiguous bytes available. False if the file ends first.
+  bool ensure(int n) {
+    while (available() < n) {
+      if (endOfFile || n > STREAM_READ_AHEAD) return false;
+      if (!readChunk()) return false;
+    }
+    return true;
+  }
+
+  // Skip n bytes, seeking the file if they are not buffered
+  void skip(uint32_t n) {
+    if (n <= (uint32_t)available()) {
+      consume(n);
+    } else {
+      seekInput(position() + n);
+    }
+  }
+
+  void seekInput(uint32_t offset) {
+    file.seek(offset);
+    bufferOffset = offset;
+    inputStart = 0;
+    inputEnd = 0;
+    endOfFile = (offset >= fileSize);
+  }
+
+  // ---- Output ------------------------------------------------
+  int pcmSpace() { return STREAM_PCM_FRAMES - (int)(pcmHead - pcmTail); }
+
+  void pushPcm(const int16_t *stereo, int frames) {
+    for (int i = 0; i < frames; i++) {
+      uint32_t index = ((pcmHead + i) % STREAM_PCM_FRAMES) * 2;
+      pcm[index] = stereo[2 * i];
+      pcm[index + 1] = stereo[2 * i + 1];
+    }
+    // Publish only after the samples are written
+    pcmHead += frames;
+    statFrames += frames;
+    if (pcmTap) pcmTap(stereo, frames);
+  }
+
+private:
+  int16_t *pcm;
+  volatile uint32_t pcmHead;   // Written by pump()
+  volatile uint32_t pcmTail;   // Written by update()
+  volatile bool playing;
+  volatile bool finished;
+  volatile bool paused;
+  uint32_t framesOut;
+  uint32_t underrunCount;
+  uint32_t statMicros;
+  uint32_t statFrames;
+  PcmTap pcmTap;
+
+  // The heap lives in RAM2 on Teensy 4, which keeps these large buffers
+  // out of the tightly coupled RAM the audio library uses
+  bool allocateBuffers() {
+    if (!input) input = (uint8_t *)malloc(STREAM_READ_AHEAD);
+    if (!pcm) pcm = (int16_t *)malloc(STREAM_PCM_FRAMES * 2 * sizeof(int16_t));
+    return input && pcm;
+  }
+
+  bool readChunk() {
+    // Slide what is left to the front before reading more
+    if (inputStart > 0) {
+      memmove(input, input + inputStart, available());
+      bufferOffset += inputStart;
+      inputEnd -= inputStart;
+      inputStart = 0;
+    }
+
+    int space = STREAM_READ_AHEAD - inputEnd;
+    if (space <= 0) return false;
+
+    int got = file.read(input + inputEnd, min(space, STREAM_READ_CHUNK));
+    if (got <= 0) {
+      endOfFile = true;
+      return false;
+    }
+    inputEnd += got;
+    return true;
+  }
+
+  // Keep one chunk of read-ahead in hand so a decode never waits on SD
+  void refill() {
+    if (!endOfFile && STREAM_READ_AHEAD - available() >= STREAM_READ_CHUNK && available() < STREAM_READ_AHEAD / 2) {
+      readChunk();
+    }
+  }
+};
+
+// ============================================================
+// Metadata
+// ============================================================
+
+// Pull a track gain out of a Vorbis comment block (FLAC VORBIS_COMMENT
+// and Opus OpusTags share the layout). R128 values are relative to
+// -23 LUFS; the result is relative to the -18 LUFS ReplayGain reference.
+bool streamCommentGain(const uint8_t *block, uint32_t length, float &gainDb) {
+  if (length < 8) return false;
+
+  uint32_t pos = 4 + (block[0] | (block[1] << 8) | (block[2] << 16) | ((uint32_t)block[3] << 24));
+  if (pos + 4 > length) return false;
+
+  uint32_t count = block[pos] | (block[pos + 1] << 8) | (block[pos + 2] << 16) | ((uint32_t)block[pos + 3] << 24);
+  pos += 4;
+
+  bool found = false;
+  for (uint32_t i = 0; i < count && pos + 4 <= length; i++) {
+    uint32_t size = block[pos] | (block[pos + 1] << 8) | (block[pos + 2] << 16) | ((uint32_t)block[pos + 3] << 24);
+    pos += 4;
+    if (size > length - pos) break;
+
+    char comment[48];
+    uint32_t n = min(size, (uint32_t)sizeof(comment) - 1);
+    memcpy(comment, &block[pos], n);
+    comment[n] = 0;
+    pos += size;
+
+    if (strncasecmp(comment, "REPLAYGAIN_TRACK_GAIN=", 22) == 0) {
+      gainDb = atof(comment + 22);
+      return true;
+    }
+    if (strncasecmp(comment, "R128_TRACK_GAIN=", 16) == 0) {
+      gainDb = atoi(comment + 16) / 256.0f + 5.0f;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+#endif
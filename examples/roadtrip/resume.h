@@ -0,0 +1,232 @@
+/**
+ * Resume Checkpoint for Roadtrip
+ *
+ * Car power is cut on every ignition off, so the player keeps a small
+ * checkpoint of where it is (album, track, file offset and elapsed time)
+ * in EEPROM and seeks straight back there on the next boot.
+ *
+ * Wear leveling:
+ *   The checkpoint area is a ring of RESUME_SLOT_COUNT fixed-size slots.
+ *   Every save goes into the slot after the newest one and carries an
+ *   increasing sequence number plus a CRC32. Each cell therefore sees only
+ *   1/RESUME_SLOT_COUNT of the writes, and a save torn by a power cut just
+ *   leaves the previous slot as the newest valid record.
+ *
+ * Seeking:
+ *   The decoder reads ahead, so the saved offset is only close to the
+ *   frame that was playing. On boot we rewind a little, then walk the MP3
+ *   frame headers (two consecutive valid headers = a real frame boundary)
+ *   and hand the decoder a file that starts exactly on a frame. Nothing is
+ *   decoded from the start of the track.
+ */
+
+#ifndef RESUME_H
+#define RESUME_H
+
+#include <EEPROM.h>
+#include <SD.h>
+#include <play_sd_mp3.h>
+
+// EEPROM layout
+#define RESUME_EEPROM_ADDR       0
+#define RESUME_SLOT_COUNT       64
+#define RESUME_MAGIC        0x5254   // "RT"
+
+// Timing
+#define RESUME_CHECKPOINT_MS  5000   // Checkpoint interval while playing
+
+// Seeking
+#define RESUME_REWIND_BYTES   2048   // Decoder read-ahead (one SD buffer)
+#define RESUME_SYNC_WINDOW    4096   // Bytes searched for a frame boundary
+
+struct ResumeRecord {
+  uint16_t magic;
+  uint16_t album;        // Index into the sorted album list
+  uint32_t sequence;     // Increments on every save, newest wins
+  uint32_t albumHash;    // FNV-1a of the album folder name
+  uint32_t trackHash;    // FNV-1a of the track file name
+  uint32_t byteOffset;   // Approximate file offset of the playing frame
+  uint32_t elapsedMs;    // Playback position shown on the display
+  uint16_t track;        // Index into the sorted track list
+  uint8_t  paused;
+  uint8_t  shuffleMode;
+  uint16_t shuffleEpoch;
+  uint16_t shuffleStart; // Where the epoch's order was seated (see ShuffleQueue)
+  uint32_t shuffleSeed;  // Shuffle order is rebuilt from mode, seed, epoch and start
+  uint32_t crc;          // CRC32 of everything above
+};
+
+// MP3 player that can start decoding part way into a file. The codec
+// library keeps its file helpers protected, so expose what we need here.
+class AudioPlaySdMp3Resumable : public AudioPlaySdMp3
+{
+public:
+  int playFrom(const char *filename, uint32_t byteOffset)
+  {
+    stop();
+    if (!fopen(filename)) return ERR_CODEC_FILE_NOT_FOUND;
+    if (byteOffset > 0 && byteOffset < fsize()) fseek(byteOffset);
+    return play();
+  }
+
+  uint32_t filePosition() { return fposition(); }
+};
+
+// ============================================================
+// Hashing and CRC
+// ============================================================
+uint32_t resumeHashName(const char *name) {
+  uint32_t hash = 2166136261UL;
+  while (*name) {
+    hash ^= (uint8_t)*name++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+uint32_t resumeCrc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t resumeRecordCrc(const ResumeRecord &record) {
+  return resumeCrc32((const uint8_t *)&record, offsetof(ResumeRecord, crc));
+}
+
+// ============================================================
+// EEPROM Ring
+// ============================================================
+int resumeNewestSlot = -1;       // Cached after the boot scan
+uint32_t resumeNewestSequence = 0;
+ResumeRecord resumeLastSaved;
+
+int resumeSlotAddress(int slot) {
+  return RESUME_EEPROM_ADDR + slot * (int)sizeof(ResumeRecord);
+}
+
+bool resumeRecordValid(const ResumeRecord &record) {
+  return record.magic == RESUME_MAGIC && record.crc == resumeRecordCrc(record);
+}
+
+// Scan every slot once and return the newest valid checkpoint
+bool resumeLoad(ResumeRecord &out) {
+  resumeNewestSlot = -1;
+
+  for (int slot = 0; slot < RESUME_SLOT_COUNT; slot++) {
+    ResumeRecord record;
+    EEPROM.get(resumeSlotAddress(slot), record);
+    if (!resumeRecordValid(record)) continue;
+
+    // Serial number arithmetic so the counter can wrap
+    if (resumeNewestSlot < 0 || (int32_t)(record.sequence - resumeNewestSequence) > 0) {
+      resumeNewestSlot = slot;
+      resumeNewestSequence = record.sequence;
+      out = record;
+    }
+  }
+
+  if (resumeNewestSlot < 0) return false;
+
+  resumeLastSaved = out;
+  return true;
+}
+
+bool resumeSameCheckpoint(const ResumeRecord &a, const ResumeRecord &b) {
+  return a.album == b.album && a.track == b.track &&
+         a.albumHash == b.albumHash && a.trackHash == b.trackHash &&
+         a.byteOffset == b.byteOffset && a.paused == b.paused &&
+         a.shuffleMode == b.shuffleMode && a.shuffleSeed == b.shuffleSeed &&
+         a.shuffleEpoch == b.shuffleEpoch && a.shuffleStart == b.shuffleStart;
+}
+
+// Write a checkpoint into the next slot. Unchanged checkpoints (sitting
+// paused in a parked car) are skipped so they cost no wear at all.
+void resumeSave(ResumeRecord record) {
+  if (resumeNewestSlot >= 0 && resumeSameCheckpoint(record, resumeLastSaved)) return;
+
+  int slot = (resumeNewestSlot + 1) % RESUME_SLOT_COUNT;
+  record.magic = RESUME_MAGIC;
+  record.sequence = resumeNewestSequence + 1;
+  record.crc = resumeRecordCrc(record);
+
+  EEPROM.put(resumeSlotAddress(slot), record);
+
+  resumeNewestSlot = slot;
+  resumeNewestSequence = record.sequence;
+  resumeLastSaved = record;
+}
+
+// ============================================================
+// MP3 Frame Sync
+// ============================================================
+
+// Returns the length of the MPEG audio frame starting at h, or 0 if the
+// four bytes are not a plausible Layer III header.
+uint32_t resumeMp3FrameLength(const uint8_t *h) {
+  static const uint16_t BITRATES_V1[16] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0};
+  static const uint16_t BITRATES_V2[16] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0};
+  static const uint32_t RATES_V1[4] = {44100, 48000, 32000, 0};
+
+  if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return 0;
+
+  uint8_t version = (h[1] >> 3) & 0x03;   // 0 = 2.5, 2 = 2, 3 = 1
+  uint8_t layer = (h[1] >> 1) & 0x03;     // 1 = Layer III
+  uint8_t bitrateIndex = (h[2] >> 4) & 0x0F;
+  uint8_t rateIndex = (h[2] >> 2) & 0x03;
+  uint8_t padding = (h[2] >> 1) & 0x01;
+
+  if (version == 1 || layer != 1 || rateIndex == 3) return 0;
+
+  uint32_t sampleRate = RATES_V1[rateIndex];
+  if (version == 2) sampleRate /= 2;
+  if (version == 0) sampleRate /= 4;
+
+  uint32_t bitrate = (version == 3) ? BITRATES_V1[bitrateIndex] : BITRATES_V2[bitrateIndex];
+  if (bitrate == 0) return 0;
+
+  uint32_t samplesPerFrame = (version == 3) ? 1152 : 576;
+  return (samplesPerFrame / 8) * bitrate * 1000 / sampleRate + padding;
+}
+
+// Find the first real frame boundary at or after offset. Two headers in a
+// row with matching version and sample rate rule out stray 0xFFE patterns
+// in the audio data. Returns offset unchanged if nothing was found.
+uint32_t resumeFindFrame(const char *filepath, uint32_t offset) {
+  static uint8_t window[RESUME_SYNC_WINDOW];
+
+  File f = SD.open(filepath);
+  if (!f) return offset;
+
+  if (offset >= f.size()) {
+    f.close();
+    return 0;
+  }
+
+  f.seek(offset);
+  int length = f.read(window, sizeof(window));
+  f.close();
+
+  for (int i = 0; i + 4 <= length; i++) {
+    uint32_t frameLength = resumeMp3FrameLength(&window[i]);
+    if (frameLength == 0) continue;
+
+    int next = i + (int)frameLength;
+    if (next + 4 > length) break;
+
+    if (resumeMp3FrameLength(&window[next]) != 0 &&
+        (window[next + 1] & 0x18) == (window[i + 1] & 0x18) &&
+        (window[next + 2] & 0x0C) == (window[i + 2] & 0x0C)) {
+      return offset + i;
+    }
+  }
+
+  return offset;
+}
+
+#endif
@@ -2,6 +2,7 @@
  * Roadtrip - Car MP3 Player for Songbird V3
  * 
  * A simple, car-friendly MP3 player with album/playlist folders.
+ * Also plays Ogg Opus (.opus) and FLAC (.flac) files.
  * 
  * Hardware: Teensy 4.1 + SGTL5000 + LM4811 HP amp + SSD1306 OLED
  * 
@@ -17,11 +18,21 @@
  *   UP     - Short: Next album | Long/Hold: Volume up
  *   DOWN   - Short: Play/Pause | Long/Hold: Volume down
  *   LEFT   - Restart track / Previous track (double-press)
- *   RIGHT  - Next track
+ *   RIGHT  - Short: Next track | Long: Shuffle off/album/library
  *   
  * LEDs:
  *   LED1 - Pulses while playing
  *   LED2 - Solid when paused, off when playing
+ *
+ * Resume:
+ *   The current album, track and position are checkpointed to EEPROM every
+ *   few seconds and on pause. After a power cycle playback picks up where
+ *   it left off (see resume.h).
+ *
+ * Loudness:
+ *   Each track is played at a common loudness using ReplayGain/R128 tags,
+ *   or a measurement: made in the background while other tracks play for
+ *   MP3, or while the track itself plays for FLAC and Opus (see loudness.h).
  * 
  * Required Board Package:
  *   Teensyduino
@@ -55,6 +66,8 @@
  * 
  *  Adafruit GFX Library
  *    Install via Library Manager: "Adafruit GFX Library"
+ * 
+ *  arduino-libopus (for .opus playback, same library VoiceChat uses)
  *   
  */
 
@@ -62,11 +75,19 @@
 #include <Wire.h>
 #include <SPI.h>
 #include <SD.h>
+#include <EEPROM.h>
 #include <play_sd_mp3.h>
 #include <Bounce.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+#include <SongbirdTelemetry.h>
 #include "splash.h"
+#include "resume.h"
+#include "loudness.h"
+#include "shuffle.h"
+#include "play_sd_opus.h"
+#include "play_sd_flac.h"
+#include "cabin_eq.h"
 
 // ============================================================
 // Hardware Pin Definitions
@@ -102,22 +123,45 @@
 #define LONG_PRESS_MS    400
 #define VOLUME_REPEAT_MS 150
 #define VOLUME_DISPLAY_MS 1500
+#define RESUME_SKIP_SPLASH  1     // Skip the splash when resuming a checkpoint
+#define CABIN_NOISE_ADAPTIVE 0    // Raise bass/presence with road noise (needs a cabin mic)
+#define PLAYER_STATS         0    // Print decoder and EQ cost on every track change
+#define AUDIO_MEMORY_BLOCKS  24
 
 // ============================================================
 // Audio Objects
 // ============================================================
-AudioPlaySdMp3       mp3;
+AudioPlaySdMp3Resumable mp3;
+AudioPlaySdOpus      opus;
+AudioPlaySdFlac      flac;
 AudioMixer4          mixerL;
 AudioMixer4          mixerR;
+AudioFilterCabinEq   cabinEq;
 AudioOutputI2S       i2s_out;
 AudioOutputUSB       usb_out;
+#if CABIN_NOISE_ADAPTIVE
+AudioInputI2S        micIn;
+AudioAnalyzeRMS      programLevel;
+AudioAnalyzeRMS      noiseLevel;
+#endif
 AudioConnection      patchCord1(mp3, 0, mixerL, 0);
 AudioConnection      patchCord2(mp3, 1, mixerR, 0);
-AudioConnection      patchCord3(mixerL, 0, i2s_out, 0);
-AudioConnection      patchCord4(mixerR, 0, i2s_out, 1);
-AudioConnection      patchCord5(mixerL, 0, usb_out, 0);
-AudioConnection      patchCord6(mixerR, 0, usb_out, 1);
+AudioConnection      patchCord3(cabinEq, 0, i2s_out, 0);
+AudioConnection      patchCord4(cabinEq, 1, i2s_out, 1);
+AudioConnection      patchCord5(cabinEq, 0, usb_out, 0);
+AudioConnection      patchCord6(cabinEq, 1, usb_out, 1);
+AudioConnection      patchCord7(opus, 0, mixerL, 1);
+AudioConnection      patchCord8(opus, 1, mixerR, 1);
+AudioConnection      patchCord9(flac, 0, mixerL, 2);
+AudioConnection      patchCord10(flac, 1, mixerR, 2);
+AudioConnection      patchCord11(mixerL, 0, cabinEq, 0);
+AudioConnection      patchCord12(mixerR, 0, cabinEq, 1);
+#if CABIN_NOISE_ADAPTIVE
+AudioConnection      patchCord13(cabinEq, 0, programLevel, 0);
+AudioConnection      patchCord14(micIn, 0, noiseLevel, 0);
+#endif
 AudioControlSGTL5000 codec;
+SongbirdTelemetry    telemetry;
 
 // ============================================================
 // Display
@@ -137,12 +181,20 @@ Bounce btnDown  = Bounce(SW_DOWN_PIN,  DEBOUNCE_MS);
 // ============================================================
 struct Album {
   char name[MAX_NAME_LEN];
+  int trackCount;       // -1 until the folder has been listed
 };
 
 struct Track {
   char name[MAX_NAME_LEN];
 };
 
+enum TrackFormat {
+  FORMAT_NONE,
+  FORMAT_MP3,
+  FORMAT_OPUS,
+  FORMAT_FLAC
+};
+
 // ============================================================
 // Player State
 // ============================================================
@@ -157,9 +209,11 @@ bool isPaused = false;
 unsigned long lastLeftPress = 0;
 unsigned long lastDisplayUpdate = 0;
 unsigned long playStartTime = 0;
+unsigned long pauseStartTime = 0;
 int scrollOffset = 0;
 unsigned long lastScrollTime = 0;
 unsigned long currentTrackLengthMs = 0;
+TrackFormat currentFormat = FORMAT_NONE;
 
 // Volume control state
 int currentVolume = 50;
@@ -171,11 +225,30 @@ unsigned long volumeDisplayUntil = 0;
 bool upHeld = false;
 bool downHeld = false;
 
+// Resume state
+ResumeRecord savedCheckpoint;
+bool hasCheckpoint = false;
+unsigned long lastCheckpointTime = 0;
+
+// Loudness state
+unsigned long lastGainRampTime = 0;
+
+// Shuffle state
+ShuffleQueue shuffle;
+Track prefetchTracks[MAX_TRACKS];   // Track list of the album shuffle goes to next
+int prefetchAlbum = -1;
+int prefetchCount = 0;
+bool prefetchPending = false;
+unsigned long shuffleDisplayUntil = 0;
+unsigned long rightPressTime = 0;
+bool rightHeld = false;
+
 // ============================================================
 // Forward Declarations
 // ============================================================
 void scanAlbums();
 void loadAlbumTracks(int albumIndex);
+int readAlbumTracks(int albumIndex, Track *list);
 void playTrack(int trackIndex);
 void nextTrack();
 void prevTrack();
@@ -191,6 +264,28 @@ void volumeUp();
 void volumeDown();
 void setVolume(int vol);
 void showVolumeOverlay();
+unsigned long getElapsedMs();
+void checkpointPosition();
+bool resumeFromCheckpoint(const ResumeRecord &record);
+void applyMixerGain();
+TrackFormat trackFormat(const char* filename);
+bool playerStart(const char* filepath, uint32_t byteOffset);
+void playerStop();
+void playerPause(bool paused);
+bool playerIsPlaying();
+uint32_t playerFilePosition();
+void applyTrackGain(const char* filepath);
+LoudnessWork findLoudnessWork(char *filepath, size_t size, uint32_t &albumHash, uint32_t &trackHash);
+int albumTrackTotal(int albumIndex);
+int libraryTrackTotal();
+int libraryIndexOf(int albumIndex, int trackIndex);
+void libraryLocate(uint32_t index, int &album, int &track);
+void setShuffleMode(ShuffleMode mode);
+bool shuffleStep(int direction, int &album, int &track);
+int shuffleAlbumStart();
+void switchToAlbum(int albumIndex);
+void prefetchUpcoming();
+void showShuffleOverlay();
 
 // ============================================================
 // Setup
@@ -220,10 +315,17 @@ void setup()
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
   
+  // Look for a checkpoint before the splash so a warm start can skip it
+  hasCheckpoint = resumeLoad(savedCheckpoint);
+
   // Play cinematic splash screen
-  playSplashScreen(display);
+  if (!(hasCheckpoint && RESUME_SKIP_SPLASH))
+  {
+    playSplashScreen(display);
+  }
   
-  AudioMemory(20);
+  AudioMemory(AUDIO_MEMORY_BLOCKS);
+  telemetry.begin(AUDIO_MEMORY_BLOCKS);
   
   if(!codec.enable())
   {
@@ -236,6 +338,12 @@ void setup()
   
   codec.lineOutLevel(LINEOUT_DEFAULT);
   codec.unmuteLineout();
+  
+  cabinEq.begin();
+#if CABIN_NOISE_ADAPTIVE
+  codec.inputSelect(AUDIO_INPUT_MIC);
+  codec.micGain(CABIN_NOISE_MIC_GAIN);
+#endif
 
   setVolume(0);
 
@@ -254,6 +362,10 @@ void setup()
     while (1);
   }
   
+  loudnessLoadIndex();
+  opus.setPcmTap(loudnessPlayTap);
+  flac.setPcmTap(loudnessPlayTap);
+  
   setupHeadphoneAmp();
   
   display.clearDisplay();
@@ -265,7 +377,10 @@ void setup()
   scanAlbums();
   
   // Ensure scanning message is visible for at least 1 second
-  delay(1000);
+  if (!hasCheckpoint)
+  {
+    delay(1000);
+  }
   
   if(albumCount == 0)
   {
@@ -280,10 +395,13 @@ void setup()
     while (1);
   }
   
-  loadAlbumTracks(0);
+  if (!hasCheckpoint || !resumeFromCheckpoint(savedCheckpoint))
+  {
+    loadAlbumTracks(0);
   
-  if (trackCount > 0) {
-    playTrack(0);
+    if (trackCount > 0) {
+      playTrack(0);
+    }
   }
   
   updateDisplay();
@@ -294,6 +412,8 @@ void setup()
 // ============================================================
 void loop()
 {
+  telemetry.loopTick();
+  
   btnLeft.update();
   btnRight.update();
   btnUp.update();
@@ -360,12 +480,28 @@ void loop()
   
   if (btnRight.fallingEdge())
   {
-    nextTrack();
+    rightPressTime = now;
+    rightHeld = false;
+  }
+  
+  if (btnRight.read() == LOW && !rightHeld && now - rightPressTime >= LONG_PRESS_MS)
+  {
+    setShuffleMode((ShuffleMode)((shuffle.mode + 1) % SHUFFLE_MODE_COUNT));
+    rightHeld = true;
+  }
+  
+  if (btnRight.risingEdge())
+  {
+    if (!rightHeld)
+    {
+      nextTrack();
+    }
+    rightHeld = false;
   }
   
   if (btnLeft.fallingEdge())
   {
-    unsigned long playTime = now - playStartTime;
+    unsigned long playTime = getElapsedMs();
     
     if (now - lastLeftPress < DOUBLE_PRESS_MS)
     {
@@ -384,17 +520,45 @@ void loop()
     lastLeftPress = now;
   }
   
-  if(isPlaying && !isPaused && !mp3.isPlaying())
+  opus.pump();
+  flac.pump();
+  
+  if(isPlaying && !isPaused && !playerIsPlaying())
   {
     nextTrack();
   }
   
+  if(isPlaying && !isPaused && millis() - lastCheckpointTime >= RESUME_CHECKPOINT_MS)
+  {
+    checkpointPosition();
+  }
+  
+  if(loudnessUpdateRamp(millis() - lastGainRampTime))
+  {
+    applyMixerGain();
+  }
+  lastGainRampTime = millis();
+  
+  if(prefetchPending)
+  {
+    prefetchUpcoming();
+  }
+  
+  loudnessService(findLoudnessWork);
+  
+#if CABIN_NOISE_ADAPTIVE
+  cabinNoiseService(cabinEq, programLevel, noiseLevel);
+#endif
+  
   if(millis() - lastDisplayUpdate > 100)
   {
     lastDisplayUpdate = millis();
     updateDisplay();
     updateLEDs();
   }
+  
+  // Audio CPU and memory on request ("TELEMETRY" over USB serial)
+  telemetry.poll(Serial);
 }
 
 // ============================================================
@@ -409,14 +573,23 @@ void setVolume(int vol)
 {
   currentVolume = constrain(vol, VOLUME_MIN, VOLUME_MAX);
   
-  float mixerGain = currentVolume / 100.0;
-    
-  mixerL.gain(0, mixerGain);
-  mixerR.gain(0, mixerGain);
+  applyMixerGain();
   
   volumeDisplayUntil = millis() + VOLUME_DISPLAY_MS;
 }
 
+void applyMixerGain()
+{
+  float mixerGain = currentVolume / 100.0 * loudnessCurrentGain;
+  
+  // One mixer channel per decoder; only the active one carries audio
+  for(int ch = 0; ch < 3; ch++)
+  {
+    mixerL.gain(ch, mixerGain);
+    mixerR.gain(ch, mixerGain);
+  }
+}
+
 void setHpAmpToStep(int targetStep)
 {
   for(int step = 0; step > targetStep; --step)
@@ -471,6 +644,7 @@ void scanAlbums()
       {
         strncpy(albums[albumCount].name, name, MAX_NAME_LEN - 1);
         albums[albumCount].name[MAX_NAME_LEN - 1] = '\0';
+        albums[albumCount].trackCount = -1;
         albumCount++;
         Serial.print("Found album: ");
         Serial.println(name);
@@ -498,57 +672,84 @@ void scanAlbums()
 
 void loadAlbumTracks(int albumIndex)
 {
-  trackCount = 0;
   currentAlbum = albumIndex;
   currentTrack = 0;
   tracks[0].name[0] = '\0';
+  trackCount = readAlbumTracks(albumIndex, tracks);
+}
+
+// List the playable files of an album into list, sorted by name, and return how
+// many there are. With a NULL list the tracks are only counted. Safe to
+// call while a track is playing.
+int readAlbumTracks(int albumIndex, Track *list)
+{
+  int count = 0;
   
   char path[MAX_NAME_LEN + 2];
   snprintf(path, sizeof(path), "/%s", albums[albumIndex].name);
   
+  loudnessLockSd();
   File dir = SD.open(path);
+  loudnessUnlockSd();
   if (!dir)
   {
     Serial.print("Failed to open: ");
     Serial.println(path);
-    return;
+    return 0;
   }
   
-  while (trackCount < MAX_TRACKS)
+  while (count < MAX_TRACKS)
   {
+    loudnessLockSd();
     File entry = dir.openNextFile();
+    loudnessUnlockSd();
     if (!entry) break;
     
     if (!entry.isDirectory())
     {
       const char* name = entry.name();
-      int len = strlen(name);
       
-      if (len > 4 && strcasecmp(name + len - 4, ".mp3") == 0)
+      if (trackFormat(name) != FORMAT_NONE)
       {
-        strncpy(tracks[trackCount].name, name, MAX_NAME_LEN - 1);
-        tracks[trackCount].name[MAX_NAME_LEN - 1] = '\0';
-        trackCount++;
+        if (list)
+        {
+          strncpy(list[count].name, name, MAX_NAME_LEN - 1);
+          list[count].name[MAX_NAME_LEN - 1] = '\0';
+        }
+        count++;
       }
     }
 
+    loudnessLockSd();
     entry.close();
+    loudnessUnlockSd();
   }
 
+  loudnessLockSd();
   dir.close();
+  loudnessUnlockSd();
+  
+  albums[albumIndex].trackCount = count;
+  
+  if (!list)
+  {
+    return count;
+  }
   
-  for(int i = 0; i < trackCount - 1; i++)
+  for(int i = 0; i < count - 1; i++)
   {
-    for(int j = i + 1; j < trackCount; j++)
+    for(int j = i + 1; j < count; j++)
     {
-      if(strcasecmp(tracks[i].name, tracks[j].name) > 0)
+      if(strcasecmp(list[i].name, list[j].name) > 0)
       {
-        Track temp = tracks[i];
-        tracks[i] = tracks[j];
-        tracks[j] = temp;
+        Track temp = list[i];
+        list[i] = list[j];
+        list[j] = temp;
       }
     }
-  }  
+  }
+  
+  return count;
 }
 
 // ============================================================
@@ -588,14 +789,18 @@ void playTrack(int trackIndex)
     currentTrackLengthMs = 0;
   }
   
-  mp3.stop();
+  playerStop();
+  loudnessFlushIndex();
+  applyTrackGain(filepath);
   delay(10);
-  mp3.play(filepath);
+  playerStart(filepath, 0);
   
   isPlaying = true;
   isPaused = false;
   playStartTime = millis();
+  prefetchPending = (shuffle.mode != SHUFFLE_OFF);
   
+  checkpointPosition();
   updateDisplay();
 }
 
@@ -606,6 +811,17 @@ void nextTrack()
     return;
   }
   
+  if (shuffle.mode != SHUFFLE_OFF)
+  {
+    int album, track;
+    if (shuffleStep(1, album, track))
+    {
+      switchToAlbum(album);
+      playTrack(track);
+    }
+    return;
+  }
+  
   int next = currentTrack + 1;
   if(next >= trackCount)
   {
@@ -621,6 +837,21 @@ void prevTrack()
 {
   if (trackCount == 0) return;
   
+  if (shuffle.mode != SHUFFLE_OFF)
+  {
+    int album, track;
+    if (shuffleStep(-1, album, track))
+    {
+      switchToAlbum(album);
+      playTrack(track);
+    }
+    else
+    {
+      restartTrack();
+    }
+    return;
+  }
+  
   int prev = currentTrack - 1;
   if (prev < 0)
   {
@@ -645,13 +876,13 @@ void nextAlbum()
     return;
   }
   
-  mp3.stop();
+  playerStop();
   int next = (currentAlbum + 1) % albumCount;
   loadAlbumTracks(next);
   
   if(trackCount > 0) 
   {
-    playTrack(0);
+    playTrack(shuffleAlbumStart());
   }
   else
   {
@@ -667,13 +898,13 @@ void prevAlbum()
     return;
   }
   
-  mp3.stop();
+  playerStop();
   int prev = (currentAlbum - 1 + albumCount) % albumCount;
   loadAlbumTracks(prev);
   
   if(trackCount > 0)
   {
-    playTrack(0);
+    playTrack(shuffleAlbumStart());
   }
   else
   {
@@ -698,18 +929,645 @@ void togglePause()
   
   if(isPaused)
   {
-    mp3.pause(true);
+    playerPause(true);
+    pauseStartTime = millis();
+    loudnessFlushIndex();
     Serial.println("Paused");
   }
   else
   {
-    mp3.pause(false);
+    playerPause(false);
+    playStartTime += millis() - pauseStartTime;
     Serial.println("Resumed");
   }
   
+  checkpointPosition();
   updateDisplay();
 }
 
+unsigned long getElapsedMs()
+{
+  unsigned long now = isPaused ? pauseStartTime : millis();
+  return now - playStartTime;
+}
+
+// ============================================================
+// Players
+// ============================================================
+TrackFormat trackFormat(const char* filename)
+{
+  const char* ext = strrchr(filename, '.');
+  if(!ext || filename[0] == '.')
+  {
+    return FORMAT_NONE;
+  }
+  
+  if(strcasecmp(ext, ".mp3") == 0) return FORMAT_MP3;
+  if(strcasecmp(ext, ".opus") == 0) return FORMAT_OPUS;
+  if(strcasecmp(ext, ".flac") == 0) return FORMAT_FLAC;
+  return FORMAT_NONE;
+}
+
+AudioPlaySdStream* streamPlayer()
+{
+  if(currentFormat == FORMAT_OPUS) return &opus;
+  if(currentFormat == FORMAT_FLAC) return &flac;
+  return NULL;
+}
+
+bool playerStart(const char* filepath, uint32_t byteOffset)
+{
+  currentFormat = trackFormat(filepath);
+  
+  if(currentFormat == FORMAT_MP3)
+  {
+    return mp3.playFrom(filepath, byteOffset) == ERR_CODEC_NONE;
+  }
+  
+  AudioPlaySdStream* player = streamPlayer();
+  if(!player || !player->playFrom(filepath, byteOffset))
+  {
+    Serial.print("Unsupported or damaged file: ");
+    Serial.println(filepath);
+    return false;
+  }
+  
+  // Vorbis comment gain only turns up once the headers are parsed
+  float gainDb;
+  uint32_t albumHash = resumeHashName(albums[currentAlbum].name);
+  uint32_t trackHash = resumeHashName(tracks[currentTrack].name);
+  File f = SD.open(filepath);
+  uint32_t size = f ? f.size() : 0;
+  if(f)
+  {
+    f.close();
+  }
+  if(!loudnessLookup(albumHash, trackHash, size) && player->tagGain(gainDb))
+  {
+    gainDb = loudnessClampGain(gainDb, 0.0f);
+    loudnessStore(albumHash, trackHash, size, gainDb, LOUDNESS_SOURCE_TAG);
+    loudnessSetTarget(gainDb);
+  }
+  
+  // No tag and never measured: meter it as it plays, if it plays through
+  if(byteOffset == 0 && !loudnessLookup(albumHash, trackHash, size))
+  {
+    loudnessPlayBegin(albumHash, trackHash, size);
+  }
+  
+  return true;
+}
+
+void playerStop()
+{
+  AudioPlaySdStream* player = streamPlayer();
+#if PLAYER_STATS
+  // Report what the outgoing decoder cost before it is reused
+  if(player && player->decodeMicrosPerSecond() > 0)
+  {
+    Serial.printf("Decode: %lu us per second of audio, %lu underruns\n",
+                  (unsigned long)player->decodeMicrosPerSecond(), (unsigned long)player->underruns());
+  }
+  Serial.printf("EQ: %lu cycles per block (max %lu, budget %lu), %d of %d bands\n",
+                (unsigned long)cabinEq.cyclesPerBlock(), (unsigned long)cabinEq.cyclesPerBlockMax(),
+                (unsigned long)cabinEq.budget(), cabinEq.stagesActive(), cabinEq.stagesConfigured());
+  cabinEq.resetCycleMax();
+#endif
+  
+  // Still playing means skipped or stopped early, which is no measurement
+  loudnessPlayEnd(player && !player->isPlaying());
+  
+  mp3.stop();
+  opus.stop();
+  flac.stop();
+}
+
+void playerPause(bool paused)
+{
+  if(currentFormat == FORMAT_MP3)
+  {
+    mp3.pause(paused);
+  }
+  else if(streamPlayer())
+  {
+    streamPlayer()->pause(paused);
+  }
+}
+
+bool playerIsPlaying()
+{
+  if(currentFormat == FORMAT_MP3)
+  {
+    return mp3.isPlaying();
+  }
+  
+  AudioPlaySdStream* player = streamPlayer();
+  return player && player->isPlaying();
+}
+
+uint32_t playerFilePosition()
+{
+  if(currentFormat == FORMAT_MP3)
+  {
+    return mp3.filePosition();
+  }
+  
+  AudioPlaySdStream* player = streamPlayer();
+  return player ? player->filePosition() : 0;
+}
+
+// ============================================================
+// Resume
+// ============================================================
+void checkpointPosition()
+{
+  lastCheckpointTime = millis();
+
+  if(!isPlaying || trackCount == 0)
+  {
+    return;
+  }
+
+  uint32_t position = playerFilePosition();
+
+  ResumeRecord record;
+  record.album = currentAlbum;
+  record.track = currentTrack;
+  record.albumHash = resumeHashName(albums[currentAlbum].name);
+  record.trackHash = resumeHashName(tracks[currentTrack].name);
+  record.byteOffset = (position > RESUME_REWIND_BYTES) ? position - RESUME_REWIND_BYTES : 0;
+  record.elapsedMs = getElapsedMs();
+  record.paused = isPaused ? 1 : 0;
+  record.shuffleMode = shuffle.mode;
+  record.shuffleSeed = shuffle.seed;
+  record.shuffleEpoch = shuffle.epoch;
+  record.shuffleStart = shuffle.start();
+
+  resumeSave(record);
+}
+
+bool resumeFromCheckpoint(const ResumeRecord &record)
+{
+  elapsedMillis resumeTimer;
+
+  // Prefer the saved index, but fall back to a name match in case albums
+  // were added or removed since the checkpoint was taken
+  int album = -1;
+  if(record.album < albumCount && resumeHashName(albums[record.album].name) == record.albumHash)
+  {
+    album = record.album;
+  }
+  else
+  {
+    for(int i = 0; i < albumCount; i++)
+    {
+      if(resumeHashName(albums[i].name) == record.albumHash)
+      {
+        album = i;
+        break;
+      }
+    }
+  }
+
+  if(album < 0)
+  {
+    Serial.println("Resume: album not found");
+    return false;
+  }
+
+  loadAlbumTracks(album);
+
+  int track = -1;
+  if(record.track < trackCount && resumeHashName(tracks[record.track].name) == record.trackHash)
+  {
+    track = record.track;
+  }
+  else
+  {
+    for(int i = 0; i < trackCount; i++)
+    {
+      if(resumeHashName(tracks[i].name) == record.trackHash)
+      {
+        track = i;
+        break;
+      }
+    }
+  }
+
+  if(track < 0)
+  {
+    Serial.println("Resume: track not found");
+    return false;
+  }
+
+  currentTrack = track;
+  scrollOffset = 0;
+  lastScrollTime = millis();
+
+  // Rebuild the same shuffle order and find our place in it
+  shuffle.mode = (ShuffleMode)record.shuffleMode;
+  shuffle.seed = record.shuffleSeed;
+  if(shuffle.mode == SHUFFLE_ALBUM)
+  {
+    shuffle.rejoin(trackCount, record.shuffleEpoch, record.shuffleStart, currentTrack);
+  }
+  else if(shuffle.mode == SHUFFLE_LIBRARY)
+  {
+    shuffle.rejoin(libraryTrackTotal(), record.shuffleEpoch, record.shuffleStart,
+                   libraryIndexOf(currentAlbum, currentTrack));
+  }
+  prefetchPending = (shuffle.mode != SHUFFLE_OFF);
+
+  char filepath[MAX_NAME_LEN * 2 + 4];
+  snprintf(filepath, sizeof(filepath), "/%s/%s", albums[currentAlbum].name, tracks[currentTrack].name);
+
+  File f = SD.open(filepath);
+  if(!f)
+  {
+    return false;
+  }
+  currentTrackLengthMs = (f.size() * 1000UL) / 24000UL;
+  f.close();
+
+  applyTrackGain(filepath);
+
+  // MP3 needs a frame boundary found for it; the other players resync
+  // themselves
+  uint32_t frameOffset = record.byteOffset;
+  if(trackFormat(filepath) == FORMAT_MP3)
+  {
+    frameOffset = resumeFindFrame(filepath, record.byteOffset);
+  }
+  
+  if(!playerStart(filepath, frameOffset))
+  {
+    Serial.println("Resume: decoder failed to start");
+    return false;
+  }
+
+  isPlaying = true;
+  isPaused = false;
+  playStartTime = millis() - record.elapsedMs;
+  lastCheckpointTime = millis();
+
+  // Powered off while paused: come back paused at the same place
+  if(record.paused)
+  {
+    playerPause(true);
+    isPaused = true;
+    pauseStartTime = millis();
+  }
+
+  Serial.printf("Resumed %s at byte %lu (%lu s%s) in %lu ms\n",
+                filepath, frameOffset, record.elapsedMs / 1000, isPaused ? ", paused" : "",
+                (unsigned long)resumeTimer);
+  return true;
+}
+
+// ============================================================
+// Loudness
+// ============================================================
+
+// Pick the gain for a track about to start. Called with the decoder
+// stopped, so reading the tag here cannot disturb playback.
+void applyTrackGain(const char* filepath)
+{
+  uint32_t albumHash = resumeHashName(albums[currentAlbum].name);
+  uint32_t trackHash = resumeHashName(tracks[currentTrack].name);
+  float gainDb = loudnessDefaultGainDb();
+
+  File f = SD.open(filepath);
+  if(f)
+  {
+    const LoudnessEntry *entry = loudnessLookup(albumHash, trackHash, f.size());
+    if(entry)
+    {
+      gainDb = entry->gainCentiDb / 100.0f;
+    }
+    else if(trackFormat(filepath) == FORMAT_MP3 && loudnessReadTagGain(f, gainDb))
+    {
+      loudnessStore(albumHash, trackHash, f.size(), gainDb, LOUDNESS_SOURCE_TAG);
+    }
+    f.close();
+  }
+
+  Serial.printf("Track gain: %.1f dB\n", gainDb);
+  loudnessSetGain(gainDb);
+  applyMixerGain();
+}
+
+// Next track the background analyzer should measure: the current album
+// first, then the rest of the library in album order. Each call opens a
+// directory or looks at one entry, so a big album cannot hold up loop();
+// the walk carries on from there on the next call.
+LoudnessWork findLoudnessWork(char *filepath, size_t size, uint32_t &albumHash, uint32_t &trackHash)
+{
+  static bool albumDone[MAX_ALBUMS];
+  static int doneForAlbumCount = -1;
+  static int walkFrom = -1;       // Album this pass started at
+  static int walkStep = 0;        // Albums finished this pass
+  static int walkAlbum = 0;
+  static File walkDir;
+  static bool skippedPlaying = false;
+
+  if(doneForAlbumCount != albumCount)
+  {
+    memset(albumDone, 0, sizeof(albumDone));
+    doneForAlbumCount = albumCount;
+    walkFrom = -1;
+  }
+
+  // The current album always comes first, so start over when it changes
+  if(walkFrom != currentAlbum)
+  {
+    if(walkDir)
+    {
+      loudnessLockSd();
+      walkDir.close();
+      loudnessUnlockSd();
+    }
+    walkFrom = currentAlbum;
+    walkStep = 0;
+  }
+
+  if(!walkDir)
+  {
+    while(walkStep < albumCount && albumDone[(walkFrom + walkStep) % albumCount])
+    {
+      walkStep++;
+    }
+    if(walkStep >= albumCount)
+    {
+      walkStep = 0;
+      return LOUDNESS_WORK_DONE;
+    }
+
+    walkAlbum = (walkFrom + walkStep) % albumCount;
+    char path[MAX_NAME_LEN + 2];
+    snprintf(path, sizeof(path), "/%s", albums[walkAlbum].name);
+
+    loudnessLockSd();
+    walkDir = SD.open(path);
+    loudnessUnlockSd();
+    if(!walkDir)
+    {
+      albumDone[walkAlbum] = true;
+    }
+    skippedPlaying = false;
+    return LOUDNESS_WORK_PENDING;
+  }
+
+  loudnessLockSd();
+  File entry = walkDir.openNextFile();
+  loudnessUnlockSd();
+  if(!entry)
+  {
+    loudnessLockSd();
+    walkDir.close();
+    loudnessUnlockSd();
+    if(!skippedPlaying)
+    {
+      albumDone[walkAlbum] = true;
+    }
+    walkStep++;
+    return LOUDNESS_WORK_PENDING;
+  }
+
+  LoudnessWork work = LOUDNESS_WORK_PENDING;
+  const char* name = entry.name();
+  int len = strlen(name);
+
+  if(!entry.isDirectory() && name[0] != '.' && len > 4 && strcasecmp(name + len - 4, ".mp3") == 0)
+  {
+    albumHash = resumeHashName(albums[walkAlbum].name);
+    trackHash = resumeHashName(name);
+
+    if(!loudnessLookup(albumHash, trackHash, entry.size()))
+    {
+      // Leave the playing track alone, it gets measured another time
+      if(walkAlbum == currentAlbum && isPlaying && strcmp(name, tracks[currentTrack].name) == 0)
+      {
+        skippedPlaying = true;
+      }
+      else
+      {
+        snprintf(filepath, size, "/%s/%s", albums[walkAlbum].name, name);
+        work = LOUDNESS_WORK_FOUND;
+      }
+    }
+  }
+
+  loudnessLockSd();
+  entry.close();
+  loudnessUnlockSd();
+  return work;
+}
+
+// ============================================================
+// Shuffle
+// ============================================================
+int albumTrackTotal(int albumIndex)
+{
+  if(albums[albumIndex].trackCount < 0)
+  {
+    readAlbumTracks(albumIndex, NULL);
+  }
+  return albums[albumIndex].trackCount;
+}
+
+int libraryTrackTotal()
+{
+  int total = 0;
+  for(int i = 0; i < albumCount; i++)
+  {
+    total += albumTrackTotal(i);
+  }
+  return total;
+}
+
+// Library shuffle numbers every track on the card: album 0's tracks
+// first, then album 1's, and so on
+int libraryIndexOf(int albumIndex, int trackIndex)
+{
+  int index = trackIndex;
+  for(int i = 0; i < albumIndex; i++)
+  {
+    index += albumTrackTotal(i);
+  }
+  return index;
+}
+
+void libraryLocate(uint32_t index, int &album, int &track)
+{
+  for(album = 0; album < albumCount; album++)
+  {
+    int count = albumTrackTotal(album);
+    if(index < (uint32_t)count)
+    {
+      track = index;
+      return;
+    }
+    index -= count;
+  }
+
+  album = currentAlbum;
+  track = 0;
+}
+
+void setShuffleMode(ShuffleMode mode)
+{
+  uint32_t seed = shuffleMix(micros()) ^ millis();
+
+  if(mode == SHUFFLE_ALBUM)
+  {
+    shuffle.begin(mode, seed, trackCount, currentTrack);
+  }
+  else if(mode == SHUFFLE_LIBRARY)
+  {
+    shuffle.begin(mode, seed, libraryTrackTotal(), libraryIndexOf(currentAlbum, currentTrack));
+  }
+  else
+  {
+    shuffle.mode = SHUFFLE_OFF;
+  }
+
+  prefetchAlbum = -1;
+  prefetchPending = (mode != SHUFFLE_OFF);
+  shuffleDisplayUntil = millis() + VOLUME_DISPLAY_MS;
+
+  Serial.print("Shuffle: ");
+  Serial.println(shuffleModeName(mode));
+
+  checkpointPosition();
+  updateDisplay();
+}
+
+// Move the shuffle order one step and return the album/track it lands on.
+// Album shuffle rolls on to the next album (in order) after the last
+// track; library shuffle starts a fresh order. Returns false when going
+// back past the first track played.
+bool shuffleStep(int direction, int &album, int &track)
+{
+  album = currentAlbum;
+
+  if(direction > 0 && !shuffle.next())
+  {
+    if(shuffle.mode == SHUFFLE_ALBUM)
+    {
+      // Skip empty folders
+      for(int i = 0; i < albumCount; i++)
+      {
+        album = (album + 1) % albumCount;
+        if(albumTrackTotal(album) > 0)
+        {
+          break;
+        }
+      }
+      shuffle.nextEpoch(albumTrackTotal(album));
+    }
+    else
+    {
+      shuffle.nextEpoch(libraryTrackTotal());
+    }
+  }
+  else if(direction < 0 && !shuffle.prev())
+  {
+    if(shuffle.mode == SHUFFLE_ALBUM)
+    {
+      for(int i = 0; i < albumCount; i++)
+      {
+        album = (album - 1 + albumCount) % albumCount;
+        if(albumTrackTotal(album) > 0)
+        {
+          break;
+        }
+      }
+      if(!shuffle.prevEpoch(albumTrackTotal(album)))
+      {
+        album = currentAlbum;
+        return false;
+      }
+    }
+    else if(!shuffle.prevEpoch(libraryTrackTotal()))
+    {
+      return false;
+    }
+  }
+
+  if(shuffle.mode == SHUFFLE_LIBRARY)
+  {
+    libraryLocate(shuffle.current(), album, track);
+  }
+  else
+  {
+    track = shuffle.current();
+  }
+
+  return true;
+}
+
+// First track to play after a manual album change
+int shuffleAlbumStart()
+{
+  if(shuffle.mode == SHUFFLE_ALBUM)
+  {
+    shuffle.nextEpoch(trackCount);
+    return shuffle.current();
+  }
+
+  if(shuffle.mode == SHUFFLE_LIBRARY)
+  {
+    // A fresh pass through the library that starts at the new album:
+    // re-seating the current pass would skip or repeat tracks in it
+    shuffle.seat(libraryTrackTotal(), shuffle.epoch + 1, libraryIndexOf(currentAlbum, 0));
+  }
+
+  return 0;
+}
+
+void switchToAlbum(int albumIndex)
+{
+  if(albumIndex == currentAlbum)
+  {
+    return;
+  }
+
+  if(albumIndex == prefetchAlbum)
+  {
+    memcpy(tracks, prefetchTracks, sizeof(Track) * prefetchCount);
+    trackCount = prefetchCount;
+    currentAlbum = albumIndex;
+    currentTrack = 0;
+    prefetchAlbum = -1;
+    return;
+  }
+
+  loadAlbumTracks(albumIndex);
+}
+
+// Look one step ahead in the shuffle order and, if it leaves the current
+// album, list that album now so the change is instant
+void prefetchUpcoming()
+{
+  prefetchPending = false;
+
+  ShuffleQueue saved = shuffle;
+  int album, track;
+  bool ok = shuffleStep(1, album, track);
+  shuffle = saved;
+
+  if(!ok || album == currentAlbum || album == prefetchAlbum)
+  {
+    return;
+  }
+
+  prefetchCount = readAlbumTracks(album, prefetchTracks);
+  prefetchAlbum = album;
+
+  Serial.print("Prefetched: ");
+  Serial.println(albums[album].name);
+}
+
 // ============================================================
 // Display
 // ============================================================
@@ -717,9 +1575,9 @@ String getDisplayName(const char* filename)
 {
   String name = String(filename);
   
-  if(name.endsWith(".mp3") || name.endsWith(".MP3"))
+  if(trackFormat(filename) != FORMAT_NONE)
   {
-    name = name.substring(0, name.length() - 4);
+    name = name.substring(0, name.lastIndexOf('.'));
   }
   
   unsigned int start = 0;
@@ -765,6 +1623,20 @@ void showVolumeOverlay()
   }
 }
 
+void showShuffleOverlay()
+{
+  display.setTextSize(1);
+  display.setCursor(43, 0);
+  display.print("SHUFFLE");
+  
+  const char* name = shuffleModeName(shuffle.mode);
+  display.setTextSize(2);
+  display.setCursor((SCREEN_WIDTH - strlen(name) * 12) / 2, 12);
+  display.print(name);
+  
+  display.setTextSize(1);
+}
+
 void updateDisplay()
 {
   display.clearDisplay();
@@ -776,6 +1648,13 @@ void updateDisplay()
     return;
   }
   
+  if(millis() < shuffleDisplayUntil)
+  {
+    showShuffleOverlay();
+    display.display();
+    return;
+  }
+  
   display.setTextSize(1);
   display.setCursor(0, 0);
   
@@ -838,7 +1717,7 @@ void updateDisplay()
   
   if(isPlaying)
   {
-    unsigned long elapsedMs = millis() - playStartTime;
+    unsigned long elapsedMs = getElapsedMs();
     int totalSecs = elapsedMs / 1000;
     int mins = totalSecs / 60;
     int secs = totalSecs % 60;
@@ -865,6 +1744,12 @@ void updateDisplay()
     display.print("--:--");
   }
   
+  if(shuffle.mode != SHUFFLE_OFF)
+  {
+    display.setCursor(82, 20);
+    display.print(shuffle.mode == SHUFFLE_LIBRARY ? "S" : "s");
+  }
+  
   // Joust-style bird animation
   if(isPlaying && !isPaused)
   {
@@ -0,0 +1,197 @@
+/**
+ * Shuffle for Roadtrip
+ *
+ * Shuffle order is computed, not stored. A small Feistel network is a
+ * bijection on [0, 2^(2*halfBits)); "cycle walking" (re-applying it until
+ * the result lands below size) turns that into a bijection on [0, size).
+ * So position -> track is a true permutation of any track count, with no
+ * table in RAM, and running the network backwards gives the position of
+ * a given track. Previous is just position - 1.
+ *
+ * Every pass through the list (an "epoch") gets its own key derived from
+ * the seed, so the order changes each time round. The same seed always
+ * gives the same order.
+ *
+ * Seating a queue on a track (shuffle switched on, a new album picked)
+ * rotates the epoch's order so that track comes first, rather than
+ * jumping into the middle of it: the pass still plays every track once.
+ */
+
+#ifndef SHUFFLE_H
+#define SHUFFLE_H
+
+#include <Arduino.h>
+
+#define SHUFFLE_ROUNDS  4
+
+enum ShuffleMode {
+  SHUFFLE_OFF = 0,
+  SHUFFLE_ALBUM,      // Tracks of each album in random order, albums in sequence
+  SHUFFLE_LIBRARY,    // Every track on the card in one random order
+  SHUFFLE_MODE_COUNT
+};
+
+const char* shuffleModeName(ShuffleMode mode) {
+  switch (mode) {
+    case SHUFFLE_ALBUM:   return "ALBUM";
+    case SHUFFLE_LIBRARY: return "LIBRARY";
+    default:              return "OFF";
+  }
+}
+
+// Murmur3 finalizer, a cheap full-avalanche 32-bit mix
+uint32_t shuffleMix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x85EBCA6BUL;
+  x ^= x >> 13;
+  x *= 0xC2B2AE35UL;
+  x ^= x >> 16;
+  return x;
+}
+
+// ============================================================
+// Permutation
+// ============================================================
+struct ShufflePermutation {
+  uint32_t size;
+  uint32_t key;
+  uint8_t halfBits;
+  uint32_t halfMask;
+
+  void begin(uint32_t n, uint32_t k) {
+    size = n;
+    key = k;
+
+    // Smallest even width covering n keeps the cycle walk under 4 steps
+    halfBits = 1;
+    while (((uint32_t)1 << (2 * halfBits)) < n) halfBits++;
+    halfMask = ((uint32_t)1 << halfBits) - 1;
+  }
+
+  uint32_t round(uint32_t half, int r) const {
+    return shuffleMix(half ^ key ^ ((uint32_t)r * 0x9E3779B9UL)) & halfMask;
+  }
+
+  uint32_t encrypt(uint32_t x) const {
+    uint32_t left = x >> halfBits;
+    uint32_t right = x & halfMask;
+    for (int r = 0; r < SHUFFLE_ROUNDS; r++) {
+      uint32_t next = left ^ round(right, r);
+      left = right;
+      right = next;
+    }
+    return (left << halfBits) | right;
+  }
+
+  uint32_t decrypt(uint32_t x) const {
+    uint32_t left = x >> halfBits;
+    uint32_t right = x & halfMask;
+    for (int r = SHUFFLE_ROUNDS - 1; r >= 0; r--) {
+      uint32_t prev = right ^ round(left, r);
+      right = left;
+      left = prev;
+    }
+    return (left << halfBits) | right;
+  }
+
+  // Position -> item
+  uint32_t forward(uint32_t position) const {
+    if (size <= 1) return 0;
+    uint32_t x = encrypt(position);
+    while (x >= size) x = encrypt(x);
+    return x;
+  }
+
+  // Item -> position
+  uint32_t inverse(uint32_t item) const {
+    if (size <= 1) return 0;
+    uint32_t x = decrypt(item);
+    while (x >= size) x = decrypt(x);
+    return x;
+  }
+};
+
+// ============================================================
+// Shuffle Queue
+// ============================================================
+struct ShuffleQueue {
+  ShuffleMode mode;
+  uint32_t seed;
+  uint16_t epoch;
+  uint32_t position;
+  uint16_t seatEpoch;   // The epoch that was seated on a track...
+  uint32_t seatStart;   // ...and the position in its order that plays first
+  ShufflePermutation order;
+
+  uint32_t epochKey(uint16_t e) const {
+    return shuffleMix(seed ^ shuffleMix((uint32_t)e + 1));
+  }
+
+  // Rotation of the current epoch's order; only the seated one has one
+  uint32_t start() const {
+    return (epoch == seatEpoch) ? seatStart : 0;
+  }
+
+  // Start the order for the given epoch with item first
+  void seat(uint32_t size, uint16_t e, uint32_t item) {
+    epoch = e;
+    order.begin(size, epochKey(e));
+    seatEpoch = e;
+    seatStart = (item < size) ? order.inverse(item) : 0;
+    position = 0;
+  }
+
+  // Rejoin an epoch whose order starts at first (a saved checkpoint) so
+  // that item is the current position. Epochs before it are taken as
+  // unseated, so stepping back past the one saved may differ from what
+  // played before the power cut.
+  void rejoin(uint32_t size, uint16_t e, uint32_t first, uint32_t item) {
+    epoch = e;
+    order.begin(size, epochKey(e));
+    seatEpoch = e;
+    seatStart = (first < size) ? first : 0;
+    position = (item < size) ? (order.inverse(item) + size - seatStart) % size : 0;
+  }
+
+  void begin(ShuffleMode m, uint32_t s, uint32_t size, uint32_t item) {
+    mode = m;
+    seed = s;
+    seat(size, 0, item);
+  }
+
+  uint32_t current() const {
+    if (order.size == 0) return 0;
+    return order.forward((position + start()) % order.size);
+  }
+
+  // Step within the current epoch. Returns false when stepping off either
+  // end, leaving the caller to decide what the next epoch covers.
+  bool next() {
+    if (position + 1 >= order.size) return false;
+    position++;
+    return true;
+  }
+
+  bool prev() {
+    if (position == 0) return false;
+    position--;
+    return true;
+  }
+
+  // Move to the following/previous epoch over size items
+  void nextEpoch(uint32_t size) {
+    epoch++;
+    order.begin(size, epochKey(epoch));
+    position = 0;
+  }
+
+  bool prevEpoch(uint32_t size) {
+    if (epoch == 0) return false;
+    epoch--;
+    order.begin(size, epochKey(epoch));
+    position = size > 0 ? size - 1 : 0;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,414 @@
+/*
+ * AecBench.cpp - Echo cancellation and cost of the VoiceChat echo canceller
+ *
+ *   aec_bench [far_only|double_talk|path_change|cycles...] [--ir path.wav...]
+ *
+ * Runs EchoCanceller (examples/VoiceChat, built against the host shims)
+ * at 16 kHz on what OpusCodec would hand it: a far-end talker played
+ * through an echo path into the mic, a near-end talker and a -60 dBFS
+ * noise floor. Echo paths are impulse responses from the play queue to
+ * the mic, graph delay included. Built in:
+ *
+ *   headset_bleed  closed headset, bleed 26 dB down, 6 ms after the play
+ *                  queue (two audio blocks of output buffering)
+ *   headset_open   open-back headset, 14 dB down, a longer ring
+ *   speaker_room   small speaker on a desk, 10 dB down, 9 ms room tail
+ *
+ * --ir adds responses recorded on the device: play a click through the
+ * play queue and record the reference and mic queues; the mic response
+ * from the click on, mono, any rate (it is resampled to 16 kHz).
+ *
+ *   far_only     10 s of far-end speech: ERLE after convergence and the
+ *                time to get within 3 dB of it
+ *   double_talk  the near end talks over seconds 4-8: ERLE of what is
+ *                left of the echo with and without double-talk detection,
+ *                and how often the detector fires with and without a
+ *                near-end talker
+ *   path_change  the path moves at 6 s (headset shifted): time to
+ *                reconverge
+ *   cycles       cycles per 20 ms Opus frame with and without playback
+ *                (host time counted at the Teensy clock)
+ *
+ * ERLE (echo return loss enhancement) is 10 log10 of echo energy over
+ * residual echo energy, in 100 ms windows while the far end talks.
+ * Every run is deterministic.
+ */
+
+#include <Arduino.h>
+#include "EchoCanceller.h"
+#include "WavFile.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#define FS              AEC_SAMPLE_RATE
+#define FRAME           320                 // 20 ms, one Opus frame
+#define WINDOW          (FS / 10)           // ERLE window
+#define NOISE_AMPLITUDE 33.0                // -60 dBFS
+
+struct EchoPath {
+    std::string name;
+    std::vector<double> response;
+};
+
+static uint32_t benchRandom = 12345;
+
+static uint32_t nextRandom() {
+    benchRandom ^= benchRandom << 13;
+    benchRandom ^= benchRandom >> 17;
+    benchRandom ^= benchRandom << 5;
+    return benchRandom;
+}
+
+static double uniform() {
+    return (nextRandom() >> 8) * (1.0 / 16777216.0);
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double mean(const std::vector<double>& values) {
+    if (values.empty()) return 0.0;
+    double sum = 0;
+    for (double v : values) sum += v;
+    return sum / values.size();
+}
+
+static double energyDb(double ratio) {
+    return ratio > 0 ? 10.0 * log10(ratio) : -200.0;
+}
+
+// Speech-like: noise through a formant resonator, in syllables of
+// 120-300 ms with 40-160 ms gaps, peaking at peak
+static std::vector<double> talker(size_t samples, uint32_t seed, double formantHz, double peak) {
+    benchRandom = seed;
+    double r = 0.97;
+    double a1 = 2 * r * cos(2 * M_PI * formantHz / FS);
+    double a2 = -r * r;
+
+    std::vector<double> out(samples, 0.0);
+    double y1 = 0, y2 = 0;
+    size_t pos = 0;
+    while (pos < samples) {
+        size_t length = (size_t)((0.12 + 0.18 * uniform()) * FS);
+        size_t gap = (size_t)((0.04 + 0.12 * uniform()) * FS);
+        double level = 0.5 + 0.5 * uniform();
+        size_t ramp = FS / 100;
+        for (size_t i = 0; i < length && pos + i < samples; i++) {
+            double envelope = level;
+            if (i < ramp) envelope *= (double)i / ramp;
+            if (length - i < ramp) envelope *= (double)(length - i) / ramp;
+            double y = (uniform() - 0.5) + a1 * y1 + a2 * y2;
+            y2 = y1;
+            y1 = y;
+            out[pos + i] = y * envelope;
+        }
+        pos += length + gap;
+    }
+
+    double maximum = 0;
+    for (double v : out) maximum = std::max(maximum, fabs(v));
+    for (double& v : out) v *= peak / maximum;
+    return out;
+}
+
+// delay samples, then taps decaying by decayMs with random signs,
+// scaled to gainDb of energy
+static EchoPath syntheticPath(const char* name, size_t delay, double decayMs, size_t length,
+                              double gainDb, uint32_t seed) {
+    benchRandom = seed;
+    std::vector<double> response(delay + length, 0.0);
+    double energy = 0;
+    for (size_t i = 0; i < length; i++) {
+        double tap = exp(-(double)i / (decayMs * FS / 1000.0)) * (uniform() * 2 - 1);
+        if (i == 0) tap = 1.0;
+        response[delay + i] = tap;
+        energy += tap * tap;
+    }
+    double scale = pow(10.0, gainDb / 20.0) / sqrt(energy);
+    for (double& tap : response) tap *= scale;
+    return { name, response };
+}
+
+static std::vector<EchoPath> builtinPaths() {
+    return {
+        syntheticPath("headset_bleed", 96, 0.4, 24, -26.0, 101),
+        syntheticPath("headset_open", 96, 1.5, 64, -14.0, 202),
+        syntheticPath("speaker_room", 100, 9.0, 150, -10.0, 303),
+    };
+}
+
+static bool loadPath(const std::string& path, EchoPath& echo, std::string& error) {
+    WavData wav;
+    if (!readWav(path, wav, error)) return false;
+    if (wav.channels != 1) {
+        error = "impulse response must be mono";
+        return false;
+    }
+    double step = (double)wav.sampleRate / FS;
+    size_t frames = (size_t)(wav.frames() / step);
+    echo.name = path;
+    echo.response.assign(frames, 0.0);
+    for (size_t i = 0; i < frames; i++) {
+        double position = i * step;
+        size_t index = (size_t)position;
+        double frac = position - index;
+        double a = wav.samples[index] / 32768.0;
+        double b = index + 1 < wav.frames() ? wav.samples[index + 1] / 32768.0 : 0.0;
+        // Resampling keeps the response's gain, not its energy
+        echo.response[i] = (a + (b - a) * frac) / step;
+    }
+    return true;
+}
+
+static std::vector<double> convolve(const std::vector<double>& signal, const std::vector<double>& response) {
+    std::vector<double> out(signal.size(), 0.0);
+    for (size_t i = 0; i < signal.size(); i++) {
+        if (signal[i] == 0) continue;
+        size_t end = std::min(response.size(), signal.size() - i);
+        for (size_t j = 0; j < end; j++) out[i + j] += signal[i] * response[j];
+    }
+    return out;
+}
+
+static int16_t toSample(double v) {
+    return (int16_t)std::max(-32768.0, std::min(32767.0, floor(v + 0.5)));
+}
+
+struct Run {
+    std::vector<int16_t> output;
+    std::vector<bool> doubleTalk;   // Per sub-block
+};
+
+// Sub-block by sub-block, so the detector can be read after each
+static Run cancel(EchoCanceller& aec, const std::vector<int16_t>& mic, const std::vector<int16_t>& reference) {
+    Run run;
+    run.output = mic;
+    for (size_t i = 0; i + AEC_SUBBLOCK <= mic.size(); i += AEC_SUBBLOCK) {
+        aec.process(&run.output[i], &reference[i], AEC_SUBBLOCK);
+        run.doubleTalk.push_back(aec.isDoubleTalk());
+    }
+    return run;
+}
+
+// ERLE per window where the echo is 10 dB above the noise, NAN elsewhere.
+// residual = output - near - noise, what is left of the echo.
+static std::vector<double> erleWindows(const std::vector<double>& echo, const std::vector<int16_t>& output,
+                                       const std::vector<double>& nearAndNoise) {
+    std::vector<double> windows;
+    for (size_t start = 0; start + WINDOW <= echo.size(); start += WINDOW) {
+        double echoEnergy = 0, residual = 0;
+        for (size_t i = start; i < start + WINDOW; i++) {
+            echoEnergy += echo[i] * echo[i];
+            double r = output[i] - nearAndNoise[i];
+            residual += r * r;
+        }
+        bool active = echoEnergy > 10.0 * NOISE_AMPLITUDE * NOISE_AMPLITUDE * WINDOW;
+        windows.push_back(active ? energyDb(echoEnergy / std::max(residual, 1.0)) : NAN);
+    }
+    return windows;
+}
+
+static double meanOver(const std::vector<double>& windows, size_t from, size_t to) {
+    std::vector<double> values;
+    for (size_t i = from; i < to && i < windows.size(); i++) {
+        if (!isnan(windows[i])) values.push_back(windows[i]);
+    }
+    return mean(values);
+}
+
+// Time from window from until the ERLE first gets within 3 dB of target
+static double settleMs(const std::vector<double>& windows, size_t from, double target) {
+    for (size_t i = from; i < windows.size(); i++) {
+        if (!isnan(windows[i]) && windows[i] >= target - 3.0) return (i + 1 - from) * 1000.0 * WINDOW / FS;
+    }
+    return NAN;
+}
+
+struct Scene {
+    std::vector<int16_t> reference;
+    std::vector<int16_t> mic;
+    std::vector<double> echo;
+    std::vector<double> nearAndNoise;
+};
+
+static Scene makeScene(const std::vector<double>& far, const std::vector<double>& near,
+                       const EchoPath& path, const EchoPath* changed, size_t changeAt) {
+    Scene scene;
+    scene.echo = convolve(far, path.response);
+    if (changed) {
+        std::vector<double> second = convolve(far, changed->response);
+        for (size_t i = changeAt; i < far.size(); i++) scene.echo[i] = second[i];
+    }
+
+    benchRandom = 777;
+    for (size_t i = 0; i < far.size(); i++) {
+        double noise = (uniform() * 2 - 1) * NOISE_AMPLITUDE * sqrt(3.0) / 2;
+        scene.reference.push_back(toSample(far[i]));
+        scene.nearAndNoise.push_back(near[i] + noise);
+        scene.mic.push_back(toSample(scene.echo[i] + near[i] + noise));
+    }
+    return scene;
+}
+
+static void farOnly(const std::vector<EchoPath>& paths) {
+    size_t samples = 10 * FS;
+    std::vector<double> far = talker(samples, 1, 600.0, 16000.0);
+    std::vector<double> silence(samples, 0.0);
+
+    for (const EchoPath& path : paths) {
+        Scene scene = makeScene(far, silence, path, NULL, 0);
+        EchoCanceller aec;
+        Run run = cancel(aec, scene.mic, scene.reference);
+        std::vector<double> windows = erleWindows(scene.echo, run.output, scene.nearAndNoise);
+
+        double steady = meanOver(windows, windows.size() / 2, windows.size());
+        size_t falseAlarms = std::count(run.doubleTalk.begin(), run.doubleTalk.end(), true);
+        printf("{\"test\":\"far_only\",\"path\":\"%s\",\"path_taps\":%zu,\"erle_db\":%.1f,"
+               "\"converge_ms\":%.0f,\"canceller_erle_db\":%.1f,\"double_talk_pct\":%.2f}\n",
+               path.name.c_str(), path.response.size(), steady, settleMs(windows, 0, steady),
+               aec.getErle(), 100.0 * falseAlarms / run.doubleTalk.size());
+    }
+}
+
+static void doubleTalk(const std::vector<EchoPath>& paths) {
+    size_t samples = 10 * FS;
+    std::vector<double> far = talker(samples, 1, 600.0, 16000.0);
+    std::vector<double> near = talker(samples, 2, 1100.0, 8000.0);
+    for (size_t i = 0; i < samples; i++) {
+        if (i < 4 * FS || i >= 8 * FS) near[i] = 0;
+    }
+
+    for (const EchoPath& path : paths) {
+        Scene scene = makeScene(far, near, path, NULL, 0);
+
+        double erle[2];
+        double detected = 0, falseAlarm = 0;
+        for (int dtd = 0; dtd < 2; dtd++) {
+            EchoCanceller aec;
+            aec.enableDoubleTalkDetection(dtd == 1);
+            Run run = cancel(aec, scene.mic, scene.reference);
+            std::vector<double> windows = erleWindows(scene.echo, run.output, scene.nearAndNoise);
+            erle[dtd] = meanOver(windows, 4 * FS / WINDOW, 8 * FS / WINDOW);
+
+            if (dtd == 1) {
+                // Sub-blocks where each talker is actually talking
+                size_t nearActive = 0, nearFlagged = 0, farActive = 0, farFlagged = 0;
+                for (size_t b = 0; b < run.doubleTalk.size(); b++) {
+                    double nearPeak = 0, farPeak = 0;
+                    for (size_t i = b * AEC_SUBBLOCK; i < (b + 1) * AEC_SUBBLOCK; i++) {
+                        nearPeak = std::max(nearPeak, fabs(near[i]));
+                        farPeak = std::max(farPeak, fabs(far[i]));
+                    }
+                    if (nearPeak > 800) {
+                        nearActive++;
+                        nearFlagged += run.doubleTalk[b];
+                    } else if (farPeak > 800 && b * AEC_SUBBLOCK < 4 * FS) {
+                        farActive++;
+                        farFlagged += run.doubleTalk[b];
+                    }
+                }
+                detected = 100.0 * nearFlagged / std::max<size_t>(nearActive, 1);
+                falseAlarm = 100.0 * farFlagged / std::max<size_t>(farActive, 1);
+            }
+        }
+
+        printf("{\"test\":\"double_talk\",\"path\":\"%s\",\"erle_db\":%.1f,\"erle_no_dtd_db\":%.1f,"
+               "\"detected_pct\":%.1f,\"false_alarm_pct\":%.1f}\n",
+               path.name.c_str(), erle[1], erle[0], detected, falseAlarm);
+    }
+}
+
+static void pathChange(const std::vector<EchoPath>& paths) {
+    size_t samples = 12 * FS;
+    size_t changeAt = 6 * FS;
+    std::vector<double> far = talker(samples, 1, 600.0, 16000.0);
+    std::vector<double> silence(samples, 0.0);
+
+    for (const EchoPath& path : paths) {
+        // Shifted by 5 samples and 4 dB louder
+        EchoPath moved = path;
+        moved.response.insert(moved.response.begin(), 5, 0.0);
+        for (double& tap : moved.response) tap *= pow(10.0, 4.0 / 20.0);
+
+        Scene scene = makeScene(far, silence, path, &moved, changeAt);
+        EchoCanceller aec;
+        Run run = cancel(aec, scene.mic, scene.reference);
+        std::vector<double> windows = erleWindows(scene.echo, run.output, scene.nearAndNoise);
+
+        size_t change = changeAt / WINDOW;
+        double before = meanOver(windows, change / 2, change);
+        double after = meanOver(windows, windows.size() - change / 2, windows.size());
+        printf("{\"test\":\"path_change\",\"path\":\"%s\",\"erle_before_db\":%.1f,\"erle_after_db\":%.1f,"
+               "\"erle_at_change_db\":%.1f,\"reconverge_ms\":%.0f}\n",
+               path.name.c_str(), before, after, windows[change], settleMs(windows, change, after));
+    }
+}
+
+static void cycles(const std::vector<EchoPath>& paths) {
+    size_t samples = 10 * FS;
+    std::vector<double> far = talker(samples, 1, 600.0, 16000.0);
+    std::vector<double> silence(samples, 0.0);
+    Scene scene = makeScene(far, silence, paths[0], NULL, 0);
+    double frameCycles = (double)F_CPU_ACTUAL * FRAME / FS;
+
+    for (int playing = 1; playing >= 0; playing--) {
+        EchoCanceller aec;
+        std::vector<int16_t> mic = scene.mic;
+        std::vector<double> counts;
+        for (size_t i = 0; i + FRAME <= samples; i += FRAME) {
+            uint32_t before = ARM_DWT_CYCCNT;
+            aec.process(&mic[i], playing ? &scene.reference[i] : NULL, FRAME);
+            counts.push_back(ARM_DWT_CYCCNT - before);
+        }
+
+        // The host is not real time: the 99th percentile, not the maximum
+        double average = mean(counts);
+        printf("{\"test\":\"cycles\",\"playback\":%s,\"frames\":%zu,\"cycles_per_frame\":%.0f,"
+               "\"cycles_per_frame_p99\":%.0f,\"cycles_per_sample\":%.1f,\"cpu_pct\":%.3f,"
+               "\"cycles_clock_hz\":%u}\n",
+               playing ? "true" : "false", counts.size(), average, percentile(counts, 0.99),
+               average / FRAME, 100.0 * average / frameCycles, F_CPU_ACTUAL);
+    }
+}
+
+static int usage() {
+    fprintf(stderr, "usage: aec_bench [far_only|double_talk|path_change|cycles...] [--ir path.wav...]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> tests;
+    std::vector<EchoPath> paths = builtinPaths();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--ir" && i + 1 < argc) {
+            EchoPath path;
+            std::string error;
+            if (!loadPath(argv[++i], path, error)) {
+                fprintf(stderr, "aec_bench: %s: %s\n", argv[i], error.c_str());
+                return 1;
+            }
+            paths.push_back(path);
+        } else if (arg == "far_only" || arg == "double_talk" || arg == "path_change" || arg == "cycles") {
+            tests.push_back(arg);
+        } else {
+            return usage();
+        }
+    }
+    if (tests.empty()) tests = { "far_only", "double_talk", "path_change", "cycles" };
+
+    for (const std::string& test : tests) {
+        if (test == "far_only") farOnly(paths);
+        else if (test == "double_talk") doubleTalk(paths);
+        else if (test == "path_change") pathChange(paths);
+        else if (test == "cycles") cycles(paths);
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * CabinEqBench.cpp - Accuracy, budget cross-fade and cost of roadtrip's cabin EQ
+ *
+ *   cabin_eq_bench [response|budget|cycles...]     JSON lines on stdout
+ *
+ * Drives AudioFilterCabinEq (examples/roadtrip/cabin_eq.h, built against
+ * the host shims) block by block, as the audio interrupt would:
+ *
+ *   response  sines at -20 dBFS through the preset curve; the settled
+ *             gain against the float biquads less the preamp headroom
+ *   budget    a steady tone on the 2.5 kHz presence band while the budget
+ *             is cut to nothing (bands drop to one) and then raised
+ *             (they all come back). Reports the largest block-to-block
+ *             level change, which a band switched in one step would make
+ *             as large as its whole gain.
+ *   cycles    speech-like noise through 1 to 5 active bands, cycles per
+ *             128-sample block (host time counted at the Teensy clock)
+ *
+ * Every run is deterministic except the cycle counts. Exits 1 when the
+ * response is off by more than 0.1 dB or a budget change steps by more
+ * than 0.25 dB in one block.
+ */
+
+#include <Arduino.h>
+#include <Audio.h>
+#include "cabin_eq.h"
+#include "TestSignals.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#define FS                  AUDIO_SAMPLE_RATE_EXACT
+#define RESPONSE_LIMIT_DB   0.1
+#define STEP_LIMIT_DB       0.25
+
+static bool failed = false;
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double mean(const std::vector<double>& values) {
+    if (values.empty()) return 0.0;
+    double sum = 0;
+    for (double v : values) sum += v;
+    return sum / values.size();
+}
+
+static double toDb(double amplitude) {
+    return amplitude > 0 ? 20.0 * log10(amplitude) : -200.0;
+}
+
+// One block of the same signal on both channels; the left output is
+// written back over the input
+static void runBlock(AudioFilterCabinEq& eq, int16_t* samples, std::vector<double>* cycles = NULL) {
+    for (unsigned channel = 0; channel < 2; channel++) {
+        audio_block_t* block = AudioStream::allocate();
+        memcpy(block->data, samples, sizeof(block->data));
+        eq.hostDeliver(block, channel);
+        AudioStream::release(block);
+    }
+
+    uint32_t before = ARM_DWT_CYCCNT;
+    eq.update();
+    if (cycles) cycles->push_back(ARM_DWT_CYCCNT - before);
+
+    audio_block_t* left = eq.hostTakeOutput(0);
+    audio_block_t* right = eq.hostTakeOutput(1);
+    if (left) memcpy(samples, left->data, sizeof(left->data));
+    AudioStream::release(left);
+    AudioStream::release(right);
+}
+
+static int16_t sineSample(double hz, double rmsDb, size_t n) {
+    double amplitude = 32768.0 * sqrt(2.0) * pow(10.0, rmsDb / 20.0);
+    return (int16_t)lround(amplitude * sin(2.0 * M_PI * hz * n / FS));
+}
+
+static double blockRms(const int16_t* samples) {
+    double sum = 0;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) sum += (double)samples[i] * samples[i];
+    return sqrt(sum / AUDIO_BLOCK_SAMPLES);
+}
+
+// What the preset should do at a frequency: the sum of the float
+// biquads, less the headroom applyBands() takes for the curve's peak
+static double expectedDb(double hz) {
+    double peakDb = 0;
+    for (int i = 0; i < 48; i++) {
+        float f = 20.0f * powf(1000.0f, i / 47.0f);
+        float db = 0;
+        for (const CabinEqBand& band : cabinEqPreset) {
+            if (fabsf(band.gainDb) < 0.05f) continue;
+            float c[5];
+            cabinEqDesign(band.type, band.frequency, band.gainDb, band.q, c);
+            db += cabinEqResponseDb(c, f);
+        }
+        peakDb = std::max(peakDb, (double)db);
+    }
+    int32_t preamp = (int32_t)(32767.0f * powf(10.0f, (float)-peakDb / 20.0f));
+
+    double db = toDb(preamp / 32768.0);
+    for (const CabinEqBand& band : cabinEqPreset) {
+        if (fabsf(band.gainDb) < 0.05f) continue;
+        float c[5];
+        cabinEqDesign(band.type, band.frequency, band.gainDb, band.q, c);
+        db += cabinEqResponseDb(c, (float)hz);
+    }
+    return db;
+}
+
+static void response() {
+    static const double FREQUENCIES[] = { 50, 120, 250, 500, 1000, 2500, 6000, 12000, 16000 };
+    const size_t settle = (size_t)(FS / 4);
+    const size_t measure = (size_t)FS;
+
+    double worst = 0;
+    for (double hz : FREQUENCIES) {
+        AudioFilterCabinEq eq;
+        eq.begin();
+        eq.setBudget(100.0f);
+
+        int16_t block[AUDIO_BLOCK_SAMPLES];
+        double inSum = 0, outSum = 0;
+        for (size_t start = 0; start < settle + measure; start += AUDIO_BLOCK_SAMPLES) {
+            for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) block[i] = sineSample(hz, -20.0, start + i);
+            double in = blockRms(block);
+            runBlock(eq, block);
+            if (start < settle) continue;
+            inSum += in * in;
+            double out = blockRms(block);
+            outSum += out * out;
+        }
+
+        double gainDb = 10.0 * log10(outSum / inSum);
+        double expected = expectedDb(hz);
+        double error = gainDb - expected;
+        worst = std::max(worst, fabs(error));
+        printf("{\"test\":\"response\",\"hz\":%.0f,\"gain_db\":%.3f,\"expected_db\":%.3f,\"error_db\":%.4f}\n",
+               hz, gainDb, expected, error);
+    }
+    printf("{\"summary\":\"response\",\"max_error_db\":%.4f,\"limit_db\":%.2f}\n", worst, RESPONSE_LIMIT_DB);
+    if (worst > RESPONSE_LIMIT_DB) failed = true;
+}
+
+static void budget() {
+    // Seven cycles per block, so every block of the tone has the same RMS
+    const double hz = 7.0 * FS / AUDIO_BLOCK_SAMPLES;
+    const int phaseBlocks = 800;
+
+    AudioFilterCabinEq eq;
+    eq.begin();
+    eq.setBudget(100.0f);
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    size_t n = 0;
+    double last = 0;
+    double worstStep = 0;
+    int lowest = eq.stagesActive();
+    int drops = 0, restores = 0;
+    int previousActive = eq.stagesActive();
+    double startDb = 0, droppedDb = 0, restoredDb = 0;
+
+    for (int b = 0; b < 3 * phaseBlocks; b++) {
+        // Settle, then no budget at all, then plenty
+        if (b == phaseBlocks) eq.setBudget(0.0f);
+        if (b == 2 * phaseBlocks) eq.setBudget(100.0f);
+
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) block[i] = sineSample(hz, -20.0, n++);
+        runBlock(eq, block);
+
+        int active = eq.stagesActive();
+        if (active < previousActive) drops++;
+        if (active > previousActive) restores++;
+        previousActive = active;
+        lowest = std::min(lowest, active);
+
+        double level = toDb(blockRms(block) / 32768.0);
+        if (b > phaseBlocks / 2) worstStep = std::max(worstStep, fabs(level - last));
+        last = level;
+        if (b == phaseBlocks - 1) startDb = level;
+        if (b == 2 * phaseBlocks - 1) droppedDb = level;
+        if (b == 3 * phaseBlocks - 1) restoredDb = level;
+    }
+
+    printf("{\"test\":\"budget\",\"hz\":%.1f,\"bands\":%d,\"lowest_active\":%d,\"drops\":%d,\"restores\":%d,"
+           "\"level_dbfs\":%.3f,\"dropped_level_dbfs\":%.3f,\"restored_level_dbfs\":%.3f,"
+           "\"max_block_step_db\":%.4f,\"limit_db\":%.2f}\n",
+           hz, eq.stagesConfigured(), lowest, drops, restores, startDb, droppedDb, restoredDb, worstStep,
+           STEP_LIMIT_DB);
+    if (worstStep > STEP_LIMIT_DB || drops == 0 || restores != drops) failed = true;
+}
+
+static void cycles() {
+    WavData speech = speechLike(20000, 3);
+    double blockCycles = (double)F_CPU_ACTUAL * AUDIO_BLOCK_SAMPLES / FS;
+
+    for (int bands = 1; bands <= CABIN_EQ_BANDS; bands++) {
+        AudioFilterCabinEq eq;
+        eq.begin();
+        eq.setBudget(100.0f);
+        // Band 4 is the preset's flat spare; give it some gain to count it
+        eq.setBand(4, CABIN_EQ_PEAK, 1000.0f, bands == CABIN_EQ_BANDS ? 1.0f : 0.0f, 1.0f);
+        for (int band = bands; band < CABIN_EQ_BANDS - 1; band++) {
+            eq.setBand(band, cabinEqPreset[band].type, cabinEqPreset[band].frequency, 0.0f, cabinEqPreset[band].q);
+        }
+
+        std::vector<double> counts;
+        int16_t block[AUDIO_BLOCK_SAMPLES];
+        for (size_t start = 0; start + AUDIO_BLOCK_SAMPLES <= speech.samples.size(); start += AUDIO_BLOCK_SAMPLES) {
+            memcpy(block, &speech.samples[start], sizeof(block));
+            runBlock(eq, block, &counts);
+        }
+
+        // The host is not real time: the 99th percentile, not the maximum
+        double average = mean(counts);
+        printf("{\"test\":\"cycles\",\"bands\":%d,\"blocks\":%zu,\"cycles_per_block\":%.0f,"
+               "\"cycles_per_block_p99\":%.0f,\"cycles_per_sample\":%.1f,\"cpu_pct\":%.3f,"
+               "\"cycles_clock_hz\":%u}\n",
+               eq.stagesActive(), counts.size(), average, percentile(counts, 0.99),
+               average / AUDIO_BLOCK_SAMPLES, 100.0 * average / blockCycles, F_CPU_ACTUAL);
+    }
+}
+
+static int usage() {
+    fprintf(stderr, "usage: cabin_eq_bench [response|budget|cycles...]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> tests;
+    for (int i = 1; i < argc; i++) tests.push_back(argv[i]);
+    if (tests.empty()) tests = { "response", "budget", "cycles" };
+
+    AudioMemory(8);
+    for (const std::string& test : tests) {
+        if (test == "response") response();
+        else if (test == "budget") budget();
+        else if (test == "cycles") cycles();
+        else return usage();
+    }
+    return failed ? 1 : 0;
+}
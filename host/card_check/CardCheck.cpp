@@ -0,0 +1,404 @@
+/*
+ * CardCheck.cpp - Check, and repair, the recordings on a Songbird SD card
+ *
+ *   card_check [-j threads] [-r] [-q] <dir|file>...
+ *
+ * Every .wav and .opus under the given directories (a card mounted or
+ * copied on the host; loop-mount a raw image first) is memory-mapped and
+ * checked on a work-stealing pool, one file per job:
+ *
+ *   .wav   RIFF/WAVE, a fmt chunk before the data chunk, the RIFF size
+ *          matching the file and the data size matching what follows it.
+ *          Recorder and FieldRecorder write zero sizes when a recording
+ *          starts and patch them when it stops, so power loss leaves a
+ *          complete file with stale sizes. The audio itself is not read,
+ *          which is why a card of WAVs checks at disk-listing speed.
+ *   .opus  VoiceChat's format: "OPUS" then packets, each a 16-bit little
+ *          endian size (1..256, as PlaybackEngine accepts) and its bytes.
+ *          A transfer cut off by a SerialProtocol reset ends mid-packet;
+ *          the player stops at the first bad size.
+ *
+ * -r repairs in place what can be repaired without guessing: WAV sizes
+ * are rewritten from the file length (a trailing partial sample frame is
+ * cut), and an .opus file is cut after its last whole packet. A file with
+ * no usable header is left alone and reported broken; one with no audio
+ * is reported empty.
+ *
+ * One JSON line per file that is not clean, in path order, then a
+ * summary; progress on stderr (-q to silence). Exits 1 if anything is
+ * still damaged or broken.
+ */
+
+#include "WorkPool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define WAV_HEADER_MIN          12      // "RIFF", size, "WAVE"
+#define OPUS_HEADER_SIZE        6       // "OPUS" 0x01 0x00
+#define OPUS_PACKET_MAX         256     // OPUS_MAX_PACKET_SIZE in VoiceChat's OpusCodec.h
+
+enum Verdict {
+    VERDICT_OK,
+    VERDICT_DAMAGED,    // Repairable, not repaired
+    VERDICT_REPAIRED,
+    VERDICT_BROKEN      // Nothing safe to repair
+};
+
+static const char* VERDICT_NAMES[] = {"ok", "damaged", "repaired", "broken"};
+
+struct Patch {
+    uint64_t offset;
+    uint32_t value;     // Written little-endian
+};
+
+struct Finding {
+    Verdict verdict = VERDICT_OK;
+    std::vector<std::string> problems;
+    std::string error;          // Why a repair or the check itself failed
+    bool empty = false;         // No audio
+    uint64_t size = 0;
+    uint64_t audioBytes = 0;    // WAV sample data
+    uint32_t packets = 0;       // .opus
+
+    // Repair plan
+    std::vector<Patch> patches;
+    uint64_t truncateTo = UINT64_MAX;
+
+    void problem(const char* name, Verdict level) {
+        problems.push_back(name);
+        verdict = std::max(verdict, level);
+    }
+};
+
+static uint32_t readLE32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t readLE16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+// =============================================================================
+// WAV
+// =============================================================================
+
+// Whether [pos, size) is whole chunks with printable IDs, as after a
+// correct data chunk (stale audio would have to fake both)
+static bool chunksToEnd(const uint8_t* data, uint64_t pos, uint64_t size) {
+    while (pos + 8 <= size) {
+        for (int i = 0; i < 4; i++) {
+            if (data[pos + i] < 0x20 || data[pos + i] > 0x7E) return false;
+        }
+        uint64_t chunk = readLE32(data + pos + 4);
+        pos += 8 + chunk + (chunk & 1);
+    }
+    return pos == size;
+}
+
+static void checkWav(const uint8_t* data, uint64_t size, Finding& finding) {
+    if (size == 0) {
+        finding.empty = true;
+        finding.problem("zero_length", VERDICT_BROKEN);
+        return;
+    }
+    if (size < WAV_HEADER_MIN || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        finding.problem("not_riff_wave", VERDICT_BROKEN);
+        return;
+    }
+
+    uint16_t blockAlign = 0;
+    uint64_t dataOffset = 0, dataSize = 0;
+    for (uint64_t pos = WAV_HEADER_MIN; pos + 8 <= size;) {
+        uint32_t chunk = readLE32(data + pos + 4);
+        if (memcmp(data + pos, "fmt ", 4) == 0 && chunk >= 16 && pos + 8 + 16 <= size) {
+            blockAlign = readLE16(data + pos + 8 + 12);
+        } else if (memcmp(data + pos, "data", 4) == 0) {
+            dataOffset = pos + 8;
+            dataSize = chunk;
+            break;
+        }
+        pos += 8 + (uint64_t)chunk + (chunk & 1);
+    }
+    if (blockAlign == 0) {
+        finding.problem("no_fmt", VERDICT_BROKEN);
+        return;
+    }
+    if (dataOffset == 0) {
+        finding.problem("no_data_chunk", VERDICT_BROKEN);
+        return;
+    }
+
+    // A data size that ends on a chunk boundary before the end is a file
+    // with trailing chunks (LIST and the like), not a stale one
+    uint64_t available = size - dataOffset;
+    uint64_t whole = available - available % blockAlign;
+    uint64_t fileSize = size;
+    bool trailing = dataSize < available && dataSize % blockAlign == 0
+                    && chunksToEnd(data, dataOffset + dataSize + (dataSize & 1), size);
+
+    if (!trailing) {
+        if (dataSize != whole) {
+            finding.problem(dataSize == 0 ? "data_size_zero" : "data_size_stale", VERDICT_DAMAGED);
+            finding.patches.push_back({dataOffset - 4, (uint32_t)std::min<uint64_t>(whole, UINT32_MAX)});
+        }
+        if (whole != available) {
+            finding.problem("partial_frame", VERDICT_DAMAGED);
+            finding.truncateTo = dataOffset + whole;
+            fileSize = finding.truncateTo;
+        }
+        dataSize = whole;
+    }
+    if (readLE32(data + 4) != fileSize - 8) {
+        finding.problem(readLE32(data + 4) == 0 ? "riff_size_zero" : "riff_size_stale", VERDICT_DAMAGED);
+        finding.patches.push_back({4, (uint32_t)std::min<uint64_t>(fileSize - 8, UINT32_MAX)});
+    }
+
+    finding.audioBytes = dataSize;
+    if (dataSize == 0) {
+        finding.empty = true;
+        finding.problems.push_back("no_audio");
+    }
+}
+
+// =============================================================================
+// OPUS
+// =============================================================================
+
+static void checkOpus(const uint8_t* data, uint64_t size, Finding& finding) {
+    if (size == 0) {
+        finding.empty = true;
+        finding.problem("zero_length", VERDICT_BROKEN);
+        return;
+    }
+    if (size < OPUS_HEADER_SIZE || memcmp(data, "OPUS", 4) != 0) {
+        finding.problem("bad_header", VERDICT_BROKEN);
+        return;
+    }
+
+    uint64_t pos = OPUS_HEADER_SIZE;
+    while (pos < size) {
+        if (pos + 2 > size) {
+            finding.problem("truncated_size", VERDICT_DAMAGED);
+            break;
+        }
+        uint16_t packet = readLE16(data + pos);
+        if (packet == 0 || packet > OPUS_PACKET_MAX) {
+            finding.problem("bad_packet_size", VERDICT_DAMAGED);
+            break;
+        }
+        if (pos + 2 + packet > size) {
+            finding.problem("truncated_packet", VERDICT_DAMAGED);
+            break;
+        }
+        pos += 2 + packet;
+        finding.packets++;
+    }
+    if (pos < size) finding.truncateTo = pos;
+
+    if (finding.packets == 0) {
+        finding.empty = true;
+        finding.problems.push_back("no_audio");
+    }
+}
+
+// =============================================================================
+// Files
+// =============================================================================
+
+static bool isWav(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".wav";
+}
+
+static bool isOpus(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".opus";
+}
+
+static void checkFile(const std::string& path, Finding& finding) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        finding.error = strerror(errno);
+        finding.problem("unreadable", VERDICT_BROKEN);
+        return;
+    }
+    finding.size = info.st_size;
+
+    const uint8_t* data = nullptr;
+    if (finding.size > 0) {
+        void* map = mmap(nullptr, finding.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            finding.error = strerror(errno);
+            finding.problem("unreadable", VERDICT_BROKEN);
+            return;
+        }
+        madvise(map, finding.size, MADV_SEQUENTIAL);
+        data = (const uint8_t*)map;
+    }
+
+    if (isWav(path)) checkWav(data, finding.size, finding);
+    else checkOpus(data, finding.size, finding);
+
+    if (data) munmap((void*)data, finding.size);
+    close(fd);
+}
+
+static bool repairFile(const std::string& path, Finding& finding) {
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        finding.error = strerror(errno);
+        return false;
+    }
+
+    bool ok = true;
+    for (const Patch& patch : finding.patches) {
+        uint8_t bytes[4] = {(uint8_t)patch.value, (uint8_t)(patch.value >> 8), (uint8_t)(patch.value >> 16),
+                            (uint8_t)(patch.value >> 24)};
+        if (pwrite(fd, bytes, sizeof(bytes), patch.offset) != sizeof(bytes)) ok = false;
+    }
+    if (ok && finding.truncateTo != UINT64_MAX && ftruncate(fd, finding.truncateTo) != 0) ok = false;
+    if (ok && fsync(fd) != 0) ok = false;
+    if (!ok) finding.error = strerror(errno);
+    close(fd);
+    return ok;
+}
+
+// Card files under each argument, sorted; the rest are counted
+static bool collectFiles(const std::vector<std::string>& inputs, std::vector<std::string>& files,
+                         uint32_t& skipped) {
+    for (const std::string& input : inputs) {
+        std::error_code error;
+        if (!fs::is_directory(input, error)) {
+            if (!fs::exists(input, error)) {
+                fprintf(stderr, "card_check: %s does not exist\n", input.c_str());
+                return false;
+            }
+            files.push_back(input);
+            continue;
+        }
+
+        std::vector<std::string> found;
+        for (auto it = fs::recursive_directory_iterator(input, error);
+             !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+            if (!it->is_regular_file(error)) continue;
+            if (isWav(it->path()) || isOpus(it->path())) found.push_back(it->path().string());
+            else skipped++;
+        }
+        if (error) {
+            fprintf(stderr, "card_check: cannot walk %s: %s\n", input.c_str(), error.message().c_str());
+            return false;
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return true;
+}
+
+static void report(const std::string& path, const Finding& finding) {
+    std::string problems;
+    for (const std::string& problem : finding.problems) {
+        problems += (problems.empty() ? "\"" : ",\"") + problem + "\"";
+    }
+    printf("{\"file\":\"%s\",\"verdict\":\"%s\",\"problems\":[%s],\"size\":%llu,", path.c_str(),
+           VERDICT_NAMES[finding.verdict], problems.c_str(), (unsigned long long)finding.size);
+    if (isWav(path)) printf("\"audio_bytes\":%llu", (unsigned long long)finding.audioBytes);
+    else printf("\"packets\":%u", finding.packets);
+    if (finding.truncateTo != UINT64_MAX) printf(",\"cut_to\":%llu", (unsigned long long)finding.truncateTo);
+    if (!finding.error.empty()) printf(",\"error\":\"%s\"", finding.error.c_str());
+    printf("}\n");
+}
+
+static int usage() {
+    fprintf(stderr, "usage: card_check [-j threads] [-r] [-q] <dir|file>...\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    long workers = defaultWorkers();
+    bool repair = false;
+    bool quiet = false;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-r") {
+            repair = true;
+        } else if (arg == "-q") {
+            quiet = true;
+        } else if (arg == "-j") {
+            char* end;
+            if (i + 1 >= argc) return usage();
+            workers = strtol(argv[++i], &end, 10);
+            if (*end || workers < 1 || workers > 256) return usage();
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) return usage();
+
+    std::vector<std::string> files;
+    uint32_t skipped = 0;
+    if (!collectFiles(inputs, files, skipped)) return 1;
+
+    std::vector<uint64_t> costs(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        std::error_code error;
+        costs[i] = isOpus(files[i]) ? fs::file_size(files[i], error) : 0;   // WAV audio is not read
+    }
+
+    std::vector<Finding> findings(files.size());
+    WorkPool pool(std::min<size_t>(workers, std::max<size_t>(files.size(), 1)));
+    auto start = std::chrono::steady_clock::now();
+    pool.run(costs,
+             [&](unsigned, size_t job) {
+                 Finding& finding = findings[job];
+                 checkFile(files[job], finding);
+                 if (repair && finding.verdict == VERDICT_DAMAGED) {
+                     finding.verdict = repairFile(files[job], finding) ? VERDICT_REPAIRED : VERDICT_DAMAGED;
+                 }
+             },
+             [&](size_t done, size_t count) {
+                 if (quiet) return;
+                 fprintf(stderr, "\rcard_check: %zu/%zu files   ", done, count);
+                 if (done == count) fprintf(stderr, "\n");
+             });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t counts[4] = {};
+    uint32_t wav = 0, opus = 0, empty = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        const Finding& finding = findings[i];
+        counts[finding.verdict]++;
+        if (isWav(files[i])) wav++;
+        else opus++;
+        if (finding.empty) empty++;
+        bytes += finding.size;
+        if (!finding.problems.empty()) report(files[i], finding);
+    }
+
+    printf("{\"summary\":\"%s\",\"files\":%zu,\"wav\":%u,\"opus\":%u,\"skipped\":%u,\"bytes\":%llu,\"ok\":%u,"
+           "\"damaged\":%u,\"repaired\":%u,\"broken\":%u,\"empty\":%u,\"workers\":%u,\"wall_s\":%.3f,"
+           "\"gb_per_min\":%.1f}\n",
+           repair ? "repair" : "check", files.size(), wav, opus, skipped, (unsigned long long)bytes,
+           counts[VERDICT_OK], counts[VERDICT_DAMAGED], counts[VERDICT_REPAIRED], counts[VERDICT_BROKEN], empty,
+           pool.workers(), seconds, seconds > 0 ? bytes / 1e9 / (seconds / 60) : 0.0);
+    return counts[VERDICT_DAMAGED] || counts[VERDICT_BROKEN] ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * CodecBench.cpp - Round-trip quality and throughput of VoiceChat's OpusCodec
+ *
+ *   codec_bench generate <dir>                      Write the synthetic corpus
+ *   codec_bench run [-b rates] [-c levels] <wav|dir>...
+ *                                                   Benchmark, JSON lines on stdout
+ *
+ * Every file (16-bit WAV at 44.1 kHz, first channel; a directory means
+ * its .wav files) goes through OpusCodec the way VoiceChat drives it:
+ * 128-sample blocks into addSamples() as RecordingEngine feeds them,
+ * getEncodedPacket() after each, and decode() on a second codec as
+ * PlaybackEngine plays them. That is repeated at every bitrate and
+ * complexity (-b 8000,16000 -c 0,5,10 to pick; default all of both).
+ *
+ * One line per file and setting, then a summary line per setting:
+ *
+ *   kbps           what the packets actually cost
+ *   frame_drift    packets out minus the 20 ms frames the input holds
+ *   drift_ms       decoded length minus input length
+ *   *_cycles       per 20 ms frame, host time counted at F_CPU_ACTUAL
+ *                  (cycles_clock_hz), so comparable between runs on one
+ *                  host, not a Teensy measurement
+ *   *_fps          frames per second of host time
+ *   seg_snr_db, nsim, lsd_db, delay_ms    see CodecQuality.h
+ *
+ * OpusCodec's encoder is built with the sketch's Config.h, so the
+ * resampler and frame sizes are the firmware's own.
+ */
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Config.h"
+#include "OpusCodec.h"
+#include "CodecQuality.h"
+#include "SpeechCorpus.h"
+#include "WavFile.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define QUALITY_MAX_LAG_MS  50.0
+
+static const int BITRATES[] = {6000, 8000, 12000, 16000, 24000, 32000};
+static const int COMPLEXITIES[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+struct RunResult {
+    size_t inputSamples = 0;
+    uint32_t expectedFrames = 0;
+    uint32_t packets = 0;
+    uint64_t bytes = 0;
+    std::vector<int16_t> decoded;
+    std::vector<double> encodeCycles;
+    std::vector<double> decodeCycles;
+    CodecQuality quality;
+};
+
+struct Summary {
+    int files = 0;
+    int failed = 0;
+    double kbps = 0;
+    long frameDrift = 0;
+    double driftMs = 0;
+    double segSnrDb = 0;
+    double nsim = 0;
+    double lsdDb = 0;
+    std::vector<double> encodeCycles;
+    std::vector<double> decodeCycles;
+};
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double mean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+static double framesPerSecond(const std::vector<double>& cycles) {
+    double total = 0.0;
+    for (double c : cycles) total += c;
+    return total > 0 ? cycles.size() / (total / F_CPU_ACTUAL) : 0.0;
+}
+
+static bool runCodec(const WavData& wav, int bitrate, int complexity, RunResult& result) {
+    OpusCodec encoder, decoder;
+    if (!encoder.begin() || !decoder.begin()) return false;
+    encoder.setBitrate(bitrate);
+    encoder.setComplexity(complexity);
+
+    size_t frames = wav.frames();
+    result.inputSamples = frames;
+    result.expectedFrames = frames / (TEENSY_SAMPLE_RATE * OPUS_FRAME_MS / 1000);
+    result.decoded.reserve(frames + RESAMPLE_OUTPUT_SAMPLES);
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    uint8_t packet[OPUS_MAX_PACKET_SIZE];
+    int16_t output[RESAMPLE_OUTPUT_SAMPLES];
+
+    for (size_t start = 0; start < frames; start += AUDIO_BLOCK_SAMPLES) {
+        size_t count = std::min((size_t)AUDIO_BLOCK_SAMPLES, frames - start);
+        for (size_t i = 0; i < count; i++) block[i] = wav.samples[(start + i) * wav.channels];
+
+        uint32_t cycles = ARM_DWT_CYCCNT;
+        int encoded = encoder.addSamples(block, count);
+        cycles = ARM_DWT_CYCCNT - cycles;
+        if (encoded < 0) return false;
+        if (encoded > 0) result.encodeCycles.push_back((double)cycles / encoded);
+
+        int size = encoder.getEncodedPacket(packet, sizeof(packet));
+        if (size <= 0) continue;
+        result.packets++;
+        result.bytes += size;
+
+        cycles = ARM_DWT_CYCCNT;
+        int samples = decoder.decode(packet, size, output, RESAMPLE_OUTPUT_SAMPLES);
+        result.decodeCycles.push_back(ARM_DWT_CYCCNT - cycles);
+        if (samples < 0) return false;
+        result.decoded.insert(result.decoded.end(), output, output + samples);
+    }
+
+    std::vector<int16_t> reference(frames);
+    for (size_t i = 0; i < frames; i++) reference[i] = wav.samples[i * wav.channels];
+    result.quality = measureQuality(reference, result.decoded, wav.sampleRate, QUALITY_MAX_LAG_MS);
+    return true;
+}
+
+static void report(const std::string& file, int bitrate, int complexity, const RunResult& result,
+                   Summary& summary) {
+    double seconds = result.packets * OPUS_FRAME_MS / 1000.0;
+    double kbps = seconds > 0 ? result.bytes * 8.0 / seconds / 1000.0 : 0.0;
+    long frameDrift = (long)result.packets - (long)result.expectedFrames;
+    double driftMs = ((double)result.decoded.size() - (double)result.inputSamples) * 1000.0 / TEENSY_SAMPLE_RATE;
+    const CodecQuality& q = result.quality;
+
+    printf("{\"file\":\"%s\",\"bitrate\":%d,\"complexity\":%d,\"packets\":%u,\"expected_frames\":%u,"
+           "\"frame_drift\":%ld,\"drift_ms\":%.2f,\"kbps\":%.2f,\"encode_cycles\":%.0f,\"encode_cycles_p99\":%.0f,"
+           "\"decode_cycles\":%.0f,\"decode_cycles_p99\":%.0f,\"encode_fps\":%.0f,\"decode_fps\":%.0f,"
+           "\"delay_ms\":%.2f,\"seg_snr_db\":%.2f,\"nsim\":%.4f,\"lsd_db\":%.2f}\n",
+           file.c_str(), bitrate, complexity, result.packets, result.expectedFrames, frameDrift, driftMs, kbps,
+           mean(result.encodeCycles), percentile(result.encodeCycles, 0.99),
+           mean(result.decodeCycles), percentile(result.decodeCycles, 0.99),
+           framesPerSecond(result.encodeCycles), framesPerSecond(result.decodeCycles),
+           q.delayMs, q.segSnrDb, q.nsim, q.lsdDb);
+
+    summary.files++;
+    summary.kbps += kbps;
+    summary.frameDrift += frameDrift;
+    summary.driftMs += driftMs;
+    summary.segSnrDb += q.segSnrDb;
+    summary.nsim += q.nsim;
+    summary.lsdDb += q.lsdDb;
+    summary.encodeCycles.insert(summary.encodeCycles.end(), result.encodeCycles.begin(), result.encodeCycles.end());
+    summary.decodeCycles.insert(summary.decodeCycles.end(), result.decodeCycles.begin(), result.decodeCycles.end());
+}
+
+static void reportSummary(int bitrate, int complexity, const Summary& summary) {
+    double n = summary.files ? summary.files : 1;
+
+    // The host is not real time: a preempted frame shows up as a huge
+    // maximum, so the summary gives the 99th percentile instead
+    printf("{\"summary\":\"%d/%d\",\"bitrate\":%d,\"complexity\":%d,\"files\":%d,\"failed\":%d,"
+           "\"kbps\":%.2f,\"frame_drift\":%ld,\"drift_ms\":%.2f,\"encode_cycles\":%.0f,\"encode_cycles_p99\":%.0f,"
+           "\"decode_cycles\":%.0f,\"decode_cycles_p99\":%.0f,\"encode_fps\":%.0f,\"decode_fps\":%.0f,"
+           "\"seg_snr_db\":%.2f,\"nsim\":%.4f,\"lsd_db\":%.2f,\"cycles_clock_hz\":%u}\n",
+           bitrate, complexity, bitrate, complexity, summary.files, summary.failed,
+           summary.kbps / n, summary.frameDrift, summary.driftMs / n,
+           mean(summary.encodeCycles), percentile(summary.encodeCycles, 0.99),
+           mean(summary.decodeCycles), percentile(summary.decodeCycles, 0.99),
+           framesPerSecond(summary.encodeCycles), framesPerSecond(summary.decodeCycles),
+           summary.segSnrDb / n, summary.nsim / n, summary.lsdDb / n, F_CPU_ACTUAL);
+}
+
+static bool parseList(const char* text, std::vector<int>& values) {
+    values.clear();
+    std::string list = text;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        char* end;
+        long value = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end) return false;
+        values.push_back((int)value);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return !values.empty();
+}
+
+static int usage() {
+    fprintf(stderr, "usage: codec_bench generate <dir>\n"
+                    "       codec_bench run [-b bitrate,...] [-c complexity,...] <wav|dir>...\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+    std::string command = argv[1];
+
+    if (command == "generate") {
+        if (!generateCorpus(argv[2])) {
+            fprintf(stderr, "codec_bench: cannot write the corpus to %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+    if (command != "run") return usage();
+
+    std::vector<int> bitrates(BITRATES, BITRATES + sizeof(BITRATES) / sizeof(BITRATES[0]));
+    std::vector<int> complexities(COMPLEXITIES, COMPLEXITIES + sizeof(COMPLEXITIES) / sizeof(COMPLEXITIES[0]));
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-b" || arg == "-c") {
+            if (i + 1 >= argc || !parseList(argv[++i], arg == "-b" ? bitrates : complexities)) return usage();
+            continue;
+        }
+        std::error_code error;
+        if (fs::is_directory(arg, error)) {
+            std::vector<std::string> found;
+            for (const fs::directory_entry& entry : fs::directory_iterator(arg, error)) {
+                if (entry.path().extension() == ".wav") found.push_back(entry.path().string());
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) return usage();
+
+    std::vector<WavData> corpus(files.size());
+    for (size_t f = 0; f < files.size(); f++) {
+        std::string error;
+        if (!readWav(files[f], corpus[f], error)) {
+            fprintf(stderr, "codec_bench: %s\n", error.c_str());
+            return 1;
+        }
+        if (corpus[f].sampleRate != TEENSY_SAMPLE_RATE) {
+            fprintf(stderr, "codec_bench: %s is %u Hz, not %d\n", files[f].c_str(), corpus[f].sampleRate,
+                    TEENSY_SAMPLE_RATE);
+            return 1;
+        }
+    }
+
+    for (int bitrate : bitrates) {
+        for (int complexity : complexities) {
+            Summary summary;
+            for (size_t f = 0; f < files.size(); f++) {
+                RunResult result;
+                std::string name = fs::path(files[f]).filename().string();
+                if (!runCodec(corpus[f], bitrate, complexity, result)) {
+                    fprintf(stderr, "codec_bench: %s failed at %d bps, complexity %d\n", name.c_str(), bitrate,
+                            complexity);
+                    summary.failed++;
+                    continue;
+                }
+                report(name, bitrate, complexity, result, summary);
+            }
+            reportSummary(bitrate, complexity, summary);
+        }
+    }
+    return 0;
+}
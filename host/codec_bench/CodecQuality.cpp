@@ -0,0 +1,221 @@
+/*
+ * CodecQuality.cpp - Alignment, segmental SNR and spectrogram similarity
+ */
+
+#include "CodecQuality.h"
+#include <math.h>
+#include <algorithm>
+#include <complex>
+
+typedef std::complex<double> Complex;
+
+#define SEGMENT_MS          20.0
+#define SEGMENT_ACTIVE_DB   -40.0   // Below the loudest segment: silence
+#define SNR_MIN_DB          -10.0
+#define SNR_MAX_DB          35.0
+#define SPECTRUM_SIZE       1024
+#define SPECTRUM_HOP        512
+#define MEL_BANDS           32
+#define MEL_LOW_HZ          50.0
+#define MEL_HIGH_HZ         8000.0
+#define SPECTRUM_FLOOR_DB   -100.0
+#define SPECTRUM_RANGE_DB   60.0    // Below the reference's peak counts as silence
+#define ALIGN_WINDOW        131072  // About 3 s at 44.1 kHz
+
+// In-place radix-2; size a power of two
+static void fft(std::vector<Complex>& data, bool inverse) {
+    size_t n = data.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    for (size_t length = 2; length <= n; length <<= 1) {
+        double angle = 2.0 * M_PI / length * (inverse ? 1 : -1);
+        Complex step(cos(angle), sin(angle));
+        for (size_t i = 0; i < n; i += length) {
+            Complex w(1.0);
+            for (size_t k = 0; k < length / 2; k++) {
+                Complex even = data[i + k];
+                Complex odd = data[i + k + length / 2] * w;
+                data[i + k] = even + odd;
+                data[i + k + length / 2] = even - odd;
+                w *= step;
+            }
+        }
+    }
+    if (inverse) {
+        for (Complex& c : data) c /= (double)n;
+    }
+}
+
+// Lag of decoded behind reference, by FFT cross-correlation over the
+// first ALIGN_WINDOW samples
+static size_t findDelay(const std::vector<int16_t>& reference, const std::vector<int16_t>& decoded,
+                        size_t maxLag) {
+    size_t window = std::min({(size_t)ALIGN_WINDOW, reference.size(), decoded.size()});
+    size_t n = 1;
+    while (n < 2 * window) n <<= 1;
+
+    std::vector<Complex> a(n), b(n);
+    for (size_t i = 0; i < window; i++) {
+        a[i] = reference[i];
+        b[i] = decoded[i];
+    }
+    fft(a, false);
+    fft(b, false);
+    for (size_t i = 0; i < n; i++) a[i] = b[i] * std::conj(a[i]);
+    fft(a, true);
+
+    size_t best = 0;
+    for (size_t lag = 1; lag <= maxLag && lag < n; lag++) {
+        if (a[lag].real() > a[best].real()) best = lag;
+    }
+    return best;
+}
+
+static double melFromHz(double hz) { return 2595.0 * log10(1.0 + hz / 700.0); }
+static double hzFromMel(double mel) { return 700.0 * (pow(10.0, mel / 2595.0) - 1.0); }
+
+// Frames x bands, dB; triangular mel filters over a Hann-windowed FFT
+static std::vector<std::vector<double>> melSpectrogram(const int16_t* signal, size_t length, uint32_t sampleRate) {
+    std::vector<double> edges(MEL_BANDS + 2);
+    for (int b = 0; b < MEL_BANDS + 2; b++) {
+        double mel = melFromHz(MEL_LOW_HZ) + (melFromHz(MEL_HIGH_HZ) - melFromHz(MEL_LOW_HZ)) * b / (MEL_BANDS + 1);
+        edges[b] = hzFromMel(mel) * SPECTRUM_SIZE / sampleRate;   // In bins
+    }
+
+    std::vector<std::vector<double>> frames;
+    std::vector<Complex> buffer(SPECTRUM_SIZE);
+    for (size_t start = 0; start + SPECTRUM_SIZE <= length; start += SPECTRUM_HOP) {
+        for (size_t i = 0; i < SPECTRUM_SIZE; i++) {
+            double hann = 0.5 - 0.5 * cos(2.0 * M_PI * i / (SPECTRUM_SIZE - 1));
+            buffer[i] = signal[start + i] / 32768.0 * hann;
+        }
+        fft(buffer, false);
+
+        std::vector<double> bands(MEL_BANDS);
+        for (int b = 0; b < MEL_BANDS; b++) {
+            double power = 0;
+            for (int bin = (int)edges[b]; bin <= (int)edges[b + 2] + 1 && bin < SPECTRUM_SIZE / 2; bin++) {
+                double weight = bin < edges[b + 1] ? (bin - edges[b]) / (edges[b + 1] - edges[b])
+                                                   : (edges[b + 2] - bin) / (edges[b + 2] - edges[b + 1]);
+                if (weight > 0) power += weight * std::norm(buffer[bin]);
+            }
+            bands[b] = std::max(SPECTRUM_FLOOR_DB, 10.0 * log10(power + 1e-20));
+        }
+        frames.push_back(bands);
+    }
+    return frames;
+}
+
+CodecQuality measureQuality(const std::vector<int16_t>& reference, const std::vector<int16_t>& decoded,
+                            uint32_t sampleRate, double maxLagMs) {
+    CodecQuality quality;
+    size_t delay = findDelay(reference, decoded, (size_t)(maxLagMs * sampleRate / 1000.0));
+    quality.delayMs = delay * 1000.0 / sampleRate;
+    if (decoded.size() <= delay) return quality;
+
+    const int16_t* aligned = decoded.data() + delay;
+    size_t length = std::min(reference.size(), decoded.size() - delay);
+
+    // Segmental SNR over segments with speech in them
+    size_t segment = (size_t)(SEGMENT_MS * sampleRate / 1000.0);
+    std::vector<double> energies;
+    for (size_t start = 0; start + segment <= length; start += segment) {
+        double energy = 0;
+        for (size_t i = start; i < start + segment; i++) energy += (double)reference[i] * reference[i];
+        energies.push_back(energy);
+    }
+    double loudest = energies.empty() ? 0 : *std::max_element(energies.begin(), energies.end());
+    double threshold = loudest * pow(10.0, SEGMENT_ACTIVE_DB / 10.0);
+    double snrSum = 0;
+    for (size_t s = 0; s < energies.size(); s++) {
+        if (energies[s] <= threshold || energies[s] == 0) continue;
+        double error = 0;
+        for (size_t i = s * segment; i < (s + 1) * segment; i++) {
+            double e = (double)reference[i] - aligned[i];
+            error += e * e;
+        }
+        double snr = error > 0 ? 10.0 * log10(energies[s] / error) : SNR_MAX_DB;
+        snrSum += std::min(SNR_MAX_DB, std::max(SNR_MIN_DB, snr));
+        quality.activeSegments++;
+    }
+    quality.segSnrDb = quality.activeSegments ? snrSum / quality.activeSegments : 0;
+
+    // Spectrogram similarity over active frames
+    std::vector<std::vector<double>> ref = melSpectrogram(reference.data(), length, sampleRate);
+    std::vector<std::vector<double>> deg = melSpectrogram(aligned, length, sampleRate);
+    if (ref.size() < 3) return quality;
+
+    // Levels as dB above a floor SPECTRUM_RANGE_DB under the reference's
+    // peak: non-negative, as NSIM needs, and deaf to noise nobody hears
+    double refMax = SPECTRUM_FLOOR_DB;
+    std::vector<double> frameLevel(ref.size());
+    for (size_t f = 0; f < ref.size(); f++) {
+        frameLevel[f] = *std::max_element(ref[f].begin(), ref[f].end());
+        refMax = std::max(refMax, frameLevel[f]);
+    }
+    double floorDb = refMax - SPECTRUM_RANGE_DB;
+
+    // Level matched first, as ViSQOL does: a quieter copy is not worse
+    double refPower = 0, degPower = 0;
+    for (size_t i = 0; i < length; i++) {
+        refPower += (double)reference[i] * reference[i];
+        degPower += (double)aligned[i] * aligned[i];
+    }
+    double gainDb = (refPower > 0 && degPower > 0) ? 10.0 * log10(refPower / degPower) : 0.0;
+
+    for (size_t f = 0; f < ref.size(); f++) {
+        for (int b = 0; b < MEL_BANDS; b++) {
+            ref[f][b] = std::max(ref[f][b], floorDb) - floorDb;
+            deg[f][b] = std::max(deg[f][b] + gainDb, floorDb) - floorDb;
+        }
+    }
+    double c1 = pow(0.01 * SPECTRUM_RANGE_DB, 2);
+    double c2 = pow(0.03 * SPECTRUM_RANGE_DB, 2) / 2.0;
+
+    double nsimSum = 0, lsdSum = 0;
+    int patches = 0, frames = 0;
+    for (size_t f = 1; f + 1 < ref.size(); f++) {
+        if (frameLevel[f] < refMax + SEGMENT_ACTIVE_DB) continue;
+
+        double squares = 0;
+        for (int b = 0; b < MEL_BANDS; b++) squares += pow(ref[f][b] - deg[f][b], 2);
+        lsdSum += sqrt(squares / MEL_BANDS);
+        frames++;
+
+        for (int b = 1; b + 1 < MEL_BANDS; b++) {
+            double meanR = 0, meanD = 0;
+            for (int df = -1; df <= 1; df++) {
+                for (int db = -1; db <= 1; db++) {
+                    meanR += ref[f + df][b + db];
+                    meanD += deg[f + df][b + db];
+                }
+            }
+            meanR /= 9;
+            meanD /= 9;
+            double varR = 0, varD = 0, cov = 0;
+            for (int df = -1; df <= 1; df++) {
+                for (int db = -1; db <= 1; db++) {
+                    double r = ref[f + df][b + db] - meanR;
+                    double d = deg[f + df][b + db] - meanD;
+                    varR += r * r;
+                    varD += d * d;
+                    cov += r * d;
+                }
+            }
+            varR /= 9;
+            varD /= 9;
+            cov /= 9;
+            double intensity = (2 * meanR * meanD + c1) / (meanR * meanR + meanD * meanD + c1);
+            double structure = (cov + c2) / (sqrt(varR) * sqrt(varD) + c2);
+            nsimSum += intensity * structure;
+            patches++;
+        }
+    }
+    quality.nsim = patches ? nsimSum / patches : 0;
+    quality.lsdDb = frames ? lsdSum / frames : 0;
+    return quality;
+}
@@ -0,0 +1,37 @@
+/*
+ * CodecQuality.h - Objective round-trip quality for the codec benchmark
+ *
+ * Reference and decoded signals at the same rate; the decoded one is
+ * delayed by the codec and resamplers, so it is aligned first (the lag
+ * with the highest cross-correlation, up to maxLagMs).
+ *
+ *   seg_snr   Segmental SNR over 20 ms segments with speech in the
+ *             reference, each clamped to [-10, 35] dB. Waveform
+ *             matching: harsh on Opus's low-rate modes, which keep the
+ *             spectrum rather than the waveform.
+ *   nsim      Neurogram similarity as ViSQOL computes it, on 32-band mel
+ *             spectrograms (50 Hz - 8 kHz, 23 ms frames) in dB, level
+ *             matched, 60 dB deep, 3x3 patches, over the active frames:
+ *             1 is identical. A proxy for ViSQOL/POLQA, not a MOS;
+ *             compare settings with it.
+ *   lsd       Log-spectral distance on the same spectrograms, dB.
+ */
+
+#ifndef SONGBIRD_HOST_CODECQUALITY_H
+#define SONGBIRD_HOST_CODECQUALITY_H
+
+#include <stdint.h>
+#include <vector>
+
+struct CodecQuality {
+    double delayMs = 0;
+    double segSnrDb = 0;
+    double nsim = 0;
+    double lsdDb = 0;
+    int activeSegments = 0;
+};
+
+CodecQuality measureQuality(const std::vector<int16_t>& reference, const std::vector<int16_t>& decoded,
+                            uint32_t sampleRate, double maxLagMs);
+
+#endif
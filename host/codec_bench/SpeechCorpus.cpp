@@ -0,0 +1,146 @@
+/*
+ * SpeechCorpus.cpp - Formant-synthesized speech for the codec benchmark
+ */
+
+#include "SpeechCorpus.h"
+#include "WavFile.h"
+#include <math.h>
+#include <stdio.h>
+#include <random>
+
+static const double CORPUS_RATE = 44100.0;
+static const double CORPUS_LENGTH_MS = 8000.0;
+static const double CORPUS_PEAK = 0.5;
+
+struct Voice {
+    const char* name;
+    double pitchHz;
+    double formantScale;
+};
+
+static const Voice VOICES[] = {
+    {"male", 110.0, 1.0},
+    {"female", 210.0, 1.17},
+    {"child", 290.0, 1.3},
+};
+
+// F1-F3 for a male voice (Peterson and Barney): a e i o u ae
+static const double VOWELS[][3] = {
+    {730, 1090, 2440}, {530, 1840, 2480}, {270, 2290, 3010},
+    {570, 840, 2410}, {300, 870, 2240}, {660, 1720, 2410},
+};
+static const int VOWEL_COUNT = sizeof(VOWELS) / sizeof(VOWELS[0]);
+
+enum PhoneKind { PHONE_VOWEL, PHONE_NASAL, PHONE_FRICATIVE, PHONE_PAUSE };
+
+// Two-pole resonator; 0 Hz makes it a low-pass
+struct Resonator {
+    double y1 = 0, y2 = 0;
+
+    double run(double x, double hz, double bandwidth) {
+        double r = exp(-M_PI * bandwidth / CORPUS_RATE);
+        double b1 = 2.0 * r * cos(2.0 * M_PI * hz / CORPUS_RATE);
+        double b2 = -r * r;
+        double y = (1.0 - r) * x + b1 * y1 + b2 * y2;
+        y2 = y1;
+        y1 = y;
+        return y;
+    }
+};
+
+static void synthesize(const Voice& voice, uint32_t seed, WavData& wav) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> gaussian(0.0, 1.0);
+
+    size_t frames = (size_t)(CORPUS_LENGTH_MS * CORPUS_RATE / 1000.0);
+    wav.sampleRate = (uint32_t)CORPUS_RATE;
+    wav.channels = 1;
+    wav.samples.assign(frames, 0);
+    std::vector<double> out(frames, 0.0);
+
+    Resonator formants[3], fricative, glottis;
+    double formantHz[3] = {500, 1500, 2500};
+    double targetHz[3] = {500, 1500, 2500};
+    double voicing = 0, noise = 0, targetVoicing = 0, targetNoise = 0;
+    double phase = 0;
+    size_t phoneEnd = (size_t)(0.3 * CORPUS_RATE);     // Lead-in pause
+    int syllables = 0;
+
+    for (size_t i = 0; i < frames; i++) {
+        if (i >= phoneEnd) {
+            // Syllables of consonant + vowel, a pause every few
+            PhoneKind kind;
+            double lengthMs;
+            if (syllables > 0 && syllables % 5 == 0 && targetVoicing > 0) {
+                kind = PHONE_PAUSE;
+                lengthMs = 150 + 250 * uniform(random);
+                syllables++;
+            } else if (targetVoicing > 0 && uniform(random) < 0.5) {
+                kind = uniform(random) < 0.5 ? PHONE_FRICATIVE : PHONE_NASAL;
+                lengthMs = 50 + 60 * uniform(random);
+            } else {
+                kind = PHONE_VOWEL;
+                lengthMs = 90 + 180 * uniform(random);
+                syllables++;
+            }
+
+            targetVoicing = (kind == PHONE_VOWEL) ? 1.0 : (kind == PHONE_NASAL) ? 0.4 : 0.0;
+            targetNoise = (kind == PHONE_FRICATIVE) ? 0.8 : 0.0;
+            if (kind == PHONE_VOWEL) {
+                const double* vowel = VOWELS[random() % VOWEL_COUNT];
+                for (int f = 0; f < 3; f++) targetHz[f] = vowel[f] * voice.formantScale;
+            } else if (kind == PHONE_NASAL) {
+                targetHz[0] = 250 * voice.formantScale;
+                targetHz[1] = 1100 * voice.formantScale;
+                targetHz[2] = 2500 * voice.formantScale;
+            }
+            phoneEnd = i + (size_t)(lengthMs * CORPUS_RATE / 1000.0);
+        }
+
+        // Articulators glide over about 20 ms; the envelope a little faster
+        for (int f = 0; f < 3; f++) formantHz[f] += (targetHz[f] - formantHz[f]) * 0.0012;
+        voicing += (targetVoicing - voicing) * 0.002;
+        noise += (targetNoise - noise) * 0.002;
+
+        // Pitch falls across the phrase, with a slow wobble
+        double t = i / CORPUS_RATE;
+        double pitch = voice.pitchHz * (1.1 - 0.2 * fmod(t, 2.0) / 2.0) * (1.0 + 0.03 * sin(2.0 * M_PI * 5.0 * t));
+        phase += pitch / CORPUS_RATE;
+        double pulse = 0;
+        if (phase >= 1.0) {
+            phase -= 1.0;
+            pulse = 1.0;
+        }
+        // Glottal pulse: a smoothed impulse plus a breath of aspiration
+        double source = glottis.run(pulse * 40.0, 0.0, 400.0) * voicing + 0.02 * voicing * gaussian(random);
+
+        double voiced = 0;
+        double gains[3] = {1.0, 0.5, 0.25};
+        for (int f = 0; f < 3; f++) {
+            voiced += gains[f] * formants[f].run(source, formantHz[f], 60.0 + 0.05 * formantHz[f]);
+        }
+        double hiss = fricative.run(noise * gaussian(random), 5500.0 * voice.formantScale, 3000.0);
+        out[i] = voiced + hiss;
+    }
+
+    double peak = 1e-9;
+    for (double v : out) peak = std::max(peak, fabs(v));
+    for (size_t i = 0; i < frames; i++) {
+        wav.samples[i] = (int16_t)lrint(out[i] / peak * CORPUS_PEAK * 32767.0);
+    }
+}
+
+bool generateCorpus(const std::string& directory) {
+    uint32_t seed = 1;
+    for (const Voice& voice : VOICES) {
+        for (int take = 1; take <= 2; take++) {
+            WavData wav;
+            synthesize(voice, seed++, wav);
+            char name[64];
+            snprintf(name, sizeof(name), "/%s_%d.wav", voice.name, take);
+            if (!writeWav(directory + name, wav)) return false;
+        }
+    }
+    return true;
+}
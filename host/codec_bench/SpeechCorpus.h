@@ -0,0 +1,20 @@
+/*
+ * SpeechCorpus.h - Synthetic speech for the codec benchmark
+ *
+ * Formant synthesis, not recordings: a glottal pulse train with a moving
+ * pitch through three vowel formants, fricative noise, nasals and
+ * pauses, for male, female and child voices. Enough like speech that
+ * Opus picks its speech modes and a quality score moves the way it does
+ * on real talk; recorded corpora (16-bit mono WAV at 44.1 kHz) are run
+ * the same way by naming them on the command line.
+ */
+
+#ifndef SONGBIRD_HOST_SPEECHCORPUS_H
+#define SONGBIRD_HOST_SPEECHCORPUS_H
+
+#include <string>
+
+// Writes the synthetic set as WAV files into directory
+bool generateCorpus(const std::string& directory);
+
+#endif
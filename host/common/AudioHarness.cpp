@@ -0,0 +1,81 @@
+/*
+ * AudioHarness.cpp - Block updates on the virtual clock
+ */
+
+#include "AudioHarness.h"
+
+AudioHarness::AudioHarness(AudioRecordQueue* record, AudioPlayQueue* play)
+    : record(record), play(play), origin(hostMicros())
+{
+    out.sampleRate = AUDIO_HARNESS_RATE;
+    out.channels = 1;
+    hostAttachTimer(this);
+}
+
+AudioHarness::~AudioHarness() {
+    hostDetachTimer(this);
+}
+
+bool AudioHarness::loadInput(const std::string& path, std::string& error) {
+    WavData wav;
+    if (!readWav(path, wav, error)) return false;
+    return setInput(wav, error);
+}
+
+bool AudioHarness::setInput(const WavData& wav, std::string& error) {
+    if (wav.sampleRate != AUDIO_HARNESS_RATE) {
+        error = "input must be " + std::to_string(AUDIO_HARNESS_RATE) + " Hz, not " +
+                std::to_string(wav.sampleRate);
+        return false;
+    }
+    input.resize(wav.frames());
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = wav.samples[i * wav.channels];
+    }
+    inputPos = 0;
+    return true;
+}
+
+uint64_t AudioHarness::blockStartMicros(uint64_t block) {
+    return (uint64_t)(block * AUDIO_BLOCK_SAMPLES * 1e6 / AUDIO_SAMPLE_RATE_EXACT);
+}
+
+void AudioHarness::runBlocks(uint32_t count) {
+    uint64_t target = blocks + count;
+    while (blocks < target) {
+        uint64_t due = hostDue();
+        hostAdvanceMicros(due > hostMicros() ? due - hostMicros() : 0);
+    }
+}
+
+// One audio interrupt: input into the record queue, play queue out
+void AudioHarness::runBlock() {
+    if (record) {
+        audio_block_t* block = AudioStream::allocate();
+        if (block) {
+            size_t count = inputPos < input.size() ? std::min(input.size() - inputPos, (size_t)AUDIO_BLOCK_SAMPLES) : 0;
+            memcpy(block->data, input.data() + inputPos, count * sizeof(int16_t));
+            memset(block->data + count, 0, (AUDIO_BLOCK_SAMPLES - count) * sizeof(int16_t));
+            inputPos += count;
+
+            record->hostDeliver(block);
+            AudioStream::release(block);
+            record->update();
+        }
+    } else if (inputPos < input.size()) {
+        inputPos = std::min(input.size(), inputPos + AUDIO_BLOCK_SAMPLES);
+    }
+
+    if (play) {
+        play->update();
+        audio_block_t* block = play->hostTakeOutput();
+        if (block) {
+            out.samples.insert(out.samples.end(), block->data, block->data + AUDIO_BLOCK_SAMPLES);
+            AudioStream::release(block);
+        } else {
+            out.samples.insert(out.samples.end(), AUDIO_BLOCK_SAMPLES, 0);
+        }
+    }
+
+    blocks++;
+}
@@ -0,0 +1,67 @@
+/*
+ * AudioHarness.h - Drives the audio "interrupt" for host runs of sketch code
+ *
+ * Stands in for the audio graph around an engine's queues: every block
+ * period of virtual time it delivers the next 128 input samples (from a
+ * WAV file, then silence) to the record queue and takes one block from
+ * the play queue into the output (silence on underrun). It is a
+ * HostTimer, so the updates run whenever the virtual clock passes their
+ * due time: in advance() between sketch calls, and inside a sketch call
+ * that blocks (a delay(), a simulated SD stall). millis() and the queues
+ * move together as on the device, only as fast as the host can go.
+ *
+ *   AudioHarness audio(&recordQueue, &playQueue);
+ *   audio.loadInput("speech.wav", error);
+ *   while (!audio.inputDone()) { audio.advance(1000); engine.process(...); }
+ *   writeWav("out.wav", audio.output());
+ */
+
+#ifndef SONGBIRD_HOST_AUDIOHARNESS_H
+#define SONGBIRD_HOST_AUDIOHARNESS_H
+
+#include <Arduino.h>
+#include <Audio.h>
+#include <string>
+#include "WavFile.h"
+
+#define AUDIO_HARNESS_RATE  44100   // WAV rate that stands for AUDIO_SAMPLE_RATE_EXACT
+
+class AudioHarness : public HostTimer {
+public:
+    // Either queue may be NULL
+    AudioHarness(AudioRecordQueue* record, AudioPlayQueue* play);
+    ~AudioHarness();
+
+    // Mono or the first channel, at AUDIO_HARNESS_RATE
+    bool loadInput(const std::string& path, std::string& error);
+    bool setInput(const WavData& wav, std::string& error);
+
+    // Move the virtual clock on; every block update that falls due runs
+    void advance(uint32_t us) { hostAdvanceMicros(us); }
+    void runBlocks(uint32_t blocks);
+
+    bool inputDone() const { return inputPos >= input.size(); }
+    uint64_t blocksRun() const { return blocks; }
+    const WavData& output() const { return out; }
+
+    // When block n is due, in microseconds after block 0
+    static uint64_t blockStartMicros(uint64_t block);
+
+    uint64_t hostDue() const override { return origin + blockStartMicros(blocks + 1); }
+    void hostFire() override { runBlock(); }
+
+private:
+    AudioRecordQueue* record;
+    AudioPlayQueue* play;
+
+    std::vector<int16_t> input;
+    size_t inputPos = 0;
+    WavData out;
+
+    uint64_t origin;        // Virtual time of block 0
+    uint64_t blocks = 0;
+
+    void runBlock();
+};
+
+#endif
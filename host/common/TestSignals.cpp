@@ -0,0 +1,28 @@
+/*
+ * TestSignals.cpp - Synthetic audio for host harnesses
+ */
+
+#include "TestSignals.h"
+#include "AudioHarness.h"
+
+WavData speechLike(uint32_t milliseconds, uint32_t seed) {
+    WavData wav;
+    wav.sampleRate = AUDIO_HARNESS_RATE;
+    wav.channels = 1;
+    wav.samples.resize((size_t)milliseconds * AUDIO_HARNESS_RATE / 1000);
+
+    uint32_t random = seed ? seed : 1;
+    float envelope = 0;
+    for (size_t i = 0; i < wav.samples.size(); i++) {
+        // 200 ms steps, talking three out of five
+        bool talking = (i / (AUDIO_HARNESS_RATE / 5)) % 5 < 3;
+        envelope += ((talking ? 1.0f : 0.0f) - envelope) * 0.001f;
+
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        float noise = (float)(int32_t)random / 2147483648.0f;
+        wav.samples[i] = (int16_t)(noise * envelope * 8000);
+    }
+    return wav;
+}
@@ -0,0 +1,17 @@
+/*
+ * TestSignals.h - Synthetic audio for host harnesses that need "some voice"
+ *
+ * Not speech, but loaded like it: noise bursts of a few hundred ms with
+ * pauses, so Opus sees talk and silence and packet sizes vary.
+ */
+
+#ifndef SONGBIRD_HOST_TESTSIGNALS_H
+#define SONGBIRD_HOST_TESTSIGNALS_H
+
+#include <stdint.h>
+#include "WavFile.h"
+
+// Mono at AUDIO_HARNESS_RATE; the same seed gives the same samples
+WavData speechLike(uint32_t milliseconds, uint32_t seed);
+
+#endif
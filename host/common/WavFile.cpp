@@ -0,0 +1,243 @@
+/*
+ * WavFile.cpp - 16-bit PCM WAV reading and writing
+ */
+
+#include "WavFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static uint32_t readLE32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t readLE16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static void writeLE32(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void writeLE16(uint8_t* p, uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+}
+
+bool readWav(const std::string& path, WavData& wav, std::string& error) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+
+    if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0) {
+        error = path + ": not a RIFF/WAVE file";
+        return false;
+    }
+
+    // Walk the chunks; fmt must come before data
+    bool haveFormat = false;
+    size_t pos = 12;
+    while (pos + 8 <= bytes.size()) {
+        uint32_t size = readLE32(&bytes[pos + 4]);
+        const uint8_t* body = &bytes[pos + 8];
+        size_t available = bytes.size() - pos - 8;
+
+        if (memcmp(&bytes[pos], "fmt ", 4) == 0 && size >= 16 && available >= 16) {
+            uint16_t format = readLE16(body);
+            wav.channels = readLE16(body + 2);
+            wav.sampleRate = readLE32(body + 4);
+            uint16_t bits = readLE16(body + 14);
+            // WAVE_FORMAT_EXTENSIBLE carries PCM in its subformat
+            if ((format != 1 && format != 0xFFFE) || bits != 16 || wav.channels == 0) {
+                error = path + ": only 16-bit PCM is supported";
+                return false;
+            }
+            haveFormat = true;
+        } else if (memcmp(&bytes[pos], "data", 4) == 0) {
+            if (!haveFormat) {
+                error = path + ": data chunk before fmt";
+                return false;
+            }
+            // A truncated recording still has its samples; use what is there
+            size_t length = std::min<size_t>(size, available) / 2;
+            wav.samples.resize(length - length % wav.channels);
+            for (size_t i = 0; i < wav.samples.size(); i++) {
+                wav.samples[i] = (int16_t)readLE16(body + 2 * i);
+            }
+            return true;
+        }
+        pos += 8 + size + (size & 1);
+    }
+
+    error = path + ": no data chunk";
+    return false;
+}
+
+// 44-byte canonical header
+static void fillHeader(uint8_t* header, uint32_t sampleRate, uint16_t channels, uint32_t dataBytes) {
+    memcpy(header, "RIFF", 4);
+    writeLE32(header + 4, 36 + dataBytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    writeLE32(header + 16, 16);
+    writeLE16(header + 20, 1);
+    writeLE16(header + 22, channels);
+    writeLE32(header + 24, sampleRate);
+    writeLE32(header + 28, sampleRate * channels * 2);
+    writeLE16(header + 32, channels * 2);
+    writeLE16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    writeLE32(header + 40, dataBytes);
+}
+
+bool writeWav(const std::string& path, const WavData& wav) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    uint32_t dataBytes = wav.samples.size() * 2;
+    uint8_t header[44];
+    fillHeader(header, wav.sampleRate, wav.channels, dataBytes);
+
+    std::vector<uint8_t> data(dataBytes);
+    for (size_t i = 0; i < wav.samples.size(); i++) {
+        writeLE16(&data[2 * i], (uint16_t)wav.samples[i]);
+    }
+
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+              && fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+// =============================================================================
+// Streaming
+// =============================================================================
+
+bool WavReader::open(const std::string& path, std::string& error) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    uint8_t riff[12];
+    if (fread(riff, 1, sizeof(riff), file) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0
+        || memcmp(riff + 8, "WAVE", 4) != 0) {
+        error = path + ": not a RIFF/WAVE file";
+        close();
+        return false;
+    }
+
+    // Walk the chunks; fmt must come before data
+    bool haveFormat = false;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+        uint32_t size = readLE32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t body[16];
+            if (fread(body, 1, sizeof(body), file) != sizeof(body)) break;
+            uint16_t format = readLE16(body);
+            channelCount = readLE16(body + 2);
+            rate = readLE32(body + 4);
+            uint16_t bits = readLE16(body + 14);
+            // WAVE_FORMAT_EXTENSIBLE carries PCM in its subformat
+            if ((format != 1 && format != 0xFFFE) || bits != 16 || channelCount == 0) {
+                error = path + ": only 16-bit PCM is supported";
+                close();
+                return false;
+            }
+            haveFormat = true;
+            size -= sizeof(body);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                error = path + ": data chunk before fmt";
+                close();
+                return false;
+            }
+            // A truncated recording still has its samples; read() stops at the end
+            remaining = size / (2 * channelCount);
+            return true;
+        }
+        if (fseek(file, size + (size & 1), SEEK_CUR) != 0) break;
+    }
+
+    error = path + ": no data chunk";
+    close();
+    return false;
+}
+
+void WavReader::close() {
+    if (file) fclose(file);
+    file = nullptr;
+    remaining = 0;
+}
+
+size_t WavReader::read(int16_t* samples, size_t count) {
+    if (!file) return 0;
+    uint8_t buffer[4096];
+    size_t frameBytes = 2 * channelCount;
+    size_t done = 0;
+
+    count = (size_t)std::min<uint64_t>(count, remaining);
+    while (done < count) {
+        size_t frames = std::min(count - done, sizeof(buffer) / frameBytes);
+        size_t got = fread(buffer, 1, frames * frameBytes, file) / frameBytes;
+        for (size_t i = 0; i < got * channelCount; i++) {
+            samples[done * channelCount + i] = (int16_t)readLE16(buffer + 2 * i);
+        }
+        done += got;
+        if (got < frames) {
+            remaining = 0;
+            return done;
+        }
+    }
+    remaining -= done;
+    return done;
+}
+
+bool WavWriter::open(const std::string& path, uint32_t sampleRate, uint16_t channels) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    rate = sampleRate;
+    channelCount = channels;
+    dataBytes = 0;
+
+    uint8_t header[44];
+    fillHeader(header, rate, channelCount, 0);
+    failed = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    return !failed;
+}
+
+bool WavWriter::write(const int16_t* samples, size_t count) {
+    if (!file) return false;
+    uint8_t buffer[4096];
+    size_t total = count * channelCount;
+    for (size_t done = 0; done < total;) {
+        size_t n = std::min(total - done, sizeof(buffer) / 2);
+        for (size_t i = 0; i < n; i++) writeLE16(buffer + 2 * i, (uint16_t)samples[done + i]);
+        if (fwrite(buffer, 2, n, file) != n) failed = true;
+        done += n;
+    }
+    dataBytes += total * 2;
+    return !failed;
+}
+
+bool WavWriter::close() {
+    if (!file) return false;
+    uint8_t header[44];
+    fillHeader(header, rate, channelCount, (uint32_t)std::min<uint64_t>(dataBytes, 0xFFFFFFFFu - 36));
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header)) failed = true;
+    if (fclose(file) != 0) failed = true;
+    file = nullptr;
+    return !failed;
+}
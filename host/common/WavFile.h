@@ -0,0 +1,67 @@
+/*
+ * WavFile.h - 16-bit PCM WAV reading and writing for host harnesses
+ *
+ * readWav/writeWav take whole files, which suits seconds-long fixtures;
+ * WavReader/WavWriter stream for tools that go through hours of audio.
+ * Multi-channel files are kept interleaved; other sample formats are
+ * rejected.
+ */
+
+#ifndef SONGBIRD_HOST_WAVFILE_H
+#define SONGBIRD_HOST_WAVFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct WavData {
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    std::vector<int16_t> samples;   // Interleaved
+
+    size_t frames() const { return channels ? samples.size() / channels : 0; }
+};
+
+// Returns false (with a reason in error) on I/O or format problems
+bool readWav(const std::string& path, WavData& wav, std::string& error);
+bool writeWav(const std::string& path, const WavData& wav);
+
+class WavReader {
+public:
+    ~WavReader() { close(); }
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    uint32_t sampleRate() const { return rate; }
+    uint16_t channels() const { return channelCount; }
+
+    // Up to count frames, interleaved; 0 at the end
+    size_t read(int16_t* samples, size_t count);
+
+private:
+    FILE* file = nullptr;
+    uint32_t rate = 0;
+    uint16_t channelCount = 0;
+    uint64_t remaining = 0;     // Frames
+};
+
+// The sizes in the header are filled in by close()
+class WavWriter {
+public:
+    ~WavWriter() { close(); }
+
+    bool open(const std::string& path, uint32_t sampleRate, uint16_t channels);
+    bool write(const int16_t* samples, size_t count);
+    bool close();
+
+private:
+    FILE* file = nullptr;
+    uint32_t rate = 0;
+    uint16_t channelCount = 0;
+    uint64_t dataBytes = 0;
+    bool failed = false;
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * WorkPool.cpp - Per-worker deques with stealing
+ */
+
+#include "WorkPool.h"
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+WorkPool::WorkPool(unsigned workers) {
+    for (unsigned i = 0; i < std::max(workers, 1u); i++) queues.emplace_back(new Queue());
+}
+
+unsigned defaultWorkers() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+bool WorkPool::next(unsigned worker, size_t& job) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.jobs.empty()) {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+
+    // Steal the smallest job of the fullest queue: its owner keeps the big
+    // ones it is about to start, and the thief is done with it soonest
+    while (true) {
+        Queue* victim = nullptr;
+        size_t most = 0;
+        for (auto& queue : queues) {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            if (queue->jobs.size() > most) {
+                most = queue->jobs.size();
+                victim = queue.get();
+            }
+        }
+        if (!victim) return false;
+
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (victim->jobs.empty()) continue;     // Emptied since the scan
+        job = victim->jobs.back();
+        victim->jobs.pop_back();
+        stolen++;
+        return true;
+    }
+}
+
+void WorkPool::work(unsigned worker, const Task& task) {
+    size_t job;
+    while (next(worker, job)) {
+        task(worker, job);
+        if (++done == total) {
+            std::lock_guard<std::mutex> guard(finishedLock);
+            finished.notify_all();
+        }
+    }
+}
+
+void WorkPool::run(const std::vector<uint64_t>& costs, const Task& task, const Progress& progress,
+                   uint32_t progressMs) {
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+    for (size_t i = 0; i < order.size(); i++) queues[i % queues.size()]->jobs.push_back(order[i]);
+
+    total = costs.size();
+    done = 0;
+    stolen = 0;
+    std::vector<std::thread> threads;
+    for (unsigned worker = 0; worker < queues.size(); worker++) {
+        threads.emplace_back(&WorkPool::work, this, worker, std::cref(task));
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(finishedLock);
+        while (!finished.wait_for(guard, std::chrono::milliseconds(progressMs), [&] { return done == total; })) {
+            if (progress) progress(done, total);
+        }
+    }
+    for (std::thread& thread : threads) thread.join();
+    if (progress) progress(done, costs.size());
+}
@@ -0,0 +1,60 @@
+/*
+ * WorkPool.h - Work-stealing thread pool for batch tools
+ *
+ * Jobs are indices 0..count-1 with a cost (file size, say). They are
+ * dealt biggest first, round-robin, onto one deque per worker. A worker
+ * takes from the front of its own deque; when that is empty it steals
+ * from the back of the fullest other one, so a few long files cannot
+ * leave the other threads idle at the end of a batch.
+ *
+ * run() blocks the calling thread until every job is done, calling
+ * progress() from it at the given interval and once at the end.
+ */
+
+#ifndef SONGBIRD_HOST_WORKPOOL_H
+#define SONGBIRD_HOST_WORKPOOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class WorkPool {
+public:
+    // task(worker, job); worker is 0..workers-1, for per-thread state
+    typedef std::function<void(unsigned worker, size_t job)> Task;
+    typedef std::function<void(size_t done, size_t count)> Progress;
+
+    explicit WorkPool(unsigned workers);
+
+    unsigned workers() const { return (unsigned)queues.size(); }
+    uint32_t steals() const { return stolen; }
+
+    void run(const std::vector<uint64_t>& costs, const Task& task, const Progress& progress,
+             uint32_t progressMs = 250);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    size_t total = 0;
+    std::atomic<size_t> done{0};
+    std::mutex finishedLock;
+    std::condition_variable finished;
+    std::atomic<uint32_t> stolen{0};
+
+    bool next(unsigned worker, size_t& job);
+    void work(unsigned worker, const Task& task);
+};
+
+// Hardware threads, at least one
+unsigned defaultWorkers();
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * DynamicsBench.cpp - Level accuracy and cost of the software AGC/limiter
+ *
+ *   dynamics_bench                     JSON lines on stdout
+ *
+ * Drives AudioEffectSongbirdDynamics (src/SongbirdDynamics.cpp, built
+ * against the host shims) block by block with synthetic signals:
+ *
+ *   fixed_point   log2Q16/exp2Q16 against libm over their whole range
+ *   static_curve  a 1 kHz sine at -60 .. -3 dBFS RMS through each preset;
+ *                 the settled output level against the float curve the
+ *                 settings describe
+ *   true_peak     the limiter alone with 12 dB of makeup, so everything
+ *                 hits it: sines up to 19 kHz, a burst out of silence and
+ *                 speech-like noise (band-limited to 18 kHz, and full
+ *                 band). Output true peak is measured 8x oversampled;
+ *                 overshoot_db > 0 went past the ceiling.
+ *   timing        the voice preset on a sine stepping -40 -> -10 -> -40
+ *                 dBFS: time for the output to settle within 1 dB
+ *   cycles        speech-like noise through each preset, cycles per
+ *                 128-sample block (host time counted at the Teensy clock)
+ *
+ * Every run is deterministic.
+ */
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "SongbirdDynamics.h"
+#include "TestSignals.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#define FS              AUDIO_SAMPLE_RATE_EXACT
+#define OVERSAMPLE      8
+#define SINC_TAPS       24      // Each side, per output point
+
+struct Preset {
+    const char* name;
+    DynamicsSettings settings;
+};
+
+static const Preset PRESETS[] = {
+    { "voice", dynamicsVoice },
+    { "ambience", dynamicsAmbience },
+    { "limiter", dynamicsLimiter },
+};
+
+static uint32_t benchRandom = 12345;
+
+static uint32_t nextRandom() {
+    benchRandom ^= benchRandom << 13;
+    benchRandom ^= benchRandom >> 17;
+    benchRandom ^= benchRandom << 5;
+    return benchRandom;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double mean(const std::vector<double>& values) {
+    if (values.empty()) return 0.0;
+    double sum = 0;
+    for (double v : values) sum += v;
+    return sum / values.size();
+}
+
+static double toDb(double amplitude) {
+    return amplitude > 0 ? 20.0 * log10(amplitude) : -200.0;
+}
+
+// Block by block, as the audio interrupt would; the output has the same
+// length (the lookahead delay included)
+static std::vector<int16_t> run(AudioEffectSongbirdDynamics& dynamics, const std::vector<int16_t>& input,
+                                std::vector<double>* cycles = NULL) {
+    std::vector<int16_t> output(input.size(), 0);
+    for (size_t start = 0; start < input.size(); start += AUDIO_BLOCK_SAMPLES) {
+        audio_block_t* block = AudioStream::allocate();
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            block->data[i] = start + i < input.size() ? input[start + i] : 0;
+        }
+        dynamics.hostDeliver(block);
+        AudioStream::release(block);
+
+        uint32_t before = ARM_DWT_CYCCNT;
+        dynamics.update();
+        if (cycles) cycles->push_back(ARM_DWT_CYCCNT - before);
+
+        audio_block_t* out = dynamics.hostTakeOutput();
+        if (!out) continue;
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES && start + i < output.size(); i++) output[start + i] = out->data[i];
+        AudioStream::release(out);
+    }
+    return output;
+}
+
+// Sine at an RMS level, dBFS (a full-scale sine is -3 dB)
+static void addSine(std::vector<int16_t>& samples, size_t from, size_t to, double hz, double rmsDb, double phase) {
+    double amplitude = 32768.0 * sqrt(2.0) * pow(10.0, rmsDb / 20.0);
+    for (size_t i = from; i < to && i < samples.size(); i++) {
+        double v = amplitude * sin(2.0 * M_PI * hz * i / FS + phase);
+        samples[i] = (int16_t)std::max(-32768.0, std::min(32767.0, lround(v) * 1.0));
+    }
+}
+
+static double rmsDb(const std::vector<int16_t>& samples, size_t from, size_t to) {
+    double sum = 0;
+    for (size_t i = from; i < to; i++) sum += (double)samples[i] * samples[i];
+    return toDb(sqrt(sum / (to - from)) / 32768.0);
+}
+
+// Highest point of the band-limited signal: windowed-sinc interpolation
+// at OVERSAMPLE points per sample
+static double truePeakDb(const std::vector<int16_t>& samples, size_t from, size_t to) {
+    double peak = 0;
+    for (size_t n = from; n < to; n++) {
+        peak = std::max(peak, fabs((double)samples[n]));
+        for (int p = 1; p < OVERSAMPLE; p++) {
+            double t = n + (double)p / OVERSAMPLE;
+            double sum = 0;
+            for (int k = -SINC_TAPS + 1; k <= SINC_TAPS; k++) {
+                long m = (long)n + k;
+                if (m < 0 || m >= (long)samples.size()) continue;
+                double x = t - m;
+                double window = 0.5 + 0.5 * cos(M_PI * x / SINC_TAPS);
+                sum += samples[m] * sin(M_PI * x) / (M_PI * x) * window;
+            }
+            peak = std::max(peak, fabs(sum));
+        }
+    }
+    return toDb(peak / 32768.0);
+}
+
+// Windowed-sinc low-pass, 127 taps
+static std::vector<int16_t> lowpass(const std::vector<int16_t>& samples, double hz) {
+    const int half = 63;
+    double cutoff = hz / FS;
+    std::vector<double> taps(2 * half + 1);
+    for (int k = -half; k <= half; k++) {
+        double sinc = k == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * k) / (M_PI * k);
+        taps[k + half] = sinc * (0.42 + 0.5 * cos(M_PI * k / half) + 0.08 * cos(2 * M_PI * k / half));
+    }
+    std::vector<int16_t> out(samples.size());
+    for (size_t n = 0; n < samples.size(); n++) {
+        double sum = 0;
+        for (int k = -half; k <= half; k++) {
+            long m = (long)n - k;
+            if (m >= 0 && m < (long)samples.size()) sum += taps[k + half] * samples[m];
+        }
+        out[n] = (int16_t)std::max(-32768.0, std::min(32767.0, (double)lround(sum)));
+    }
+    return out;
+}
+
+// What the settings describe, in float
+static double expectedGainDb(const DynamicsSettings& s, double levelDb) {
+    double over = levelDb - s.thresholdDb;
+    double knee = std::max(s.kneeDb, 0.0f);
+    double slope = 1.0 / std::max(s.ratio, 1.0f) - 1.0;
+    double curve;
+    if (2 * over <= -knee) curve = 0;
+    else if (2 * over >= knee) curve = slope * over;
+    else curve = slope * (over + knee / 2) * (over + knee / 2) / (2 * knee);
+    return std::min((double)DYNAMICS_MAX_GAIN_DB, s.makeupDb + curve);
+}
+
+static void fixedPoint() {
+    double log2Error = 0, exp2Error = 0;
+    for (double e = 0; e < 31.99; e += 0.001) {
+        uint32_t x = (uint32_t)pow(2.0, e);
+        double exact = log2((double)x) - 16.0;
+        log2Error = std::max(log2Error, fabs(AudioEffectSongbirdDynamics::log2Q16(x) / 65536.0 - exact));
+    }
+    for (int32_t x = -15 * 65536; x < 5 * 65536; x += 61) {
+        double exact = pow(2.0, x / 65536.0);
+        double got = AudioEffectSongbirdDynamics::exp2Q16(x) / 65536.0;
+        if (exact < 1.0 / 256) continue;        // Below the Q16 resolution
+        exp2Error = std::max(exp2Error, fabs(toDb(got / exact)));
+    }
+    printf("{\"test\":\"fixed_point\",\"log2_max_error\":%.5f,\"level_error_db\":%.4f,"
+           "\"exp2_error_db\":%.4f}\n",
+           log2Error, log2Error * 3.0103, exp2Error);
+}
+
+static void staticCurve() {
+    for (const Preset& preset : PRESETS) {
+        double worst = 0;
+        for (int level = -60; level <= -3; level += 3) {
+            AudioEffectSongbirdDynamics dynamics;
+            dynamics.configure(preset.settings);
+
+            // Long enough for the slowest release to settle from the makeup gain
+            size_t length = (size_t)(FS * (3.0 + preset.settings.releaseMs * 5 / 1000.0));
+            std::vector<int16_t> input(length, 0);
+            addSine(input, 0, length, 1000.0, level, 0.0);
+            std::vector<int16_t> output = run(dynamics, input);
+
+            size_t window = (size_t)(FS * 0.5);
+            double measured = rmsDb(output, length - window, length);
+            double expected = level + expectedGainDb(preset.settings, level);
+            // The limiter holds a sine's peak (RMS + 3 dB) at the ceiling
+            expected = std::min(expected, (double)preset.settings.ceilingDb - 3.0103);
+            double error = measured - expected;
+            worst = std::max(worst, fabs(error));
+
+            printf("{\"test\":\"static_curve\",\"preset\":\"%s\",\"input_dbfs\":%d,\"output_dbfs\":%.2f,"
+                   "\"expected_dbfs\":%.2f,\"error_db\":%.3f,\"gain_db\":%.2f}\n",
+                   preset.name, level, measured, expected, error, dynamics.gainDb());
+        }
+        printf("{\"summary\":\"static_curve\",\"preset\":\"%s\",\"max_error_db\":%.3f}\n", preset.name, worst);
+    }
+}
+
+static void truePeakRun(const char* signal, const std::vector<int16_t>& input, double& worst) {
+    DynamicsSettings settings = dynamicsLimiter;
+    settings.makeupDb = 12.0f;
+    AudioEffectSongbirdDynamics dynamics;
+    dynamics.configure(settings);
+    std::vector<int16_t> output = run(dynamics, input);
+
+    double ceiling = settings.ceilingDb;
+    int16_t ceilingSample = (int16_t)(32768.0 * pow(10.0, ceiling / 20.0));
+    long over = 0;
+    double samplePeak = 0;
+    for (int16_t s : output) {
+        if (abs(s) > ceilingSample) over++;
+        samplePeak = std::max(samplePeak, (double)abs(s));
+    }
+    // The signals start and stop abruptly, which rings in the
+    // interpolation: leave 50 ms out at each end
+    size_t edge = (size_t)(FS * 0.05);
+    double truePeak = truePeakDb(output, edge, output.size() - edge);
+    worst = std::max(worst, truePeak - ceiling);
+
+    printf("{\"test\":\"true_peak\",\"signal\":\"%s\",\"ceiling_dbfs\":%.1f,\"sample_peak_dbfs\":%.2f,"
+           "\"true_peak_dbfs\":%.2f,\"overshoot_db\":%.3f,\"samples_over\":%ld,\"limited_blocks\":%u}\n",
+           signal, ceiling, toDb(samplePeak / 32768.0), truePeak, truePeak - ceiling, over,
+           dynamics.limitedBlocks());
+}
+
+static void truePeak() {
+    double worst = -100;
+    size_t length = (size_t)(FS * 1.0);
+    const double frequencies[] = { 100, 1000, 5000, 10000, 15000, 19000 };
+    for (double hz : frequencies) {
+        std::vector<int16_t> input(length, 0);
+        double phase = (nextRandom() % 1000) / 1000.0 * 2 * M_PI;
+        addSine(input, 0, length, hz, -9.0, phase);
+        std::string name = "sine_" + std::to_string((int)hz);
+        truePeakRun(name.c_str(), input, worst);
+    }
+
+    // Out of silence straight to full scale: only the lookahead can catch it
+    std::vector<int16_t> burst(length, 0);
+    addSine(burst, length / 2, length, 3000.0, -3.0103, 0.0);
+    truePeakRun("burst", burst, worst);
+
+    // Speech-like noise as a codec's decimation filter leaves it, and
+    // full band up to Nyquist (past what BS.1770's interpolator covers)
+    WavData speech = speechLike(5000, 7);
+    for (int16_t& s : speech.samples) s = (int16_t)std::max(-32768, std::min(32767, s * 3));
+    truePeakRun("speech", lowpass(speech.samples, 18000.0), worst);
+    double fullBand = -100;
+    truePeakRun("speech_full_band", speech.samples, fullBand);
+
+    printf("{\"summary\":\"true_peak\",\"max_overshoot_db\":%.3f,\"full_band_overshoot_db\":%.3f}\n", worst,
+           fullBand);
+}
+
+// Time from sample from until the 1 ms RMS stays within 1 dB of its final value
+static double settleMs(const std::vector<int16_t>& output, size_t from, size_t to) {
+    size_t window = (size_t)(FS / 1000);
+    double final = rmsDb(output, to - 20 * window, to);
+    size_t settled = from;
+    for (size_t i = from; i + window <= to; i += window) {
+        if (fabs(rmsDb(output, i, i + window) - final) > 1.0) settled = i + window;
+    }
+    return (settled - from) * 1000.0 / FS;
+}
+
+static void timing() {
+    AudioEffectSongbirdDynamics dynamics;
+    dynamics.configure(dynamicsVoice);
+
+    size_t second = (size_t)FS;
+    std::vector<int16_t> input(5 * second, 0);
+    addSine(input, 0, second, 1000.0, -40.0, 0.0);
+    addSine(input, second, 3 * second, 1000.0, -10.0, 0.0);
+    addSine(input, 3 * second, 5 * second, 1000.0, -40.0, 0.0);
+    std::vector<int16_t> output = run(dynamics, input);
+
+    size_t latency = dynamics.latencySamples();
+    double attack = settleMs(output, second + latency, 3 * second);
+    double release = settleMs(output, 3 * second + latency, 5 * second);
+
+    double stepPeak = 0;
+    for (size_t i = second; i < second + second / 10; i++) stepPeak = std::max(stepPeak, (double)abs(output[i]));
+
+    printf("{\"test\":\"timing\",\"preset\":\"voice\",\"attack_ms\":%.1f,\"release_ms\":%.1f,"
+           "\"step_peak_dbfs\":%.2f,\"latency_samples\":%u,\"latency_ms\":%.2f}\n",
+           attack, release, toDb(stepPeak / 32768.0), (unsigned)latency, latency * 1000.0 / FS);
+}
+
+static void cycles() {
+    WavData speech = speechLike(20000, 3);
+    double blockCycles = (double)F_CPU_ACTUAL * AUDIO_BLOCK_SAMPLES / FS;
+    for (const Preset& preset : PRESETS) {
+        AudioEffectSongbirdDynamics dynamics;
+        dynamics.configure(preset.settings);
+        std::vector<double> counts;
+        run(dynamics, speech.samples, &counts);
+
+        // The host is not real time: the 99th percentile, not the maximum
+        double average = mean(counts);
+        printf("{\"test\":\"cycles\",\"preset\":\"%s\",\"blocks\":%zu,\"cycles_per_block\":%.0f,"
+               "\"cycles_per_block_p99\":%.0f,\"cycles_per_sample\":%.1f,\"cpu_pct\":%.3f,"
+               "\"cycles_clock_hz\":%u}\n",
+               preset.name, counts.size(), average, percentile(counts, 0.99), average / AUDIO_BLOCK_SAMPLES,
+               100.0 * average / blockCycles, F_CPU_ACTUAL);
+    }
+}
+
+static int usage() {
+    fprintf(stderr, "usage: dynamics_bench [fixed_point|static_curve|true_peak|timing|cycles...]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> tests;
+    for (int i = 1; i < argc; i++) tests.push_back(argv[i]);
+    if (tests.empty()) tests = { "fixed_point", "static_curve", "true_peak", "timing", "cycles" };
+
+    AudioMemory(8);
+    for (const std::string& test : tests) {
+        if (test == "fixed_point") fixedPoint();
+        else if (test == "static_curve") staticCurve();
+        else if (test == "true_peak") truePeak();
+        else if (test == "timing") timing();
+        else if (test == "cycles") cycles();
+        else return usage();
+    }
+    return 0;
+}
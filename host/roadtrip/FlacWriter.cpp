@@ -0,0 +1,545 @@
+/*
+ * FlacWriter.cpp - Small FLAC encoder for roadtrip decoder fixtures
+ */
+
+#include "FlacWriter.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#define LPC_PRECISION       12
+#define MAX_PARTITION_ORDER 8
+
+namespace {
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void put(uint32_t value, int bits) {
+        if (bits == 0) return;
+        if (bits < 32) value &= (1u << bits) - 1;
+        acc = (acc << bits) | value;
+        count += bits;
+        while (count >= 8) {
+            out.push_back((uint8_t)(acc >> (count - 8)));
+            count -= 8;
+        }
+        acc &= (1u << count) - 1;
+    }
+
+    void putSigned(int32_t value, int bits) { put((uint32_t)value, bits); }
+
+    void putUnary(uint32_t zeros) {
+        while (zeros >= 24) {
+            put(0, 24);
+            zeros -= 24;
+        }
+        put(1, zeros + 1);
+    }
+
+    void align() {
+        if (count) put(0, 8 - count);
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t acc = 0;
+    int count = 0;
+};
+
+uint8_t crc8(const uint8_t* p, size_t n) {
+    uint8_t crc = 0;
+    while (n--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+uint16_t crc16(const uint8_t* p, size_t n) {
+    uint16_t crc = 0;
+    while (n--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+// Bits a two's complement value needs
+int signedBits(int32_t v) {
+    int bits = 1;
+    while (bits < 32 && (v < -(1LL << (bits - 1)) || v >= (1LL << (bits - 1)))) bits++;
+    return bits;
+}
+
+enum SubframeType { SUB_CONSTANT, SUB_VERBATIM, SUB_FIXED, SUB_LPC };
+
+struct Partition {
+    uint32_t param;     // Rice parameter, or the raw width when escaped
+    bool escaped;
+};
+
+struct Subframe {
+    SubframeType type = SUB_VERBATIM;
+    int order = 0;
+    int shift = 0;
+    std::vector<int32_t> coefs;
+    std::vector<int32_t> residual;      // From sample order on
+    int method = 0;                     // 0: 4-bit parameters, 1: 5-bit
+    int partitionOrder = 0;
+    std::vector<Partition> partitions;
+    uint64_t bits = UINT64_MAX;
+};
+
+// Cheapest Rice coding of the residual; false if it cannot be coded
+bool planResidual(Subframe& sub, uint32_t blockSize) {
+    uint64_t bestBits = UINT64_MAX;
+
+    for (int po = 0; po <= MAX_PARTITION_ORDER; po++) {
+        if (blockSize % (1u << po) != 0) break;
+        uint32_t per = blockSize >> po;
+        if (per <= (uint32_t)sub.order) break;
+
+        std::vector<Partition> parts;
+        uint64_t bits = 2 + 4;
+        bool wide = false;
+        size_t index = 0;
+        for (uint32_t part = 0; part < (1u << po); part++) {
+            uint32_t count = (part == 0) ? per - sub.order : per;
+            const int32_t* r = &sub.residual[index];
+            uint64_t sum = 0;
+            int32_t low = 0, high = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                sum += zigzag(r[i]);
+                low = std::min(low, r[i]);
+                high = std::max(high, r[i]);
+            }
+
+            // The cost is convex in k and lowest near log2 of the mean
+            int estimate = 0;
+            while (estimate < 30 && ((uint64_t)count << (estimate + 1)) <= sum) estimate++;
+            uint64_t best = UINT64_MAX;
+            Partition choice = { 0, false };
+            for (int k = std::max(0, estimate - 1); k <= std::min(30, estimate + 1); k++) {
+                uint64_t cost = (uint64_t)count * (k + 1);
+                for (uint32_t i = 0; i < count && cost < best; i++) cost += zigzag(r[i]) >> k;
+                if (cost < best) {
+                    best = cost;
+                    choice = { (uint32_t)k, false };
+                }
+            }
+
+            int raw = std::max(signedBits(low), signedBits(high));
+            if (5 + (uint64_t)count * raw < best) {
+                best = 5 + (uint64_t)count * raw;
+                choice = { (uint32_t)raw, true };
+            }
+            if (!choice.escaped && choice.param > 14) wide = true;
+            bits += best;
+            parts.push_back(choice);
+            index += count;
+        }
+        bits += (uint64_t)parts.size() * (wide ? 5 : 4);
+
+        if (bits < bestBits) {
+            bestBits = bits;
+            sub.partitionOrder = po;
+            sub.partitions = parts;
+            sub.method = wide ? 1 : 0;
+        }
+    }
+
+    if (bestBits == UINT64_MAX) return false;
+    sub.bits += bestBits;
+    return true;
+}
+
+bool fixedResidual(const int32_t* x, uint32_t n, int order, std::vector<int32_t>& residual) {
+    residual.clear();
+    for (uint32_t i = order; i < n; i++) {
+        int64_t r;
+        switch (order) {
+            case 0: r = x[i]; break;
+            case 1: r = (int64_t)x[i] - x[i - 1]; break;
+            case 2: r = (int64_t)x[i] - 2LL * x[i - 1] + x[i - 2]; break;
+            case 3: r = (int64_t)x[i] - 3LL * x[i - 1] + 3LL * x[i - 2] - x[i - 3]; break;
+            default: r = (int64_t)x[i] - 4LL * x[i - 1] + 6LL * x[i - 2] - 4LL * x[i - 3] + x[i - 4]; break;
+        }
+        if (r < -(1LL << 30) || r >= (1LL << 30)) return false;
+        residual.push_back((int32_t)r);
+    }
+    return true;
+}
+
+// Windowed autocorrelation and Levinson-Durbin, quantized the way the
+// decoder reads it back
+bool lpcCoefficients(const int32_t* x, uint32_t n, int order, std::vector<int32_t>& coefs, int& shift) {
+    if (n <= (uint32_t)order * 2) return false;
+
+    std::vector<double> w(n);
+    for (uint32_t i = 0; i < n; i++) w[i] = x[i] * (0.5 - 0.5 * cos(2.0 * M_PI * (i + 0.5) / n));
+
+    std::vector<double> r(order + 1, 0.0);
+    for (int lag = 0; lag <= order; lag++) {
+        for (uint32_t i = lag; i < n; i++) r[lag] += w[i] * w[i - lag];
+    }
+    if (r[0] <= 0.0) return false;
+    r[0] *= 1.0 + 1e-9;
+
+    std::vector<double> a(order + 1, 0.0);
+    std::vector<double> previous(order + 1, 0.0);
+    double error = r[0];
+    for (int i = 1; i <= order; i++) {
+        double k = r[i];
+        for (int j = 1; j < i; j++) k -= a[j] * r[i - j];
+        k /= error;
+        previous = a;
+        a[i] = k;
+        for (int j = 1; j < i; j++) a[j] = previous[j] - k * previous[i - j];
+        error *= 1.0 - k * k;
+        if (error <= 0.0) return false;
+    }
+
+    double peak = 0.0;
+    for (int j = 1; j <= order; j++) peak = std::max(peak, fabs(a[j]));
+    int exponent;
+    frexp(peak, &exponent);
+    shift = std::min(15, LPC_PRECISION - 1 - exponent);
+    if (shift < 0) return false;
+
+    const int32_t limit = (1 << (LPC_PRECISION - 1)) - 1;
+    coefs.assign(order, 0);
+    double carry = 0.0;
+    for (int j = 0; j < order; j++) {
+        double value = a[j + 1] * (1 << shift) + carry;
+        int32_t q = (int32_t)lround(value);
+        q = std::max(-limit - 1, std::min(limit, q));
+        carry = value - q;
+        coefs[j] = q;
+    }
+    return true;
+}
+
+bool lpcResidual(const int32_t* x, uint32_t n, const std::vector<int32_t>& coefs, int shift,
+                 std::vector<int32_t>& residual) {
+    int order = (int)coefs.size();
+    residual.clear();
+    for (uint32_t i = order; i < n; i++) {
+        int64_t sum = 0;
+        for (int j = 0; j < order; j++) sum += (int64_t)coefs[j] * x[i - 1 - j];
+        int64_t r = (int64_t)x[i] - (sum >> shift);
+        if (r < -(1LL << 30) || r >= (1LL << 30)) return false;
+        residual.push_back((int32_t)r);
+    }
+    return true;
+}
+
+Subframe planSubframe(const int32_t* x, uint32_t n, int sampleBits) {
+    Subframe best;
+    best.type = SUB_VERBATIM;
+    best.bits = 8 + (uint64_t)n * sampleBits;
+
+    bool constant = true;
+    for (uint32_t i = 1; i < n && constant; i++) constant = (x[i] == x[0]);
+    if (constant) {
+        Subframe sub;
+        sub.type = SUB_CONSTANT;
+        sub.bits = 8 + sampleBits;
+        return sub;
+    }
+
+    for (int order = 0; order <= 4; order++) {
+        Subframe sub;
+        sub.type = SUB_FIXED;
+        sub.order = order;
+        sub.bits = 8 + (uint64_t)order * sampleBits;
+        if (!fixedResidual(x, n, order, sub.residual) || !planResidual(sub, n)) continue;
+        if (sub.bits < best.bits) best = sub;
+    }
+
+    static const int LPC_ORDERS[] = { 8, 12 };
+    for (int order : LPC_ORDERS) {
+        Subframe sub;
+        sub.type = SUB_LPC;
+        sub.order = order;
+        if (!lpcCoefficients(x, n, order, sub.coefs, sub.shift)) continue;
+        sub.bits = 8 + (uint64_t)order * sampleBits + 4 + 5 + (uint64_t)order * LPC_PRECISION;
+        if (!lpcResidual(x, n, sub.coefs, sub.shift, sub.residual) || !planResidual(sub, n)) continue;
+        if (sub.bits < best.bits) best = sub;
+    }
+
+    return best;
+}
+
+void writeResidual(BitWriter& bits, const Subframe& sub, uint32_t blockSize) {
+    bits.put(sub.method, 2);
+    bits.put(sub.partitionOrder, 4);
+    int paramBits = sub.method == 0 ? 4 : 5;
+    uint32_t escape = sub.method == 0 ? 15 : 31;
+
+    uint32_t per = blockSize >> sub.partitionOrder;
+    size_t index = 0;
+    for (size_t part = 0; part < sub.partitions.size(); part++) {
+        uint32_t count = (part == 0) ? per - sub.order : per;
+        const Partition& p = sub.partitions[part];
+        if (p.escaped) {
+            bits.put(escape, paramBits);
+            bits.put(p.param, 5);
+            for (uint32_t i = 0; i < count; i++) bits.putSigned(sub.residual[index + i], p.param);
+        } else {
+            bits.put(p.param, paramBits);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t u = zigzag(sub.residual[index + i]);
+                bits.putUnary(u >> p.param);
+                bits.put(u, p.param);
+            }
+        }
+        index += count;
+    }
+}
+
+void writeSubframe(BitWriter& bits, const Subframe& sub, const int32_t* x, uint32_t n, int sampleBits,
+                   FlacWriterStats& stats) {
+    switch (sub.type) {
+        case SUB_CONSTANT:
+            bits.put(0x00, 8);
+            bits.putSigned(x[0], sampleBits);
+            stats.constant++;
+            break;
+        case SUB_VERBATIM:
+            bits.put(0x02, 8);
+            for (uint32_t i = 0; i < n; i++) bits.putSigned(x[i], sampleBits);
+            stats.verbatim++;
+            break;
+        case SUB_FIXED:
+            bits.put((8 + sub.order) << 1, 8);
+            for (int i = 0; i < sub.order; i++) bits.putSigned(x[i], sampleBits);
+            writeResidual(bits, sub, n);
+            stats.fixed++;
+            break;
+        case SUB_LPC:
+            bits.put((32 + sub.order - 1) << 1, 8);
+            for (int i = 0; i < sub.order; i++) bits.putSigned(x[i], sampleBits);
+            bits.put(LPC_PRECISION - 1, 4);
+            bits.putSigned(sub.shift, 5);
+            for (int c : sub.coefs) bits.putSigned(c, LPC_PRECISION);
+            writeResidual(bits, sub, n);
+            stats.lpc++;
+            break;
+    }
+}
+
+void putUtf8(std::vector<uint8_t>& out, uint32_t v) {
+    if (v < 0x80) {
+        out.push_back((uint8_t)v);
+    } else if (v < 0x800) {
+        out.push_back((uint8_t)(0xC0 | (v >> 6)));
+        out.push_back((uint8_t)(0x80 | (v & 0x3F)));
+    } else if (v < 0x10000) {
+        out.push_back((uint8_t)(0xE0 | (v >> 12)));
+        out.push_back((uint8_t)(0x80 | ((v >> 6) & 0x3F)));
+        out.push_back((uint8_t)(0x80 | (v & 0x3F)));
+    } else {
+        out.push_back((uint8_t)(0xF0 | (v >> 18)));
+        out.push_back((uint8_t)(0x80 | ((v >> 12) & 0x3F)));
+        out.push_back((uint8_t)(0x80 | ((v >> 6) & 0x3F)));
+        out.push_back((uint8_t)(0x80 | (v & 0x3F)));
+    }
+}
+
+void putFrameHeader(std::vector<uint8_t>& out, const FlacSource& source, uint32_t blockSize,
+                    uint32_t frameNumber, int assignment) {
+    size_t start = out.size();
+
+    uint8_t blockCode;
+    if (blockSize == 192) blockCode = 1;
+    else if (blockSize == 576 || blockSize == 1152 || blockSize == 2304 || blockSize == 4608)
+        blockCode = (uint8_t)(2 + log2(blockSize / 576));
+    else if (blockSize >= 256 && blockSize <= 32768 && (blockSize & (blockSize - 1)) == 0)
+        blockCode = (uint8_t)(8 + log2(blockSize / 256));
+    else if (blockSize <= 256) blockCode = 6;
+    else blockCode = 7;
+
+    uint8_t rateCode = source.sampleRate == 48000 ? 10 : 9;
+    uint8_t sizeCode = source.bitsPerSample == 8 ? 1 : source.bitsPerSample == 12 ? 2 :
+                       source.bitsPerSample == 16 ? 4 : source.bitsPerSample == 20 ? 5 : 6;
+
+    out.push_back(0xFF);
+    out.push_back(0xF8);
+    out.push_back((uint8_t)((blockCode << 4) | rateCode));
+    out.push_back((uint8_t)((assignment << 4) | (sizeCode << 1)));
+    putUtf8(out, frameNumber);
+    if (blockCode == 6) out.push_back((uint8_t)(blockSize - 1));
+    if (blockCode == 7) {
+        out.push_back((uint8_t)((blockSize - 1) >> 8));
+        out.push_back((uint8_t)(blockSize - 1));
+    }
+    out.push_back(crc8(&out[start], out.size() - start));
+}
+
+void putBlockHeader(std::vector<uint8_t>& out, bool last, uint8_t type, uint32_t length) {
+    out.push_back((uint8_t)((last ? 0x80 : 0) | type));
+    out.push_back((uint8_t)(length >> 16));
+    out.push_back((uint8_t)(length >> 8));
+    out.push_back((uint8_t)length);
+}
+
+void putLe32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+}  // namespace
+
+std::vector<uint8_t> encodeFlac(const FlacSource& source, const FlacWriterOptions& options,
+                                FlacWriterStats& stats) {
+    stats = FlacWriterStats();
+
+    // Frames first: STREAMINFO needs their sizes
+    std::vector<uint8_t> frames;
+    std::vector<uint32_t> frameStarts;
+    uint32_t minFrame = UINT32_MAX;
+    uint32_t maxFrame = 0;
+
+    size_t total = source.frames();
+    std::vector<int32_t> ch[4];
+    for (uint32_t number = 0; (size_t)number * source.blockSize < total; number++) {
+        size_t first = (size_t)number * source.blockSize;
+        uint32_t n = (uint32_t)std::min((size_t)source.blockSize, total - first);
+
+        for (int c = 0; c < 4; c++) ch[c].assign(n, 0);
+        for (uint32_t i = 0; i < n; i++) {
+            for (int c = 0; c < source.channels; c++) ch[c][i] = source.samples[(first + i) * source.channels + c];
+        }
+
+        int bps = source.bitsPerSample;
+        int assignment = source.channels - 1;
+        Subframe plan[2];
+        const int32_t* data[2] = { ch[0].data(), ch[1].data() };
+        int bits[2] = { bps, bps };
+
+        if (source.channels == 1) {
+            plan[0] = planSubframe(ch[0].data(), n, bps);
+        } else {
+            // ch[2] = side, ch[3] = mid
+            for (uint32_t i = 0; i < n; i++) {
+                ch[2][i] = ch[0][i] - ch[1][i];
+                ch[3][i] = (ch[0][i] + ch[1][i]) >> 1;
+            }
+            Subframe left = planSubframe(ch[0].data(), n, bps);
+            Subframe right = planSubframe(ch[1].data(), n, bps);
+            Subframe side = planSubframe(ch[2].data(), n, bps + 1);
+            Subframe mid = planSubframe(ch[3].data(), n, bps);
+
+            uint64_t independent = left.bits + right.bits;
+            uint64_t leftSide = left.bits + side.bits;
+            uint64_t sideRight = side.bits + right.bits;
+            uint64_t midSide = mid.bits + side.bits;
+            uint64_t best = std::min(std::min(independent, leftSide), std::min(sideRight, midSide));
+
+            if (best == independent) {
+                assignment = 1;
+                plan[0] = left;
+                plan[1] = right;
+            } else if (best == leftSide) {
+                assignment = 8;
+                plan[0] = left;
+                plan[1] = side;
+                data[1] = ch[2].data();
+                bits[1] = bps + 1;
+            } else if (best == sideRight) {
+                assignment = 9;
+                plan[0] = side;
+                plan[1] = right;
+                data[0] = ch[2].data();
+                bits[0] = bps + 1;
+            } else {
+                assignment = 10;
+                plan[0] = mid;
+                plan[1] = side;
+                data[0] = ch[3].data();
+                data[1] = ch[2].data();
+                bits[1] = bps + 1;
+            }
+            if (assignment >= 8) stats.sideCoded++;
+        }
+
+        size_t start = frames.size();
+        frameStarts.push_back((uint32_t)start);
+        putFrameHeader(frames, source, n, number, assignment);
+
+        BitWriter writer(frames);
+        for (int c = 0; c < source.channels; c++) writeSubframe(writer, plan[c], data[c], n, bits[c], stats);
+        writer.align();
+
+        uint16_t crc = crc16(&frames[start], frames.size() - start);
+        frames.push_back((uint8_t)(crc >> 8));
+        frames.push_back((uint8_t)crc);
+
+        uint32_t size = (uint32_t)(frames.size() - start);
+        minFrame = std::min(minFrame, size);
+        maxFrame = std::max(maxFrame, size);
+    }
+
+    std::vector<uint8_t> out;
+    if (options.id3) {
+        // ID3v2.4 header and an empty (all padding) body
+        const uint32_t body = 1000;
+        const uint8_t header[10] = {
+            'I', 'D', '3', 4, 0, 0,
+            (uint8_t)((body >> 21) & 0x7F), (uint8_t)((body >> 14) & 0x7F),
+            (uint8_t)((body >> 7) & 0x7F), (uint8_t)(body & 0x7F)
+        };
+        out.insert(out.end(), header, header + 10);
+        out.resize(out.size() + body, 0);
+    }
+
+    out.insert(out.end(), { 'f', 'L', 'a', 'C' });
+
+    bool haveComments = !options.comments.empty();
+    bool havePadding = options.padding > 0;
+
+    putBlockHeader(out, !haveComments && !havePadding, 0, 34);
+    out.push_back((uint8_t)(source.blockSize >> 8));
+    out.push_back((uint8_t)source.blockSize);
+    out.push_back((uint8_t)(source.blockSize >> 8));
+    out.push_back((uint8_t)source.blockSize);
+    for (uint32_t size : { minFrame, maxFrame }) {
+        out.push_back((uint8_t)(size >> 16));
+        out.push_back((uint8_t)(size >> 8));
+        out.push_back((uint8_t)size);
+    }
+    uint64_t packed = ((uint64_t)source.sampleRate << 44) | ((uint64_t)(source.channels - 1) << 41) |
+                      ((uint64_t)(source.bitsPerSample - 1) << 36) | (uint64_t)total;
+    for (int i = 7; i >= 0; i--) out.push_back((uint8_t)(packed >> (8 * i)));
+    out.resize(out.size() + 16, 0);     // No MD5
+
+    if (haveComments) {
+        const std::string vendor = "songbird host";
+        uint32_t length = 4 + (uint32_t)vendor.size() + 4;
+        for (const std::string& c : options.comments) length += 4 + (uint32_t)c.size();
+        putBlockHeader(out, !havePadding, 4, length);
+        putLe32(out, (uint32_t)vendor.size());
+        out.insert(out.end(), vendor.begin(), vendor.end());
+        putLe32(out, (uint32_t)options.comments.size());
+        for (const std::string& c : options.comments) {
+            putLe32(out, (uint32_t)c.size());
+            out.insert(out.end(), c.begin(), c.end());
+        }
+    }
+
+    if (havePadding) {
+        putBlockHeader(out, true, 1, options.padding);
+        out.resize(out.size() + options.padding, 0);
+    }
+
+    uint32_t base = (uint32_t)out.size();
+    for (uint32_t start : frameStarts) stats.frameOffsets.push_back(base + start);
+    out.insert(out.end(), frames.begin(), frames.end());
+    return out;
+}
@@ -0,0 +1,49 @@
+/*
+ * FlacWriter.h - Small FLAC encoder for roadtrip decoder fixtures
+ *
+ * Writes the streams play_sd_flac.h has to decode, so the bench needs no
+ * flac tool: STREAMINFO, a VORBIS_COMMENT block, padding large enough
+ * that the player has to seek past it, and optionally an ID3v2 tag in
+ * front. Each subframe is whichever of CONSTANT, VERBATIM, FIXED (orders
+ * 0-4) and LPC (orders 8 and 12, 12-bit coefficients) codes smallest,
+ * with Rice partitions (and escapes) chosen per subframe, and stereo
+ * frames pick the cheapest of independent, left/side, side/right and
+ * mid/side. That covers every path in the decoder.
+ */
+
+#ifndef SONGBIRD_HOST_FLACWRITER_H
+#define SONGBIRD_HOST_FLACWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct FlacSource {
+    uint32_t sampleRate = 44100;
+    uint8_t channels = 2;
+    uint8_t bitsPerSample = 16;
+    uint32_t blockSize = 4096;
+    std::vector<int32_t> samples;   // Interleaved, at bitsPerSample
+
+    size_t frames() const { return channels ? samples.size() / channels : 0; }
+};
+
+struct FlacWriterOptions {
+    std::vector<std::string> comments;   // "NAME=value"
+    bool id3 = false;                    // ID3v2 tag in front of "fLaC"
+    uint32_t padding = 40000;            // PADDING block bytes
+};
+
+struct FlacWriterStats {
+    uint32_t constant = 0;      // Subframes of each type
+    uint32_t verbatim = 0;
+    uint32_t fixed = 0;
+    uint32_t lpc = 0;
+    uint32_t sideCoded = 0;     // Frames with a side channel
+    std::vector<uint32_t> frameOffsets;   // File offset of each frame
+};
+
+std::vector<uint8_t> encodeFlac(const FlacSource& source, const FlacWriterOptions& options,
+                                FlacWriterStats& stats);
+
+#endif
@@ -0,0 +1,649 @@
+/*
+ * RoadtripBench.cpp - Roadtrip's FLAC and Ogg Opus players on the host
+ *
+ *   roadtrip_bench <workdir> [flac|resampler|opus...]
+ *                                      JSON lines on stdout, exit 1 on failure
+ *
+ * Runs the sketch's own players (play_sd_flac.h, play_sd_opus.h and
+ * play_sd_stream.h, unchanged) on the SD shim, with generated files on a
+ * card under <workdir>: pump() as loop() calls it, update() as the audio
+ * interrupt does, every block collected.
+ *
+ *   flac       streams from FlacWriter (16 and 24 bit, mono and stereo,
+ *              44.1 and 48 kHz, several block sizes, an ID3 tag in front)
+ *              must decode bit-exact: the source reduced to 16 bits, and
+ *              at 48 kHz put through Resampler48To44 on its own. Also
+ *              checked: the REPLAYGAIN comment reaches tagGain(), and a
+ *              resume from the middle of a frame picks up bit-exact at
+ *              the next one.
+ *   resampler  Resampler48To44 on 48 kHz sines: gain through the
+ *              passband, what is left besides the tone (residual_db) and
+ *              how far down tones between 22.05 and 24 kHz come out once
+ *              they fold back below 22.05 kHz (alias_db). Fails if the
+ *              passband to 17 kHz is not flat to 0.1 dB or an alias is
+ *              above -40 dB. The filter is -6 dB at its 19.5 kHz cutoff,
+ *              so 18-20 kHz is rolled off on purpose.
+ *   opus       an Ogg Opus file from libopus (128 kb/s, packets spanning
+ *              pages, an R128_TRACK_GAIN tag): output length against
+ *              the source, SNR against the source resampled the same
+ *              way, the tag gain, and a resume from the middle of the
+ *              file. Needs libopus at configure time.
+ *
+ * Cost: host_us_per_audio_s is the time spent in playFrom() and pump()
+ * per second of audio out, the figure roadtrip prints as "Decode:" on
+ * Serial. It is host time, good for comparing formats and changes on one
+ * machine; it says nothing about a Teensy's CPU.
+ *
+ * Every run is deterministic.
+ */
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <SD.h>
+#include "play_sd_flac.h"
+#ifdef ROADTRIP_HOST_OPUS
+#include "play_sd_opus.h"
+#endif
+#include "FlacWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <math.h>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define PLAY_BLOCKS_PER_PUMP    16      // Audio blocks per loop() pass, ~46 ms
+#define PLAY_STALL_PASSES     1000
+
+static int failures = 0;
+
+static uint32_t benchRandom = 12345;
+
+static uint32_t nextRandom() {
+    benchRandom ^= benchRandom << 13;
+    benchRandom ^= benchRandom >> 17;
+    benchRandom ^= benchRandom << 5;
+    return benchRandom;
+}
+
+static double uniform() {
+    return (nextRandom() >> 8) * (1.0 / 16777216.0) * 2.0 - 1.0;
+}
+
+static double hostMicrosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ============================================================
+// Test Material
+// ============================================================
+
+// Stereo "music" at any rate and bit depth: chords of harmonic tones that
+// change every 1.5 s, a noise bed, half a second of digital silence and a
+// passage driven into full-scale clipping. The channels share most of
+// their content, as real mixes do.
+static std::vector<int32_t> musicLike(uint32_t frames, uint32_t rate, int channels, int bits, uint32_t seed) {
+    static const double CHORDS[][3] = {
+        { 220.0, 277.18, 329.63 }, { 196.0, 246.94, 293.66 },
+        { 174.61, 220.0, 261.63 }, { 164.81, 207.65, 246.94 },
+    };
+
+    benchRandom = seed;
+    const double full = (double)((1 << (bits - 1)) - 1);
+    std::vector<int32_t> out((size_t)frames * channels);
+    double phase[3][6] = {};
+    double noise[2] = {};
+
+    for (uint32_t i = 0; i < frames; i++) {
+        double t = (double)i / rate;
+        int chord = (int)(t / 1.5) % 4;
+        double envelope = 0.6 + 0.4 * sin(2.0 * M_PI * 0.7 * t);
+        bool silent = t >= 3.0 && t < 3.5;
+        double drive = (t >= 5.0 && t < 5.5) ? 3.0 : 1.0;
+
+        double tone = 0.0;
+        for (int n = 0; n < 3; n++) {
+            for (int h = 0; h < 6; h++) {
+                phase[n][h] += 2.0 * M_PI * CHORDS[chord][n] * (h + 1) / rate;
+                tone += sin(phase[n][h]) * 0.12 / (h + 1);
+            }
+        }
+
+        for (int c = 0; c < channels; c++) {
+            // Low-passed noise, different in each channel
+            noise[c] = 0.9 * noise[c] + 0.1 * uniform();
+            double x = (tone * (c == 0 ? 1.0 : 0.8) + 0.05 * noise[c]) * envelope * drive;
+            x = std::max(-1.0, std::min(1.0, x));
+            int32_t sample = silent ? 0 : (int32_t)lround(x * full + (bits > 16 ? uniform() * 2.0 : 0.0));
+            out[(size_t)i * channels + c] = std::max(-(int32_t)full - 1, std::min((int32_t)full, sample));
+        }
+    }
+    return out;
+}
+
+// What the player hands the audio library: 16-bit stereo
+static std::vector<int16_t> toPlayerPcm(const std::vector<int32_t>& samples, int channels, int bits) {
+    int shift = bits - 16;
+    size_t frames = samples.size() / channels;
+    std::vector<int16_t> out(frames * 2);
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < 2; c++) {
+            int32_t x = samples[i * channels + std::min(c, channels - 1)];
+            out[2 * i + c] = (int16_t)(shift >= 0 ? x >> shift : x << -shift);
+        }
+    }
+    return out;
+}
+
+static std::vector<int16_t> resample(const std::vector<int16_t>& stereo) {
+    static Resampler48To44 resampler;
+    resampler.begin();
+    int frames = (int)(stereo.size() / 2);
+    std::vector<int16_t> out((size_t)Resampler48To44::outputFrames(frames) * 2);
+    int written = resampler.process(stereo.data(), frames, out.data());
+    out.resize((size_t)written * 2);
+    return out;
+}
+
+static bool writeCardFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return fclose(f) == 0 && ok;
+}
+
+// ============================================================
+// Playback
+// ============================================================
+
+// Globals, like the sketch's: the player classes count on zeroed members
+static AudioPlaySdFlac flacPlayer;
+#ifdef ROADTRIP_HOST_OPUS
+static AudioPlaySdOpus opusPlayer;
+#endif
+
+struct Playback {
+    bool started = false;
+    bool stalled = false;
+    std::vector<int16_t> out;       // Stereo, whole blocks
+    double hostMicros = 0.0;
+    bool gainValid = false;
+    float gainDb = 0.0f;
+};
+
+static Playback play(AudioPlaySdStream& player, const char* path, uint32_t byteOffset) {
+    Playback p;
+
+    auto start = std::chrono::steady_clock::now();
+    p.started = player.playFrom(path, byteOffset);
+    p.hostMicros = hostMicrosSince(start);
+    if (!p.started) return p;
+    p.gainValid = player.tagGain(p.gainDb);
+
+    int idle = 0;
+    while (player.isPlaying()) {
+        start = std::chrono::steady_clock::now();
+        player.pump();
+        p.hostMicros += hostMicrosSince(start);
+
+        size_t before = p.out.size();
+        for (int b = 0; b < PLAY_BLOCKS_PER_PUMP && player.isPlaying(); b++) {
+            player.update();
+            audio_block_t* left = player.hostTakeOutput(0);
+            audio_block_t* right = player.hostTakeOutput(1);
+            if (left && right) {
+                for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+                    p.out.push_back(left->data[i]);
+                    p.out.push_back(right->data[i]);
+                }
+            }
+            if (left) AudioStream::release(left);
+            if (right) AudioStream::release(right);
+            if (!left || !right) break;
+        }
+
+        idle = (p.out.size() == before) ? idle + 1 : 0;
+        if (idle >= PLAY_STALL_PASSES) {
+            p.stalled = true;
+            player.stop();
+        }
+    }
+    return p;
+}
+
+struct Comparison {
+    size_t mismatches = 0;      // Samples that differ, counting any length difference
+    long firstMismatch = -1;    // Frame
+};
+
+// got is whole blocks: the tail past want has to be the silence update()
+// pads the last block with
+static Comparison compare(const std::vector<int16_t>& got, const std::vector<int16_t>& want) {
+    Comparison c;
+    size_t wantFrames = want.size() / 2;
+    size_t paddedFrames = (wantFrames + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+
+    for (size_t i = 0; i < std::min(got.size(), paddedFrames * 2); i++) {
+        int16_t expected = (i < want.size()) ? want[i] : 0;
+        if (got[i] != expected) {
+            if (c.firstMismatch < 0) c.firstMismatch = (long)(i / 2);
+            c.mismatches++;
+        }
+    }
+    size_t lengthDifference = (size_t)labs((long)got.size() - (long)(paddedFrames * 2));
+    if (lengthDifference && c.firstMismatch < 0) c.firstMismatch = (long)(std::min(got.size(), paddedFrames * 2) / 2);
+    c.mismatches += lengthDifference;
+    return c;
+}
+
+static double audioSeconds(const Playback& p) {
+    return p.out.size() / 2 / 44100.0;
+}
+
+// ============================================================
+// FLAC
+// ============================================================
+struct FlacCase {
+    const char* name;
+    uint32_t sampleRate;
+    uint8_t channels;
+    uint8_t bitsPerSample;
+    uint32_t blockSize;
+    bool id3;
+};
+
+static const FlacCase FLAC_CASES[] = {
+    { "cd", 44100, 2, 16, 4096, false },
+    { "cd_1152", 44100, 2, 16, 1152, false },
+    { "cd_4608", 44100, 2, 16, 4608, false },
+    { "mono", 44100, 1, 16, 4096, false },
+    { "hires_24", 44100, 2, 24, 4096, true },
+    { "rate_48k", 48000, 2, 16, 4096, false },
+    { "hires_48k_24", 48000, 2, 24, 4608, true },
+};
+
+#define FLAC_SECONDS        8
+#define FLAC_GAIN_COMMENT   "REPLAYGAIN_TRACK_GAIN=-6.50 dB"
+#define FLAC_GAIN_DB        -6.5f
+
+static void runFlac(const std::string& card) {
+    for (const FlacCase& fc : FLAC_CASES) {
+        FlacSource source;
+        source.sampleRate = fc.sampleRate;
+        source.channels = fc.channels;
+        source.bitsPerSample = fc.bitsPerSample;
+        source.blockSize = fc.blockSize;
+        // Not a whole number of blocks, so the last frame is a short one
+        uint32_t frames = fc.sampleRate * FLAC_SECONDS + 1234;
+        source.samples = musicLike(frames, fc.sampleRate, fc.channels, fc.bitsPerSample, 777 + fc.blockSize);
+
+        FlacWriterOptions options;
+        options.comments = { "TITLE=roadtrip bench", FLAC_GAIN_COMMENT };
+        options.id3 = fc.id3;
+        FlacWriterStats stats;
+        std::vector<uint8_t> file = encodeFlac(source, options, stats);
+
+        std::string name = std::string("/flac_") + fc.name + ".flac";
+        if (!writeCardFile(card + name, file)) {
+            fprintf(stderr, "roadtrip_bench: cannot write %s%s\n", card.c_str(), name.c_str());
+            failures++;
+            continue;
+        }
+
+        std::vector<int16_t> want = toPlayerPcm(source.samples, fc.channels, fc.bitsPerSample);
+        if (fc.sampleRate == 48000) want = resample(want);
+
+        Playback p = play(flacPlayer, name.c_str(), 0);
+        Comparison full = compare(p.out, want);
+
+        // Resume from a few bytes before the middle frame: the player has
+        // to find that frame and carry on from its first sample
+        size_t middle = stats.frameOffsets.size() / 2;
+        std::vector<int32_t> tail(source.samples.begin() + middle * fc.blockSize * fc.channels, source.samples.end());
+        std::vector<int16_t> wantTail = toPlayerPcm(tail, fc.channels, fc.bitsPerSample);
+        if (fc.sampleRate == 48000) wantTail = resample(wantTail);
+        Playback resumed = play(flacPlayer, name.c_str(), stats.frameOffsets[middle] - 3);
+        Comparison resume = compare(resumed.out, wantTail);
+
+        bool gainOk = p.gainValid && fabsf(p.gainDb - FLAC_GAIN_DB) < 0.01f;
+        bool ok = p.started && !p.stalled && full.mismatches == 0 &&
+                  resumed.started && !resumed.stalled && resume.mismatches == 0 && gainOk;
+        if (!ok) failures++;
+
+        double rawBytes = (double)source.frames() * fc.channels * fc.bitsPerSample / 8.0;
+        printf("{\"test\":\"flac\",\"case\":\"%s\",\"rate\":%u,\"channels\":%u,\"bits\":%u,\"block\":%u,"
+               "\"id3\":%s,\"frames\":%zu,\"file_bytes\":%zu,\"ratio\":%.3f,"
+               "\"subframes\":{\"constant\":%u,\"verbatim\":%u,\"fixed\":%u,\"lpc\":%u},\"side_coded_frames\":%u,"
+               "\"bit_exact\":%s,\"mismatches\":%zu,\"first_mismatch\":%ld,"
+               "\"tag_gain_db\":%.2f,\"resume_bit_exact\":%s,\"resume_mismatches\":%zu,"
+               "\"host_us_per_audio_s\":%.0f,\"ok\":%s}\n",
+               fc.name, fc.sampleRate, fc.channels, fc.bitsPerSample, fc.blockSize,
+               fc.id3 ? "true" : "false", source.frames(), file.size(), file.size() / rawBytes,
+               stats.constant, stats.verbatim, stats.fixed, stats.lpc, stats.sideCoded,
+               full.mismatches == 0 ? "true" : "false", full.mismatches, full.firstMismatch,
+               p.gainValid ? p.gainDb : 0.0f, resume.mismatches == 0 ? "true" : "false", resume.mismatches,
+               p.hostMicros / std::max(audioSeconds(p), 1e-9), ok ? "true" : "false");
+    }
+}
+
+// ============================================================
+// Resampler
+// ============================================================
+#define RESAMPLER_SECONDS       2
+#define RESAMPLER_AMPLITUDE     16384.0     // -6 dBFS
+#define RESAMPLER_SETTLE        256         // Output frames left out of the fit
+#define PASSBAND_EDGE_HZ        17000.0
+#define PASSBAND_RIPPLE_DB      0.1
+#define ALIAS_LIMIT_DB          -40.0
+
+struct ToneFit {
+    double levelDb;         // Of the tone at the fitted frequency, re the input
+    double residualDb;      // Everything else, re the input tone
+};
+
+// Least-squares fit of a sine at freq to the left channel
+static ToneFit fitTone(const std::vector<int16_t>& stereo, double freq, double rate) {
+    size_t frames = stereo.size() / 2;
+    double ss = 0, sc = 0, cc = 0, xs = 0, xc = 0;
+    for (size_t i = RESAMPLER_SETTLE; i < frames; i++) {
+        double w = 2.0 * M_PI * freq * i / rate;
+        double s = sin(w), c = cos(w), x = stereo[2 * i];
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        xs += x * s;
+        xc += x * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (xs * cc - xc * sc) / det;
+    double b = (xc * ss - xs * sc) / det;
+
+    double residual = 0.0;
+    for (size_t i = RESAMPLER_SETTLE; i < frames; i++) {
+        double w = 2.0 * M_PI * freq * i / rate;
+        double e = stereo[2 * i] - a * sin(w) - b * cos(w);
+        residual += e * e;
+    }
+    residual = sqrt(residual / (frames - RESAMPLER_SETTLE)) * sqrt(2.0);
+
+    ToneFit fit;
+    fit.levelDb = 20.0 * log10(std::max(sqrt(a * a + b * b), 1e-9) / RESAMPLER_AMPLITUDE);
+    fit.residualDb = 20.0 * log10(std::max(residual, 1e-9) / RESAMPLER_AMPLITUDE);
+    return fit;
+}
+
+static std::vector<int16_t> sine48k(double freq, uint32_t frames) {
+    std::vector<int16_t> out((size_t)frames * 2);
+    for (uint32_t i = 0; i < frames; i++) {
+        int16_t x = (int16_t)lround(RESAMPLER_AMPLITUDE * sin(2.0 * M_PI * freq * i / 48000.0));
+        out[2 * i] = x;
+        out[2 * i + 1] = x;
+    }
+    return out;
+}
+
+static void runResampler() {
+    static const double PASSBAND[] = {
+        20, 50, 100, 200, 500, 1000, 2000, 5000, 8000, 10000, 12000,
+        14000, 15000, 16000, 17000, 18000, 19000, 20000
+    };
+    static const double ALIASES[] = { 22100, 22300, 22600, 23000, 23500, 23900 };
+
+    const uint32_t frames = 48000 * RESAMPLER_SECONDS;
+    double low = 1e9, high = -1e9, worstResidual = -1e9;
+
+    for (double freq : PASSBAND) {
+        ToneFit fit = fitTone(resample(sine48k(freq, frames)), freq, 44100.0);
+        if (freq <= PASSBAND_EDGE_HZ) {
+            low = std::min(low, fit.levelDb);
+            high = std::max(high, fit.levelDb);
+            worstResidual = std::max(worstResidual, fit.residualDb);
+        }
+        printf("{\"test\":\"resampler\",\"kind\":\"passband\",\"freq_hz\":%.0f,\"gain_db\":%.3f,\"residual_db\":%.1f}\n",
+               freq, fit.levelDb, fit.residualDb);
+    }
+
+    double worstAlias = -1e9;
+    for (double freq : ALIASES) {
+        double folded = 44100.0 - freq;
+        ToneFit fit = fitTone(resample(sine48k(freq, frames)), folded, 44100.0);
+        worstAlias = std::max(worstAlias, fit.levelDb);
+        printf("{\"test\":\"resampler\",\"kind\":\"alias\",\"freq_hz\":%.0f,\"folded_hz\":%.0f,\"alias_db\":%.1f}\n",
+               freq, folded, fit.levelDb);
+    }
+
+    // Cost of the resampler alone, on 10 s of stereo music
+    std::vector<int32_t> music = musicLike(480000, 48000, 2, 16, 99);
+    std::vector<int16_t> pcm = toPlayerPcm(music, 2, 16);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int16_t> out = resample(pcm);
+    double micros = hostMicrosSince(start);
+
+    double ripple = std::max(high, -low);
+    bool ok = ripple <= PASSBAND_RIPPLE_DB && worstAlias <= ALIAS_LIMIT_DB;
+    if (!ok) failures++;
+    printf("{\"test\":\"resampler\",\"kind\":\"summary\",\"passband_hz\":%.0f,\"ripple_db\":%.3f,"
+           "\"worst_residual_db\":%.1f,\"worst_alias_db\":%.1f,\"host_us_per_audio_s\":%.0f,\"ok\":%s}\n",
+           PASSBAND_EDGE_HZ, ripple, worstResidual, worstAlias, micros / (out.size() / 2 / 44100.0),
+           ok ? "true" : "false");
+}
+
+// ============================================================
+// Ogg Opus
+// ============================================================
+#ifdef ROADTRIP_HOST_OPUS
+
+#define OPUS_SECONDS        8
+#define OPUS_BITRATE        128000
+#define OPUS_FRAME          960         // 20 ms at 48 kHz
+#define OPUS_GAIN_COMMENT   "R128_TRACK_GAIN=-2560"
+#define OPUS_GAIN_DB        -5.0f       // -10 dB re -23 LUFS is -5 re -18
+
+class OggWriter {
+public:
+    explicit OggWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    // A page of its own, as the Opus header packets need
+    void headerPacket(const std::vector<uint8_t>& packet, bool first) {
+        addPacket(packet, 0);
+        flush(first ? 0x02 : 0x00);
+    }
+
+    // Pages fill up to 255 segments, so packets carry over between them
+    void addPacket(const std::vector<uint8_t>& packet, uint64_t granule) {
+        size_t pos = 0;
+        while (true) {
+            int length = (int)std::min<size_t>(255, packet.size() - pos);
+            lacing.push_back((uint8_t)length);
+            body.insert(body.end(), packet.begin() + pos, packet.begin() + pos + length);
+            pos += length;
+            bool last = length < 255;
+            if (last) {
+                pageGranule = granule;
+                completed = true;
+            }
+            if (lacing.size() == 255) flush(0x00);
+            if (last) break;
+        }
+    }
+
+    void finish() { flush(0x04); }
+
+private:
+    std::vector<uint8_t>& out;
+    std::vector<uint8_t> lacing;
+    std::vector<uint8_t> body;
+    uint64_t pageGranule = 0;
+    bool completed = false;
+    bool continued = false;
+    uint32_t sequence = 0;
+
+    static uint32_t crc(const uint8_t* p, size_t n) {
+        uint32_t c = 0;
+        while (n--) {
+            c ^= (uint32_t)(*p++) << 24;
+            for (int i = 0; i < 8; i++) c = (c & 0x80000000u) ? (c << 1) ^ 0x04C11DB7u : (c << 1);
+        }
+        return c;
+    }
+
+    void flush(uint8_t flags) {
+        if (lacing.empty() && !(flags & 0x04)) return;
+
+        size_t start = out.size();
+        out.insert(out.end(), { 'O', 'g', 'g', 'S', 0 });
+        out.push_back((uint8_t)(flags | (continued ? 0x01 : 0x00)));
+        uint64_t granule = completed ? pageGranule : UINT64_MAX;
+        for (int i = 0; i < 8; i++) out.push_back((uint8_t)(granule >> (8 * i)));
+        for (uint32_t v : { 0x50D0B12Du, sequence++, 0u }) {
+            for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+        }
+        out.push_back((uint8_t)lacing.size());
+        out.insert(out.end(), lacing.begin(), lacing.end());
+        out.insert(out.end(), body.begin(), body.end());
+
+        uint32_t c = crc(&out[start], out.size() - start);
+        for (int i = 0; i < 4; i++) out[start + 22 + i] = (uint8_t)(c >> (8 * i));
+
+        // A page ending on a 255 lacing value leaves its packet open
+        continued = !lacing.empty() && lacing.back() == 255;
+        lacing.clear();
+        body.clear();
+        completed = false;
+    }
+};
+
+static void putLe(std::vector<uint8_t>& v, uint32_t x, int bytes) {
+    for (int i = 0; i < bytes; i++) v.push_back((uint8_t)(x >> (8 * i)));
+}
+
+static double snrDb(const std::vector<int16_t>& got, const std::vector<int16_t>& want, size_t skipFrames) {
+    double signal = 0.0, noise = 0.0;
+    size_t n = std::min(got.size(), want.size());
+    for (size_t i = skipFrames * 2; i < n; i++) {
+        double e = (double)got[i] - want[i];
+        signal += (double)want[i] * want[i];
+        noise += e * e;
+    }
+    return 10.0 * log10(std::max(signal, 1.0) / std::max(noise, 1.0));
+}
+
+static void runOpus(const std::string& card) {
+    const uint32_t frames = 48000 * OPUS_SECONDS + 777;
+    std::vector<int16_t> source = toPlayerPcm(musicLike(frames, 48000, 2, 16, 4242), 2, 16);
+
+    int err;
+    OpusEncoder* encoder = opus_encoder_create(48000, 2, OPUS_APPLICATION_AUDIO, &err);
+    if (err != OPUS_OK) {
+        fprintf(stderr, "roadtrip_bench: opus_encoder_create failed (%d)\n", err);
+        failures++;
+        return;
+    }
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(OPUS_BITRATE));
+    opus_int32 lookahead = 0;
+    opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+
+    std::vector<uint8_t> file;
+    OggWriter ogg(file);
+
+    std::vector<uint8_t> head = { 'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 2 };
+    putLe(head, (uint32_t)lookahead, 2);
+    putLe(head, 48000, 4);
+    putLe(head, 0, 2);      // Output gain
+    head.push_back(0);      // Mapping family 0
+    ogg.headerPacket(head, true);
+
+    std::vector<uint8_t> tags = { 'O', 'p', 'u', 's', 'T', 'a', 'g', 's' };
+    const std::string vendor = "songbird host";
+    const std::string comment = OPUS_GAIN_COMMENT;
+    putLe(tags, (uint32_t)vendor.size(), 4);
+    tags.insert(tags.end(), vendor.begin(), vendor.end());
+    putLe(tags, 1, 4);
+    putLe(tags, (uint32_t)comment.size(), 4);
+    tags.insert(tags.end(), comment.begin(), comment.end());
+    ogg.headerPacket(tags, false);
+
+    // The lookahead worth of silence at the end flushes the encoder
+    std::vector<int16_t> padded = source;
+    uint32_t packets = (frames + lookahead + OPUS_FRAME - 1) / OPUS_FRAME;
+    padded.resize((size_t)packets * OPUS_FRAME * 2, 0);
+    uint64_t granule = 0;
+    std::vector<uint8_t> packet(4000);
+    for (uint32_t i = 0; i < packets; i++) {
+        int bytes = opus_encode(encoder, &padded[(size_t)i * OPUS_FRAME * 2], OPUS_FRAME, packet.data(), (int)packet.size());
+        if (bytes <= 0) break;
+        granule += OPUS_FRAME;
+        ogg.addPacket(std::vector<uint8_t>(packet.begin(), packet.begin() + bytes), granule);
+    }
+    ogg.finish();
+    opus_encoder_destroy(encoder);
+
+    const char* name = "/opus_music.opus";
+    if (!writeCardFile(card + name, file)) {
+        fprintf(stderr, "roadtrip_bench: cannot write %s%s\n", card.c_str(), name);
+        failures++;
+        return;
+    }
+
+    std::vector<int16_t> want = resample(source);
+    Playback p = play(opusPlayer, name, 0);
+    Playback resumed = play(opusPlayer, name, (uint32_t)file.size() / 2);
+
+    // Everything the packets hold comes out, the tail of the last one as
+    // well: at least the source, less than a packet more
+    long extra = (long)(p.out.size() / 2) - (long)(want.size() / 2);
+    long packetOut = OPUS_FRAME * 147 / 160 + AUDIO_BLOCK_SAMPLES;
+    bool gainOk = p.gainValid && fabsf(p.gainDb - OPUS_GAIN_DB) < 0.01f;
+    bool ok = p.started && !p.stalled && extra >= 0 && extra < packetOut && gainOk &&
+              resumed.started && !resumed.stalled && !resumed.out.empty();
+    if (!ok) failures++;
+
+    printf("{\"test\":\"opus\",\"kbps\":%.0f,\"pre_skip\":%d,\"frames\":%zu,\"extra_frames\":%ld,"
+           "\"snr_db\":%.1f,\"tag_gain_db\":%.2f,\"resume_frames\":%zu,"
+           "\"host_us_per_audio_s\":%.0f,\"ok\":%s}\n",
+           file.size() * 8.0 / (frames / 48000.0) / 1000.0, (int)lookahead, want.size() / 2, extra,
+           snrDb(p.out, want, OPUS_FRAME), p.gainValid ? p.gainDb : 0.0f, resumed.out.size() / 2,
+           p.hostMicros / std::max(audioSeconds(p), 1e-9), ok ? "true" : "false");
+}
+
+#endif // ROADTRIP_HOST_OPUS
+
+static int usage() {
+    fprintf(stderr, "usage: roadtrip_bench <workdir> [flac|resampler|opus...]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+    std::string card = std::string(argv[1]) + "/card";
+
+    std::vector<std::string> tests;
+    for (int i = 2; i < argc; i++) tests.push_back(argv[i]);
+    if (tests.empty()) tests = { "flac", "resampler", "opus" };
+
+    std::error_code ec;
+    fs::create_directories(card, ec);
+    SD.hostMount(card);
+    if (!SD.begin()) {
+        fprintf(stderr, "roadtrip_bench: cannot use %s as the card\n", card.c_str());
+        return 1;
+    }
+    AudioMemory(8);
+
+    for (const std::string& test : tests) {
+        if (test == "flac") runFlac(card);
+        else if (test == "resampler") runResampler();
+        else if (test == "opus") {
+#ifdef ROADTRIP_HOST_OPUS
+            runOpus(card);
+#else
+            fprintf(stderr, "roadtrip_bench: built without libopus, opus skipped\n");
+#endif
+        }
+        else return usage();
+    }
+    return failures ? 1 : 0;
+}
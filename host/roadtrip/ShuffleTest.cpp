@@ -0,0 +1,155 @@
+/*
+ * ShuffleTest.cpp - Checks on the roadtrip shuffle order (shuffle.h)
+ *
+ *   shuffle_test                       JSON lines on stdout, exit 1 on failure
+ *
+ *   permutation   ShufflePermutation over 1, 2, odd, non-power-of-two and
+ *                 power-of-two track counts up to 2048, several keys each:
+ *                 forward() hits every track exactly once and inverse()
+ *                 undoes it
+ *   epochs        ShuffleQueue seated on a track part way through the
+ *                 list and stepped forward through several epochs (with a
+ *                 different track count in each, as album shuffle does)
+ *                 and back again: the seated track plays first, every
+ *                 epoch (the first included) plays each track once, a
+ *                 queue rejoined from the saved epoch and start lands on
+ *                 the same track at every step, prev retraces next exactly
+ *                 across the epoch boundaries and stops at the seated track
+ */
+
+#include <Arduino.h>
+#include "shuffle.h"
+
+#include <stdio.h>
+#include <vector>
+
+static const uint32_t SIZES[] = {
+    1, 2, 3, 5, 7, 10, 13, 100, 255, 256, 257, 1000, 1023, 1025, 2047, 2048
+};
+static const uint32_t KEYS[] = { 0, 1, 0xDEADBEEF, 0x9E3779B9, 0xFFFFFFFF };
+
+static int failures = 0;
+
+static void fail(const char* test, uint32_t size, const char* what) {
+    fprintf(stderr, "%s: size %u: %s\n", test, (unsigned)size, what);
+    failures++;
+}
+
+static void permutation() {
+    for (uint32_t size : SIZES) {
+        bool ok = true;
+        for (uint32_t key : KEYS) {
+            ShufflePermutation order;
+            order.begin(size, key);
+
+            std::vector<int> seen(size, 0);
+            for (uint32_t position = 0; position < size; position++) {
+                uint32_t item = order.forward(position);
+                if (item >= size) {
+                    fail("permutation", size, "forward() out of range");
+                    ok = false;
+                    break;
+                }
+                seen[item]++;
+                if (order.inverse(item) != position) {
+                    fail("permutation", size, "inverse() does not undo forward()");
+                    ok = false;
+                    break;
+                }
+            }
+            for (uint32_t item = 0; item < size && ok; item++) {
+                if (seen[item] != 1) {
+                    fail("permutation", size, "track played other than once");
+                    ok = false;
+                }
+            }
+        }
+        printf("{\"test\":\"permutation\",\"size\":%u,\"keys\":%zu,\"ok\":%s}\n",
+               (unsigned)size, sizeof(KEYS) / sizeof(KEYS[0]), ok ? "true" : "false");
+    }
+}
+
+struct Step {
+    uint16_t epoch;
+    uint32_t position;
+    uint32_t item;
+};
+
+// Track count of each epoch: album shuffle moves to a different album
+static uint32_t epochSize(uint32_t base, uint16_t epoch) {
+    return base + (epoch % 3) * (base / 2 + 1);
+}
+
+static void epochs() {
+    const int EPOCHS = 5;
+
+    for (uint32_t base : SIZES) {
+        bool ok = true;
+        ShuffleQueue queue;
+        uint32_t seated = epochSize(base, 0) / 2;
+        queue.begin(SHUFFLE_ALBUM, 0x5EED0000 + base, epochSize(base, 0), seated);
+        if (queue.current() != seated) {
+            fail("epochs", base, "the seated track does not play first");
+            ok = false;
+        }
+
+        // Forward through EPOCHS epochs
+        std::vector<Step> path;
+        std::vector<int> seen(epochSize(base, 0), 0);
+        while (true) {
+            path.push_back({ queue.epoch, queue.position, queue.current() });
+            seen[queue.current()]++;
+
+            // What a checkpoint keeps: epoch, start and the playing track
+            ShuffleQueue resumed;
+            resumed.seed = queue.seed;
+            resumed.rejoin(queue.order.size, queue.epoch, queue.start(), queue.current());
+            if (ok && (resumed.position != queue.position || resumed.current() != queue.current())) {
+                fail("epochs", base, "rejoin lands on a different step");
+                ok = false;
+            }
+            if (queue.next()) continue;
+
+            for (int count : seen) {
+                if (count != 1) {
+                    fail("epochs", base, "epoch did not play each track once");
+                    ok = false;
+                    break;
+                }
+            }
+            if (queue.epoch + 1 >= EPOCHS) break;
+            queue.nextEpoch(epochSize(base, queue.epoch + 1));
+            seen.assign(queue.order.size, 0);
+        }
+
+        // And back: prev must visit the same steps in reverse
+        for (size_t i = path.size(); i-- > 0;) {
+            const Step& step = path[i];
+            if (queue.epoch != step.epoch || queue.position != step.position || queue.current() != step.item) {
+                fail("epochs", base, "prev does not retrace next");
+                ok = false;
+                break;
+            }
+            if (i == 0) break;
+            if (!queue.prev() && !queue.prevEpoch(epochSize(base, queue.epoch - 1))) {
+                fail("epochs", base, "prev stopped before the first epoch");
+                ok = false;
+                break;
+            }
+        }
+        // Nothing before the seated track
+        if (ok && (queue.prev() || queue.prevEpoch(epochSize(base, 0)) || queue.current() != seated)) {
+            fail("epochs", base, "prev went past the start");
+            ok = false;
+        }
+
+        printf("{\"test\":\"epochs\",\"size\":%u,\"epochs\":%d,\"steps\":%zu,\"ok\":%s}\n",
+               (unsigned)base, EPOCHS, path.size(), ok ? "true" : "false");
+    }
+}
+
+int main() {
+    permutation();
+    epochs();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+/*
+ * SdBench.cpp - VoiceChat storage throughput and robustness on simulated cards
+ *
+ *   sd_bench <workdir> [card...]       JSON lines on stdout
+ *
+ * Runs the VoiceChat engines (unchanged sketch sources) against the SD
+ * shim's card model, one card preset at a time (ideal, class10, worn by
+ * default; see SdCardModel.h), each on a fresh card under <workdir>:
+ *
+ *   serial_rx     SerialProtocol receiving messages from the bridge at
+ *                 USB speed, one byte per File::write as the sketch does
+ *   record        RecordingEngine encoding and writing a recording from
+ *                 the audio harness; dropped blocks are lost audio
+ *   channel_scan  PlaybackEngine::loadChannelQueue over a full channel,
+ *                 then startPlayback (which reads the first file through
+ *                 to count its packets)
+ *
+ * and then two failure runs on the class10 card:
+ *
+ *   serial_rx_full     the card fills halfway through the messages
+ *   serial_rx_removal  the card is pulled mid-message and put back 2 s later
+ *
+ * record and channel_scan need the Opus engines (libopus at configure
+ * time). Every run is deterministic: the card model is seeded and all
+ * time is virtual.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <Audio.h>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "AudioHarness.h"
+#include "TestSignals.h"
+#include "SerialProtocol.h"
+#ifdef VOICECHAT_HOST_OPUS
+#include "PlaybackEngine.h"
+#include "RecordingEngine.h"
+#endif
+
+namespace fs = std::filesystem;
+
+#define BENCH_LOOP_US           1000    // loop() time outside the engine
+#define BENCH_USB_BYTES_PER_MS  1000    // Bridge to Songbird over USB serial
+#define BENCH_SERIAL_BACKLOG    4096    // Bytes the port holds before the bridge waits
+#define BENCH_MESSAGES          20
+#define BENCH_MESSAGE_BYTES     8000    // About 4 s of 16 kbps Opus
+#define BENCH_RECORD_SECONDS    30
+#define BENCH_SCAN_FILES        50
+#define BENCH_REINSERT_MS       2000
+#define BENCH_USERNAME          "Bench"
+
+static const char* const CARDS[] = {"ideal", "class10", "worn"};
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static uint32_t benchRandom = 12345;
+
+static uint32_t nextRandom() {
+    benchRandom ^= benchRandom << 13;
+    benchRandom ^= benchRandom >> 17;
+    benchRandom ^= benchRandom << 5;
+    return benchRandom;
+}
+
+// Empty card with the VoiceChat directories, stats cleared
+static bool freshCard(const std::string& directory, const SdCardConfig& config) {
+    std::error_code error;
+    fs::remove_all(directory, error);
+    SD.hostConfigure(SdCardConfig());
+    SD.hostMount(directory);
+    SD.mkdir(TX_DIR);
+    for (int channel = 1; channel <= NUM_CHANNELS; channel++) {
+        SD.mkdir((String(RX_DIR_PREFIX) + String(channel)).c_str());
+    }
+    SD.hostConfigure(config);
+    benchRandom = 12345;
+    return SD.begin(SDCARD_CS_PIN);
+}
+
+static void printCall(const std::vector<double>& callUs) {
+    printf("\"call_us_p50\":%.0f,\"call_us_p99\":%.0f,\"call_us_max\":%.0f,",
+           percentile(callUs, 0.5), percentile(callUs, 0.99), percentile(callUs, 1.0));
+}
+
+static void printCard() {
+    const SdCardStats& stats = SD.hostCard().stats();
+    printf("\"sd_write_amplification\":%.3f,\"sd_sectors_written\":%llu,\"sd_metadata_sectors\":%llu,"
+           "\"sd_sectors_read\":%llu,\"sd_clusters\":%u,\"sd_stalls\":%u,\"sd_write_max_us\":%u,"
+           "\"sd_sync_max_us\":%u,\"sd_open_max_us\":%u,\"sd_failed_writes\":%u,\"sd_failed_opens\":%u,"
+           "\"sd_removals\":%u}\n",
+           stats.writeAmplification(SD.hostCard().config().sectorSize),
+           (unsigned long long)stats.sectorsWritten, (unsigned long long)stats.metadataSectorsWritten,
+           (unsigned long long)stats.sectorsRead, stats.clustersAllocated, stats.stalls,
+           stats.maxLatencyUs[SD_OP_WRITE], stats.maxLatencyUs[SD_OP_SYNC], stats.maxLatencyUs[SD_OP_OPEN],
+           stats.failedWrites, stats.failedOpens, stats.removals);
+}
+
+// =============================================================================
+// serial_rx
+// =============================================================================
+
+enum SerialFailure { FAIL_NONE, FAIL_FULL, FAIL_REMOVAL };
+
+static void runSerialRx(const std::string& directory, const char* cardName, SerialFailure failure) {
+    SdCardConfig config;
+    SdCardConfig::preset(cardName, config);
+    config.detectPin = SDCARD_DETECT_PIN;
+    freshCard(directory, config);
+
+    // Framed as the bridge sends them: header, username, payload
+    std::vector<uint8_t> stream;
+    for (int m = 0; m < BENCH_MESSAGES; m++) {
+        uint8_t header[] = {SYNC_BYTE_1, SYNC_BYTE_2,
+                            BENCH_MESSAGE_BYTES & 0xFF, (BENCH_MESSAGE_BYTES >> 8) & 0xFF, 0, 0,
+                            1, (uint8_t)strlen(BENCH_USERNAME)};
+        stream.insert(stream.end(), header, header + sizeof(header));
+        stream.insert(stream.end(), BENCH_USERNAME, BENCH_USERNAME + strlen(BENCH_USERNAME));
+        for (int i = 0; i < BENCH_MESSAGE_BYTES; i++) stream.push_back((uint8_t)nextRandom());
+    }
+
+    SdCardModel& card = SD.hostCard();
+    SdCardConfig failing = card.config();
+    if (failure == FAIL_FULL) {
+        failing.capacityBytes = card.usedBytes() +
+                                (uint64_t)BENCH_MESSAGES / 2 * card.clustersFor(BENCH_MESSAGE_BYTES) * failing.clusterSize;
+    } else if (failure == FAIL_REMOVAL) {
+        failing.removeAfterWrites = (uint32_t)(BENCH_MESSAGES * BENCH_MESSAGE_BYTES * 0.4);
+    }
+    SD.hostConfigure(failing);
+
+    HostStream port;
+    SerialProtocol protocol;
+    protocol.begin(&port);
+
+    std::vector<double> callUs;
+    std::vector<std::string> files;
+    size_t sent = 0;
+    uint64_t start = hostMicros();
+    uint64_t removedAt = 0;
+
+    while (sent < stream.size() || port.available()) {
+        if (port.available() < BENCH_SERIAL_BACKLOG && sent < stream.size()) {
+            size_t chunk = std::min((size_t)BENCH_USB_BYTES_PER_MS * BENCH_LOOP_US / 1000, stream.size() - sent);
+            port.hostPush(stream.data() + sent, chunk);
+            sent += chunk;
+        }
+
+        uint64_t before = hostMicros();
+        if (protocol.processIncoming()) {
+            files.push_back(protocol.getReceivedFilePath());
+            protocol.clearReceivedFile();
+        }
+        callUs.push_back((double)(hostMicros() - before));
+        port.hostTake();
+
+        if (failure == FAIL_REMOVAL && card.stats().removals && !card.present()) {
+            if (!removedAt) removedAt = hostMicros();
+            if (hostMicros() - removedAt >= (uint64_t)BENCH_REINSERT_MS * 1000) SD.hostInsertCard();
+        }
+        hostAdvanceMicros(BENCH_LOOP_US);
+    }
+    double elapsedMs = (hostMicros() - start) / 1000.0;
+
+    // Intact: on the card at full length
+    int intact = 0;
+    for (const std::string& path : files) {
+        std::error_code error;
+        if (fs::file_size(SD.hostPath(path.c_str()), error) == BENCH_MESSAGE_BYTES) intact++;
+    }
+
+    const char* scenario = failure == FAIL_FULL ? "serial_rx_full" :
+                           failure == FAIL_REMOVAL ? "serial_rx_removal" : "serial_rx";
+    printf("{\"scenario\":\"%s\",\"card\":\"%s\",\"messages\":%d,\"received\":%zu,\"intact\":%d,"
+           "\"elapsed_ms\":%.1f,\"kbytes_per_s\":%.1f,",
+           scenario, cardName, BENCH_MESSAGES, files.size(), intact, elapsedMs,
+           elapsedMs > 0 ? stream.size() / elapsedMs : 0.0);
+    printCall(callUs);
+    printCard();
+}
+
+#ifdef VOICECHAT_HOST_OPUS
+// =============================================================================
+// record
+// =============================================================================
+
+static void runRecord(const std::string& directory, const char* cardName) {
+    SdCardConfig config;
+    SdCardConfig::preset(cardName, config);
+    config.detectPin = SDCARD_DETECT_PIN;
+    freshCard(directory, config);
+
+    AudioRecordQueue queue;
+    AudioHarness audio(&queue, NULL);
+    std::string error;
+    audio.setInput(speechLike(BENCH_RECORD_SECONDS * 1000, nextRandom()), error);
+
+    RecordingEngine recorder;
+    if (!recorder.begin() || !recorder.startRecording(0)) {
+        fprintf(stderr, "sd_bench: recording did not start on %s\n", cardName);
+        return;
+    }
+    queue.begin();
+
+    std::vector<double> callUs;
+    while (!audio.inputDone()) {
+        uint64_t before = hostMicros();
+        recorder.processRecording(&queue);
+        callUs.push_back((double)(hostMicros() - before));
+        audio.advance(BENCH_LOOP_US);
+    }
+    recorder.stopRecording();
+    queue.end();
+
+    printf("{\"scenario\":\"record\",\"card\":\"%s\",\"audio_s\":%d,\"packets\":%u,\"bytes\":%u,"
+           "\"blocks_dropped\":%u,",
+           cardName, BENCH_RECORD_SECONDS, recorder.getPacketCount(), recorder.getRecordingSize(),
+           queue.hostOverruns());
+    printCall(callUs);
+    printCard();
+}
+
+// =============================================================================
+// channel_scan
+// =============================================================================
+
+// Written straight to the host directory, then the card is rescanned
+static void fillChannel(int files) {
+    for (int f = 0; f < files; f++) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s1/MSG_%05d_from_%s.opus", RX_DIR_PREFIX, f + 1, BENCH_USERNAME);
+        FILE* file = fopen(SD.hostPath(path).c_str(), "wb");
+        if (!file) continue;
+        const uint8_t header[] = {'O', 'P', 'U', 'S', 0x01, 0x00};
+        fwrite(header, 1, sizeof(header), file);
+        for (int p = 0; p < 200; p++) {
+            uint16_t size = 30 + nextRandom() % 20;
+            uint8_t packet[OPUS_MAX_PACKET_SIZE];
+            for (int i = 0; i < size; i++) packet[i] = (uint8_t)nextRandom();
+            fwrite(&size, 2, 1, file);
+            fwrite(packet, 1, size, file);
+        }
+        fclose(file);
+    }
+}
+
+static void runChannelScan(const std::string& directory, const char* cardName) {
+    SdCardConfig config;
+    SdCardConfig::preset(cardName, config);
+    freshCard(directory, config);
+    fillChannel(BENCH_SCAN_FILES);
+    SD.hostConfigure(config);
+
+    AudioPlayQueue queue;
+    PlaybackEngine player;
+    player.begin();
+
+    uint64_t start = hostMicros();
+    player.loadChannelQueue(0);
+    uint64_t loaded = hostMicros();
+    bool playing = player.startPlayback(&queue);
+    uint64_t started = hostMicros();
+
+    printf("{\"scenario\":\"channel_scan\",\"card\":\"%s\",\"files\":%u,\"playing\":%s,"
+           "\"load_ms\":%.2f,\"start_ms\":%.2f,",
+           cardName, player.getQueuedCount(), playing ? "true" : "false",
+           (loaded - start) / 1000.0, (started - loaded) / 1000.0);
+    player.stopPlayback();
+    printCard();
+}
+#endif
+
+static int usage() {
+    fprintf(stderr, "usage: sd_bench <workdir> [ideal|class10|worn...]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+    std::string directory = std::string(argv[1]) + "/card";
+
+    std::vector<const char*> cards;
+    for (int i = 2; i < argc; i++) {
+        SdCardConfig config;
+        if (!SdCardConfig::preset(argv[i], config)) return usage();
+        cards.push_back(argv[i]);
+    }
+    if (cards.empty()) cards.assign(std::begin(CARDS), std::end(CARDS));
+
+    for (const char* card : cards) {
+        runSerialRx(directory, card, FAIL_NONE);
+#ifdef VOICECHAT_HOST_OPUS
+        runRecord(directory, card);
+        runChannelScan(directory, card);
+#endif
+    }
+    runSerialRx(directory, "class10", FAIL_FULL);
+    runSerialRx(directory, "class10", FAIL_REMOVAL);
+
+#ifndef VOICECHAT_HOST_OPUS
+    fprintf(stderr, "sd_bench: built without libopus, record and channel_scan skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * SettingsWear.cpp - EEPROM wear and power-loss safety of FieldRecorder's settings
+ *
+ *   settings_wear [days]      JSON lines on stdout (default 365 days)
+ *
+ * Runs a year of typical field use against three ways of saving Settings:
+ *
+ *   in_place    what StorageManager did before the journal: EEPROM.put of
+ *               the struct at EEPROM_SETTINGS_ADDR with its rotate-XOR
+ *               checksum on every change, rewriting the same cells
+ *   journal     saveSettings() on every change, appending to SongbirdJournal
+ *   write_back  as the sketch is now: queueSettings() on every change,
+ *               update() from loop() except while recording, flush() when
+ *               a recording stops
+ *
+ * The day, on the virtual clock: USAGE_RECORDINGS recordings with idle
+ * time between them and a countdown before each. Starting one changes the
+ * sequence number. During some, the gain is stepped a few presses one way,
+ * sometimes overshooting and coming back; AGC or wind-cut is toggled now
+ * and then while idle. A seeded generator makes every run identical.
+ *
+ * Wear is per cell, counting only bytes that changed (the shim's update()
+ * semantics). lifetime_years is how long until the hottest cell reaches
+ * CELL_ENDURANCE writes. That models real EEPROM; Teensy 4 emulates EEPROM
+ * in flash with its own wear leveling, where what costs erase cycles and
+ * blocks loop() is the number of writes and bytes changed, reported per
+ * hour of use.
+ *
+ * Then POWER_TRIALS saves are cut short after a random number of bytes
+ * and the settings are loaded again, as after the next boot: they should
+ * come back as the new or the previous settings, not as defaults (the
+ * sequence number lost) or as something else that passed the check.
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "Config.h"
+#include "StorageManager.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+#define USAGE_RECORDINGS        20      // Per day
+#define USAGE_IDLE_MIN_S        60      // Between recordings
+#define USAGE_IDLE_MAX_S        1800
+#define USAGE_RECORD_MIN_S      30
+#define USAGE_RECORD_MAX_S      900
+#define USAGE_MANUAL_GAIN       0.3     // Share of recordings with manual gain
+#define USAGE_GAIN_PRESSES      6       // Up to, per manual-gain recording
+#define USAGE_OVERSHOOT         0.3     // Chance of stepping back after a burst
+#define USAGE_PRESS_MIN_MS      250     // Between presses in a burst
+#define USAGE_PRESS_MAX_MS      600
+#define USAGE_TOGGLES           0.5     // AGC or wind-cut toggles per day
+#define LOOP_STEP_MS            250     // How often the simulation runs update()
+#define CELL_ENDURANCE          100000  // Write cycles per EEPROM cell
+#define POWER_TRIALS            2000
+
+static uint32_t benchRandom = 1;
+
+// xorshift32
+static uint32_t nextRandom() {
+    benchRandom ^= benchRandom << 13;
+    benchRandom ^= benchRandom >> 17;
+    benchRandom ^= benchRandom << 5;
+    return benchRandom;
+}
+
+static uint32_t randomBetween(uint32_t low, uint32_t high) {
+    return low + nextRandom() % (high - low + 1);
+}
+
+static bool chance(double probability) {
+    return (nextRandom() & 0xFFFFFF) < probability * 0x1000000;
+}
+
+static bool sameSettings(const Settings& a, const Settings& b) {
+    return a.version == b.version && a.micGain == b.micGain && a.playbackVolume == b.playbackVolume
+           && a.agcEnabled == b.agcEnabled && a.windCutEnabled == b.windCutEnabled
+           && a.sequenceNumber == b.sequenceNumber;
+}
+
+// =============================================================================
+// The three stores
+// =============================================================================
+
+class SettingsStore {
+public:
+    virtual ~SettingsStore() {}
+    virtual const char* name() const = 0;
+    virtual void begin() = 0;                       // After a reboot
+    virtual bool load(Settings& settings) = 0;
+    virtual void change(const Settings& settings) = 0;
+    virtual void recordingStopped() {}
+
+    // Time passing in loop()
+    virtual void idle(uint32_t ms, bool recording) {
+        (void)recording;
+        hostAdvanceMicros((uint64_t)ms * 1000);
+    }
+
+    uint64_t saves = 0;     // Settings actually written
+};
+
+// StorageManager before the journal
+class InPlaceStore : public SettingsStore {
+public:
+    const char* name() const override { return "in_place"; }
+    void begin() override {}
+
+    bool load(Settings& settings) override {
+        EEPROM.get(EEPROM_SETTINGS_ADDR, settings);
+        return settings.version != 0xFF && settings.micGain <= MAX_MIC_GAIN && settings.playbackVolume >= 0.0f
+               && settings.playbackVolume <= 1.0f && settings.checksum == checksum(settings);
+    }
+
+    void change(const Settings& settings) override {
+        Settings toSave = settings;
+        toSave.checksum = checksum(toSave);
+        EEPROM.put(EEPROM_SETTINGS_ADDR, toSave);
+        saves++;
+    }
+
+private:
+    static uint32_t checksum(const Settings& settings) {
+        uint32_t sum = 0;
+        const uint8_t* data = (const uint8_t*)&settings;
+        for (size_t i = 0; i < offsetof(Settings, checksum); i++) {
+            sum ^= data[i];
+            sum = (sum << 1) | (sum >> 31);
+        }
+        return sum;
+    }
+};
+
+class JournalStore : public SettingsStore {
+public:
+    const char* name() const override { return "journal"; }
+    void begin() override {
+        storage.reset(new StorageManager());
+        storage->begin();
+    }
+    bool load(Settings& settings) override { return storage->loadSettings(settings); }
+    void change(const Settings& settings) override {
+        storage->saveSettings(settings);
+        saves++;
+    }
+
+protected:
+    std::unique_ptr<StorageManager> storage;
+};
+
+class WriteBackStore : public JournalStore {
+public:
+    const char* name() const override { return "write_back"; }
+
+    void change(const Settings& settings) override { storage->queueSettings(settings); }
+    void recordingStopped() override { commit([&] { storage->flush(); }); }
+
+    void idle(uint32_t ms, bool recording) override {
+        while (ms > 0) {
+            uint32_t step = std::min<uint32_t>(ms, LOOP_STEP_MS);
+            hostAdvanceMicros((uint64_t)step * 1000);
+            ms -= step;
+            if (!recording) commit([&] { storage->update(); });
+        }
+    }
+
+private:
+    template <typename Call> void commit(Call&& call) {
+        uint32_t before = storage->getCommitCount();
+        call();
+        saves += storage->getCommitCount() - before;
+    }
+};
+
+// =============================================================================
+// Wear
+// =============================================================================
+
+static Settings defaultSettings() {
+    Settings settings;
+    memset(&settings, 0, sizeof(settings));     // Padding too, so runs repeat
+    settings.version = SETTINGS_VERSION;
+    settings.micGain = DEFAULT_MIC_GAIN;
+    settings.playbackVolume = DEFAULT_PLAYBACK_VOLUME;
+    settings.agcEnabled = true;
+    settings.windCutEnabled = false;
+    settings.sequenceNumber = 1;
+    return settings;
+}
+
+static void stepGain(Settings& settings, bool up) {
+    int gain = settings.micGain + (up ? GAIN_STEP : -GAIN_STEP);
+    settings.micGain = std::max(MIN_MIC_GAIN, std::min(MAX_MIC_GAIN, gain));
+}
+
+// One recording, idle time and countdown first
+static void simulateRecording(SettingsStore& store, Settings& settings) {
+    store.idle(randomBetween(USAGE_IDLE_MIN_S, USAGE_IDLE_MAX_S) * 1000, false);
+    store.idle(COUNTDOWN_SECONDS * 1000, false);
+
+    settings.sequenceNumber++;
+    store.change(settings);
+
+    uint32_t length = randomBetween(USAGE_RECORD_MIN_S, USAGE_RECORD_MAX_S) * 1000;
+    uint32_t elapsed = 0;
+    if (!settings.agcEnabled && chance(USAGE_MANUAL_GAIN)) {
+        uint32_t at = nextRandom() % (length / 2);
+        store.idle(at, true);
+        elapsed += at;
+
+        int presses = randomBetween(1, USAGE_GAIN_PRESSES);
+        int back = chance(USAGE_OVERSHOOT) ? randomBetween(1, presses) : 0;
+        bool up = nextRandom() & 1;
+        for (int i = 0; i < presses + back; i++) {
+            stepGain(settings, i < presses ? up : !up);
+            store.change(settings);
+            uint32_t gap = randomBetween(USAGE_PRESS_MIN_MS, USAGE_PRESS_MAX_MS);
+            store.idle(gap, true);
+            elapsed += gap;
+        }
+    }
+    store.idle(length > elapsed ? length - elapsed : 0, true);
+    store.recordingStopped();
+}
+
+static void runWear(SettingsStore& store, uint32_t days) {
+    EEPROM.hostErase();
+    benchRandom = 12345;
+    store.begin();
+    Settings settings = defaultSettings();
+    store.change(settings);
+    store.recordingStopped();
+    store.idle(SETTINGS_COMMIT_DELAY_MS, false);
+    EEPROM.hostResetWear();
+    store.saves = 0;
+
+    uint64_t started = hostMicros();
+    for (uint32_t day = 0; day < days; day++) {
+        for (int recording = 0; recording < USAGE_RECORDINGS; recording++) {
+            simulateRecording(store, settings);
+        }
+        if (chance(USAGE_TOGGLES)) {
+            if (chance(0.5)) settings.agcEnabled = !settings.agcEnabled;
+            else settings.windCutEnabled = !settings.windCutEnabled;
+            store.change(settings);
+        }
+    }
+    store.idle(SETTINGS_COMMIT_DELAY_MS, false);
+    double hours = (hostMicros() - started) / 3.6e9;
+
+    uint32_t hottest = 0, cells = 0;
+    for (int address = 0; address < EEPROM.length(); address++) {
+        uint32_t writes = EEPROM.hostCellWrites(address);
+        hottest = std::max(hottest, writes);
+        if (writes) cells++;
+    }
+    double perYear = (double)hottest * 365.0 / days;
+
+    Settings loaded;
+    store.begin();
+    bool intact = store.load(loaded) && sameSettings(loaded, settings);
+
+    printf("{\"store\":\"%s\",\"days\":%u,\"hours\":%.0f,\"saves\":%llu,\"saves_per_hour\":%.2f,"
+           "\"bytes_written\":%u,\"bytes_per_hour\":%.1f,\"cells_used\":%u,\"hottest_cell_writes\":%u,"
+           "\"lifetime_years\":%.1f,\"final_load_ok\":%s}\n",
+           store.name(), days, hours, (unsigned long long)store.saves, store.saves / hours,
+           EEPROM.hostBytesWritten(), EEPROM.hostBytesWritten() / hours, cells, hottest,
+           perYear > 0 ? CELL_ENDURANCE / perYear : 0.0, intact ? "true" : "false");
+}
+
+// =============================================================================
+// Power loss
+// =============================================================================
+
+static void runPowerLoss(SettingsStore& store) {
+    uint32_t newer = 0, older = 0, defaults = 0, wrong = 0;
+    benchRandom = 777;
+
+    for (int trial = 0; trial < POWER_TRIALS; trial++) {
+        EEPROM.hostErase();
+        store.begin();
+
+        // Some history, so the journal is part way round its ring
+        Settings before = defaultSettings();
+        int history = nextRandom() % 300;
+        for (int i = 0; i < history; i++) {
+            before.sequenceNumber++;
+            store.change(before);
+            store.recordingStopped();
+        }
+
+        Settings after = before;
+        after.sequenceNumber += 1 + nextRandom() % 1000;
+        after.micGain = nextRandom() % (MAX_MIC_GAIN + 1);
+        after.agcEnabled = !before.agcEnabled;
+        EEPROM.hostCutPowerAfter(nextRandom() % (sizeof(Settings) + JOURNAL_HEADER_SIZE + JOURNAL_CRC_SIZE));
+        store.change(after);
+        store.recordingStopped();
+        EEPROM.hostRestorePower();
+
+        Settings loaded;
+        store.begin();
+        if (!store.load(loaded)) defaults++;
+        else if (sameSettings(loaded, after)) newer++;
+        else if (sameSettings(loaded, before)) older++;
+        else wrong++;
+    }
+
+    printf("{\"store\":\"%s\",\"power_trials\":%d,\"new\":%u,\"previous\":%u,\"lost\":%u,\"wrong\":%u}\n",
+           store.name(), POWER_TRIALS, newer, older, defaults, wrong);
+}
+
+static int usage() {
+    fprintf(stderr, "usage: settings_wear [days]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    uint32_t days = 365;
+    if (argc > 2) return usage();
+    if (argc == 2) {
+        char* end;
+        long value = strtol(argv[1], &end, 10);
+        if (*end || value < 1) return usage();
+        days = (uint32_t)value;
+    }
+
+    Serial.hostQuiet(true);     // StorageManager reports every save
+
+    InPlaceStore inPlace;
+    JournalStore journal;
+    WriteBackStore writeBack;
+    SettingsStore* stores[] = {&inPlace, &journal, &writeBack};
+    for (SettingsStore* store : stores) runWear(*store, days);
+    for (SettingsStore* store : stores) runPowerLoss(*store);
+    return 0;
+}
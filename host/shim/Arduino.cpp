@@ -0,0 +1,75 @@
+/*
+ * Arduino.cpp - Host shim: virtual clock, cycle counter, pins, Serial
+ */
+
+#include "Arduino.h"
+#include <chrono>
+#include <vector>
+
+HostSerial Serial;
+uint32_t F_CPU_ACTUAL = 600000000;
+
+static uint64_t virtualMicros = 0;
+static std::vector<HostTimer*> timers;
+static bool firing = false;
+
+uint32_t millis() { return (uint32_t)(virtualMicros / 1000); }
+uint32_t micros() { return (uint32_t)virtualMicros; }
+
+// Nothing waits on the host; a delay just moves the clock
+void delay(uint32_t ms) { hostAdvanceMicros((uint64_t)ms * 1000); }
+
+void hostAdvanceMicros(uint64_t us) {
+    uint64_t target = virtualMicros + us;
+
+    // A timer that moves the clock itself does not fire others from inside
+    while (!firing) {
+        HostTimer* next = nullptr;
+        for (HostTimer* timer : timers) {
+            if (timer->hostDue() <= target && (!next || timer->hostDue() < next->hostDue())) next = timer;
+        }
+        if (!next) break;
+
+        if (next->hostDue() > virtualMicros) virtualMicros = next->hostDue();
+        firing = true;
+        next->hostFire();
+        firing = false;
+    }
+    if (target > virtualMicros) virtualMicros = target;
+}
+
+uint64_t hostMicros() { return virtualMicros; }
+
+void hostAttachTimer(HostTimer* timer) {
+    hostDetachTimer(timer);
+    timers.push_back(timer);
+}
+
+void hostDetachTimer(HostTimer* timer) {
+    for (size_t i = 0; i < timers.size(); i++) {
+        if (timers[i] == timer) timers.erase(timers.begin() + i--);
+    }
+}
+
+uint32_t hostCycleCount() {
+    static const auto origin = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - origin;
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return (uint32_t)(ns * (F_CPU_ACTUAL / 1000000) / 1000);
+}
+
+static uint8_t pins[HOST_PIN_COUNT];
+
+// A pulled-up input reads HIGH until the harness drives it (a button press)
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (mode == INPUT_PULLUP) hostSetPin(pin, HIGH);
+}
+
+int digitalRead(uint8_t pin) { return pin < HOST_PIN_COUNT ? pins[pin] : LOW; }
+
+// Outputs are kept too, so a harness can read back an LED or a chip select
+void digitalWrite(uint8_t pin, uint8_t value) { hostSetPin(pin, value); }
+
+void hostSetPin(uint8_t pin, uint8_t value) {
+    if (pin < HOST_PIN_COUNT) pins[pin] = value ? HIGH : LOW;
+}
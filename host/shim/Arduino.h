@@ -0,0 +1,116 @@
+/*
+ * Arduino.h - Host shim for building sketch modules on Linux
+ *
+ * Just enough of the Teensy core for the DSP and engine code to compile
+ * and run unchanged: integer types, min/max/constrain, interrupt masking
+ * (no-ops, there is only one thread), millis()/micros() on a virtual
+ * clock, the DWT cycle counter, digital pins the harness sets, String,
+ * Print/Stream and Serial.
+ *
+ * ARM_DWT_CYCCNT counts host time at F_CPU_ACTUAL, so cycle figures from
+ * the modules read as "cycles at 600 MHz if the M7 were as fast as this
+ * machine". Compare them between builds on one host, not with hardware.
+ */
+
+#ifndef SONGBIRD_HOST_ARDUINO_H
+#define SONGBIRD_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "WString.h"
+#include "Stream.h"
+
+#define HOST_BUILD 1
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+using std::min;
+using std::max;
+
+template <class T, class L, class H>
+static inline T constrain(T value, L low, H high) {
+    return value < low ? (T)low : (value > high ? (T)high : value);
+}
+
+// Single-threaded host: the audio "interrupt" is a function call
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+static inline void AudioNoInterrupts() {}
+static inline void AudioInterrupts() {}
+
+// Virtual clock, advanced by the harness (and by delay() and simulated
+// SD latency, which stand for time the sketch spends blocked)
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void hostAdvanceMicros(uint64_t us);
+uint64_t hostMicros();
+
+// Work that interrupts the sketch at set virtual times (the audio
+// update). Whatever moves the clock fires every timer that falls due on
+// the way, at its due time, so a stall inside an engine call is seen by
+// the audio side as it would be on the device.
+class HostTimer {
+public:
+    virtual ~HostTimer() {}
+    virtual uint64_t hostDue() const = 0;
+    virtual void hostFire() = 0;
+};
+
+void hostAttachTimer(HostTimer* timer);
+void hostDetachTimer(HostTimer* timer);
+
+// Host time in F_CPU_ACTUAL cycles
+extern uint32_t F_CPU_ACTUAL;
+uint32_t hostCycleCount();
+#define ARM_DWT_CYCCNT (hostCycleCount())
+
+// Digital pins read whatever the harness last set (LOW by default, HIGH
+// from pinMode(INPUT_PULLUP) so buttons start released)
+#define LOW             0
+#define HIGH            1
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define HOST_PIN_COUNT  64
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void hostSetPin(uint8_t pin, uint8_t value);
+
+// Serial writes to stderr, so harness results on stdout stay clean
+class HostSerial : public Stream {
+public:
+    void begin(uint32_t) {}
+    explicit operator bool() const { return true; }
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t byte) override {
+        if (!quiet) fputc(byte, stderr);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return quiet ? size : fwrite(buffer, 1, size, stderr);
+    }
+    using Print::write;
+
+    // Drop the sketch's debug output, for harnesses that call it in bulk
+    void hostQuiet(bool on) { quiet = on; }
+
+private:
+    bool quiet = false;
+};
+
+extern HostSerial Serial;
+
+#endif
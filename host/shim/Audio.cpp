@@ -0,0 +1,108 @@
+/*
+ * Audio.cpp - Host shim record and play queues, RMS analyzer
+ */
+
+#include "Audio.h"
+
+#include <math.h>
+
+// =============================================================================
+// AudioRecordQueue
+// =============================================================================
+
+void AudioRecordQueue::update(void) {
+    audio_block_t* block = receiveReadOnly();
+    if (!block) return;
+
+    if (!enabled || count == AUDIO_RECORD_QUEUE_BLOCKS) {
+        if (enabled) overruns++;
+        release(block);
+        return;
+    }
+    queue[(head + count) % AUDIO_RECORD_QUEUE_BLOCKS] = block;
+    count++;
+}
+
+int16_t* AudioRecordQueue::readBuffer() {
+    if (count == 0) return NULL;
+    return queue[head]->data;
+}
+
+void AudioRecordQueue::freeBuffer() {
+    if (count == 0) return;
+    release(queue[head]);
+    queue[head] = NULL;
+    head = (head + 1) % AUDIO_RECORD_QUEUE_BLOCKS;
+    count--;
+}
+
+void AudioRecordQueue::clear() {
+    while (count > 0) freeBuffer();
+}
+
+// =============================================================================
+// AudioPlayQueue
+// =============================================================================
+
+// Room in the queue, and a block in the pool to fill
+bool AudioPlayQueue::available() const {
+    if (pending) return true;
+    if (count == AUDIO_PLAY_QUEUE_BLOCKS) return false;
+    // The pool is made on first allocation when AudioMemory() was never called
+    return AudioStream::memory_allocated == 0 || AudioStream::memory_used < AudioStream::memory_allocated;
+}
+
+int16_t* AudioPlayQueue::getBuffer() {
+    if (!pending) pending = allocate();
+    return pending ? pending->data : NULL;
+}
+
+void AudioPlayQueue::playBuffer() {
+    if (!pending) return;
+    if (count == AUDIO_PLAY_QUEUE_BLOCKS) {
+        release(pending);
+    } else {
+        queue[(head + count) % AUDIO_PLAY_QUEUE_BLOCKS] = pending;
+        count++;
+    }
+    pending = NULL;
+}
+
+void AudioPlayQueue::update(void) {
+    if (count == 0) {
+        underruns++;
+        return;
+    }
+    audio_block_t* block = queue[head];
+    queue[head] = NULL;
+    head = (head + 1) % AUDIO_PLAY_QUEUE_BLOCKS;
+    count--;
+    if (played++ == 0) firstPlayedMicros = hostMicros();
+
+    transmit(block);
+    release(block);
+}
+
+// =============================================================================
+// AudioAnalyzeRMS
+// =============================================================================
+
+void AudioAnalyzeRMS::update(void) {
+    audio_block_t* block = receiveReadOnly();
+    count++;
+    if (!block) return;
+
+    int64_t sum = 0;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) sum += (int32_t)block->data[i] * block->data[i];
+    accum += sum;
+    release(block);
+}
+
+float AudioAnalyzeRMS::read() {
+    int64_t sum = accum;
+    uint32_t blocks = count;
+    accum = 0;
+    count = 0;
+    if (blocks == 0) return 0.0f;
+    return sqrtf((float)sum / ((float)blocks * AUDIO_BLOCK_SAMPLES)) / 32767.0f;
+}
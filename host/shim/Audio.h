@@ -0,0 +1,96 @@
+/*
+ * Audio.h - Host shim for the Teensy Audio Library objects the engines use
+ *
+ * The two queues that connect sketch code to the audio graph (the
+ * record queue the engines drain and the play queue they fill) and the
+ * RMS analyzer sketches read levels from. The rest
+ * of the graph (codec, mixers, filters) stays on the device; on the host
+ * the harness is the graph, delivering input blocks to the record queue
+ * and collecting the play queue's output (see common/AudioHarness.h).
+ *
+ * Unlike the device, nothing here blocks: getBuffer() returns NULL when
+ * the pool is empty and playBuffer() drops the block when the queue is
+ * full. Check available() first, as the engines do.
+ */
+
+#ifndef SONGBIRD_HOST_AUDIO_H
+#define SONGBIRD_HOST_AUDIO_H
+
+#include "Arduino.h"
+#include "AudioStream.h"
+
+#define AUDIO_RECORD_QUEUE_BLOCKS   53
+#define AUDIO_PLAY_QUEUE_BLOCKS     32
+
+class AudioRecordQueue : public AudioStream {
+public:
+    AudioRecordQueue() : AudioStream(1, inputQueueArray) {}
+
+    void begin() { enabled = true; }
+    void end() { enabled = false; }
+    void clear();
+    int available() const { return count; }
+    int16_t* readBuffer();
+    void freeBuffer();
+
+    void update(void) override;
+
+    // Blocks dropped because the sketch did not drain the queue in time
+    uint32_t hostOverruns() const { return overruns; }
+
+private:
+    audio_block_t* inputQueueArray[1];
+    audio_block_t* queue[AUDIO_RECORD_QUEUE_BLOCKS] = {};
+    int head = 0;
+    int count = 0;
+    bool enabled = false;
+    uint32_t overruns = 0;
+};
+
+class AudioPlayQueue : public AudioStream {
+public:
+    AudioPlayQueue() : AudioStream(0, NULL) {}
+
+    bool available() const;
+    int16_t* getBuffer();
+    void playBuffer();
+
+    void update(void) override;
+
+    // Updates that found the queue empty and sent nothing
+    uint32_t hostUnderruns() const { return underruns; }
+    int hostQueued() const { return count; }
+
+    // Blocks sent on since hostResetPlayed(), and the virtual time of the first
+    uint32_t hostPlayed() const { return played; }
+    uint64_t hostFirstPlayedMicros() const { return firstPlayedMicros; }
+    void hostResetPlayed() { played = 0; firstPlayedMicros = 0; }
+
+private:
+    audio_block_t* pending = NULL;
+    audio_block_t* queue[AUDIO_PLAY_QUEUE_BLOCKS] = {};
+    int head = 0;
+    int count = 0;
+    uint32_t underruns = 0;
+    uint32_t played = 0;
+    uint64_t firstPlayedMicros = 0;
+};
+
+// As on the device, an update with no input block counts as a block of
+// silence, so a stopped source still produces readings
+class AudioAnalyzeRMS : public AudioStream {
+public:
+    AudioAnalyzeRMS() : AudioStream(1, inputQueueArray) {}
+
+    bool available() const { return count > 0; }
+    float read();
+
+    void update(void) override;
+
+private:
+    audio_block_t* inputQueueArray[1];
+    int64_t accum = 0;
+    uint32_t count = 0;
+};
+
+#endif
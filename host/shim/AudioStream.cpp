@@ -0,0 +1,95 @@
+/*
+ * AudioStream.cpp - Host shim block pool and stream plumbing
+ */
+
+#include "AudioStream.h"
+#include <vector>
+
+static std::vector<audio_block_t> pool;
+static std::vector<uint16_t> freeList;
+
+uint16_t AudioStream::memory_used = 0;
+uint16_t AudioStream::memory_used_max = 0;
+uint16_t AudioStream::memory_allocated = 0;
+
+// Harnesses that never call AudioMemory() get a generous pool
+#define AUDIO_HOST_DEFAULT_BLOCKS 256
+
+void AudioStream::initialize_memory(unsigned int count) {
+    pool.assign(count, audio_block_t());
+    freeList.clear();
+    for (unsigned int i = count; i > 0; i--) {
+        pool[i - 1].memory_pool_index = i - 1;
+        freeList.push_back(i - 1);
+    }
+    memory_used = 0;
+    memory_used_max = 0;
+    memory_allocated = count;
+}
+
+audio_block_t* AudioStream::allocate(void) {
+    if (pool.empty()) initialize_memory(AUDIO_HOST_DEFAULT_BLOCKS);
+    if (freeList.empty()) return NULL;
+
+    audio_block_t* block = &pool[freeList.back()];
+    freeList.pop_back();
+    block->ref_count = 1;
+    memory_used++;
+    if (memory_used > memory_used_max) memory_used_max = memory_used;
+    return block;
+}
+
+void AudioStream::release(audio_block_t* block) {
+    if (!block) return;
+    if (--block->ref_count == 0) {
+        freeList.push_back(block->memory_pool_index);
+        memory_used--;
+    }
+}
+
+AudioStream::AudioStream(unsigned char ninput, audio_block_t** iqueue)
+    : numInputs(ninput), inputQueue(iqueue)
+{
+    for (unsigned char i = 0; i < numInputs; i++) inputQueue[i] = NULL;
+    for (int i = 0; i < AUDIO_HOST_MAX_OUTPUTS; i++) outputs[i] = NULL;
+}
+
+void AudioStream::hostDeliver(audio_block_t* block, unsigned int index) {
+    if (index >= numInputs || !block) return;
+    // An undelivered block is dropped, as when update() skips an input
+    release(inputQueue[index]);
+    block->ref_count++;
+    inputQueue[index] = block;
+}
+
+audio_block_t* AudioStream::hostTakeOutput(unsigned int index) {
+    if (index >= AUDIO_HOST_MAX_OUTPUTS) return NULL;
+    audio_block_t* block = outputs[index];
+    outputs[index] = NULL;
+    return block;
+}
+
+audio_block_t* AudioStream::receiveReadOnly(unsigned int index) {
+    if (index >= numInputs) return NULL;
+    audio_block_t* block = inputQueue[index];
+    inputQueue[index] = NULL;
+    return block;
+}
+
+audio_block_t* AudioStream::receiveWritable(unsigned int index) {
+    audio_block_t* block = receiveReadOnly(index);
+    if (block && block->ref_count > 1) {
+        audio_block_t* copy = allocate();
+        if (copy) memcpy(copy->data, block->data, sizeof(copy->data));
+        release(block);
+        block = copy;
+    }
+    return block;
+}
+
+void AudioStream::transmit(audio_block_t* block, unsigned char index) {
+    if (index >= AUDIO_HOST_MAX_OUTPUTS || !block) return;
+    release(outputs[index]);
+    block->ref_count++;
+    outputs[index] = block;
+}
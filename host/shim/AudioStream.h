@@ -0,0 +1,66 @@
+/*
+ * AudioStream.h - Host shim for the Teensy Audio Library base class
+ *
+ * Blocks come from a reference-counted pool as on the device. There is
+ * no update interrupt: the harness hands blocks to an object's inputs
+ * with hostDeliver(), calls update() itself and collects what it
+ * transmitted with hostTakeOutput().
+ */
+
+#ifndef SONGBIRD_HOST_AUDIOSTREAM_H
+#define SONGBIRD_HOST_AUDIOSTREAM_H
+
+#include "Arduino.h"
+
+#define AUDIO_BLOCK_SAMPLES      128
+#define AUDIO_SAMPLE_RATE_EXACT  44117.64706f
+#define AUDIO_SAMPLE_RATE        AUDIO_SAMPLE_RATE_EXACT
+
+#define AUDIO_HOST_MAX_OUTPUTS   8
+
+typedef struct audio_block_struct {
+    uint8_t  ref_count;
+    uint8_t  reserved1;
+    uint16_t memory_pool_index;
+    int16_t  data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioStream {
+public:
+    AudioStream(unsigned char ninput, audio_block_t** iqueue);
+    virtual ~AudioStream() {}
+
+    virtual void update(void) = 0;
+
+    // Host harness: the patch cord's job. The object takes its own
+    // reference; the caller keeps (and releases) theirs.
+    void hostDeliver(audio_block_t* block, unsigned int index = 0);
+    // Block transmitted on an output during the last update(), or NULL.
+    // The caller owns the returned reference.
+    audio_block_t* hostTakeOutput(unsigned int index = 0);
+
+    // Block pool, as AudioMemory() sizes it on the device
+    static void initialize_memory(unsigned int count);
+    static audio_block_t* allocate(void);
+    static void release(audio_block_t* block);
+    static uint16_t memory_used;
+    static uint16_t memory_used_max;
+    static uint16_t memory_allocated;   // 0 until the pool exists
+
+protected:
+    audio_block_t* receiveReadOnly(unsigned int index = 0);
+    audio_block_t* receiveWritable(unsigned int index = 0);
+    void transmit(audio_block_t* block, unsigned char index = 0);
+
+private:
+    unsigned char numInputs;
+    audio_block_t** inputQueue;
+    audio_block_t* outputs[AUDIO_HOST_MAX_OUTPUTS];
+};
+
+#define AudioMemory(num) AudioStream::initialize_memory(num)
+#define AudioMemoryUsage() (AudioStream::memory_used)
+#define AudioMemoryUsageMax() (AudioStream::memory_used_max)
+#define AudioMemoryUsageMaxReset() (AudioStream::memory_used_max = AudioStream::memory_used)
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * EEPROM.cpp - Host shim EEPROM contents
+ */
+
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+void EEPROMClass::write(int address, uint8_t value) {
+    if (!inRange(address) || data[address] == value) return;
+    if (powerCut) {
+        if (powerLeft == 0) return;
+        powerLeft--;
+    }
+    data[address] = value;
+    cellWrites[address]++;
+    bytesWritten++;
+}
+
+void EEPROMClass::hostErase() {
+    memset(data, 0xFF, sizeof(data));
+    hostResetWear();
+}
+
+void EEPROMClass::hostResetWear() {
+    memset(cellWrites, 0, sizeof(cellWrites));
+    bytesWritten = 0;
+}
+
+// A short or missing file leaves the rest erased
+bool EEPROMClass::hostLoad(const std::string& path) {
+    hostErase();
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    fread(data, 1, sizeof(data), file);
+    fclose(file);
+    return true;
+}
+
+bool EEPROMClass::hostSave(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool written = fwrite(data, 1, sizeof(data), file) == sizeof(data);
+    return fclose(file) == 0 && written;
+}
@@ -0,0 +1,66 @@
+/*
+ * EEPROM.h - Host shim for the Teensy EEPROM emulation
+ *
+ * Teensy 4.1 size, erased to 0xFF. A harness can load and save the
+ * contents as a file to carry settings between runs, and read how many
+ * bytes were actually changed (update() and put() skip equal bytes, as
+ * the device's emulation does), in total and per cell for wear.
+ *
+ * hostCutPowerAfter(n) lets n more bytes change and then drops every
+ * write, as if power went mid-save; hostRestorePower() ends it.
+ */
+
+#ifndef SONGBIRD_HOST_EEPROM_H
+#define SONGBIRD_HOST_EEPROM_H
+
+#include "Arduino.h"
+#include <string>
+
+#define E2END 0x10BB
+
+class EEPROMClass {
+public:
+    EEPROMClass() { hostErase(); }
+
+    void begin() {}
+    uint16_t length() const { return E2END + 1; }
+
+    uint8_t read(int address) const {
+        return inRange(address) ? data[address] : 0xFF;
+    }
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value) { write(address, value); }
+
+    template <class T> T& get(int address, T& value) const {
+        for (size_t i = 0; i < sizeof(T); i++) ((uint8_t*)&value)[i] = read(address + (int)i);
+        return value;
+    }
+    template <class T> const T& put(int address, const T& value) {
+        for (size_t i = 0; i < sizeof(T); i++) write(address + (int)i, ((const uint8_t*)&value)[i]);
+        return value;
+    }
+
+    // The harness's side
+    void hostErase();
+    bool hostLoad(const std::string& path);
+    bool hostSave(const std::string& path) const;
+    uint32_t hostBytesWritten() const { return bytesWritten; }
+    uint32_t hostCellWrites(int address) const { return inRange(address) ? cellWrites[address] : 0; }
+    void hostResetWear();
+
+    void hostCutPowerAfter(uint32_t bytes) { powerLeft = bytes; powerCut = true; }
+    void hostRestorePower() { powerCut = false; }
+
+private:
+    uint8_t data[E2END + 1];
+    uint32_t cellWrites[E2END + 1];
+    uint32_t bytesWritten = 0;
+    bool powerCut = false;
+    uint32_t powerLeft = 0;
+
+    static bool inRange(int address) { return address >= 0 && address <= E2END; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
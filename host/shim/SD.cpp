@@ -0,0 +1,434 @@
+/*
+ * SD.cpp - Host shim SD card on a directory
+ */
+
+#include "SD.h"
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+SDClass SD;
+
+#define DIRECTORY_ENTRIES_PER_SECTOR    16
+#define FAT_COPIES                      2
+
+struct HostFileHandle {
+    std::string name;
+    std::string hostFile;
+    FILE* file = nullptr;
+    bool directory = false;
+    bool open = false;
+    bool lastWasWrite = false;
+
+    // Directory listing, taken when opened
+    std::string cardPath;
+    std::vector<std::string> entries;
+    size_t nextEntry = 0;
+
+    // What the card holds for this file, as SdFat would have it
+    uint32_t clusters = 0;
+    uint32_t syncedSize = 0;
+    int64_t cacheSector = -1;
+    bool cacheDirty = false;
+    bool fatDirty = false;
+    bool entryDirty = false;
+
+    ~HostFileHandle() {
+        if (file) fclose(file);
+    }
+
+    // stdio needs a seek between a write and a read on the same stream
+    void switchTo(bool writing) {
+        if (file && writing != lastWasWrite) fseek(file, 0, SEEK_CUR);
+        lastWasWrite = writing;
+    }
+
+    uint32_t size() const {
+        long here = ftell(file);
+        fseek(file, 0, SEEK_END);
+        long end = ftell(file);
+        fseek(file, here, SEEK_SET);
+        return (uint32_t)end;
+    }
+};
+
+static std::string lastComponent(std::string path) {
+    while (path.size() > 1 && path.back() == '/') path.pop_back();
+    if (path.empty() || path == "/") return "/";
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Directory sectors read to find a path: one per component
+static uint32_t pathComponents(const char* path) {
+    uint32_t count = 0;
+    bool inName = false;
+    for (const char* c = path; *c; c++) {
+        if (*c != '/' && !inName) count++;
+        inName = *c != '/';
+    }
+    return std::max(count, 1u);
+}
+
+// =============================================================================
+// File
+// =============================================================================
+
+File::operator bool() const {
+    return handle && handle->open;
+}
+
+const char* File::name() const {
+    return handle ? handle->name.c_str() : "";
+}
+
+bool File::isDirectory() const {
+    return handle && handle->open && handle->directory;
+}
+
+uint32_t File::size() const {
+    if (!*this || !handle->file) return 0;
+    return handle->size();
+}
+
+uint32_t File::position() const {
+    if (!*this || !handle->file) return 0;
+    return (uint32_t)ftell(handle->file);
+}
+
+bool File::seek(uint32_t position) {
+    if (!*this || !handle->file || !SD.ready()) return false;
+    if (position > size()) return false;
+    return fseek(handle->file, position, SEEK_SET) == 0;
+}
+
+int File::available() {
+    if (!*this || !handle->file || !SD.ready()) return 0;
+    return (int)(size() - position());
+}
+
+int File::read() {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int File::peek() {
+    if (!*this || !handle->file || !SD.ready()) return -1;
+    handle->switchTo(false);
+    int c = fgetc(handle->file);
+    if (c != EOF) ungetc(c, handle->file);
+    return c == EOF ? -1 : c;
+}
+
+// Through the sector cache: a partial sector is read into it (after the
+// cached one is written back if dirty), whole sectors go direct
+int File::read(void* buffer, size_t size) {
+    if (!*this || !handle->file || !SD.ready()) return -1;
+    handle->switchTo(false);
+
+    uint32_t sectorSize = SD.card.config().sectorSize;
+    uint32_t start = position();
+    int count = (int)fread(buffer, 1, size, handle->file);
+
+    uint32_t reads = 0, writes = 0;
+    if (count > 0) {
+        for (int64_t sector = start / sectorSize; sector <= (int64_t)(start + count - 1) / sectorSize; sector++) {
+            if (sector == handle->cacheSector) continue;
+            uint64_t first = std::max<uint64_t>(start, sector * sectorSize);
+            uint64_t last = std::min<uint64_t>(start + count, (sector + 1) * sectorSize);
+            if (last - first == sectorSize) {
+                reads++;
+                continue;
+            }
+            if (handle->cacheDirty) writes++;
+            handle->cacheDirty = false;
+            handle->cacheSector = sector;
+            reads++;
+        }
+        SD.card.countBytes(SD_OP_READ, count);
+    }
+    SD.card.charge(SD_OP_READ, reads, writes);
+    return count;
+}
+
+size_t File::write(uint8_t byte) {
+    return write(&byte, 1);
+}
+
+// Clusters first (a full card fails the whole write), then sectors: whole
+// ones direct, partial ones via the cache with a read-modify-write when
+// they hold data, written back as soon as they fill
+size_t File::write(const uint8_t* buffer, size_t size) {
+    if (!*this || !handle->file) return 0;
+    SD.card.countWriteCall();
+    if (!SD.ready() || size == 0) {
+        SD.card.countFailure(SD_OP_WRITE);
+        return 0;
+    }
+    handle->switchTo(true);
+
+    SdCardModel& card = SD.card;
+    uint32_t sectorSize = card.config().sectorSize;
+    uint32_t oldSize = handle->size();
+    uint32_t start = position();
+    uint32_t end = start + (uint32_t)size;
+
+    uint32_t needed = card.clustersFor(std::max(oldSize, end));
+    if (needed > handle->clusters) {
+        if (!card.allocate(needed - handle->clusters)) {
+            card.countFailure(SD_OP_WRITE);
+            card.charge(SD_OP_WRITE, 0, 0);
+            return 0;
+        }
+        handle->clusters = needed;
+        handle->fatDirty = true;
+    }
+
+    uint32_t reads = 0, writes = 0;
+    for (int64_t sector = start / sectorSize; sector <= (int64_t)(end - 1) / sectorSize; sector++) {
+        uint64_t sectorStart = sector * sectorSize;
+        uint64_t first = std::max<uint64_t>(start, sectorStart);
+        uint64_t last = std::min<uint64_t>(end, sectorStart + sectorSize);
+
+        if (last - first == sectorSize && sector != handle->cacheSector) {
+            writes++;
+            continue;
+        }
+        if (sector != handle->cacheSector) {
+            if (handle->cacheDirty) writes++;
+            bool appending = first == sectorStart && first >= oldSize;
+            if (!appending && sectorStart < oldSize) reads++;
+            handle->cacheSector = sector;
+        }
+        handle->cacheDirty = true;
+        if (last == sectorStart + sectorSize) {
+            writes++;
+            handle->cacheDirty = false;
+        }
+    }
+    if (end > oldSize) handle->entryDirty = true;
+
+    size_t written = fwrite(buffer, 1, size, handle->file);
+    card.countBytes(SD_OP_WRITE, written);
+    card.charge(SD_OP_WRITE, reads, writes);
+    return written;
+}
+
+// Cached sector, directory entry and both FATs, whichever are dirty
+static void syncHandle(HostFileHandle& handle) {
+    uint32_t writes = handle.cacheDirty ? 1 : 0;
+    uint32_t metadata = (handle.entryDirty ? 1 : 0) + (handle.fatDirty ? FAT_COPIES : 0);
+    handle.cacheDirty = handle.entryDirty = handle.fatDirty = false;
+    fflush(handle.file);
+    handle.syncedSize = handle.size();
+    SD.hostCard().charge(SD_OP_SYNC, 0, writes, metadata);
+}
+
+void File::flush() {
+    if (*this && handle->file && SD.ready()) syncHandle(*handle);
+}
+
+// Closes every copy, as they share the one handle
+void File::close() {
+    if (!handle) return;
+    if (handle->file) {
+        if (handle->open && SD.ready()) syncHandle(*handle);
+        fclose(handle->file);
+        handle->file = nullptr;
+    }
+    handle->open = false;
+}
+
+File File::openNextFile(uint8_t mode) {
+    if (!isDirectory() || !SD.ready()) return File();
+    if (handle->nextEntry >= handle->entries.size()) {
+        SD.card.charge(SD_OP_DIRECTORY, 0, 0);
+        return File();
+    }
+
+    SD.card.charge(SD_OP_DIRECTORY, handle->nextEntry % DIRECTORY_ENTRIES_PER_SECTOR == 0 ? 1 : 0, 0);
+    std::string path = handle->cardPath;
+    if (path.empty() || path.back() != '/') path += '/';
+    path += handle->entries[handle->nextEntry++];
+    return SD.openPath(path.c_str(), mode, false);
+}
+
+void File::rewindDirectory() {
+    if (isDirectory()) handle->nextEntry = 0;
+}
+
+// =============================================================================
+// SDClass
+// =============================================================================
+
+void SDClass::hostMount(const std::string& directory) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+    root = directory;
+    card.scan(root);
+}
+
+void SDClass::hostUnmount() {
+    root.clear();
+}
+
+void SDClass::hostConfigure(const SdCardConfig& config) {
+    card.configure(config);
+    filesLost = false;
+    if (!root.empty()) card.scan(root);
+}
+
+void SDClass::hostInsertCard() {
+    card.insert();
+    filesLost = false;
+    if (!root.empty()) card.scan(root);
+}
+
+// Mounted and in the slot. When the card goes, open files lose whatever
+// they had not synced and every handle goes dead.
+bool SDClass::ready() {
+    if (root.empty()) return false;
+    if (card.present()) return true;
+
+    if (!filesLost) {
+        for (const auto& weak : openFiles) {
+            auto handle = weak.lock();
+            if (!handle || !handle->open) continue;
+            if (handle->file) {
+                fclose(handle->file);
+                handle->file = nullptr;
+                std::error_code error;
+                fs::resize_file(handle->hostFile, handle->syncedSize, error);
+            }
+            handle->open = false;
+        }
+        openFiles.clear();
+        filesLost = true;
+    }
+    return false;
+}
+
+bool SDClass::begin(uint8_t) {
+    std::error_code error;
+    return ready() && fs::is_directory(root, error);
+}
+
+std::string SDClass::hostPath(const char* path) const {
+    std::string relative = path ? path : "";
+    while (!relative.empty() && relative.front() == '/') relative.erase(0, 1);
+    return relative.empty() ? root : root + "/" + relative;
+}
+
+File SDClass::open(const char* path, uint8_t mode) {
+    return openPath(path, mode, true);
+}
+
+// charged: the lookup costs a path walk (a listing has already paid for it)
+File SDClass::openPath(const char* path, uint8_t mode, bool charged) {
+    File opened;
+    if (!path || !ready()) {
+        card.countFailure(SD_OP_OPEN);
+        return opened;
+    }
+
+    std::string hostFile = hostPath(path);
+    std::error_code error;
+    auto handle = std::make_shared<HostFileHandle>();
+    handle->name = lastComponent(path);
+    handle->cardPath = path;
+    handle->hostFile = hostFile;
+    uint32_t created = 0;
+
+    if (fs::is_directory(hostFile, error)) {
+        for (const auto& entry : fs::directory_iterator(hostFile, error)) {
+            handle->entries.push_back(entry.path().filename().string());
+        }
+        std::sort(handle->entries.begin(), handle->entries.end());
+        handle->directory = true;
+    } else if (mode == FILE_WRITE) {
+        // Read/write, created if missing, positioned at the end
+        bool exists = fs::exists(hostFile, error);
+        handle->file = fopen(hostFile.c_str(), exists ? "r+b" : "w+b");
+        if (handle->file) {
+            fseek(handle->file, 0, SEEK_END);
+            handle->lastWasWrite = true;
+            if (!exists) created = 1;
+        }
+    } else {
+        handle->file = fopen(hostFile.c_str(), "rb");
+    }
+
+    if (charged) card.charge(SD_OP_OPEN, pathComponents(path), 0, created);
+    if (!handle->directory && !handle->file) {
+        card.countFailure(SD_OP_OPEN);
+        return opened;
+    }
+
+    if (handle->file) {
+        handle->syncedSize = handle->size();
+        handle->clusters = card.clustersFor(handle->syncedSize);
+    }
+    handle->open = true;
+    opened.handle = handle;
+
+    openFiles.erase(std::remove_if(openFiles.begin(), openFiles.end(),
+                                   [](const std::weak_ptr<HostFileHandle>& weak) { return weak.expired(); }),
+                    openFiles.end());
+    openFiles.push_back(handle);
+    return opened;
+}
+
+bool SDClass::exists(const char* path) {
+    if (!ready()) return false;
+    card.charge(SD_OP_DIRECTORY, pathComponents(path), 0);
+    std::error_code error;
+    return fs::exists(hostPath(path), error);
+}
+
+// Each new directory takes a cluster, zeroed, plus its entry and the FATs
+bool SDClass::mkdir(const char* path) {
+    if (!ready()) return false;
+    std::error_code error;
+    std::string cardPath;
+    std::string remaining = path;
+    size_t pos = 0;
+    while (pos != std::string::npos) {
+        size_t next = remaining.find('/', pos + 1);
+        cardPath = remaining.substr(0, next);
+        pos = next;
+        if (cardPath.empty() || cardPath == "/") continue;
+        if (fs::is_directory(hostPath(cardPath.c_str()), error)) continue;
+
+        if (!card.allocate(1)) {
+            card.charge(SD_OP_DIRECTORY, pathComponents(cardPath.c_str()), 0);
+            return false;
+        }
+        card.charge(SD_OP_DIRECTORY, pathComponents(cardPath.c_str()), 0,
+                    card.config().clusterSize / card.config().sectorSize + 1 + FAT_COPIES);
+        fs::create_directory(hostPath(cardPath.c_str()), error);
+    }
+    return fs::is_directory(hostPath(path), error);
+}
+
+bool SDClass::remove(const char* path) {
+    if (!ready()) return false;
+    card.charge(SD_OP_DIRECTORY, pathComponents(path), 0, 1 + FAT_COPIES);
+    std::error_code error;
+    std::string hostFile = hostPath(path);
+    if (!fs::is_regular_file(hostFile, error)) return false;
+    uint32_t clusters = card.clustersFor(fs::file_size(hostFile, error));
+    if (!fs::remove(hostFile, error)) return false;
+    card.release(clusters);
+    return true;
+}
+
+bool SDClass::rmdir(const char* path) {
+    if (!ready()) return false;
+    card.charge(SD_OP_DIRECTORY, pathComponents(path), 0, 1 + FAT_COPIES);
+    std::error_code error;
+    if (!fs::is_directory(hostPath(path), error)) return false;
+    if (!fs::remove(hostPath(path), error)) return false;    // Fails unless empty, as on the card
+    card.release(1);
+    return true;
+}
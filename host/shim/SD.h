@@ -0,0 +1,99 @@
+/*
+ * SD.h - Host shim for the Teensy SD library, backed by a directory
+ *
+ * The card is a host directory: SD.hostMount("out/card") before the
+ * sketch's SD.begin(), which fails (no card) until something is mounted.
+ * Paths are card-absolute ("/TX/MSG_00001_CH1.opus") and resolve under
+ * the mounted directory.
+ *
+ * File follows the device's semantics where the engines depend on them:
+ * copies share one open handle, FILE_WRITE creates the file and starts at
+ * its end, name() is the last path component, and a directory's
+ * openNextFile() walks its entries (in name order, for repeatable runs).
+ *
+ * Every call goes through an SdCardModel (SdCardModel.h) for its cost in
+ * virtual time, sector and cluster accounting, and injected failures.
+ * Its default is an ideal card; SD.hostConfigure() picks another.
+ */
+
+#ifndef SONGBIRD_HOST_SD_H
+#define SONGBIRD_HOST_SD_H
+
+#include "Arduino.h"
+#include "SdCardModel.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FILE_READ   0
+#define FILE_WRITE  1
+
+struct HostFileHandle;
+
+class File : public Stream {
+public:
+    File() {}
+
+    explicit operator bool() const;
+    const char* name() const;
+    bool isDirectory() const;
+
+    uint32_t size() const;
+    uint32_t position() const;
+    bool seek(uint32_t position);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    int read(void* buffer, size_t size);
+
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void flush() override;
+    void close();
+
+    File openNextFile(uint8_t mode = FILE_READ);
+    void rewindDirectory();
+
+private:
+    friend class SDClass;
+    std::shared_ptr<HostFileHandle> handle;
+};
+
+class SDClass {
+public:
+    bool begin(uint8_t csPin = 0);
+
+    File open(const char* path, uint8_t mode = FILE_READ);
+    bool exists(const char* path);
+    bool mkdir(const char* path);       // Creates missing parents too
+    bool remove(const char* path);
+    bool rmdir(const char* path);
+
+    // The harness's side
+    void hostMount(const std::string& directory);
+    void hostUnmount();
+    const std::string& hostRoot() const { return root; }
+    std::string hostPath(const char* path) const;
+
+    void hostConfigure(const SdCardConfig& config);
+    SdCardModel& hostCard() { return card; }
+    void hostRemoveCard() { card.remove(); }
+    void hostInsertCard();
+
+private:
+    friend class File;
+
+    std::string root;
+    SdCardModel card;
+    std::vector<std::weak_ptr<HostFileHandle>> openFiles;
+    bool filesLost = false;
+
+    bool ready();
+    File openPath(const char* path, uint8_t mode, bool charged);
+};
+
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * SdCardModel.cpp - SD card cost, space and removal accounting
+ */
+
+#include "SdCardModel.h"
+#include "Arduino.h"
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Rough figures for a Teensy 4.1 SDIO slot: a decent class 10 card, and
+// one late in its life with long garbage-collection stalls
+bool SdCardConfig::preset(const std::string& name, SdCardConfig& config) {
+    config = SdCardConfig();
+    if (name == "ideal") return true;
+
+    SdLatency* latency = config.latency;
+    if (name == "class10" || name == "worn") {
+        latency[SD_OP_OPEN] = {20, 300, 25, 100, 0, 0, 0};
+        latency[SD_OP_READ] = {1, 150, 25, 50, 0, 0, 0};
+        latency[SD_OP_WRITE] = {1, 250, 40, 150, 0.002f, 20000, 120000};
+        latency[SD_OP_SYNC] = {2, 400, 40, 200, 0.01f, 20000, 150000};
+        latency[SD_OP_DIRECTORY] = {5, 200, 25, 100, 0, 0, 0};
+        if (name == "class10") return true;
+
+        latency[SD_OP_WRITE].perSectorUs = 80;
+        latency[SD_OP_WRITE].stallChance = 0.01f;
+        latency[SD_OP_WRITE].stallMinUs = 100000;
+        latency[SD_OP_WRITE].stallMaxUs = 500000;
+        latency[SD_OP_SYNC].perSectorUs = 80;
+        latency[SD_OP_SYNC].stallChance = 0.05f;
+        latency[SD_OP_SYNC].stallMinUs = 100000;
+        latency[SD_OP_SYNC].stallMaxUs = 800000;
+        return true;
+    }
+    return false;
+}
+
+double SdCardStats::writeAmplification(uint32_t sectorSize) const {
+    if (bytesWritten == 0) return 0;
+    return (double)(sectorsWritten + metadataSectorsWritten) * sectorSize / bytesWritten;
+}
+
+void SdCardModel::configure(const SdCardConfig& config) {
+    settings = config;
+    counters = SdCardStats();
+    inserted = true;
+    writeCalls = 0;
+    random = config.seed ? config.seed : 1;
+    if (settings.detectPin >= 0) hostSetPin(settings.detectPin, LOW);
+}
+
+// =============================================================================
+// Presence
+// =============================================================================
+
+bool SdCardModel::present() {
+    if (inserted && settings.removeAtMicros && hostMicros() >= settings.removeAtMicros) remove();
+    return inserted;
+}
+
+void SdCardModel::remove() {
+    if (!inserted) return;
+    inserted = false;
+    counters.removals++;
+    if (settings.detectPin >= 0) hostSetPin(settings.detectPin, HIGH);
+}
+
+// Triggers that already fired stay spent
+void SdCardModel::insert() {
+    inserted = true;
+    settings.removeAtMicros = 0;
+    settings.removeAfterWrites = 0;
+    if (settings.detectPin >= 0) hostSetPin(settings.detectPin, LOW);
+}
+
+// =============================================================================
+// Space
+// =============================================================================
+
+void SdCardModel::scan(const std::string& root) {
+    usedClusters = 0;
+    std::error_code error;
+    for (auto it = fs::recursive_directory_iterator(root, error); !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+        if (it->is_directory(error)) usedClusters++;
+        else usedClusters += clustersFor(it->file_size(error));
+    }
+}
+
+uint32_t SdCardModel::clustersFor(uint64_t bytes) const {
+    return (uint32_t)((bytes + settings.clusterSize - 1) / settings.clusterSize);
+}
+
+bool SdCardModel::allocate(uint32_t clusters) {
+    if (settings.capacityBytes) {
+        uint64_t total = settings.capacityBytes / settings.clusterSize;
+        if (usedClusters + clusters > total) return false;
+    }
+    usedClusters += clusters;
+    counters.clustersAllocated += clusters;
+    return true;
+}
+
+void SdCardModel::release(uint32_t clusters) {
+    usedClusters = clusters > usedClusters ? 0 : usedClusters - clusters;
+}
+
+// =============================================================================
+// Cost
+// =============================================================================
+
+void SdCardModel::charge(SdOperation op, uint32_t sectorsRead, uint32_t dataSectorsWritten,
+                         uint32_t metadataSectorsWritten) {
+    const SdLatency& latency = settings.latency[op];
+    uint32_t sectors = sectorsRead + dataSectorsWritten + metadataSectorsWritten;
+    uint64_t cost = latency.callUs;
+
+    counters.calls[op]++;
+    counters.sectorsRead += sectorsRead;
+    counters.sectorsWritten += dataSectorsWritten;
+    counters.metadataSectorsWritten += metadataSectorsWritten;
+
+    if (sectors > 0) {
+        counters.accesses[op]++;
+        cost += latency.accessUs + (uint64_t)latency.perSectorUs * sectors;
+        if (latency.jitterUs) cost += nextRandom() % (latency.jitterUs + 1);
+        if (latency.stallChance > 0 && (nextRandom() & 0xFFFFFF) < latency.stallChance * 0x1000000) {
+            uint32_t span = latency.stallMaxUs > latency.stallMinUs ? latency.stallMaxUs - latency.stallMinUs : 0;
+            cost += latency.stallMinUs + (span ? nextRandom() % (span + 1) : 0);
+            counters.stalls++;
+        }
+    }
+
+    counters.latencyUs[op] += cost;
+    if (cost > counters.maxLatencyUs[op]) counters.maxLatencyUs[op] = (uint32_t)cost;
+    if (cost) hostAdvanceMicros(cost);
+}
+
+void SdCardModel::countBytes(SdOperation op, size_t bytes) {
+    if (op == SD_OP_WRITE) counters.bytesWritten += bytes;
+    else counters.bytesRead += bytes;
+}
+
+void SdCardModel::countWriteCall() {
+    writeCalls++;
+    if (inserted && settings.removeAfterWrites && writeCalls >= settings.removeAfterWrites) remove();
+}
+
+void SdCardModel::countFailure(SdOperation op) {
+    if (op == SD_OP_WRITE) counters.failedWrites++;
+    else if (op == SD_OP_OPEN) counters.failedOpens++;
+}
+
+// xorshift32
+uint32_t SdCardModel::nextRandom() {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
@@ -0,0 +1,132 @@
+/*
+ * SdCardModel.h - Timing, wear and failure model behind the host SD shim
+ *
+ * SD.cpp keeps the files in a host directory; this decides what each
+ * call would have cost on a real card and whether the card is still
+ * there. Accounting follows SdFat on a FAT32 card closely enough to
+ * compare engine versions, not to predict a particular card:
+ *
+ *   - One 512-byte sector cache per file. Partial-sector writes land in
+ *     it and reach the card when the file moves to another sector or
+ *     syncs; whole sectors go straight to the card.
+ *   - A file grows a cluster at a time. Allocation dirties the FAT (two
+ *     copies), a size change dirties the directory entry; both are
+ *     written on flush() and close().
+ *   - Opening a path reads one directory sector per component; a
+ *     directory listing reads one sector per 16 entries.
+ *
+ * Time: every call costs callUs; a call that reaches the card adds
+ * accessUs, perSectorUs per sector, up to jitterUs, and with stallChance
+ * a busy-card stall between stallMinUs and stallMaxUs. The cost moves
+ * the virtual clock, so the sketch is blocked for it while the audio
+ * interrupt (a HostTimer) keeps running. A seeded generator makes every
+ * run with the same config identical.
+ *
+ * Failures: a capacity makes writes fail once the clusters run out; the
+ * card can be pulled at a virtual time, after a number of write calls,
+ * or by the harness. Pulling it loses what the open files had not synced
+ * and drives detectPin HIGH (the sketches' card-detect convention).
+ *
+ * The default config is an ideal card: no time, no limit, no failures.
+ */
+
+#ifndef SONGBIRD_HOST_SDCARDMODEL_H
+#define SONGBIRD_HOST_SDCARDMODEL_H
+
+#include <stdint.h>
+#include <string>
+
+enum SdOperation {
+    SD_OP_OPEN,
+    SD_OP_READ,
+    SD_OP_WRITE,
+    SD_OP_SYNC,         // flush() and close()
+    SD_OP_DIRECTORY,    // Listing, exists, mkdir, remove
+    SD_OP_COUNT
+};
+
+struct SdLatency {
+    uint32_t callUs = 0;
+    uint32_t accessUs = 0;
+    uint32_t perSectorUs = 0;
+    uint32_t jitterUs = 0;
+    float stallChance = 0;
+    uint32_t stallMinUs = 0;
+    uint32_t stallMaxUs = 0;
+};
+
+struct SdCardConfig {
+    uint64_t capacityBytes = 0;         // 0: unlimited
+    uint32_t sectorSize = 512;
+    uint32_t clusterSize = 32768;
+    SdLatency latency[SD_OP_COUNT];
+    uint32_t seed = 1;
+
+    uint64_t removeAtMicros = 0;        // Pull the card at this virtual time (0: never)
+    uint32_t removeAfterWrites = 0;     // ...or on this write call (0: never)
+    int detectPin = -1;                 // Driven HIGH while the card is out
+
+    // "ideal", "class10" or "worn"; false for an unknown name
+    static bool preset(const std::string& name, SdCardConfig& config);
+};
+
+struct SdCardStats {
+    uint32_t calls[SD_OP_COUNT] = {};
+    uint32_t accesses[SD_OP_COUNT] = {};
+    uint64_t latencyUs[SD_OP_COUNT] = {};
+    uint32_t maxLatencyUs[SD_OP_COUNT] = {};
+    uint32_t stalls = 0;
+
+    uint64_t bytesRead = 0;             // What the sketch asked for
+    uint64_t bytesWritten = 0;
+    uint64_t sectorsRead = 0;           // What the card did
+    uint64_t sectorsWritten = 0;        // File data
+    uint64_t metadataSectorsWritten = 0;// FAT and directory
+    uint32_t clustersAllocated = 0;
+
+    uint32_t failedWrites = 0;          // Card full or gone
+    uint32_t failedOpens = 0;
+    uint32_t removals = 0;
+
+    // Sectors written per sector's worth of data the sketch wrote
+    double writeAmplification(uint32_t sectorSize) const;
+};
+
+class SdCardModel {
+public:
+    void configure(const SdCardConfig& config);
+    const SdCardConfig& config() const { return settings; }
+    const SdCardStats& stats() const { return counters; }
+    void resetStats() { counters = SdCardStats(); }
+
+    // Card presence, checking the configured removal triggers
+    bool present();
+    void remove();
+    void insert();
+
+    // Space, in clusters as FAT allocates it
+    void scan(const std::string& root);
+    bool allocate(uint32_t clusters);
+    void release(uint32_t clusters);
+    uint32_t clustersFor(uint64_t bytes) const;
+    uint64_t usedBytes() const { return (uint64_t)usedClusters * settings.clusterSize; }
+
+    // Account one call and move the virtual clock by what it cost
+    void charge(SdOperation op, uint32_t sectorsRead, uint32_t dataSectorsWritten,
+                uint32_t metadataSectorsWritten = 0);
+    void countBytes(SdOperation op, size_t bytes);
+    void countWriteCall();
+    void countFailure(SdOperation op);
+
+private:
+    SdCardConfig settings;
+    SdCardStats counters;
+    bool inserted = true;
+    uint32_t writeCalls = 0;
+    uint64_t usedClusters = 0;
+    uint32_t random = 1;
+
+    uint32_t nextRandom();
+};
+
+#endif
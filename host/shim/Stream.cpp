@@ -0,0 +1,72 @@
+/*
+ * Stream.cpp - Host shim Print, Stream and HostStream
+ */
+
+#include "Stream.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (size--) written += write(*buffer++);
+    return written;
+}
+
+size_t Print::write(const char* text) {
+    if (!text) return 0;
+    return write((const uint8_t*)text, strlen(text));
+}
+
+int Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return length;
+    if ((size_t)length >= sizeof(buffer)) length = sizeof(buffer) - 1;
+    return (int)write((const uint8_t*)buffer, length);
+}
+
+// No timeout to wait out: whatever has arrived is all there is
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length && available() > 0) {
+        buffer[count++] = (uint8_t)read();
+    }
+    return count;
+}
+
+int HostStream::read() {
+    if (rx.empty()) return -1;
+    uint8_t byte = rx.front();
+    rx.pop_front();
+    return byte;
+}
+
+int HostStream::peek() {
+    return rx.empty() ? -1 : rx.front();
+}
+
+size_t HostStream::write(uint8_t byte) {
+    tx.push_back(byte);
+    written++;
+    return 1;
+}
+
+size_t HostStream::write(const uint8_t* buffer, size_t size) {
+    tx.insert(tx.end(), buffer, buffer + size);
+    written += size;
+    return size;
+}
+
+void HostStream::hostPush(const uint8_t* data, size_t size) {
+    rx.insert(rx.end(), data, data + size);
+}
+
+std::vector<uint8_t> HostStream::hostTake() {
+    std::vector<uint8_t> taken;
+    taken.swap(tx);
+    return taken;
+}
@@ -0,0 +1,75 @@
+/*
+ * Stream.h - Host shim for the Arduino Print and Stream classes
+ *
+ * Print is the device's interface (write() plus print/println/printf on
+ * top). HostStream is a Stream whose two directions are byte queues the
+ * harness fills and drains: it stands in for a serial port with the
+ * other end (a bridge, a host application) played by the harness.
+ */
+
+#ifndef SONGBIRD_HOST_STREAM_H
+#define SONGBIRD_HOST_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+#include "WString.h"
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t byte) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* text);
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value) { return printf("%.2f", value); }
+
+    size_t println() { return write((uint8_t)'\n'); }
+    template <class T> size_t println(const T& value) { return print(value) + println(); }
+
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+
+    size_t readBytes(uint8_t* buffer, size_t length);
+};
+
+class HostStream : public Stream {
+public:
+    // The sketch's side
+    int available() override { return (int)rx.size(); }
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+
+    // The harness's side: bytes for the sketch to read, and what it wrote
+    void hostPush(const uint8_t* data, size_t size);
+    size_t hostPending() const { return tx.size(); }
+    std::vector<uint8_t> hostTake();
+
+    uint64_t hostBytesWritten() const { return written; }
+
+private:
+    std::deque<uint8_t> rx;
+    std::vector<uint8_t> tx;
+    uint64_t written = 0;
+};
+
+#endif
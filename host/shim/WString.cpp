@@ -0,0 +1,51 @@
+/*
+ * WString.cpp - Host shim String
+ */
+
+#include "WString.h"
+#include <stdlib.h>
+
+bool String::startsWith(const String& prefix) const {
+    return value.compare(0, prefix.value.size(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    if (suffix.value.size() > value.size()) return false;
+    return value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t found = value.find(c, from);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+int String::indexOf(const String& text, unsigned int from) const {
+    size_t found = value.find(text.value, from);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+int String::lastIndexOf(char c) const {
+    size_t found = value.rfind(c);
+    return found == std::string::npos ? -1 : (int)found;
+}
+
+String String::substring(unsigned int begin) const {
+    return substring(begin, length());
+}
+
+// Arguments in either order, clamped to the string, as Arduino does
+String String::substring(unsigned int begin, unsigned int end) const {
+    if (begin > end) {
+        unsigned int swap = begin;
+        begin = end;
+        end = swap;
+    }
+    if (begin >= value.size()) return String();
+    if (end > value.size()) end = (unsigned int)value.size();
+    return String(value.substr(begin, end - begin));
+}
+
+// Leading digits only; 0 when there are none
+long String::toInt() const {
+    return strtol(value.c_str(), nullptr, 10);
+}
@@ -0,0 +1,536 @@
+/*
+ * Transcoder.cpp - Batch WAV <-> VoiceChat .opus conversion on all cores
+ *
+ *   opus_transcode encode [-j threads] [-b bitrate] [-c complexity] [-q] <wav|dir> <out>
+ *   opus_transcode decode [-j threads] [-q] <opus|dir> <out>
+ *   opus_transcode verify <wav>...
+ *
+ * encode writes the sketch's recording format ("OPUS" 1.0, then a 16-bit
+ * little-endian size before each packet) from 16-bit WAV at 44.1 kHz,
+ * first channel. Samples reach OpusCodec exactly as RecordingEngine gives
+ * them: 128-sample blocks, the last one padded with silence as the audio
+ * interrupt would, every ready packet taken after each block, and the
+ * encoder reset at the start of each file. At the firmware's bitrate and
+ * complexity (the defaults) the output is the file the device records;
+ * verify checks that by recording each WAV with RecordingEngine on the
+ * SD shim and comparing the bytes.
+ *
+ * decode reads the same format (packet sizes checked as PlaybackEngine
+ * does) and writes mono 44.1 kHz WAV. The decoder is reset per file, so a
+ * file decodes the same whichever worker gets it.
+ *
+ * A directory is walked recursively and mirrored under <out> with the
+ * extension swapped; a single file goes to <out>, or into it when <out>
+ * is a directory. Files are converted in parallel (-j, default one per
+ * core) by a work-stealing pool with one OpusCodec per worker, streaming
+ * a block at a time, so memory does not grow with file length. Each
+ * output is written beside its destination and renamed into place once
+ * complete; a failed file leaves nothing behind.
+ *
+ * One JSON line per file on stdout, in input order, then a summary;
+ * progress on stderr (-q to silence). Exits 1 if any file failed.
+ */
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <Audio.h>
+#include <SD.h>
+#include "Config.h"
+#include "OpusCodec.h"
+#include "RecordingEngine.h"
+#include "AudioHarness.h"
+#include "WavFile.h"
+#include "WorkPool.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const uint8_t OPUS_FILE_HEADER[] = {'O', 'P', 'U', 'S', 0x01, 0x00};
+
+struct Job {
+    std::string input;
+    std::string output;
+    std::string name;       // Input relative to what was given, for the report
+    uint64_t inputBytes = 0;
+};
+
+struct JobResult {
+    bool ok = false;
+    std::string error;
+    uint64_t outputBytes = 0;
+    uint32_t packets = 0;
+    uint64_t samples = 0;   // Audio at 44.1 kHz, in or out
+    double seconds = 0;     // Wall time on its worker
+};
+
+static double elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// =============================================================================
+// Encode
+// =============================================================================
+
+static bool writePacket(FILE* file, const uint8_t* packet, int size) {
+    uint8_t length[2] = {(uint8_t)size, (uint8_t)(size >> 8)};
+    return fwrite(length, 1, 2, file) == 2 && fwrite(packet, 1, size, file) == (size_t)size;
+}
+
+// Everything but the rename; file is closed by the caller
+static bool encodeStream(OpusCodec& codec, WavReader& reader, FILE* file, JobResult& result) {
+    if (fwrite(OPUS_FILE_HEADER, 1, sizeof(OPUS_FILE_HEADER), file) != sizeof(OPUS_FILE_HEADER)) {
+        result.error = "write failed";
+        return false;
+    }
+    result.outputBytes = sizeof(OPUS_FILE_HEADER);
+    codec.resetEncoder();
+
+    std::vector<int16_t> frames((size_t)AUDIO_BLOCK_SAMPLES * reader.channels());
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    uint8_t packet[OPUS_MAX_PACKET_SIZE];
+    size_t count;
+
+    while ((count = reader.read(frames.data(), AUDIO_BLOCK_SAMPLES)) > 0) {
+        for (size_t i = 0; i < count; i++) block[i] = frames[i * reader.channels()];
+        std::fill(block + count, block + AUDIO_BLOCK_SAMPLES, 0);
+        result.samples += count;
+
+        if (codec.addSamples(block, AUDIO_BLOCK_SAMPLES) < 0) {
+            result.error = "encoder error " + std::to_string(codec.getLastError());
+            return false;
+        }
+        while (codec.hasEncodedPacket()) {
+            int size = codec.getEncodedPacket(packet, sizeof(packet));
+            if (size <= 0) continue;
+            if (!writePacket(file, packet, size)) {
+                result.error = "write failed";
+                return false;
+            }
+            result.outputBytes += 2 + size;
+            result.packets++;
+        }
+    }
+    return true;
+}
+
+static bool encodeFile(OpusCodec& codec, const Job& job, JobResult& result) {
+    WavReader reader;
+    if (!reader.open(job.input, result.error)) return false;
+    if (reader.sampleRate() != TEENSY_SAMPLE_RATE) {
+        result.error = std::to_string(reader.sampleRate()) + " Hz, not " + std::to_string(TEENSY_SAMPLE_RATE);
+        return false;
+    }
+
+    std::string part = job.output + ".part";
+    FILE* file = fopen(part.c_str(), "wb");
+    if (!file) {
+        result.error = "cannot create " + part;
+        return false;
+    }
+    bool ok = encodeStream(codec, reader, file, result);
+    if (fclose(file) != 0 && ok) {
+        result.error = "write failed";
+        ok = false;
+    }
+
+    std::error_code error;
+    if (ok) fs::rename(part, job.output, error);
+    if (!ok || error) {
+        if (ok) result.error = "cannot rename to " + job.output;
+        fs::remove(part, error);
+        return false;
+    }
+    return true;
+}
+
+// =============================================================================
+// Decode
+// =============================================================================
+
+static bool decodeStream(OpusCodec& codec, FILE* file, WavWriter& writer, JobResult& result) {
+    uint8_t header[sizeof(OPUS_FILE_HEADER)];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, OPUS_FILE_HEADER, 4) != 0) {
+        result.error = "not a VoiceChat .opus file";
+        return false;
+    }
+    codec.resetDecoder();
+
+    uint8_t packet[OPUS_MAX_PACKET_SIZE];
+    int16_t samples[RESAMPLE_OUTPUT_SAMPLES];
+    uint8_t length[2];
+    size_t got;
+
+    while ((got = fread(length, 1, 2, file)) == 2) {
+        uint16_t size = length[0] | (length[1] << 8);
+        if (size == 0 || size > OPUS_MAX_PACKET_SIZE) {
+            result.error = "invalid packet size " + std::to_string(size) + " after packet " +
+                           std::to_string(result.packets);
+            return false;
+        }
+        if (fread(packet, 1, size, file) != size) {
+            result.error = "truncated in packet " + std::to_string(result.packets + 1);
+            return false;
+        }
+
+        int count = codec.decode(packet, size, samples, RESAMPLE_OUTPUT_SAMPLES);
+        if (count < 0) {
+            result.error = "decoder error " + std::to_string(codec.getLastError()) + " in packet " +
+                           std::to_string(result.packets + 1);
+            return false;
+        }
+        if (!writer.write(samples, count)) {
+            result.error = "write failed";
+            return false;
+        }
+        result.packets++;
+        result.samples += count;
+    }
+    if (got != 0) {
+        result.error = "truncated packet size";
+        return false;
+    }
+    return true;
+}
+
+static bool decodeFile(OpusCodec& codec, const Job& job, JobResult& result) {
+    FILE* file = fopen(job.input.c_str(), "rb");
+    if (!file) {
+        result.error = "cannot open " + job.input;
+        return false;
+    }
+
+    std::string part = job.output + ".part";
+    WavWriter writer;
+    bool ok = writer.open(part, TEENSY_SAMPLE_RATE, 1);
+    if (!ok) result.error = "cannot create " + part;
+    if (ok) ok = decodeStream(codec, file, writer, result);
+    fclose(file);
+    if (!writer.close() && ok) {
+        result.error = "write failed";
+        ok = false;
+    }
+
+    std::error_code error;
+    if (ok) {
+        result.outputBytes = 44 + result.samples * 2;
+        fs::rename(part, job.output, error);
+    }
+    if (!ok || error) {
+        if (ok) result.error = "cannot rename to " + job.output;
+        fs::remove(part, error);
+        return false;
+    }
+    return true;
+}
+
+// =============================================================================
+// Batch
+// =============================================================================
+
+static bool hasExtension(const fs::path& path, const char* extension) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == extension;
+}
+
+// Jobs for one input argument; false (with a message) if it is unusable
+static bool collectJobs(const std::string& input, const std::string& output, const char* fromExt,
+                        const char* toExt, std::vector<Job>& jobs, std::string& message) {
+    std::error_code error;
+    if (!fs::is_directory(input, error)) {
+        if (!fs::exists(input, error)) {
+            message = input + " does not exist";
+            return false;
+        }
+        Job job;
+        job.input = input;
+        job.name = fs::path(input).filename().string();
+        job.output = output;
+        if (fs::is_directory(output, error)) {
+            job.output = (fs::path(output) / fs::path(input).filename().replace_extension(toExt)).string();
+        }
+        job.inputBytes = fs::file_size(input, error);
+        jobs.push_back(job);
+        return true;
+    }
+
+    std::vector<fs::path> found;
+    for (auto it = fs::recursive_directory_iterator(input, error); !error && it != fs::recursive_directory_iterator();
+         it.increment(error)) {
+        if (it->is_regular_file(error) && hasExtension(it->path(), fromExt)) found.push_back(it->path());
+    }
+    if (error) {
+        message = "cannot walk " + input + ": " + error.message();
+        return false;
+    }
+    std::sort(found.begin(), found.end());
+
+    for (const fs::path& path : found) {
+        fs::path relative = path.lexically_relative(input);
+        fs::path target = fs::path(output) / relative;
+        target.replace_extension(toExt);
+        fs::create_directories(target.parent_path(), error);
+        if (error) {
+            message = "cannot create " + target.parent_path().string();
+            return false;
+        }
+
+        Job job;
+        job.input = path.string();
+        job.output = target.string();
+        job.name = relative.string();
+        job.inputBytes = fs::file_size(path, error);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+static void showProgress(size_t done, size_t count, uint64_t bytesDone, double seconds) {
+    fprintf(stderr, "\ropus_transcode: %zu/%zu files, %.1f MB/s   ", done, count,
+            seconds > 0 ? bytesDone / seconds / 1e6 : 0.0);
+    if (done == count) fprintf(stderr, "\n");
+}
+
+static int transcode(bool encoding, const std::string& input, const std::string& output, unsigned workers,
+                     int bitrate, int complexity, bool quiet) {
+    std::vector<Job> jobs;
+    std::string message;
+    std::error_code error;
+    if (fs::is_directory(input, error)) fs::create_directories(output, error);
+    if (!collectJobs(input, output, encoding ? ".wav" : ".opus", encoding ? ".opus" : ".wav", jobs, message)) {
+        fprintf(stderr, "opus_transcode: %s\n", message.c_str());
+        return 1;
+    }
+
+    // Codecs are set up here; workers only use their own
+    WorkPool pool(std::min<size_t>(workers, std::max<size_t>(jobs.size(), 1)));
+    std::vector<std::unique_ptr<OpusCodec>> codecs;
+    for (unsigned i = 0; i < pool.workers(); i++) {
+        codecs.emplace_back(new OpusCodec());
+        if (!codecs.back()->begin()) {
+            fprintf(stderr, "opus_transcode: codec did not start\n");
+            return 1;
+        }
+        if (bitrate) codecs.back()->setBitrate(bitrate);
+        if (complexity >= 0) codecs.back()->setComplexity(complexity);
+    }
+
+    std::vector<JobResult> results(jobs.size());
+    std::vector<uint64_t> costs(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) costs[i] = jobs[i].inputBytes;
+    std::atomic<uint64_t> bytesDone{0};
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(costs,
+             [&](unsigned worker, size_t job) {
+                 auto jobStart = std::chrono::steady_clock::now();
+                 OpusCodec& codec = *codecs[worker];
+                 JobResult& result = results[job];
+                 result.ok = encoding ? encodeFile(codec, jobs[job], result) : decodeFile(codec, jobs[job], result);
+                 result.seconds = elapsedSince(jobStart);
+                 bytesDone += jobs[job].inputBytes;
+             },
+             [&](size_t done, size_t count) {
+                 if (!quiet) showProgress(done, count, bytesDone, elapsedSince(start));
+             });
+    double seconds = elapsedSince(start);
+
+    int failed = 0;
+    uint64_t inputBytes = 0, outputBytes = 0, samples = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const JobResult& result = results[i];
+        if (!result.ok) {
+            fprintf(stderr, "opus_transcode: %s: %s\n", jobs[i].input.c_str(), result.error.c_str());
+            printf("{\"file\":\"%s\",\"ok\":false}\n", jobs[i].name.c_str());
+            failed++;
+            continue;
+        }
+        double audioSeconds = (double)result.samples / TEENSY_SAMPLE_RATE;
+        printf("{\"file\":\"%s\",\"ok\":true,\"input_bytes\":%llu,\"output_bytes\":%llu,\"packets\":%u,"
+               "\"audio_s\":%.2f,\"wall_s\":%.3f,\"realtime_x\":%.1f}\n",
+               jobs[i].name.c_str(), (unsigned long long)jobs[i].inputBytes,
+               (unsigned long long)result.outputBytes, result.packets, audioSeconds, result.seconds,
+               result.seconds > 0 ? audioSeconds / result.seconds : 0.0);
+        inputBytes += jobs[i].inputBytes;
+        outputBytes += result.outputBytes;
+        samples += result.samples;
+    }
+
+    double audioSeconds = (double)samples / TEENSY_SAMPLE_RATE;
+    printf("{\"summary\":\"%s\",\"files\":%zu,\"failed\":%d,\"workers\":%u,\"steals\":%u,\"input_bytes\":%llu,"
+           "\"output_bytes\":%llu,\"audio_s\":%.2f,\"wall_s\":%.3f,\"realtime_x\":%.1f,\"mb_per_s\":%.2f}\n",
+           encoding ? "encode" : "decode", jobs.size(), failed, pool.workers(), pool.steals(),
+           (unsigned long long)inputBytes, (unsigned long long)outputBytes, audioSeconds, seconds,
+           seconds > 0 ? audioSeconds / seconds : 0.0, seconds > 0 ? inputBytes / seconds / 1e6 : 0.0);
+    return failed ? 1 : 0;
+}
+
+// =============================================================================
+// Verify against RecordingEngine
+// =============================================================================
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& bytes) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    uint8_t buffer[65536];
+    size_t count;
+    bytes.clear();
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + count);
+    fclose(file);
+    return true;
+}
+
+// What the device records for the whole of the WAV, played into the mic
+static bool recordOnDevice(const std::string& wavPath, const std::string& card, std::vector<uint8_t>& bytes,
+                           std::string& error) {
+    WavData wav;
+    if (!readWav(wavPath, wav, error)) return false;
+
+    std::error_code fsError;
+    fs::remove_all(card, fsError);
+    fs::create_directories(card, fsError);
+    SD.hostConfigure(SdCardConfig());
+    SD.hostMount(card);
+
+    RecordingEngine recorder;
+    AudioRecordQueue queue;
+    AudioHarness audio(&queue, NULL);
+    if (!audio.setInput(wav, error)) return false;
+    if (!recorder.begin()) {
+        error = "RecordingEngine did not start";
+        return false;
+    }
+
+    queue.begin();
+    if (!recorder.startRecording(0)) {
+        error = "RecordingEngine did not start recording";
+        return false;
+    }
+    uint64_t blocks = (wav.frames() + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES;
+    while (audio.blocksRun() < blocks) {
+        audio.runBlocks(1);
+        recorder.processRecording(&queue);
+        if (!recorder.isRecording()) {
+            error = "RecordingEngine stopped early";
+            return false;
+        }
+    }
+    queue.end();
+    String filename = recorder.getCurrentFileName();
+    if (!recorder.stopRecording()) {
+        error = "RecordingEngine did not close the file";
+        return false;
+    }
+    std::string recorded = SD.hostPath(filename.c_str());
+    SD.hostUnmount();
+
+    if (!readFile(recorded, bytes)) {
+        error = "cannot read back " + std::string(filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+static int verify(const std::vector<std::string>& files) {
+    fs::path scratch = fs::temp_directory_path() / ("opus_transcode_" + std::to_string(getpid()));
+    std::error_code error;
+    fs::create_directories(scratch, error);
+
+    OpusCodec codec;
+    if (!codec.begin()) {
+        fprintf(stderr, "opus_transcode: codec did not start\n");
+        return 1;
+    }
+
+    int failed = 0;
+    for (const std::string& path : files) {
+        Job job;
+        job.input = path;
+        job.output = (scratch / "transcoded.opus").string();
+        JobResult result;
+        std::vector<uint8_t> device, transcoded;
+        std::string message;
+
+        bool ok = encodeFile(codec, job, result) && readFile(job.output, transcoded);
+        if (!ok) message = result.error;
+        if (ok && !recordOnDevice(path, (scratch / "card").string(), device, message)) ok = false;
+
+        size_t mismatch = 0;
+        if (ok) {
+            mismatch = std::mismatch(device.begin(), device.end(), transcoded.begin(), transcoded.end()).first -
+                       device.begin();
+            ok = device == transcoded;
+            if (!ok) message = "differs from the recording at byte " + std::to_string(mismatch);
+        }
+        if (!ok) {
+            fprintf(stderr, "opus_transcode: %s: %s\n", path.c_str(), message.c_str());
+            failed++;
+        }
+        printf("{\"file\":\"%s\",\"identical\":%s,\"device_bytes\":%zu,\"transcoded_bytes\":%zu}\n",
+               fs::path(path).filename().string().c_str(), ok ? "true" : "false", device.size(),
+               transcoded.size());
+    }
+
+    fs::remove_all(scratch, error);
+    return failed ? 1 : 0;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+static int usage() {
+    fprintf(stderr, "usage: opus_transcode encode [-j threads] [-b bitrate] [-c complexity] [-q] <wav|dir> <out>\n"
+                    "       opus_transcode decode [-j threads] [-q] <opus|dir> <out>\n"
+                    "       opus_transcode verify <wav>...\n");
+    return 2;
+}
+
+static bool parseInt(const char* text, long low, long high, long& value) {
+    char* end;
+    value = strtol(text, &end, 10);
+    return *text && !*end && value >= low && value <= high;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+    std::string command = argv[1];
+
+    if (command == "verify") {
+        return verify(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (command != "encode" && command != "decode") return usage();
+    bool encoding = command == "encode";
+
+    long workers = defaultWorkers();
+    long bitrate = 0;
+    long complexity = -1;
+    bool quiet = false;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-q") {
+            quiet = true;
+        } else if (arg == "-j") {
+            if (i + 1 >= argc || !parseInt(argv[++i], 1, 256, workers)) return usage();
+        } else if (arg == "-b" && encoding) {
+            if (i + 1 >= argc || !parseInt(argv[++i], 500, 512000, bitrate)) return usage();
+        } else if (arg == "-c" && encoding) {
+            if (i + 1 >= argc || !parseInt(argv[++i], 0, 10, complexity)) return usage();
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2) return usage();
+
+    return transcode(encoding, paths[0], paths[1], (unsigned)workers, (int)bitrate, (int)complexity, quiet);
+}
@@ -0,0 +1,604 @@
+/*
+ * TunerBench.cpp - Accuracy and latency benchmark for the UkuleleTuner
+ *
+ *   tuner_bench generate <dir>          Write the synthetic fixtures
+ *   tuner_bench run <manifest.csv>      Benchmark, JSON lines on stdout
+ *   tuner_bench strum <strum.csv>       Strum mode on the chord fixtures
+ *   tuner_bench strobe-check            Strobe accuracy on the clean plucks
+ *
+ * Each fixture goes block by block through the tuner's own detector code
+ * (built against the host shims), the way the sketch drives it:
+ *
+ *   mpm-auto          PitchDetector over the preset's range +
+ *                     StringClassifier (chromatic: full range, nearest
+ *                     semitone). The default.
+ *   yin               The library's AudioAnalyzeNoteFrequency (YinReference:
+ *                     44.1 kHz, 3072-sample window, probability > 0.9)
+ *                     that PitchDetector replaced, with the same string
+ *                     classification as mpm-auto
+ *   mpm-auto-ungated  The same as mpm-auto with the note gate disabled
+ *   mpm-string        PitchDetector narrowed to the expected string
+ *   strobe            StrobeTuner locked to the expected target
+ *
+ * One line per fixture and detector, then one summary line per detector.
+ * A reading is correct when it lands on the expected target; its error
+ * is the reported offset minus the true offset. Stable means three
+ * correct readings in a row within 1 cent of each other; the error
+ * figures cover the correct readings from then on. Readings before the
+ * onset and readings on the wrong target are false detections.
+ *
+ * CPU is summarized separately for idle fixtures (noise, no note) and
+ * playing ones. When both run, a comparison line puts mpm-auto's
+ * latency, error and cycles next to yin's.
+ *
+ * strum runs StrumAnalyzer over each chord, calling analyze() after every
+ * block as loop() would. Analyses whose window starts once every string
+ * has been struck are scored per string: the cents error of a sounding
+ * string, a miss when it is not reported, and a false "sounding" flag
+ * when a muted string is. Any string reported from a window that ends
+ * before the strum is a false detection too. One line per fixture, then
+ * one summary line per preset.
+ *
+ * strobe-check generates the clean plucks of the synthetic set in memory
+ * and fails (exit 1) unless the strobe locks on every one and every
+ * reading from its lock on is within STROBE_CHECK_CENTS of the truth.
+ */
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Config.h"
+#include "PitchDetector.h"
+#include "StringClassifier.h"
+#include "StrobeTuner.h"
+#include "StrumAnalyzer.h"
+#include "TuningEngine.h"
+#include "TuningMath.h"
+#include "TunerFixtures.h"
+#include "WavFile.h"
+#include "YinReference.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define STABLE_READINGS      3
+#define STABLE_SPREAD_CENTS  1.0
+#define STROBE_CHECK_CENTS   0.1
+
+static const char* DETECTORS[] = { "mpm-auto", "yin", "mpm-auto-ungated", "mpm-string", "strobe" };
+#define DETECTOR_COUNT (sizeof(DETECTORS) / sizeof(DETECTORS[0]))
+
+struct Reading {
+    double ms;          // From the onset
+    bool correct;
+    double error;       // Cents
+};
+
+struct FixtureResult {
+    std::vector<Reading> readings;
+    std::vector<uint32_t> blockCycles;
+};
+
+struct Summary {
+    int fixtures = 0;
+    int missed = 0;
+    int falseDetections = 0;
+    int idleFixtures = 0;
+    int idleFalseDetections = 0;
+    long readings = 0;
+    std::vector<double> stableMs;
+    std::vector<double> errors;
+    std::vector<double> blockCycles;
+    std::vector<double> idleBlockCycles;
+};
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+// Chromatic target: the nearest equal-tempered note at A4 = 440 Hz
+static double nearestSemitone(double frequency) {
+    static TuningEngine tuning;
+    float cents;
+    return tuning.noteFrequency(tuning.nearestNote(frequency, cents));
+}
+
+// Feed the fixture through one detector
+static FixtureResult runFixture(const TunerFixture& fixture, const WavData& wav, const char* detector) {
+    FixtureResult result;
+
+    // The tuner hears the WAV at its own sample rate
+    double trueHz = fixture.trueHz * AUDIO_SAMPLE_RATE_EXACT / wav.sampleRate;
+    double trueCents = fastCents(trueHz, fixture.targetHz);
+    const float* tuning = tuningForMode(fixture.mode);
+    bool strobe = strcmp(detector, "strobe") == 0;
+    bool yin = strcmp(detector, "yin") == 0;
+    bool autoString = yin || strncmp(detector, "mpm-auto", 8) == 0;
+    bool idle = fixture.trueHz <= 0;
+
+    PitchDetector pitchDetector;
+    StringClassifier classifier;
+    StrobeTuner strobeTuner;
+    YinReference yinReference;
+    AudioStream* stream = yin ? (AudioStream*)&yinReference : &pitchDetector;
+    pitchDetector.setGateEnabled(strcmp(detector, "mpm-auto-ungated") != 0);
+
+    if (strobe) {
+        strobeTuner.setEnabled(true);
+        strobeTuner.setTarget(fixture.targetHz);
+        stream = &strobeTuner;
+    } else if (!tuning) {
+        pitchDetector.setTarget(autoString ? 0 : fixture.targetHz);
+    } else if (autoString) {
+        float lowest = *std::min_element(tuning, tuning + FIXTURE_STRINGS);
+        float highest = *std::max_element(tuning, tuning + FIXTURE_STRINGS);
+        pitchDetector.setRange(lowest / PITCH_SEARCH_RATIO, highest * PITCH_SEARCH_RATIO);
+        classifier.setStrings(tuning, FIXTURE_STRINGS);
+    } else {
+        pitchDetector.setTarget(fixture.targetHz);
+    }
+
+    size_t frames = wav.frames();
+    for (size_t start = 0; start < frames; start += AUDIO_BLOCK_SAMPLES) {
+        audio_block_t* block = AudioStream::allocate();
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            size_t frame = start + i;
+            block->data[i] = (frame < frames) ? wav.samples[frame * wav.channels] : 0;
+        }
+        stream->hostDeliver(block);
+        AudioStream::release(block);
+
+        uint32_t cycles = ARM_DWT_CYCCNT;
+        stream->update();
+        result.blockCycles.push_back(ARM_DWT_CYCCNT - cycles);
+
+        double ms = (start + AUDIO_BLOCK_SAMPLES) * 1000.0 / wav.sampleRate - fixture.onsetMs;
+        Reading reading = { ms, false, 0.0 };
+
+        if (strobe) {
+            if (!strobeTuner.locked()) continue;
+            reading.correct = !idle;
+            reading.error = strobeTuner.cents() - trueCents;
+        } else {
+            float frequency;
+            if (yin) {
+                if (!yinReference.available()) continue;
+                frequency = yinReference.read();
+                if (yinReference.probability() <= YIN_MIN_PROBABILITY) continue;
+            } else {
+                if (!pitchDetector.available()) continue;
+                frequency = pitchDetector.read();
+                if (pitchDetector.probability() <= PITCH_MIN_CLARITY) continue;
+            }
+            if (frequency < DETECTION_MIN_FREQ || frequency > DETECTION_MAX_FREQ) continue;
+
+            double target;
+            double cents;
+            if (tuning && autoString) {
+                float offset;
+                int string = classifier.classify(frequency, offset);
+                if (string < 0) continue;
+                target = tuning[string];
+                cents = offset;
+            } else {
+                target = tuning ? fixture.targetHz : nearestSemitone(frequency);
+                cents = fastCents(frequency, target);
+            }
+            reading.correct = !idle && fabs(fastCents(target, fixture.targetHz)) < 1.0;
+            reading.error = cents - trueCents;
+        }
+
+        if (ms < 0) reading.correct = false;
+        result.readings.push_back(reading);
+    }
+
+    return result;
+}
+
+static void report(const TunerFixture& fixture, const char* detector, const FixtureResult& result, Summary& summary) {
+    const std::vector<Reading>& readings = result.readings;
+
+    // Stable point
+    int stable = -1;
+    for (size_t i = STABLE_READINGS - 1; i < readings.size() && stable < 0; i++) {
+        double low = 1e9, high = -1e9;
+        bool correct = true;
+        for (size_t j = i + 1 - STABLE_READINGS; j <= i; j++) {
+            correct = correct && readings[j].correct;
+            low = std::min(low, readings[j].error);
+            high = std::max(high, readings[j].error);
+        }
+        if (correct && high - low <= STABLE_SPREAD_CENTS) stable = i;
+    }
+
+    int falseBeforeOnset = 0;
+    int wrongTarget = 0;
+    std::vector<double> errors;
+    for (size_t i = 0; i < readings.size(); i++) {
+        if (readings[i].ms < 0) falseBeforeOnset++;
+        else if (!readings[i].correct) wrongTarget++;
+        else if (stable >= 0 && (int)i >= stable) errors.push_back(readings[i].error);
+    }
+
+    double sum = 0.0, squares = 0.0, worst = 0.0;
+    std::vector<double> magnitudes;
+    for (double e : errors) {
+        sum += e;
+        squares += e * e;
+        worst = std::max(worst, fabs(e));
+        magnitudes.push_back(fabs(e));
+    }
+    size_t n = errors.size();
+
+    double cycles = 0.0;
+    uint32_t cyclesMax = 0;
+    for (uint32_t c : result.blockCycles) {
+        cycles += c;
+        cyclesMax = std::max(cyclesMax, c);
+    }
+
+    const char* name = fixture.file.c_str();
+    const char* slash = strrchr(name, '/');
+    printf("{\"fixture\":\"%s\",\"detector\":\"%s\",\"mode\":\"%s\",\"string\":%d,"
+           "\"target_hz\":%.4f,\"true_hz\":%.4f,\"readings\":%zu,",
+           slash ? slash + 1 : name, detector, fixture.mode.c_str(), fixture.string,
+           fixture.targetHz, fixture.trueHz, readings.size());
+    if (stable >= 0) printf("\"stable_ms\":%.1f,", readings[stable].ms);
+    else printf("\"stable_ms\":null,");
+    printf("\"err_mean\":%.4f,\"err_rms\":%.4f,\"err_p50\":%.4f,\"err_p95\":%.4f,\"err_max\":%.4f,"
+           "\"false_before_onset\":%d,\"wrong_target\":%d,\"cycles_per_block\":%.0f,\"cycles_per_block_max\":%u}\n",
+           n ? sum / n : 0.0, n ? sqrt(squares / n) : 0.0, percentile(magnitudes, 0.5),
+           percentile(magnitudes, 0.95), worst, falseBeforeOnset, wrongTarget,
+           result.blockCycles.empty() ? 0.0 : cycles / result.blockCycles.size(), cyclesMax);
+
+    if (fixture.trueHz <= 0) {
+        summary.idleFixtures++;
+        summary.idleFalseDetections += falseBeforeOnset + wrongTarget;
+        summary.idleBlockCycles.insert(summary.idleBlockCycles.end(), result.blockCycles.begin(), result.blockCycles.end());
+        return;
+    }
+
+    summary.fixtures++;
+    if (stable < 0) summary.missed++;
+    else summary.stableMs.push_back(readings[stable].ms);
+    summary.falseDetections += falseBeforeOnset + wrongTarget;
+    summary.readings += readings.size();
+    summary.errors.insert(summary.errors.end(), errors.begin(), errors.end());
+    summary.blockCycles.insert(summary.blockCycles.end(), result.blockCycles.begin(), result.blockCycles.end());
+}
+
+static double mean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+static void reportSummary(const char* detector, const Summary& summary) {
+    std::vector<double> magnitudes;
+    double squares = 0.0;
+    for (double e : summary.errors) {
+        magnitudes.push_back(fabs(e));
+        squares += e * e;
+    }
+    size_t n = summary.errors.size();
+
+    // The host is not real time: a preempted block shows up as a huge
+    // maximum, so the summary gives the 99th percentile instead
+    printf("{\"summary\":\"%s\",\"fixtures\":%d,\"missed\":%d,\"stable_ms_p50\":%.1f,\"stable_ms_p95\":%.1f,"
+           "\"stable_ms_max\":%.1f,\"err_rms\":%.4f,\"err_p50\":%.4f,\"err_p95\":%.4f,\"err_max\":%.4f,"
+           "\"readings\":%ld,\"false_detections\":%d,\"cycles_per_block\":%.0f,\"cycles_per_block_p99\":%.0f,"
+           "\"idle_fixtures\":%d,\"idle_false_detections\":%d,\"idle_cycles_per_block\":%.0f,"
+           "\"idle_cycles_per_block_p99\":%.0f,\"cycles_clock_hz\":%u}\n",
+           detector, summary.fixtures, summary.missed, percentile(summary.stableMs, 0.5),
+           percentile(summary.stableMs, 0.95), percentile(summary.stableMs, 1.0),
+           n ? sqrt(squares / n) : 0.0, percentile(magnitudes, 0.5), percentile(magnitudes, 0.95),
+           percentile(magnitudes, 1.0), summary.readings, summary.falseDetections,
+           mean(summary.blockCycles), percentile(summary.blockCycles, 0.99),
+           summary.idleFixtures, summary.idleFalseDetections, mean(summary.idleBlockCycles),
+           percentile(summary.idleBlockCycles, 0.99), F_CPU_ACTUAL);
+}
+
+// The figures PitchDetector's claims rest on, side by side with the
+// detector it replaced
+static void reportComparison(const Summary& mpm, const Summary& yin) {
+    std::vector<double> mpmErrors, yinErrors;
+    for (double e : mpm.errors) mpmErrors.push_back(fabs(e));
+    for (double e : yin.errors) yinErrors.push_back(fabs(e));
+    double mpmCycles = mean(mpm.blockCycles);
+    double yinCycles = mean(yin.blockCycles);
+
+    printf("{\"comparison\":\"mpm-auto/yin\",\"missed\":[%d,%d],\"stable_ms_p50\":[%.1f,%.1f],"
+           "\"stable_ms_p95\":[%.1f,%.1f],\"err_p50\":[%.4f,%.4f],\"err_p95\":[%.4f,%.4f],"
+           "\"false_detections\":[%d,%d],\"cycles_per_block\":[%.0f,%.0f],\"cycles_ratio\":%.3f}\n",
+           mpm.missed, yin.missed, percentile(mpm.stableMs, 0.5), percentile(yin.stableMs, 0.5),
+           percentile(mpm.stableMs, 0.95), percentile(yin.stableMs, 0.95), percentile(mpmErrors, 0.5),
+           percentile(yinErrors, 0.5), percentile(mpmErrors, 0.95), percentile(yinErrors, 0.95),
+           mpm.falseDetections, yin.falseDetections, mpmCycles, yinCycles,
+           yinCycles > 0 ? mpmCycles / yinCycles : 0.0);
+}
+
+struct StrumSummary {
+    int fixtures = 0;
+    long analyses = 0;
+    int falseBeforeStrum = 0;
+    std::vector<double> errors[FIXTURE_STRINGS];
+    long sounding[FIXTURE_STRINGS] = {};
+    long missed[FIXTURE_STRINGS] = {};
+    long mutedAnalyses[FIXTURE_STRINGS] = {};
+    long falseSounding[FIXTURE_STRINGS] = {};
+    std::vector<double> cycles;
+};
+
+static void printArray(const char* name, const double* values, bool* skip, const char* format) {
+    printf("\"%s\":[", name);
+    for (int s = 0; s < FIXTURE_STRINGS; s++) {
+        if (s) printf(",");
+        if (skip && skip[s]) printf("null");
+        else printf(format, values[s]);
+    }
+    printf("]");
+}
+
+static void runStrum(const StrumFixture& fixture, const WavData& wav, StrumSummary& summary) {
+    const float* tuning = tuningForMode(fixture.mode);
+
+    StrumAnalyzer analyzer;
+    analyzer.setTargets(tuning, FIXTURE_STRINGS);
+    analyzer.setEnabled(true);
+
+    // The tuner hears the WAV at its own sample rate
+    double trueCents[FIXTURE_STRINGS];
+    for (int s = 0; s < FIXTURE_STRINGS; s++) {
+        double hz = tuning[s] * pow(2.0, fixture.cents[s] / 1200.0) * AUDIO_SAMPLE_RATE_EXACT / wav.sampleRate;
+        trueCents[s] = fastCents(hz, tuning[s]);
+    }
+
+    const double windowMs = STRUM_WINDOW * 1000.0 / PITCH_SAMPLE_RATE;
+    const double lastStringMs = fixture.onsetMs + (FIXTURE_STRINGS - 1) * STRUM_STAGGER_MS;
+
+    long analyses = 0;
+    int falseBeforeStrum = 0;
+    std::vector<double> errors[FIXTURE_STRINGS];
+    long missed[FIXTURE_STRINGS] = {};
+    long falseSounding[FIXTURE_STRINGS] = {};
+
+    size_t frames = wav.frames();
+    for (size_t start = 0; start < frames; start += AUDIO_BLOCK_SAMPLES) {
+        audio_block_t* block = AudioStream::allocate();
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            size_t frame = start + i;
+            block->data[i] = (frame < frames) ? wav.samples[frame * wav.channels] : 0;
+        }
+        analyzer.hostDeliver(block);
+        AudioStream::release(block);
+        analyzer.update();
+
+        if (!analyzer.analyze()) continue;
+        summary.cycles.push_back(analyzer.cyclesPerAnalysis());
+
+        double endMs = (start + AUDIO_BLOCK_SAMPLES) * 1000.0 / wav.sampleRate;
+        if (endMs < fixture.onsetMs) {
+            for (int s = 0; s < FIXTURE_STRINGS; s++) {
+                if (analyzer.result(s).detected) falseBeforeStrum++;
+            }
+            continue;
+        }
+        if (endMs - windowMs < lastStringMs) continue;
+
+        analyses++;
+        for (int s = 0; s < FIXTURE_STRINGS; s++) {
+            const StrumString& string = analyzer.result(s);
+            if (fixture.muted[s]) {
+                if (string.detected) falseSounding[s]++;
+            } else if (!string.detected) {
+                missed[s]++;
+            } else {
+                errors[s].push_back(string.cents - trueCents[s]);
+            }
+        }
+    }
+
+    double mean[FIXTURE_STRINGS], worst[FIXTURE_STRINGS], missedOut[FIXTURE_STRINGS], falseOut[FIXTURE_STRINGS];
+    for (int s = 0; s < FIXTURE_STRINGS; s++) {
+        double sum = 0.0;
+        worst[s] = 0.0;
+        for (double e : errors[s]) {
+            sum += e;
+            worst[s] = std::max(worst[s], fabs(e));
+        }
+        mean[s] = errors[s].empty() ? 0.0 : sum / errors[s].size();
+        missedOut[s] = missed[s];
+        falseOut[s] = falseSounding[s];
+    }
+
+    bool muted[FIXTURE_STRINGS];
+    std::copy(fixture.muted, fixture.muted + FIXTURE_STRINGS, muted);
+    const char* name = fixture.file.c_str();
+    const char* slash = strrchr(name, '/');
+    printf("{\"strum\":\"%s\",\"mode\":\"%s\",\"analyses\":%ld,", slash ? slash + 1 : name,
+           fixture.mode.c_str(), analyses);
+    printArray("cents", fixture.cents, muted, "%.1f");
+    printf(",");
+    printArray("err_mean", mean, muted, "%.3f");
+    printf(",");
+    printArray("err_max", worst, muted, "%.3f");
+    printf(",");
+    printArray("missed", missedOut, muted, "%.0f");
+    printf(",");
+    printArray("false_sounding", falseOut, NULL, "%.0f");
+    printf(",\"false_before_strum\":%d}\n", falseBeforeStrum);
+
+    summary.fixtures++;
+    summary.analyses += analyses;
+    summary.falseBeforeStrum += falseBeforeStrum;
+    for (int s = 0; s < FIXTURE_STRINGS; s++) {
+        summary.errors[s].insert(summary.errors[s].end(), errors[s].begin(), errors[s].end());
+        if (fixture.muted[s]) {
+            summary.mutedAnalyses[s] += analyses;
+            summary.falseSounding[s] += falseSounding[s];
+        } else {
+            summary.sounding[s] += analyses;
+            summary.missed[s] += missed[s];
+        }
+    }
+}
+
+static void reportStrumSummary(const char* mode, const StrumSummary& summary) {
+    double p50[FIXTURE_STRINGS], p95[FIXTURE_STRINGS], worst[FIXTURE_STRINGS], missed[FIXTURE_STRINGS], falseSounding[FIXTURE_STRINGS];
+    for (int s = 0; s < FIXTURE_STRINGS; s++) {
+        std::vector<double> magnitudes;
+        for (double e : summary.errors[s]) magnitudes.push_back(fabs(e));
+        p50[s] = percentile(magnitudes, 0.5);
+        p95[s] = percentile(magnitudes, 0.95);
+        worst[s] = percentile(magnitudes, 1.0);
+        missed[s] = summary.sounding[s] ? 100.0 * summary.missed[s] / summary.sounding[s] : 0.0;
+        falseSounding[s] = summary.mutedAnalyses[s] ? 100.0 * summary.falseSounding[s] / summary.mutedAnalyses[s] : 0.0;
+    }
+
+    printf("{\"summary\":\"strum\",\"mode\":\"%s\",\"fixtures\":%d,\"analyses\":%ld,", mode, summary.fixtures,
+           summary.analyses);
+    printArray("err_p50", p50, NULL, "%.3f");
+    printf(",");
+    printArray("err_p95", p95, NULL, "%.3f");
+    printf(",");
+    printArray("err_max", worst, NULL, "%.3f");
+    printf(",");
+    printArray("missed_pct", missed, NULL, "%.1f");
+    printf(",");
+    printArray("false_sounding_pct", falseSounding, NULL, "%.1f");
+    printf(",\"false_before_strum\":%d,\"cycles_per_analysis\":%.0f,\"cycles_per_analysis_p99\":%.0f,"
+           "\"cycles_clock_hz\":%u}\n",
+           summary.falseBeforeStrum, mean(summary.cycles), percentile(summary.cycles, 0.99), F_CPU_ACTUAL);
+}
+
+static int strum(const char* manifest) {
+    std::vector<StrumFixture> fixtures;
+    std::string error;
+    if (!readStrumManifest(manifest, fixtures, error)) {
+        fprintf(stderr, "tuner_bench: %s\n", error.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> modes;
+    std::vector<StrumSummary> summaries;
+    for (const StrumFixture& fixture : fixtures) {
+        WavData wav;
+        if (!readWav(fixture.file, wav, error)) {
+            fprintf(stderr, "tuner_bench: %s\n", error.c_str());
+            return 1;
+        }
+        size_t m = std::find(modes.begin(), modes.end(), fixture.mode) - modes.begin();
+        if (m == modes.size()) {
+            modes.push_back(fixture.mode);
+            summaries.emplace_back();
+        }
+        runStrum(fixture, wav, summaries[m]);
+    }
+
+    for (size_t m = 0; m < modes.size(); m++) {
+        reportStrumSummary(modes[m].c_str(), summaries[m]);
+    }
+    return 0;
+}
+
+static int strobeCheck() {
+    std::vector<TunerFixture> fixtures;
+    std::vector<WavData> wavs;
+    cleanPlucks(fixtures, wavs);
+
+    int failures = 0;
+    double worst = 0.0;
+    std::vector<double> lockMs;
+    for (size_t f = 0; f < fixtures.size(); f++) {
+        FixtureResult result = runFixture(fixtures[f], wavs[f], "strobe");
+        const std::vector<Reading>& readings = result.readings;
+
+        double error = 0.0;
+        for (const Reading& reading : readings) error = std::max(error, fabs(reading.error));
+        bool pass = !readings.empty() && error <= STROBE_CHECK_CENTS;
+        if (!pass) failures++;
+        worst = std::max(worst, error);
+        if (!readings.empty()) lockMs.push_back(readings[0].ms);
+
+        printf("{\"strobe_check\":\"%s\",\"readings\":%zu,", fixtures[f].file.c_str(), readings.size());
+        if (readings.empty()) printf("\"lock_ms\":null,");
+        else printf("\"lock_ms\":%.1f,", readings[0].ms);
+        printf("\"err_max\":%.4f,\"pass\":%s}\n", error, pass ? "true" : "false");
+    }
+
+    printf("{\"summary\":\"strobe_check\",\"fixtures\":%zu,\"failures\":%d,\"err_max\":%.4f,"
+           "\"limit_cents\":%.2f,\"lock_ms_max\":%.1f}\n",
+           fixtures.size(), failures, worst, STROBE_CHECK_CENTS, percentile(lockMs, 1.0));
+    return failures ? 1 : 0;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: tuner_bench generate <dir>\n"
+                    "       tuner_bench run <manifest.csv> [detector...]\n"
+                    "       tuner_bench strum <strum.csv>\n"
+                    "       tuner_bench strobe-check\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && strcmp(argv[1], "strobe-check") == 0) return strobeCheck();
+    if (argc < 3) return usage();
+    std::string command = argv[1];
+
+    if (command == "generate") {
+        if (!generateFixtures(argv[2])) {
+            fprintf(stderr, "tuner_bench: cannot write fixtures to %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+    if (command == "strum") return strum(argv[2]);
+    if (command != "run") return usage();
+
+    std::vector<TunerFixture> fixtures;
+    std::string error;
+    if (!readManifest(argv[2], fixtures, error)) {
+        fprintf(stderr, "tuner_bench: %s\n", error.c_str());
+        return 1;
+    }
+
+    std::vector<const char*> detectors;
+    for (int i = 3; i < argc; i++) {
+        bool known = false;
+        for (const char* name : DETECTORS) known = known || strcmp(argv[i], name) == 0;
+        if (!known) {
+            fprintf(stderr, "tuner_bench: unknown detector %s\n", argv[i]);
+            return 2;
+        }
+        detectors.push_back(argv[i]);
+    }
+    if (detectors.empty()) detectors.assign(DETECTORS, DETECTORS + DETECTOR_COUNT);
+
+    std::vector<Summary> summaries(detectors.size());
+    for (const TunerFixture& fixture : fixtures) {
+        WavData wav;
+        if (!readWav(fixture.file, wav, error)) {
+            fprintf(stderr, "tuner_bench: %s\n", error.c_str());
+            return 1;
+        }
+        for (size_t d = 0; d < detectors.size(); d++) {
+            // A selected string has no meaning in chromatic mode or idle,
+            // and the strobe needs a target
+            if (strcmp(detectors[d], "mpm-string") == 0 && fixture.string < 0) continue;
+            if (strcmp(detectors[d], "strobe") == 0 && fixture.targetHz <= 0) continue;
+            report(fixture, detectors[d], runFixture(fixture, wav, detectors[d]), summaries[d]);
+        }
+    }
+
+    int mpm = -1, yin = -1;
+    for (size_t d = 0; d < detectors.size(); d++) {
+        reportSummary(detectors[d], summaries[d]);
+        if (strcmp(detectors[d], "mpm-auto") == 0) mpm = d;
+        if (strcmp(detectors[d], "yin") == 0) yin = d;
+    }
+    if (mpm >= 0 && yin >= 0) reportComparison(summaries[mpm], summaries[yin]);
+    return 0;
+}
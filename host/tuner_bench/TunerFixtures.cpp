@@ -0,0 +1,341 @@
+/*
+ * TunerFixtures.cpp - Synthetic plucked-string fixtures and the manifests
+ */
+
+#include "TunerFixtures.h"
+#include "WavFile.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+const float BENCH_STANDARD_TUNING[4] = { 392.00, 261.63, 329.63, 440.00 };
+const float BENCH_LOW_G_TUNING[4]    = { 196.00, 261.63, 329.63, 440.00 };
+const float BENCH_BARITONE_TUNING[4] = { 73.42, 98.00, 123.47, 164.81 };
+
+static const char* NOTE_NAMES[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+// Synthetic set
+static const double FIXTURE_RATE = 44100.0;
+static const double FIXTURE_LEAD_MS = 250.0;      // Noise only, before the pluck
+static const double FIXTURE_LENGTH_MS = 1500.0;
+static const double FIXTURE_DETUNES[] = { -20.0, -5.0, 0.0, 3.0, 12.0 };
+static const double FIXTURE_NOISE_DBFS[] = { -200.0, -50.0, -35.0 };   // -200: clean
+static const int CHROMATIC_SEMITONES[4] = { -21, -15, -7, 2 };          // C3 F#3 D4 B4
+
+// Strum set: per-string detunes for each preset, down-strummed (string 0
+// first). A muted string (STRUM_MUTED) is damped to a short thud.
+static const double STRUM_MUTED = 1e9;
+static const double STRUM_DETUNES[][4] = {
+    { 0.0, 0.0, 0.0, 0.0 },
+    { -12.0, 5.0, -3.0, 18.0 },
+    { 25.0, -20.0, 8.0, -6.0 },
+    { -4.0, STRUM_MUTED, 10.0, -15.0 },
+    { 7.0, -9.0, 14.0, STRUM_MUTED },
+};
+static const double STRUM_NOISE_DBFS[] = { -200.0, -50.0 };
+
+const float* tuningForMode(const std::string& mode) {
+    if (mode == "standard") return BENCH_STANDARD_TUNING;
+    if (mode == "lowg") return BENCH_LOW_G_TUNING;
+    if (mode == "baritone") return BENCH_BARITONE_TUNING;
+    return NULL;
+}
+
+static std::string noteName(double frequency) {
+    int semitones = (int)lround(12.0 * log2(frequency / 440.0));
+    int index = ((semitones + 9) % 12 + 12) % 12;
+    int octave = 4 + (int)floor((semitones + 9) / 12.0);
+    return std::string(NOTE_NAMES[index]) + std::to_string(octave);
+}
+
+// Partials of a plucked string: shaped by the pluck position, higher
+// ones decaying faster, slight stiffness (partial 1 stays exactly on
+// pitch). damping scales every decay rate.
+struct PluckPartials {
+    std::vector<double> hz, amp, decay, phase;
+    double norm = 0.0;
+
+    double at(double t) const {
+        double string = 0.0;
+        for (size_t p = 0; p < hz.size(); p++) {
+            string += amp[p] * exp(-t * decay[p]) * sin(2.0 * M_PI * hz[p] * t + phase[p]);
+        }
+        return std::min(1.0, t / 0.003) * string / norm;
+    }
+};
+
+static PluckPartials pluckPartials(double frequency, double damping, std::mt19937& random) {
+    const double pluckPosition = 0.18;
+    const double stiffness = 1e-4;
+
+    PluckPartials partials;
+    for (int h = 1; h <= 24 && frequency > 0; h++) {
+        double hz = h * frequency * sqrt(1.0 + stiffness * h * h) / sqrt(1.0 + stiffness);
+        if (hz > 0.45 * FIXTURE_RATE) break;
+        partials.hz.push_back(hz);
+        partials.amp.push_back(fabs(sin(M_PI * h * pluckPosition)) / h);
+        partials.decay.push_back(damping * (1.2 + 0.5 * h));
+        partials.phase.push_back(std::uniform_real_distribution<double>(0.0, 2.0 * M_PI)(random));
+    }
+    for (double a : partials.amp) partials.norm += a;
+    return partials;
+}
+
+static std::string noiseName(double noiseDbfs) {
+    return noiseDbfs < -100 ? "clean" : (noiseDbfs < -40 ? "n50" : "n35");
+}
+
+// One plucked string, a short noise burst for the pick, and white noise
+// throughout. A frequency of 0 gives the noise alone.
+static void synthesizePluck(double frequency, double noiseDbfs, uint32_t seed, WavData& wav) {
+    const double peak = 0.35;
+
+    size_t frames = (size_t)(FIXTURE_LENGTH_MS * FIXTURE_RATE / 1000.0);
+    size_t onset = (size_t)(FIXTURE_LEAD_MS * FIXTURE_RATE / 1000.0);
+
+    std::mt19937 random(seed);
+    std::normal_distribution<double> gaussian(0.0, 1.0);
+    double noiseRms = pow(10.0, noiseDbfs / 20.0);
+    PluckPartials partials = pluckPartials(frequency, 1.0, random);
+
+    wav.sampleRate = (uint32_t)FIXTURE_RATE;
+    wav.channels = 1;
+    wav.samples.assign(frames, 0);
+    for (size_t n = 0; n < frames; n++) {
+        double x = noiseRms * gaussian(random);
+        if (n >= onset && frequency > 0) {
+            double t = (n - onset) / FIXTURE_RATE;
+            x += peak * partials.at(t) + 0.05 * exp(-t / 0.002) * gaussian(random);
+        }
+        double scaled = x * 32767.0;
+        wav.samples[n] = (int16_t)std::max(-32768.0, std::min(32767.0, round(scaled)));
+    }
+}
+
+// All four strings of a preset, STRUM_STAGGER_MS apart from string 0 on.
+// A muted string is damped 25x, so it is gone in a few tens of ms.
+static void synthesizeStrum(const float* tuning, const double* detunes, double noiseDbfs, uint32_t seed,
+                            WavData& wav) {
+    const double peak = 0.15;   // Per string
+
+    size_t frames = (size_t)(FIXTURE_LENGTH_MS * FIXTURE_RATE / 1000.0);
+    size_t onset = (size_t)(FIXTURE_LEAD_MS * FIXTURE_RATE / 1000.0);
+    size_t stagger = (size_t)(STRUM_STAGGER_MS * FIXTURE_RATE / 1000.0);
+
+    std::mt19937 random(seed);
+    std::normal_distribution<double> gaussian(0.0, 1.0);
+    double noiseRms = pow(10.0, noiseDbfs / 20.0);
+
+    PluckPartials strings[4];
+    for (int s = 0; s < 4; s++) {
+        bool muted = detunes[s] >= STRUM_MUTED;
+        strings[s] = pluckPartials(tuning[s] * pow(2.0, (muted ? 0.0 : detunes[s]) / 1200.0), muted ? 25.0 : 1.0,
+                                   random);
+    }
+
+    wav.sampleRate = (uint32_t)FIXTURE_RATE;
+    wav.channels = 1;
+    wav.samples.assign(frames, 0);
+    for (size_t n = 0; n < frames; n++) {
+        double x = noiseRms * gaussian(random);
+        for (int s = 0; s < 4; s++) {
+            size_t start = onset + s * stagger;
+            if (n < start) continue;
+            double t = (n - start) / FIXTURE_RATE;
+            x += peak * strings[s].at(t) + 0.02 * exp(-t / 0.002) * gaussian(random);
+        }
+        double scaled = x * 32767.0;
+        wav.samples[n] = (int16_t)std::max(-32768.0, std::min(32767.0, round(scaled)));
+    }
+}
+
+// The single-string plucks of the synthetic set, each with its noise
+// level and the seed it is generated from
+struct PluckSpec {
+    TunerFixture fixture;   // file is the bare name
+    double noiseDbfs;
+    uint32_t seed;
+};
+
+static std::vector<PluckSpec> pluckSet() {
+    const char* modes[4] = { "standard", "lowg", "baritone", "chromatic" };
+    std::vector<PluckSpec> plucks;
+    uint32_t seed = 1;
+
+    for (const char* mode : modes) {
+        const float* tuning = tuningForMode(mode);
+        for (int s = 0; s < 4; s++) {
+            double target = tuning ? tuning[s] : 440.0 * pow(2.0, CHROMATIC_SEMITONES[s] / 12.0);
+            for (double cents : FIXTURE_DETUNES) {
+                for (double noise : FIXTURE_NOISE_DBFS) {
+                    char name[96];
+                    snprintf(name, sizeof(name), "%s_s%d_%s_%+.0fc_%s.wav", mode, tuning ? s : -1,
+                             noteName(target).c_str(), cents, noiseName(noise).c_str());
+
+                    PluckSpec pluck;
+                    pluck.fixture.file = name;
+                    pluck.fixture.mode = mode;
+                    pluck.fixture.string = tuning ? s : -1;
+                    pluck.fixture.targetHz = target;
+                    pluck.fixture.trueHz = target * pow(2.0, cents / 1200.0);
+                    pluck.fixture.onsetMs = FIXTURE_LEAD_MS;
+                    pluck.noiseDbfs = noise;
+                    pluck.seed = seed++;
+                    plucks.push_back(pluck);
+                }
+            }
+        }
+    }
+    return plucks;
+}
+
+void cleanPlucks(std::vector<TunerFixture>& fixtures, std::vector<WavData>& wavs) {
+    for (const PluckSpec& pluck : pluckSet()) {
+        if (pluck.noiseDbfs > -100) continue;
+        fixtures.push_back(pluck.fixture);
+        wavs.emplace_back();
+        synthesizePluck(pluck.fixture.trueHz, pluck.noiseDbfs, pluck.seed, wavs.back());
+    }
+}
+
+bool generateFixtures(const std::string& directory) {
+    std::string manifestPath = directory + "/manifest.csv";
+    FILE* manifest = fopen(manifestPath.c_str(), "w");
+    if (!manifest) return false;
+    fprintf(manifest, "file,mode,string,target_hz,true_hz,onset_ms\n");
+
+    std::vector<PluckSpec> plucks = pluckSet();
+    uint32_t seed = plucks.size() + 1;
+    bool ok = true;
+
+    for (const PluckSpec& pluck : plucks) {
+        const TunerFixture& fixture = pluck.fixture;
+        WavData wav;
+        synthesizePluck(fixture.trueHz, pluck.noiseDbfs, pluck.seed, wav);
+        if (!writeWav(directory + "/" + fixture.file, wav)) {
+            ok = false;
+            break;
+        }
+        fprintf(manifest, "%s,%s,%d,%.4f,%.4f,%.1f\n", fixture.file.c_str(), fixture.mode.c_str(),
+                fixture.string, fixture.targetHz, fixture.trueHz, fixture.onsetMs);
+    }
+
+    // Idle: no note at all, the "onset" is past the end
+    for (const char* mode : { "standard", "chromatic" }) {
+        for (double noise : FIXTURE_NOISE_DBFS) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s_idle_%s.wav", mode, noiseName(noise).c_str());
+            WavData wav;
+            synthesizePluck(0.0, noise, seed++, wav);
+            ok = ok && writeWav(directory + "/" + name, wav);
+            fprintf(manifest, "%s,%s,-1,0,0,%.1f\n", name, mode, FIXTURE_LENGTH_MS);
+        }
+    }
+
+    if (fclose(manifest) != 0) ok = false;
+
+    // Strums, with their own manifest
+    std::string strumPath = directory + "/strum.csv";
+    FILE* strums = fopen(strumPath.c_str(), "w");
+    if (!strums) return false;
+    fprintf(strums, "file,mode,onset_ms,cents0,cents1,cents2,cents3\n");
+
+    for (const char* mode : { "standard", "lowg", "baritone" }) {
+        const float* tuning = tuningForMode(mode);
+        for (size_t c = 0; c < sizeof(STRUM_DETUNES) / sizeof(STRUM_DETUNES[0]) && ok; c++) {
+            for (double noise : STRUM_NOISE_DBFS) {
+                char name[64];
+                snprintf(name, sizeof(name), "strum_%s_%zu_%s.wav", mode, c, noiseName(noise).c_str());
+
+                WavData wav;
+                synthesizeStrum(tuning, STRUM_DETUNES[c], noise, seed++, wav);
+                ok = ok && writeWav(directory + "/" + name, wav);
+
+                fprintf(strums, "%s,%s,%.1f", name, mode, FIXTURE_LEAD_MS);
+                for (double cents : STRUM_DETUNES[c]) {
+                    if (cents >= STRUM_MUTED) fprintf(strums, ",muted");
+                    else fprintf(strums, ",%.1f", cents);
+                }
+                fprintf(strums, "\n");
+            }
+        }
+    }
+
+    return fclose(strums) == 0 && ok;
+}
+
+static std::string manifestDirectory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+bool readManifest(const std::string& path, std::vector<TunerFixture>& fixtures, std::string& error) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string directory = manifestDirectory(path);
+
+    char line[512];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        if (lineNumber == 1 || line[0] == '#' || line[0] == '\n') continue;
+
+        char name[256], mode[32];
+        TunerFixture fixture;
+        if (sscanf(line, "%255[^,],%31[^,],%d,%lf,%lf,%lf", name, mode, &fixture.string,
+                   &fixture.targetHz, &fixture.trueHz, &fixture.onsetMs) != 6) {
+            error = path + ":" + std::to_string(lineNumber) + ": expected 6 columns";
+            fclose(file);
+            return false;
+        }
+        fixture.file = directory + "/" + name;
+        fixture.mode = mode;
+        fixtures.push_back(fixture);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool readStrumManifest(const std::string& path, std::vector<StrumFixture>& fixtures, std::string& error) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string directory = manifestDirectory(path);
+
+    char line[512];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        if (lineNumber == 1 || line[0] == '#' || line[0] == '\n') continue;
+
+        char name[256], mode[32], cents[4][32];
+        StrumFixture fixture;
+        if (sscanf(line, "%255[^,],%31[^,],%lf,%31[^,],%31[^,],%31[^,],%31[^,\n]", name, mode, &fixture.onsetMs,
+                   cents[0], cents[1], cents[2], cents[3]) != 7 || !tuningForMode(mode)) {
+            error = path + ":" + std::to_string(lineNumber) + ": expected 7 columns and a preset mode";
+            fclose(file);
+            return false;
+        }
+        fixture.file = directory + "/" + name;
+        fixture.mode = mode;
+        for (int s = 0; s < 4; s++) {
+            fixture.muted[s] = strcmp(cents[s], "muted") == 0;
+            fixture.cents[s] = fixture.muted[s] ? 0.0 : atof(cents[s]);
+        }
+        fixtures.push_back(fixture);
+    }
+
+    fclose(file);
+    return true;
+}
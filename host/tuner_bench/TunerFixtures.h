@@ -0,0 +1,66 @@
+/*
+ * TunerFixtures.h - WAV fixtures for the tuner benchmark
+ *
+ * A fixture is a mono WAV plus a manifest row giving the tuning mode,
+ * the string (or -1 in chromatic mode), the target the tuner should pick
+ * and the true pitch. The synthetic set covers every mode, string,
+ * several detunings and noise levels; recorded fixtures are added by
+ * listing them in the same manifest.
+ *
+ * manifest.csv columns: file,mode,string,target_hz,true_hz,onset_ms
+ * (mode is standard, lowg, baritone or chromatic; file is relative to
+ * the manifest; onset_ms is where the pluck starts, anything before it
+ * is noise only). Idle fixtures, noise with no note, have true_hz 0.
+ *
+ * Strum fixtures are all four strings of a preset at once, for
+ * StrumAnalyzer, listed in strum.csv: file,mode,onset_ms,cents0..cents3
+ * (each string's detune from its target in display order, or "muted"
+ * for a string damped to a thud that should not count as sounding).
+ */
+
+#ifndef SONGBIRD_HOST_TUNERFIXTURES_H
+#define SONGBIRD_HOST_TUNERFIXTURES_H
+
+#include "WavFile.h"
+#include <string>
+#include <vector>
+
+struct TunerFixture {
+    std::string file;
+    std::string mode;
+    int string;             // 0-3, display order; -1 in chromatic mode
+    double targetHz;        // What the tuner should tune to
+    double trueHz;          // Actual fundamental, at the WAV's sample rate
+    double onsetMs;
+};
+
+#define FIXTURE_STRINGS   4        // Every fixture tuning is a ukulele's
+#define STRUM_STAGGER_MS  15.0     // Between strings in the synthetic strums
+
+struct StrumFixture {
+    std::string file;
+    std::string mode;       // standard, lowg or baritone
+    double onsetMs;         // First string; the others follow STRUM_STAGGER_MS apart
+    double cents[4];        // True offset of each string from its target
+    bool muted[4];
+};
+
+// Same tables as UkuleleTuner.ino
+extern const float BENCH_STANDARD_TUNING[4];
+extern const float BENCH_LOW_G_TUNING[4];
+extern const float BENCH_BARITONE_TUNING[4];
+
+// String table for a mode name, or NULL for chromatic/unknown
+const float* tuningForMode(const std::string& mode);
+
+// The clean plucks of the synthetic set (every mode, string and detune),
+// generated in memory; file is the name the set gives them on disk
+void cleanPlucks(std::vector<TunerFixture>& fixtures, std::vector<WavData>& wavs);
+
+// Writes the synthetic sets, manifest.csv and strum.csv, into directory
+bool generateFixtures(const std::string& directory);
+
+bool readManifest(const std::string& path, std::vector<TunerFixture>& fixtures, std::string& error);
+bool readStrumManifest(const std::string& path, std::vector<StrumFixture>& fixtures, std::string& error);
+
+#endif
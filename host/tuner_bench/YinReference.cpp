@@ -0,0 +1,98 @@
+/*
+ * YinReference.cpp - AudioAnalyzeNoteFrequency's YIN, block for block
+ */
+
+#include "YinReference.h"
+
+YinReference::YinReference() : AudioStream(1, inputQueueArray) {
+    memset(blocks, 0, sizeof(blocks));
+    memset(buffer, 0, sizeof(buffer));
+    memset(yin, 0, sizeof(yin));
+    memset(sums, 0, sizeof(sums));
+}
+
+// Blocks still being collected go back to the pool
+YinReference::~YinReference() {
+    for (int i = 0; i < collected; i++) release(blocks[i]);
+}
+
+float YinReference::read() {
+    newOutput = false;
+    return period > 0 ? AUDIO_SAMPLE_RATE_EXACT / period : 0.0f;
+}
+
+void YinReference::update(void) {
+    audio_block_t* block = receiveReadOnly();
+    if (!block) return;
+
+    blocks[collected++] = block;
+    if (!firstRun && processing) process();
+
+    if (collected >= YIN_BLOCKS) {
+        if (!firstRun && processing) process();
+        for (int i = 0; i < YIN_BLOCKS; i++) {
+            memcpy(buffer + i * AUDIO_BLOCK_SAMPLES, blocks[i]->data, sizeof(blocks[i]->data));
+            release(blocks[i]);
+            blocks[i] = NULL;
+        }
+        processing = true;
+        firstRun = false;
+        collected = 0;
+    }
+}
+
+// The next YIN_LAGS_PER_UPDATE lags of the difference function
+void YinReference::process() {
+    uint16_t lag = tau;
+    for (int cycles = YIN_LAGS_PER_UPDATE; cycles > 0; cycles--) {
+        uint64_t sum = 0;
+        for (int x = 0; x < YIN_HALF_SAMPLES; x++) {
+            int32_t delta = buffer[x] - buffer[x + lag];
+            sum += (uint64_t)(delta * delta);
+        }
+
+        runningSum += sum;
+        yin[head] = sum * lag;
+        sums[head] = runningSum;
+        head = (head + 1 >= 5) ? 0 : head + 1;
+
+        lag = estimate(lag);
+        if (lag == 0) {
+            processing = false;
+            newOutput = true;
+            head = 1;
+            runningSum = 0;
+            tau = 1;
+            return;
+        }
+    }
+
+    if (lag >= YIN_HALF_SAMPLES) {
+        processing = false;
+        newOutput = false;
+        head = 1;
+        runningSum = 0;
+        tau = 1;
+        return;
+    }
+    tau = lag;
+}
+
+// 0 with period and periodicity set when lag - 3 is a dip under the
+// threshold, otherwise the next lag to try
+uint16_t YinReference::estimate(uint16_t lag) {
+    if (lag > 4) {
+        int i0 = head;
+        int i1 = (head + 1 >= 5) ? head + 1 - 5 : head + 1;
+        int i2 = (head + 2 >= 5) ? head + 2 - 5 : head + 2;
+        float s0 = (float)yin[i0] / sums[i0];
+        float s1 = (float)yin[i1] / sums[i1];
+        float s2 = (float)yin[i2] / sums[i2];
+        if (s1 < YIN_THRESHOLD && s1 < s2) {
+            periodicity = 1.0f - s1;
+            period = (lag - 3) + 0.5f * (s0 - s2) / (s0 - 2.0f * s1 + s2);
+            return 0;
+        }
+    }
+    return lag + 1;
+}
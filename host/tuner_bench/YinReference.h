@@ -0,0 +1,64 @@
+/*
+ * YinReference.h - The Teensy Audio Library's YIN detector, for comparison
+ *
+ * A host copy of AudioAnalyzeNoteFrequency, the detector UkuleleTuner
+ * used before PitchDetector: YIN on the undecimated 44.1 kHz input over
+ * a 24-block (3072-sample) window, differences summed over the first
+ * half of it. Blocks are collected into one buffer while the previous
+ * one is searched, 64 lags per update, and the first lag whose
+ * cumulative-mean-normalized difference dips under the threshold (and
+ * is below the next lag) is interpolated and reported. The old sketch
+ * called begin(0.15) and accepted probability() > 0.9, so the bench does
+ * the same.
+ *
+ * Same timing as the library object, so its latency and cycles per
+ * block are comparable with PitchDetector's; the arithmetic is plain C
+ * rather than the library's packed SIMD.
+ */
+
+#ifndef SONGBIRD_HOST_YINREFERENCE_H
+#define SONGBIRD_HOST_YINREFERENCE_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#define YIN_BLOCKS          24
+#define YIN_HALF_SAMPLES    (YIN_BLOCKS * AUDIO_BLOCK_SAMPLES / 2)
+#define YIN_LAGS_PER_UPDATE 64
+#define YIN_THRESHOLD       0.15f
+#define YIN_MIN_PROBABILITY 0.9f
+
+class YinReference : public AudioStream {
+public:
+    YinReference();
+    ~YinReference();
+
+    bool available() const { return newOutput; }
+    float read();
+    float probability() const { return periodicity; }
+
+    void update(void) override;
+
+private:
+    audio_block_t* inputQueueArray[1];
+    audio_block_t* blocks[YIN_BLOCKS];
+    int collected = 0;
+    bool firstRun = true;
+
+    int16_t buffer[YIN_BLOCKS * AUDIO_BLOCK_SAMPLES];
+    bool processing = false;
+    uint16_t tau = 1;
+    uint64_t runningSum = 0;
+    uint64_t yin[5];
+    uint64_t sums[5];
+    uint8_t head = 1;
+
+    bool newOutput = false;
+    float period = 0.0f;
+    float periodicity = 0.0f;
+
+    void process();
+    uint16_t estimate(uint16_t lag);
+};
+
+#endif
@@ -0,0 +1,505 @@
+/*
+ * VoiceLatency.cpp - VoiceChat mouth-to-ear latency, stage by stage
+ *
+ *   voice_latency <workdir> [card...]     JSON lines on stdout
+ *
+ * Two Songbirds on one virtual clock: a talker whose PTT button the
+ * harness holds for each message, and a listener on the same channel,
+ * with the bridge between them. Both run the unchanged sketch engines
+ * (UIController, RecordingEngine, SerialProtocol, PlaybackEngine) in the
+ * order VoiceChat.ino's loop() calls them; the .ino itself needs the
+ * display and audio graph, so its PTT and playback paths are mirrored
+ * here. Every stage is stamped on the shared clock:
+ *
+ *   press            PTT pin goes low (the user starts talking)
+ *   ptt_detected     UIController reports the press
+ *   recording        startRecording() returned, audio is captured
+ *   release          PTT pin goes high
+ *   release_detected UIController reports the release
+ *   closed           stopRecording() returned (file flushed)
+ *   sent             sendFile() done and the last byte is on the wire
+ *   forwarded        the bridge starts sending it to the listener
+ *   received         processIncoming() has the whole file on SD
+ *   queued           loadChannelQueue() returned
+ *   opened           startPlayback() returned (openNextFile counts packets)
+ *   first_audio      the first decoded block leaves the play queue
+ *
+ * One "message" line per message (stage intervals in ms) and a "summary"
+ * line per card with p50/p90/p99/max of each interval, for the card
+ * presets in SdCardModel.h (ideal, class10, worn by default). The loop,
+ * display flush, bridge and codec costs below are the model's inputs:
+ * the host is far faster than a Teensy, so CPU time is charged to the
+ * clock from these figures rather than measured. The codec figures are
+ * a conservative estimate until a SONGBIRD_PROFILE build's opus_enc and
+ * opus_dec zones give real ones; every summary line repeats them.
+ *
+ * Messages go one at a time: the next press comes after the listener has
+ * played the last one and a random pause, so the numbers are latency, not
+ * queueing behind earlier messages.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <Audio.h>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "AudioHarness.h"
+#include "TestSignals.h"
+#include "UIController.h"
+#include "SerialProtocol.h"
+#include "RecordingEngine.h"
+#include "PlaybackEngine.h"
+
+namespace fs = std::filesystem;
+
+#define LATENCY_MESSAGES        50
+#define LATENCY_MIN_TALK_MS     1000
+#define LATENCY_MAX_TALK_MS     8000
+#define LATENCY_MIN_PAUSE_MS    500     // Before each press
+#define LATENCY_MAX_PAUSE_MS    3000
+#define LATENCY_TIMEOUT_MS      30000   // A stage that takes longer fails the message
+
+#define LATENCY_LOOP_US         200     // loop() outside the modelled calls
+#define LATENCY_DISPLAY_US      12000   // SSD1306 flush, 512 bytes at 400 kHz
+// Per 20 ms Opus frame. Wideband voice at complexity 5 takes in the order
+// of 20-40 MHz to encode and 5-10 MHz to decode on a Cortex-M7; these are
+// the top of those ranges at 600 MHz, rounded up.
+#define LATENCY_ENCODE_US       1500
+#define LATENCY_DECODE_US       400
+#define LATENCY_USB_BYTES_PER_MS 1000   // Songbird to and from the bridge
+#define LATENCY_SERIAL_BACKLOG  4096    // Bytes the port holds before the bridge waits
+#define LATENCY_BRIDGE_MS       50      // Bridge and server, file in to file out
+#define LATENCY_CHANNEL         0
+#define LATENCY_USERNAME        "Bench"
+
+static const char* const CARDS[] = {"ideal", "class10", "worn"};
+
+struct Stamps {
+    uint64_t press = 0;
+    uint64_t pttDetected = 0;
+    uint64_t recording = 0;
+    uint64_t release = 0;
+    uint64_t releaseDetected = 0;
+    uint64_t closed = 0;
+    uint64_t sent = 0;
+    uint64_t forwarded = 0;
+    uint64_t received = 0;
+    uint64_t queued = 0;
+    uint64_t opened = 0;
+    uint64_t firstAudio = 0;
+};
+
+struct Interval {
+    const char* name;
+    uint64_t Stamps::*from;
+    uint64_t Stamps::*to;
+};
+
+// The waterfall, in order, then the totals
+static const Interval INTERVALS[] = {
+    {"ptt_debounce", &Stamps::press, &Stamps::pttDetected},
+    {"record_start", &Stamps::pttDetected, &Stamps::recording},
+    {"release_debounce", &Stamps::release, &Stamps::releaseDetected},
+    {"record_close", &Stamps::releaseDetected, &Stamps::closed},
+    {"uplink", &Stamps::closed, &Stamps::sent},
+    {"bridge", &Stamps::sent, &Stamps::forwarded},
+    {"downlink", &Stamps::forwarded, &Stamps::received},
+    {"queue_scan", &Stamps::received, &Stamps::queued},
+    {"file_open", &Stamps::queued, &Stamps::opened},
+    {"first_block", &Stamps::opened, &Stamps::firstAudio},
+    {"clipped", &Stamps::press, &Stamps::recording},            // Speech lost at the start
+    {"release_to_ear", &Stamps::release, &Stamps::firstAudio},
+    {"mouth_to_ear", &Stamps::recording, &Stamps::firstAudio},  // First recorded sample
+};
+static const size_t INTERVAL_COUNT = sizeof(INTERVALS) / sizeof(INTERVALS[0]);
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static uint32_t benchRandom = 12345;
+
+static uint32_t nextRandom() {
+    benchRandom ^= benchRandom << 13;
+    benchRandom ^= benchRandom >> 17;
+    benchRandom ^= benchRandom << 5;
+    return benchRandom;
+}
+
+static uint32_t randomBetween(uint32_t low, uint32_t high) {
+    return low + nextRandom() % (high - low + 1);
+}
+
+// Blocking CPU work, as the sketch would spend it
+static void spend(uint64_t us) {
+    if (us) hostAdvanceMicros(us);
+}
+
+// The display refresh at the end of loop(), at the sketch's rates
+class DisplayModel {
+public:
+    void update(bool active) {
+        uint32_t interval = active ? DISPLAY_UPDATE_MS : DISPLAY_IDLE_UPDATE_MS;
+        if (millis() - last < interval) return;
+        last = millis();
+        spend(LATENCY_DISPLAY_US);
+    }
+
+private:
+    uint32_t last = 0;
+};
+
+// A button edge at a set virtual time, wherever loop() happens to be
+class PinEdge : public HostTimer {
+public:
+    explicit PinEdge(uint8_t pin) : pin(pin) { hostAttachTimer(this); }
+    ~PinEdge() { hostDetachTimer(this); }
+
+    void schedule(uint64_t at, uint8_t level) {
+        due = at;
+        value = level;
+    }
+
+    uint64_t hostDue() const override { return due; }
+    void hostFire() override {
+        hostSetPin(pin, value);
+        due = UINT64_MAX;
+    }
+
+private:
+    uint8_t pin;
+    uint8_t value = HIGH;
+    uint64_t due = UINT64_MAX;
+};
+
+// =============================================================================
+// Talker: PTT, record, send
+// =============================================================================
+
+class Talker {
+public:
+    Talker() : audio(&queue, NULL) {}
+
+    bool begin() {
+        ui.begin();
+        protocol.begin(&port);
+        port.hostTake();
+        return recorder.begin();
+    }
+
+    // Silence for the first delayMs, then speech
+    void setSpeech(WavData speech, uint32_t delayMs) {
+        size_t silence = (size_t)delayMs * AUDIO_HARNESS_RATE / 1000;
+        std::fill(speech.samples.begin(), speech.samples.begin() + std::min(silence, speech.samples.size()), 0);
+        std::string error;
+        audio.setInput(speech, error);
+    }
+
+    // One pass of loop(); the file frame it sent, once sent
+    void loop(Stamps& stamps, std::vector<uint8_t>& sentFrame) {
+        ui.update();
+
+        if (ui.wasJustPressed(BTN_UP) && !recording) {
+            stamps.pttDetected = hostMicros();
+            queue.begin();
+            if (recorder.startRecording(LATENCY_CHANNEL)) {
+                recording = true;
+                stamps.recording = hostMicros();
+            } else {
+                queue.end();
+            }
+        } else if (ui.wasJustReleased(BTN_UP) && recording) {
+            stamps.releaseDetected = hostMicros();
+            stopRecording(stamps, sentFrame);
+        }
+
+        if (recording && queue.available() > 0) {
+            uint32_t packets = recorder.getPacketCount();
+            recorder.processRecording(&queue);
+            spend((uint64_t)(recorder.getPacketCount() - packets) * LATENCY_ENCODE_US);
+        }
+
+        display.update(recording);
+        spend(LATENCY_LOOP_US);
+    }
+
+private:
+    HostStream port;
+    SerialProtocol protocol;
+    UIController ui;
+    RecordingEngine recorder;
+    AudioRecordQueue queue;
+    AudioHarness audio;
+    DisplayModel display;
+    bool recording = false;
+
+    void stopRecording(Stamps& stamps, std::vector<uint8_t>& sentFrame) {
+        queue.end();
+        recording = false;
+        bool stopped = recorder.stopRecording();
+        stamps.closed = hostMicros();
+        if (!stopped) return;
+
+        // write() blocks while USB drains, so sendFile lasts the wire time
+        String filename = recorder.getCurrentFileName();
+        port.hostTake();
+        bool sent = protocol.sendFile(filename.c_str(), LATENCY_CHANNEL + 1);
+        std::vector<uint8_t> wire = port.hostTake();
+        uint64_t wireDone = stamps.closed + (uint64_t)wire.size() * 1000 / LATENCY_USB_BYTES_PER_MS;
+        if (wireDone > hostMicros()) spend(wireDone - hostMicros());
+        if (!sent) return;
+
+        stamps.sent = hostMicros();
+        sentFrame = wire;
+        SD.remove(filename.c_str());
+    }
+};
+
+// =============================================================================
+// Bridge: the talker's TX frame becomes the listener's RX frame
+// =============================================================================
+
+static bool forwardFrame(const std::vector<uint8_t>& wire, std::vector<uint8_t>& frame) {
+    size_t pos = 0;
+    while (pos + TX_HEADER_SIZE <= wire.size()) {
+        if (wire[pos] != SYNC_BYTE_1 || wire[pos + 1] != SYNC_BYTE_2) {
+            pos++;
+            continue;
+        }
+        uint32_t length = wire[pos + 2] | (wire[pos + 3] << 8) | (wire[pos + 4] << 16) |
+                          ((uint32_t)wire[pos + 5] << 24);
+        uint8_t channel = wire[pos + 6];
+        size_t payload = pos + TX_HEADER_SIZE;
+        if (payload + length > wire.size()) return false;
+
+        if (channel >= 1 && channel <= NUM_CHANNELS) {
+            uint8_t usernameLength = (uint8_t)strlen(LATENCY_USERNAME);
+            frame.assign(wire.begin() + pos, wire.begin() + payload);
+            frame.push_back(usernameLength);
+            frame.insert(frame.end(), LATENCY_USERNAME, LATENCY_USERNAME + usernameLength);
+            frame.insert(frame.end(), wire.begin() + payload, wire.begin() + payload + length);
+            return true;
+        }
+        pos = payload + length;     // A log line
+    }
+    return false;
+}
+
+// =============================================================================
+// Listener: receive, queue, play
+// =============================================================================
+
+class Listener {
+public:
+    Listener() : audio(NULL, &queue) {}
+
+    bool begin() {
+        protocol.begin(&port);
+        port.hostTake();
+        return player.begin();
+    }
+
+    void deliver(const std::vector<uint8_t>& frame) {
+        incoming = frame;
+        incomingPos = 0;
+        deliveredAt = hostMicros();
+    }
+
+    bool playing() const { return isPlaying; }
+
+    // One pass of loop()
+    void loop(Stamps& stamps) {
+        // The bridge sends at USB speed while the port has room
+        uint64_t onWire = (hostMicros() - deliveredAt) * LATENCY_USB_BYTES_PER_MS / 1000;
+        if (incomingPos < onWire && incomingPos < incoming.size() && port.available() < LATENCY_SERIAL_BACKLOG) {
+            size_t chunk = std::min({(size_t)(onWire - incomingPos), incoming.size() - incomingPos,
+                                     (size_t)(LATENCY_SERIAL_BACKLOG - port.available())});
+            port.hostPush(incoming.data() + incomingPos, chunk);
+            incomingPos += chunk;
+        }
+
+        if (protocol.processIncoming()) {
+            uint8_t channel = protocol.getReceivedChannel();
+            protocol.clearReceivedFile();
+            stamps.received = hostMicros();
+            if (!isPlaying && channel == LATENCY_CHANNEL + 1) startPlayback(stamps);
+        }
+        port.hostTake();
+
+        if (isPlaying) {
+            // Packets decoded; the count restarts with each file
+            uint32_t before = player.getPlaybackPosition() / OPUS_FRAME_MS;
+            bool more = player.processPlayback(&queue);
+            uint32_t after = player.getPlaybackPosition() / OPUS_FRAME_MS;
+            if (after > before) spend((uint64_t)(after - before) * LATENCY_DECODE_US);
+            if (!more) {
+                player.stopPlayback();
+                player.loadChannelQueue(LATENCY_CHANNEL);  // updateQueueCounts()
+                isPlaying = false;
+            }
+        }
+        if (stamps.opened && !stamps.firstAudio && queue.hostPlayed()) {
+            stamps.firstAudio = queue.hostFirstPlayedMicros();
+        }
+
+        display.update(isPlaying);
+        spend(LATENCY_LOOP_US);
+    }
+
+private:
+    HostStream port;
+    SerialProtocol protocol;
+    PlaybackEngine player;
+    AudioPlayQueue queue;
+    AudioHarness audio;
+    DisplayModel display;
+    bool isPlaying = false;
+    std::vector<uint8_t> incoming;
+    size_t incomingPos = 0;
+    uint64_t deliveredAt = 0;
+
+    void startPlayback(Stamps& stamps) {
+        player.loadChannelQueue(LATENCY_CHANNEL);
+        stamps.queued = hostMicros();
+        if (!player.hasMessages()) return;
+
+        queue.hostResetPlayed();
+        if (!player.startPlayback(&queue)) return;
+        stamps.opened = hostMicros();
+        isPlaying = true;
+    }
+};
+
+// =============================================================================
+// Load test
+// =============================================================================
+
+static bool freshCard(const std::string& directory, const char* cardName) {
+    std::error_code error;
+    fs::remove_all(directory, error);
+    SD.hostConfigure(SdCardConfig());
+    SD.hostMount(directory);
+    SD.mkdir(TX_DIR);
+    for (int channel = 1; channel <= NUM_CHANNELS; channel++) {
+        SD.mkdir((String(RX_DIR_PREFIX) + String(channel)).c_str());
+    }
+
+    SdCardConfig config;
+    SdCardConfig::preset(cardName, config);
+    config.detectPin = SDCARD_DETECT_PIN;
+    SD.hostConfigure(config);
+    return SD.begin(SDCARD_CS_PIN);
+}
+
+// Run loop() until done() or the timeout; false on timeout
+template <typename Step, typename Done>
+static bool runUntil(Step&& step, Done&& done) {
+    uint64_t deadline = hostMicros() + (uint64_t)LATENCY_TIMEOUT_MS * 1000;
+    while (!done()) {
+        if (hostMicros() > deadline) return false;
+        step();
+    }
+    return true;
+}
+
+static double intervalMs(const Stamps& stamps, const Interval& interval) {
+    return ((double)(stamps.*interval.to) - (double)(stamps.*interval.from)) / 1000.0;
+}
+
+static void runCard(const std::string& directory, const char* cardName) {
+    if (!freshCard(directory, cardName)) {
+        fprintf(stderr, "voice_latency: card %s did not mount\n", cardName);
+        return;
+    }
+    benchRandom = 12345;
+
+    Talker talker;
+    Listener listener;
+    if (!talker.begin() || !listener.begin()) {
+        fprintf(stderr, "voice_latency: engines did not start on %s\n", cardName);
+        return;
+    }
+
+    PinEdge ptt(BTN_UP_PIN);
+    std::vector<double> intervals[INTERVAL_COUNT];
+    int complete = 0;
+
+    for (int m = 0; m < LATENCY_MESSAGES; m++) {
+        Stamps stamps;
+        std::vector<uint8_t> sentFrame;
+        uint32_t talkMs = randomBetween(LATENCY_MIN_TALK_MS, LATENCY_MAX_TALK_MS);
+        uint32_t pauseUs = randomBetween(LATENCY_MIN_PAUSE_MS * 1000, LATENCY_MAX_PAUSE_MS * 1000);
+        auto talk = [&] { talker.loop(stamps, sentFrame); };
+        auto listen = [&] { listener.loop(stamps); };
+
+        // The press lands anywhere in the loop and display cycle
+        stamps.press = hostMicros() + pauseUs;
+        stamps.release = stamps.press + (uint64_t)talkMs * 1000;
+        talker.setSpeech(speechLike(pauseUs / 1000 + talkMs + 500, nextRandom()), pauseUs / 1000);
+        ptt.schedule(stamps.press, LOW);
+        bool ok = runUntil(talk, [&] { return hostMicros() >= stamps.press; });
+        ptt.schedule(stamps.release, HIGH);
+        ok = ok && runUntil(talk, [&] { return stamps.releaseDetected != 0; });
+
+        std::vector<uint8_t> frame;
+        ok = ok && stamps.sent && forwardFrame(sentFrame, frame);
+        if (ok) {
+            // The talker's clean-up after sending overlaps the bridge
+            uint64_t forwardAt = stamps.sent + (uint64_t)LATENCY_BRIDGE_MS * 1000;
+            if (forwardAt > hostMicros()) spend(forwardAt - hostMicros());
+            stamps.forwarded = hostMicros();
+            listener.deliver(frame);
+            ok = runUntil(listen, [&] { return stamps.firstAudio != 0; });
+        }
+        runUntil(listen, [&] { return !listener.playing(); });
+
+        printf("{\"message\":%d,\"card\":\"%s\",\"talk_ms\":%u,\"bytes\":%zu,\"complete\":%s",
+               m, cardName, talkMs, frame.size(), ok ? "true" : "false");
+        if (ok) {
+            complete++;
+            for (size_t i = 0; i < INTERVAL_COUNT; i++) {
+                double ms = intervalMs(stamps, INTERVALS[i]);
+                intervals[i].push_back(ms);
+                printf(",\"%s_ms\":%.2f", INTERVALS[i].name, ms);
+            }
+        }
+        printf("}\n");
+    }
+
+    printf("{\"summary\":\"%s\",\"messages\":%d,\"complete\":%d,\"encode_us_per_frame\":%d,\"decode_us_per_frame\":%d",
+           cardName, LATENCY_MESSAGES, complete, LATENCY_ENCODE_US, LATENCY_DECODE_US);
+    for (size_t i = 0; i < INTERVAL_COUNT; i++) {
+        printf(",\"%s_p50_ms\":%.2f,\"%s_p90_ms\":%.2f,\"%s_p99_ms\":%.2f,\"%s_max_ms\":%.2f",
+               INTERVALS[i].name, percentile(intervals[i], 0.5),
+               INTERVALS[i].name, percentile(intervals[i], 0.9),
+               INTERVALS[i].name, percentile(intervals[i], 0.99),
+               INTERVALS[i].name, percentile(intervals[i], 1.0));
+    }
+    printf("}\n");
+}
+
+static int usage() {
+    fprintf(stderr, "usage: voice_latency <workdir> [ideal|class10|worn...]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+    std::string directory = std::string(argv[1]) + "/card";
+
+    std::vector<const char*> cards;
+    for (int i = 2; i < argc; i++) {
+        SdCardConfig config;
+        if (!SdCardConfig::preset(argv[i], config)) return usage();
+        cards.push_back(argv[i]);
+    }
+    if (cards.empty()) cards.assign(std::begin(CARDS), std::end(CARDS));
+
+    for (const char* card : cards) runCard(directory, card);
+    return 0;
+}
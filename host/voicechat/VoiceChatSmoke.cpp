@@ -0,0 +1,181 @@
+/*
+ * VoiceChatSmoke.cpp - One message through RecordingEngine and PlaybackEngine
+ *
+ *   voicechat_smoke <workdir>     JSON lines on stdout
+ *
+ * The ctest smoke test for the VoiceChat engines on the shim. A tone at
+ * SMOKE_TONE_HZ is played into the mic through AudioHarness while
+ * RecordingEngine encodes it to /TX on a card in <workdir>; the file is
+ * then put in /RX/CH1 as SerialProtocol would name a received message
+ * and PlaybackEngine decodes it into the harness output. Checks that:
+ *
+ *   - the recording has one packet per OPUS_FRAME_MS of input
+ *   - playback runs to the end and is as long as the input
+ *   - what comes out has the input's level and is still the tone
+ *
+ * Opus is lossy, so the limits are loose; a broken resampler, packet
+ * framing or file format misses them by far. Exits 1 on any failure.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <Audio.h>
+#include <algorithm>
+#include <filesystem>
+#include <math.h>
+#include <string>
+#include "AudioHarness.h"
+#include "Config.h"
+#include "OpusCodec.h"
+#include "RecordingEngine.h"
+#include "PlaybackEngine.h"
+
+namespace fs = std::filesystem;
+
+#define SMOKE_MS                1000
+#define SMOKE_TONE_HZ           440.0
+#define SMOKE_TONE_DBFS         -12.0
+#define SMOKE_LOOP_US           1000    // Between engine calls, as loop() would
+#define SMOKE_PACKET_SLACK      2       // Packets either way (the last partial frame)
+#define SMOKE_LENGTH_SLACK_MS   60      // Codec and resampler delay, tail padding
+#define SMOKE_LEVEL_DB          3.0
+#define SMOKE_MIN_PURITY        0.8     // Share of the output's energy at the tone
+#define SMOKE_SILENCE           64      // Samples quieter than this are not playback
+
+static bool failed = false;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    fprintf(stderr, "voicechat_smoke: %s\n", what);
+    failed = true;
+}
+
+static double rms(const int16_t* samples, size_t count) {
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) sum += (double)samples[i] * samples[i];
+    return count ? sqrt(sum / count) : 0.0;
+}
+
+// Share of the energy at one frequency (Goertzel), independent of phase
+static double purity(const int16_t* samples, size_t count, double hz) {
+    double coeff = 2.0 * cos(2.0 * M_PI * hz / AUDIO_HARNESS_RATE);
+    double s1 = 0, s2 = 0, energy = 0;
+    for (size_t i = 0; i < count; i++) {
+        double s0 = samples[i] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+        energy += (double)samples[i] * samples[i];
+    }
+    double power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+    return energy > 0 ? 2.0 * power / (count * energy) : 0.0;
+}
+
+static WavData tone() {
+    WavData wav;
+    wav.sampleRate = AUDIO_HARNESS_RATE;
+    wav.channels = 1;
+    double amplitude = 32768.0 * sqrt(2.0) * pow(10.0, SMOKE_TONE_DBFS / 20.0);
+    size_t frames = (size_t)AUDIO_HARNESS_RATE * SMOKE_MS / 1000;
+    for (size_t n = 0; n < frames; n++) {
+        wav.samples.push_back((int16_t)lround(amplitude * sin(2.0 * M_PI * SMOKE_TONE_HZ * n / AUDIO_HARNESS_RATE)));
+    }
+    return wav;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: voicechat_smoke <workdir>\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) return usage();
+    std::string card = std::string(argv[1]) + "/card";
+    std::error_code fsError;
+    fs::remove_all(card, fsError);
+    fs::create_directories(card, fsError);
+    SD.hostConfigure(SdCardConfig());
+    SD.hostMount(card);
+
+    WavData input = tone();
+    std::string error;
+    AudioRecordQueue recordQueue;
+    AudioPlayQueue playQueue;
+    AudioHarness audio(&recordQueue, &playQueue);
+    if (!audio.setInput(input, error)) {
+        fprintf(stderr, "voicechat_smoke: %s\n", error.c_str());
+        return 1;
+    }
+
+    // Record the tone
+    RecordingEngine recorder;
+    PlaybackEngine player;
+    if (!recorder.begin() || !player.begin()) {
+        fprintf(stderr, "voicechat_smoke: the engines did not start\n");
+        return 1;
+    }
+    recordQueue.begin();
+    if (!recorder.startRecording(0)) {
+        fprintf(stderr, "voicechat_smoke: RecordingEngine did not start recording\n");
+        return 1;
+    }
+    while (!audio.inputDone()) {
+        audio.advance(SMOKE_LOOP_US);
+        recorder.processRecording(&recordQueue);
+    }
+    recordQueue.end();
+    String recorded = recorder.getCurrentFileName();
+    uint32_t packets = recorder.getPacketCount();
+    uint32_t bytes = recorder.getRecordingSize();
+    check(recorder.stopRecording(), "RecordingEngine did not close the file");
+    check(!recorder.hasError(), "RecordingEngine reported an error");
+
+    int expectedPackets = SMOKE_MS / OPUS_FRAME_MS;
+    check(abs((int)packets - expectedPackets) <= SMOKE_PACKET_SLACK, "wrong packet count");
+
+    // Received as a message on channel 1
+    fs::path received = fs::path(SD.hostPath(RX_DIR_PREFIX "1")) / "MSG_00001_from_Smoke.opus";
+    fs::copy_file(SD.hostPath(recorded.c_str()), received, fs::copy_options::overwrite_existing, fsError);
+    check(!fsError, "cannot copy the recording to /RX/CH1");
+
+    // Play it back
+    size_t start = audio.output().samples.size();
+    check(player.loadChannelQueue(0) && player.hasMessages(), "PlaybackEngine found no message");
+    check(player.startPlayback(&playQueue), "PlaybackEngine did not start");
+    uint32_t duration = player.getFileDuration();
+    uint64_t limit = (uint64_t)(SMOKE_MS + 1000) * 1000;
+    for (uint64_t us = 0; player.processPlayback(&playQueue) && us < limit; us += SMOKE_LOOP_US) {
+        audio.advance(SMOKE_LOOP_US);
+    }
+    bool finished = !player.isPlaying();
+    player.stopPlayback();
+    while (playQueue.hostQueued() > 0) audio.runBlocks(1);
+    audio.runBlocks(1);
+    check(finished, "PlaybackEngine did not finish");
+
+    // The span that is not silence, and its middle half for level and tone
+    const std::vector<int16_t>& out = audio.output().samples;
+    size_t first = out.size(), last = start;
+    for (size_t i = start; i < out.size(); i++) {
+        if (abs(out[i]) < SMOKE_SILENCE) continue;
+        first = std::min(first, i);
+        last = i + 1;
+    }
+    double playedMs = last > first ? 1000.0 * (last - first) / AUDIO_HARNESS_RATE : 0.0;
+    check(fabs(playedMs - SMOKE_MS) <= SMOKE_LENGTH_SLACK_MS, "playback is not as long as the input");
+
+    double levelDb = -200.0, tonePurity = 0.0;
+    if (last > first) {
+        size_t quarter = (last - first) / 4;
+        double inputRms = rms(input.samples.data(), input.samples.size());
+        levelDb = 20.0 * log10(std::max(rms(&out[first + quarter], 2 * quarter), 1e-9) / inputRms);
+        tonePurity = purity(&out[first + quarter], 2 * quarter, SMOKE_TONE_HZ);
+    }
+    check(fabs(levelDb) <= SMOKE_LEVEL_DB, "playback level differs from the input");
+    check(tonePurity >= SMOKE_MIN_PURITY, "playback is not the input tone");
+
+    printf("{\"test\":\"smoke\",\"input_ms\":%d,\"packets\":%u,\"bytes\":%u,\"file_duration_ms\":%u,"
+           "\"played_ms\":%.1f,\"level_db\":%.2f,\"purity\":%.4f,\"ok\":%s}\n",
+           SMOKE_MS, packets, bytes, duration, playedMs, levelDb, tonePurity, failed ? "false" : "true");
+    SD.hostUnmount();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * SongbirdDynamics.cpp - Software AGC / compressor with a lookahead limiter
+ */
+
+#include "SongbirdDynamics.h"
+#include <math.h>
+
+#define DB_PER_OCTAVE           6.0205999f      // 20 * log10(2)
+#define PEAK_DECAY_MS           10.0f           // Peak detector fall time
+#define GAIN_FLOOR_Q16          (-15 * 65536)   // -90 dB, keeps exp2Q16() in range
+#define ALLOWED_ANY             0x7FFFFFFF
+
+// Ramps that reach a limit d sub-blocks ahead: 65536 / d, rounded up for
+// gain going down and down for gain going up, so both err on the quiet side
+static const uint32_t rampDown[DYNAMICS_MAX_LOOKAHEAD] = {
+    0, 65536, 32768, 21846, 16384, 13108, 10923, 9363, 8192, 7282, 6554, 5958, 5462, 5042,
+};
+static const uint32_t rampUp[DYNAMICS_MAX_LOOKAHEAD] = {
+    0, 65536, 32768, 21845, 16384, 13107, 10922, 9362, 8192, 7281, 6553, 5957, 5461, 5041,
+};
+
+// ITU-R BS.1770-4 Annex 2 true-peak interpolator: four phases of 12
+// taps, Q13 (the published coefficients are multiples of 1/8192). The
+// middle two phases are scaled up to unity gain; as published they read
+// 0.24 dB low, which the limiter would let through.
+static const int16_t truePeakTaps[4][DYNAMICS_TP_TAPS] = {
+    { 14, 90, -161, 272, -487, 1125, 7964, -838, 390, -218, 122, -68 },
+    { -246, 247, -436, 750, -1402, 3916, 6565, -1686, 855, -490, 279, -159 },
+    { -159, 279, -490, 855, -1686, 6565, 3916, -1402, 750, -436, 247, -246 },
+    { -68, 122, -218, 390, -838, 7964, 1125, -487, 272, -161, 90, 14 },
+};
+
+static int32_t toQ16(float x) {
+    return (int32_t)lroundf(x * 65536.0f);
+}
+
+// One-pole smoothing coefficient per sub-block, Q15
+static int32_t smoothing(float ms) {
+    if (ms <= 0.0f) return 32768;
+    float samples = ms * AUDIO_SAMPLE_RATE_EXACT / 1000.0f;
+    int32_t coef = (int32_t)lroundf((1.0f - expf(-(float)DYNAMICS_SUBBLOCK / samples)) * 32768.0f);
+    return constrain(coef, 1, 32768);
+}
+
+static inline int16_t saturate16(int32_t x) {
+    if (x > 32767) return 32767;
+    if (x < -32768) return -32768;
+    return x;
+}
+
+static inline int32_t absolute(int32_t x) {
+    return x < 0 ? -x : x;
+}
+
+AudioEffectSongbirdDynamics::AudioEffectSongbirdDynamics() : AudioStream(1, inputQueueArray) {
+    memset(delay, 0, sizeof(delay));
+    memset(history, 0, sizeof(history));
+    memset(peaks, 0, sizeof(peaks));
+    for (int i = 0; i < DYNAMICS_PEAK_RING; i++) allowed[i] = ALLOWED_ANY;
+    writePos = 0;
+    subblock = 0;
+    power = 0;
+    gain = 0;
+    applied = 65536;
+    lastLevel = GAIN_FLOOR_Q16;
+    lastGain = 0;
+    lastLimit = 0;
+    limited = 0;
+    cycleAverage = 0;
+    cycleMax = 0;
+    configure(dynamicsLimiter);
+}
+
+// log2 of x / 2^16, Q16. log2(1 + f) ~ f + 0.3466 f (1 - f): within
+// 0.008, 0.02 dB of level
+int32_t AudioEffectSongbirdDynamics::log2Q16(uint32_t x) {
+    if (x == 0) return -32 * 65536;
+    int exponent = 31 - __builtin_clz(x);
+    uint32_t mantissa = exponent >= 16 ? x >> (exponent - 16) : x << (16 - exponent);
+    uint32_t f = mantissa - 65536;
+    uint32_t bend = (f * (65536 - f)) >> 16;
+    return (exponent - 16) * 65536 + (int32_t)(f + ((bend * 22713) >> 16));
+}
+
+// 2^(x / 2^16), Q16. 2^f ~ 1 + f - 0.3435 f (1 - f): within 0.06 dB
+int32_t AudioEffectSongbirdDynamics::exp2Q16(int32_t x) {
+    if (x >= (14 << 16)) x = (14 << 16) - 1;
+    int32_t exponent = x >> 16;
+    uint32_t f = (uint32_t)x & 0xFFFF;
+    uint32_t bend = (f * (65536 - f)) >> 16;
+    uint32_t mantissa = 65536 + f - ((bend * 22512) >> 16);
+    if (exponent >= 0) return (int32_t)(mantissa << exponent);
+    if (exponent <= -31) return 0;
+    return (int32_t)(mantissa >> -exponent);
+}
+
+void AudioEffectSongbirdDynamics::configure(const DynamicsSettings& settings) {
+    Params next;
+    next.threshold = toQ16(settings.thresholdDb / DB_PER_OCTAVE);
+    next.halfKnee = toQ16(max(settings.kneeDb, 0.0f) / 2.0f / DB_PER_OCTAVE);
+    next.slope = toQ16(1.0f / max(settings.ratio, 1.0f) - 1.0f);
+    next.makeup = toQ16(constrain(settings.makeupDb, -DYNAMICS_MAX_GAIN_DB, DYNAMICS_MAX_GAIN_DB) / DB_PER_OCTAVE);
+    next.attack = smoothing(settings.attackMs);
+    next.release = smoothing(settings.releaseMs);
+    next.rms = settings.rmsMs > 0.0f ? smoothing(settings.rmsMs) : 0;
+    next.peakRelease = smoothing(PEAK_DECAY_MS);
+    next.limiterRelease = smoothing(settings.limiterReleaseMs);
+
+    float ceiling = 32768.0f * powf(10.0f, min(settings.ceilingDb, 0.0f) / 20.0f);
+    next.ceiling = constrain((int32_t)ceiling, 1, 32767);
+
+    float lookahead = settings.lookaheadMs * AUDIO_SAMPLE_RATE_EXACT / 1000.0f / DYNAMICS_SUBBLOCK;
+    next.lookahead = constrain((int)ceilf(lookahead), DYNAMICS_MIN_LOOKAHEAD, DYNAMICS_MAX_LOOKAHEAD);
+
+    AudioNoInterrupts();
+    current = settings;
+    params = next;
+    // Before any audio: start at the resting gain rather than ramp to it
+    if (subblock == 0) {
+        gain = next.makeup;
+        applied = exp2Q16(gain);
+    }
+    AudioInterrupts();
+}
+
+float AudioEffectSongbirdDynamics::levelDb() const {
+    return lastLevel * DB_PER_OCTAVE / 65536.0f;
+}
+
+float AudioEffectSongbirdDynamics::gainDb() const {
+    return lastGain * DB_PER_OCTAVE / 65536.0f;
+}
+
+float AudioEffectSongbirdDynamics::limitDb() const {
+    return lastLimit * DB_PER_OCTAVE / 65536.0f;
+}
+
+// Static curve: level and gain in log2 amplitude, Q16
+int32_t AudioEffectSongbirdDynamics::computeGain(int32_t level) const {
+    int32_t over = level - params.threshold;
+    int32_t curve;
+    if (over <= -params.halfKnee) {
+        curve = 0;
+    } else if (over >= params.halfKnee) {
+        curve = (int32_t)(((int64_t)params.slope * over) >> 16);
+    } else {
+        // Quadratic through the knee: slope * (over + W/2)^2 / 2W
+        int64_t t = over + params.halfKnee;
+        curve = (int32_t)((((int64_t)params.slope * t) >> 16) * t / (4 * (int64_t)params.halfKnee));
+    }
+    int32_t result = params.makeup + curve;
+    int32_t top = (int32_t)(DYNAMICS_MAX_GAIN_DB / DB_PER_OCTAVE * 65536.0f);
+    return constrain(result, GAIN_FLOOR_Q16, top);
+}
+
+void AudioEffectSongbirdDynamics::process(int16_t* data) {
+    const int lookahead = params.lookahead;
+    int32_t deepest = 0;
+
+    // The block goes into the delay line whole; output reads behind it
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        delay[(writePos + i) & DYNAMICS_DELAY_MASK] = data[i];
+    }
+    uint16_t readPos = writePos - lookahead * DYNAMICS_SUBBLOCK;
+    writePos += AUDIO_BLOCK_SAMPLES;
+
+    for (int sb = 0; sb < AUDIO_BLOCK_SAMPLES; sb += DYNAMICS_SUBBLOCK) {
+        // ---- Detector, on the undelayed input -------------------
+        // The oversampled points lag: the four between n-6 and n-5
+        // need n-11 .. n
+        int32_t x[DYNAMICS_SUBBLOCK + DYNAMICS_TP_HISTORY];
+        for (int i = 0; i < DYNAMICS_TP_HISTORY; i++) x[i] = history[i];
+        for (int i = 0; i < DYNAMICS_SUBBLOCK; i++) x[i + DYNAMICS_TP_HISTORY] = data[sb + i];
+
+        int32_t peak = 0;
+        int32_t between = 0;
+        int64_t energy = 0;
+        for (int i = 0; i < DYNAMICS_SUBBLOCK; i++) {
+            const int32_t* w = x + i;
+            int32_t s = w[DYNAMICS_TP_HISTORY];
+            for (int phase = 0; phase < 4; phase++) {
+                int32_t sum = 0;
+                for (int t = 0; t < DYNAMICS_TP_TAPS; t++) sum += truePeakTaps[phase][t] * w[t];
+                int32_t h = absolute(sum >> 13);
+                between = h > between ? h : between;
+            }
+            int32_t a = absolute(s);
+            peak = a > peak ? a : peak;
+            energy += s * s;
+        }
+        for (int i = 0; i < DYNAMICS_TP_HISTORY; i++) history[i] = x[DYNAMICS_SUBBLOCK + i];
+
+        // This sub-block's first oversampled points belong to the one
+        // before it, which is complete now
+        uint32_t k = subblock++;
+        int32_t truePeak = between > peak ? between : peak;
+        peaks[k % DYNAMICS_PEAK_RING] = truePeak;
+        int32_t previous = peaks[(k - 1) % DYNAMICS_PEAK_RING];
+        int32_t complete = truePeak > previous ? truePeak : previous;
+        allowed[(k - 1) % DYNAMICS_PEAK_RING] =
+            complete > 0 ? (int32_t)(((uint32_t)params.ceiling << 16) / (uint32_t)complete) : ALLOWED_ANY;
+
+        uint32_t mean = (uint32_t)(energy / DYNAMICS_SUBBLOCK);    // Q30
+        if (params.rms) {
+            power += (int32_t)(((int64_t)mean - (int64_t)power) * params.rms >> 15);
+        } else {
+            uint32_t square = (uint32_t)(peak * peak);
+            uint32_t decayed = power - (uint32_t)(((uint64_t)power * params.peakRelease) >> 15);
+            power = square > decayed ? square : decayed;
+        }
+
+        // ---- Gain computer --------------------------------------
+        int32_t level = (log2Q16(power) - (14 << 16)) / 2;     // Q30 power to log2 amplitude
+        int32_t target = computeGain(level);
+        int32_t coef = target < gain ? params.attack : params.release;
+        gain += (int32_t)(((int64_t)(target - gain) * coef) >> 15);
+        int32_t wanted = exp2Q16(gain);
+
+        // ---- Limiter --------------------------------------------
+        // The sub-block going out now is lookahead behind this one; the
+        // gain at its end must already be down to what each complete
+        // sub-block ahead allows, along a straight line that gets there
+        // by the time that sub-block starts
+        int32_t prev = applied;
+        int32_t next = wanted <= prev ? wanted : prev + (int32_t)(((int64_t)(wanted - prev) * params.limiterRelease) >> 15);
+        uint32_t out = k - lookahead;
+        for (int d = 0; d < lookahead; d++) {
+            int32_t limit = allowed[(out + d) % DYNAMICS_PEAK_RING];
+            int32_t line;
+            if (d == 0) {
+                line = limit;
+            } else if (limit < prev) {
+                line = prev - (int32_t)(((int64_t)(prev - limit) * rampDown[d] + 0xFFFF) >> 16);
+            } else {
+                line = prev + (int32_t)(((int64_t)(limit - prev) * rampUp[d]) >> 16);
+            }
+            next = line < next ? line : next;
+        }
+        if (next < wanted) {
+            int32_t depth = log2Q16(next) - log2Q16(wanted);
+            deepest = depth < deepest ? depth : deepest;
+        }
+
+        // ---- Apply, on the delayed audio ------------------------
+        // The gain moves in a straight line from prev to next, so it never
+        // goes above either end (the shift floors: DYNAMICS_SUBBLOCK is 16)
+        int32_t step = (next - prev) >> 4;
+        int32_t g = prev;
+        for (int i = 0; i < DYNAMICS_SUBBLOCK; i++) {
+            g += step;
+            int32_t s = delay[(readPos + sb + i) & DYNAMICS_DELAY_MASK];
+            data[sb + i] = saturate16((int32_t)(((int64_t)s * g) >> 16));
+        }
+        applied = g;
+        lastLevel = level;
+    }
+
+    lastGain = gain;
+    lastLimit = deepest;
+    if (deepest < 0) limited++;
+}
+
+void AudioEffectSongbirdDynamics::update(void) {
+    audio_block_t* block = receiveWritable(0);
+    if (!block) return;
+
+    uint32_t start = ARM_DWT_CYCCNT;
+    process(block->data);
+    uint32_t cycles = ARM_DWT_CYCCNT - start;
+
+    transmit(block);
+    release(block);
+
+    cycleAverage = cycleAverage - (cycleAverage >> 4) + cycles;
+    if (cycles > cycleMax) cycleMax = cycles;
+}
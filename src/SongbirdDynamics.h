@@ -0,0 +1,149 @@
+/*
+ * SongbirdDynamics.h - Software AGC / compressor with a lookahead limiter
+ *
+ * The SGTL5000's own AGC works on fixed constants, reacts in hundreds of
+ * milliseconds and cannot see a transient coming, so the first syllable
+ * after a pause clips. This AudioStream does the job in the audio graph:
+ *
+ *   detector      RMS over rmsMs (or peak, rmsMs = 0) of the input
+ *   gain computer threshold, ratio and a soft knee, plus makeup gain
+ *                 (the boost quiet sound gets, the AGC part), smoothed
+ *                 with attack and release in the log domain
+ *   lookahead     the audio is delayed lookaheadMs (1-5 ms), so the
+ *                 gain moves before the sound it reacts to comes out
+ *   limiter       a true-peak ceiling: the gain ramps down ahead of any
+ *                 peak that would cross ceilingDb and releases after it
+ *
+ * Everything runs in fixed point. Samples are Q15, levels and gains are
+ * log2 in Q16 until the last step, linear gain is Q16 (up to +30 dB).
+ * The detector and the gain run on 16-sample sub-blocks; the gain is
+ * interpolated across each one, so the per-sample loops are a
+ * multiply, a shift and a saturate over contiguous arrays, with no
+ * branches.
+ *
+ * True peak: the limiter looks at every sample and at four points
+ * between each pair, from the 4x interpolator of ITU-R BS.1770, so the
+ * ceiling also holds for what a DAC or a later resample reconstructs
+ * between samples: within about 0.1 dB for audio band-limited to 18 kHz,
+ * as the codec's decimation filter leaves it. That filter is most of the
+ * cost.
+ *
+ *   AudioEffectSongbirdDynamics dynamics;
+ *   dynamics.configure(dynamicsVoice);
+ *   AudioConnection c1(input, 0, dynamics, 0);
+ *   AudioConnection c2(dynamics, 0, recordQueue, 0);
+ */
+
+#ifndef SONGBIRD_DYNAMICS_H
+#define SONGBIRD_DYNAMICS_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#define DYNAMICS_SUBBLOCK       16      // Samples per detector / gain step
+#define DYNAMICS_DELAY_SIZE     512     // Ring for the lookahead, power of two
+#define DYNAMICS_DELAY_MASK     (DYNAMICS_DELAY_SIZE - 1)
+#define DYNAMICS_MIN_LOOKAHEAD  2       // Sub-blocks
+#define DYNAMICS_MAX_LOOKAHEAD  14      // Sub-blocks (5.1 ms)
+#define DYNAMICS_TP_TAPS        12      // Per phase of the true-peak interpolator
+#define DYNAMICS_TP_HISTORY     (DYNAMICS_TP_TAPS - 1)
+#define DYNAMICS_PEAK_RING      16      // Power of two, > DYNAMICS_MAX_LOOKAHEAD
+#define DYNAMICS_MAX_GAIN_DB    30.0f
+
+struct DynamicsSettings {
+    float thresholdDb;          // Compression starts here, dBFS
+    float ratio;                // Above the threshold; 1 = none
+    float kneeDb;               // Width of the soft knee around the threshold
+    float makeupDb;             // Gain below the threshold
+    float attackMs;
+    float releaseMs;
+    float rmsMs;                // Detector window; 0 = peak detector
+    float lookaheadMs;          // 1-5
+    float ceilingDb;            // Limiter ceiling, dBFS true peak
+    float limiterReleaseMs;
+};
+
+// Speech: a quiet talker comes up 12 dB, anything over -30 dBFS is 4:1
+const DynamicsSettings dynamicsVoice = {
+    -30.0f, 4.0f, 10.0f, 12.0f, 5.0f, 250.0f, 10.0f, 3.0f, -1.0f, 80.0f
+};
+
+// Field ambience: a gentle ride, slow enough not to pump on birdsong
+const DynamicsSettings dynamicsAmbience = {
+    -24.0f, 2.0f, 12.0f, 6.0f, 30.0f, 1500.0f, 50.0f, 5.0f, -1.0f, 200.0f
+};
+
+// Only the limiter
+const DynamicsSettings dynamicsLimiter = {
+    0.0f, 1.0f, 0.0f, 0.0f, 5.0f, 250.0f, 10.0f, 1.0f, -1.0f, 80.0f
+};
+
+class AudioEffectSongbirdDynamics : public AudioStream {
+public:
+    AudioEffectSongbirdDynamics();
+
+    // Recompute the fixed-point parameters and hand them to update() in
+    // one step. A new lookahead moves the delay tap: expect a click.
+    void configure(const DynamicsSettings& settings);
+    const DynamicsSettings& settings() const { return current; }
+
+    // Samples the output lags the input
+    uint16_t latencySamples() const { return params.lookahead * DYNAMICS_SUBBLOCK; }
+
+    // ---- Reporting ---------------------------------------------
+    float levelDb() const;      // Detector, dBFS
+    float gainDb() const;       // Gain computer, after smoothing
+    float limitDb() const;      // Deepest limiter action in the last block (<= 0)
+    uint32_t limitedBlocks() const { return limited; }
+    uint32_t cyclesPerBlock() const { return cycleAverage >> 4; }
+    uint32_t cyclesPerBlockMax() const { return cycleMax; }
+    void resetStats() { cycleMax = 0; limited = 0; }
+
+    virtual void update(void);
+
+    // Fixed-point helpers, public for the host bench
+    static int32_t log2Q16(uint32_t x);
+    static int32_t exp2Q16(int32_t x);
+
+private:
+    struct Params {
+        int32_t threshold;      // log2 amplitude, Q16
+        int32_t halfKnee;
+        int32_t slope;          // 1/ratio - 1, Q16
+        int32_t makeup;
+        int32_t attack;         // Per sub-block smoothing coefficients, Q15
+        int32_t release;
+        int32_t rms;            // 0 = peak detector
+        int32_t peakRelease;
+        int32_t limiterRelease;
+        int32_t ceiling;        // Q15 amplitude
+        uint8_t lookahead;      // Sub-blocks
+    };
+
+    audio_block_t* inputQueueArray[1];
+    DynamicsSettings current;
+    Params params;
+
+    // Shared with update()
+    int16_t delay[DYNAMICS_DELAY_SIZE];
+    uint16_t writePos;
+    int32_t history[DYNAMICS_TP_HISTORY];   // Last input samples, for the interpolator
+    int32_t peaks[DYNAMICS_PEAK_RING];      // Per sub-block, before the neighbour's tail
+    int32_t allowed[DYNAMICS_PEAK_RING];    // Gain the limiter allows, Q16
+    uint32_t subblock;          // Sub-blocks seen
+    uint32_t power;             // Detector, Q30
+    int32_t gain;               // Gain computer, log2 Q16
+    int32_t applied;            // Linear Q16, at the end of the last sub-block
+
+    volatile int32_t lastLevel;
+    volatile int32_t lastGain;
+    volatile int32_t lastLimit;
+    volatile uint32_t limited;
+    volatile uint32_t cycleAverage; // x16
+    volatile uint32_t cycleMax;
+
+    void process(int16_t* data);
+    int32_t computeGain(int32_t level) const;
+};
+
+#endif
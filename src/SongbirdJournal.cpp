@@ -0,0 +1,128 @@
+/*
+ * SongbirdJournal.cpp - Wear-leveled, power-safe record store in EEPROM
+ */
+
+#include "SongbirdJournal.h"
+
+static uint32_t readLE32(uint16_t address) {
+    return EEPROM.read(address) | (EEPROM.read(address + 1) << 8) | (EEPROM.read(address + 2) << 16)
+           | ((uint32_t)EEPROM.read(address + 3) << 24);
+}
+
+static void updateLE32(uint16_t address, uint32_t value) {
+    for (int i = 0; i < 4; i++) EEPROM.update(address + i, (uint8_t)(value >> (8 * i)));
+}
+
+SongbirdJournal::SongbirdJournal(uint16_t start, uint16_t size, uint16_t maxPayload)
+    : start(start), maxPayload(maxPayload), head(-1), headGeneration(0) {
+    slotBytes = JOURNAL_HEADER_SIZE + maxPayload + JOURNAL_CRC_SIZE;
+    slotCount = size / slotBytes;
+}
+
+// Reflected CRC-32 (IEEE 802.3), a nibble at a time: a 64-byte table
+// instead of 1 KB, fast enough for a few dozen bytes
+uint32_t SongbirdJournal::crc32(const uint8_t* data, size_t length, uint32_t crc) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+uint32_t SongbirdJournal::readGeneration(uint16_t slot) const {
+    return readLE32(slotAddress(slot));
+}
+
+bool SongbirdJournal::validSlot(uint16_t slot, uint16_t& length) const {
+    uint16_t address = slotAddress(slot);
+    if (readLE32(address) == JOURNAL_ERASED) return false;
+
+    length = EEPROM.read(address + 4) | (EEPROM.read(address + 5) << 8);
+    if (length == 0 || length > maxPayload) return false;
+
+    uint8_t bytes[JOURNAL_HEADER_SIZE];
+    for (uint16_t i = 0; i < JOURNAL_HEADER_SIZE; i++) bytes[i] = EEPROM.read(address + i);
+    uint32_t crc = crc32(bytes, JOURNAL_HEADER_SIZE);
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t byte = EEPROM.read(address + JOURNAL_HEADER_SIZE + i);
+        crc = crc32(&byte, 1, crc);
+    }
+    return crc == readLE32(address + JOURNAL_HEADER_SIZE + length);
+}
+
+bool SongbirdJournal::begin() {
+    head = -1;
+    headGeneration = 0;
+    if (slotCount == 0) return false;
+
+    // Newest first: a torn or corrupt slot falls back to the one before.
+    // Generations only grow, so each pass looks below the last candidate.
+    uint32_t below = JOURNAL_ERASED;
+    while (true) {
+        int32_t candidate = -1;
+        uint32_t best = 0;
+        for (uint16_t slot = 0; slot < slotCount; slot++) {
+            uint32_t generation = readGeneration(slot);
+            if (generation < below && generation >= best) {
+                best = generation;
+                candidate = slot;
+            }
+        }
+        if (candidate < 0 || best == 0) return false;
+
+        uint16_t length;
+        if (validSlot(candidate, length)) {
+            head = candidate;
+            headGeneration = best;
+            return true;
+        }
+        below = best;
+    }
+}
+
+uint16_t SongbirdJournal::load(void* data, uint16_t size) const {
+    uint16_t length;
+    if (head < 0 || !validSlot(head, length)) return 0;
+
+    uint8_t* bytes = (uint8_t*)data;
+    uint16_t address = slotAddress(head) + JOURNAL_HEADER_SIZE;
+    for (uint16_t i = 0; i < size; i++) bytes[i] = i < length ? EEPROM.read(address + i) : 0;
+    return length;
+}
+
+bool SongbirdJournal::append(const void* data, uint16_t length) {
+    if (slotCount == 0 || length == 0 || length > maxPayload) return false;
+
+    uint16_t slot = head < 0 ? 0 : (head + 1) % slotCount;
+    uint16_t address = slotAddress(slot);
+    uint32_t generation = headGeneration + 1;
+
+    uint8_t header[JOURNAL_HEADER_SIZE];
+    for (int i = 0; i < 4; i++) header[i] = (uint8_t)(generation >> (8 * i));
+    header[4] = (uint8_t)length;
+    header[5] = (uint8_t)(length >> 8);
+    uint32_t crc = crc32(header, sizeof(header));
+    crc = crc32((const uint8_t*)data, length, crc);
+
+    // Body first and the generation last: until it lands, the slot still
+    // reads as its old (now torn, so invalid) record, never as the newest
+    EEPROM.update(address + 4, header[4]);
+    EEPROM.update(address + 5, header[5]);
+    for (uint16_t i = 0; i < length; i++) {
+        EEPROM.update(address + JOURNAL_HEADER_SIZE + i, ((const uint8_t*)data)[i]);
+    }
+    updateLE32(address + JOURNAL_HEADER_SIZE + length, crc);
+    updateLE32(address, generation);
+
+    uint16_t stored;
+    if (!validSlot(slot, stored) || stored != length) return false;
+    head = slot;
+    headGeneration = generation;
+    return true;
+}
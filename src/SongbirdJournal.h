@@ -0,0 +1,74 @@
+/*
+ * SongbirdJournal.h - Wear-leveled, power-safe record store in EEPROM
+ *
+ * Settings saved in place rewrite the same cells every time, and a save
+ * cut short by power loss leaves a half-old, half-new struct. The journal
+ * instead appends: its EEPROM region is a ring of fixed-size slots, and
+ * every save goes into the slot after the newest one, so each cell is
+ * written once per lap of the ring. A slot is
+ *
+ *   generation (4)  length (2)  payload (length)  crc (4)
+ *
+ * little-endian, with a CRC-32 (IEEE) over everything before it. The
+ * newest record is the valid one with the highest generation; a torn
+ * append fails its CRC and the one before it is still there.
+ *
+ * begin() reads every slot's generation once and checks CRCs from the
+ * newest down until one holds; after that the head is cached, so load()
+ * and append() touch a single slot.
+ *
+ *   SongbirdJournal journal(0, 4096, sizeof(Settings));
+ *   journal.begin();
+ *   if (journal.load(&settings, sizeof(settings)) == 0) ...defaults...
+ *   journal.append(&settings, sizeof(settings));
+ */
+
+#ifndef SONGBIRD_JOURNAL_H
+#define SONGBIRD_JOURNAL_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#define JOURNAL_HEADER_SIZE     6       // Generation and length
+#define JOURNAL_CRC_SIZE        4
+#define JOURNAL_ERASED          0xFFFFFFFFUL
+
+class SongbirdJournal {
+public:
+    // The journal owns EEPROM [start, start + size); records hold up to
+    // maxPayload bytes
+    SongbirdJournal(uint16_t start, uint16_t size, uint16_t maxPayload);
+
+    // Find the newest valid record; false if there is none
+    bool begin();
+
+    // Copy the newest record into data (up to size bytes, the rest zeroed:
+    // a record from a shorter, older layout). Returns its stored length,
+    // 0 if there is no valid record.
+    uint16_t load(void* data, uint16_t size) const;
+
+    // Write a record into the next slot and read it back
+    bool append(const void* data, uint16_t length);
+
+    bool hasRecord() const { return head >= 0; }
+    uint32_t generation() const { return headGeneration; }
+    uint16_t slots() const { return slotCount; }
+    uint16_t slotSize() const { return slotBytes; }
+
+    static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+private:
+    uint16_t start;
+    uint16_t slotBytes;
+    uint16_t slotCount;
+    uint16_t maxPayload;
+
+    int32_t head;               // Slot of the newest record, -1 if none
+    uint32_t headGeneration;
+
+    uint16_t slotAddress(uint16_t slot) const { return start + slot * slotBytes; }
+    uint32_t readGeneration(uint16_t slot) const;
+    bool validSlot(uint16_t slot, uint16_t& length) const;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * SongbirdProfiler.cpp - Scoped timing zones for loop()
+ */
+
+#include "SongbirdProfiler.h"
+
+SongbirdProfiler::Zone SongbirdProfiler::zones[PROFILER_MAX_ZONES];
+uint8_t SongbirdProfiler::zoneCount = 0;
+uint32_t SongbirdProfiler::loopStartTicks = 0;
+uint32_t SongbirdProfiler::loopCount = 0;
+uint32_t SongbirdProfiler::worstLoopTicks = 0;
+uint32_t SongbirdProfiler::lastReport = 0;
+bool SongbirdProfiler::discardLoop = false;
+
+uint8_t SongbirdProfiler::zone(const char* name) {
+    if (zoneCount >= PROFILER_MAX_ZONES) return PROFILER_MAX_ZONES - 1;
+
+    Zone& added = zones[zoneCount];
+    memset(&added, 0, sizeof(added));
+    added.name = name;
+    added.minTicks = UINT32_MAX;
+    return zoneCount++;
+}
+
+void SongbirdProfiler::record(uint8_t zone, uint32_t ticks) {
+    Zone& z = zones[zone];
+    z.count++;
+    z.totalTicks += ticks;
+    z.loopTicks += ticks;
+    if (ticks < z.minTicks) z.minTicks = ticks;
+    if (ticks > z.maxTicks) z.maxTicks = ticks;
+
+    // Bucket b holds [2^(b-1), 2^b) us, bucket 0 under 1 us
+    uint32_t us = toMicros(ticks);
+    uint8_t bucket = 0;
+    while (us > 0 && bucket < PROFILER_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    z.histogram[bucket]++;
+}
+
+void SongbirdProfiler::loopStart() {
+    loopStartTicks = now();
+}
+
+// A new slowest iteration keeps each zone's share of it
+void SongbirdProfiler::loopEnd() {
+    uint32_t ticks = now() - loopStartTicks;
+
+    if (discardLoop) {
+        // The report itself was printed in this iteration
+        discardLoop = false;
+    } else {
+        loopCount++;
+        if (ticks > worstLoopTicks) {
+            worstLoopTicks = ticks;
+            for (uint8_t i = 0; i < zoneCount; i++) {
+                zones[i].worstLoopTicks = zones[i].loopTicks;
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < zoneCount; i++) {
+        zones[i].loopTicks = 0;
+    }
+}
+
+void SongbirdProfiler::reset() {
+    for (uint8_t i = 0; i < zoneCount; i++) {
+        const char* name = zones[i].name;
+        memset(&zones[i], 0, sizeof(zones[i]));
+        zones[i].name = name;
+        zones[i].minTicks = UINT32_MAX;
+    }
+    loopCount = 0;
+    worstLoopTicks = 0;
+}
+
+uint32_t SongbirdProfiler::toMicros(uint64_t ticks) {
+#if defined(__IMXRT1062__)
+    return (uint32_t)(ticks / (F_CPU_ACTUAL / 1000000));
+#else
+    return (uint32_t)(ticks / 1000);
+#endif
+}
+
+// =============================================================================
+// Report
+// =============================================================================
+
+uint8_t SongbirdProfiler::lineCount() {
+    return 1 + zoneCount;
+}
+
+void SongbirdProfiler::formatLine(uint8_t line, char* text, size_t size) {
+    if (line == 0) {
+        snprintf(text, size, "PROFILE loops=%lu worst_loop_us=%lu zones=%u (histogram: <1 <2 <4 ... us)",
+                 (unsigned long)loopCount, (unsigned long)toMicros(worstLoopTicks), zoneCount);
+        return;
+    }
+
+    const Zone& z = zones[line - 1];
+    int length = snprintf(text, size, "PROFILE %-10s n=%lu min_us=%lu avg_us=%lu max_us=%lu worst_us=%lu |",
+                          z.name, (unsigned long)z.count,
+                          (unsigned long)(z.count ? toMicros(z.minTicks) : 0),
+                          (unsigned long)(z.count ? toMicros(z.totalTicks) / z.count : 0),
+                          (unsigned long)toMicros(z.maxTicks),
+                          (unsigned long)toMicros(z.worstLoopTicks));
+
+    // Histogram up to the last non-empty bucket
+    int last = PROFILER_BUCKETS - 1;
+    while (last > 0 && z.histogram[last] == 0) last--;
+    for (int b = 0; b <= last && length > 0 && (size_t)length < size; b++) {
+        length += snprintf(text + length, size - length, " %lu", (unsigned long)z.histogram[b]);
+    }
+}
+
+void SongbirdProfiler::print(Print& out) {
+    char text[PROFILER_LINE_MAX];
+    for (uint8_t line = 0; line < lineCount(); line++) {
+        formatLine(line, text, sizeof(text));
+        out.println(text);
+    }
+    discardLoop = true;
+}
+
+void SongbirdProfiler::report(Print& out, uint32_t intervalMs) {
+    uint32_t ms = millis();
+    if (ms - lastReport < intervalMs) return;
+    lastReport = ms;
+    print(out);
+}
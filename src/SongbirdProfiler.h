@@ -0,0 +1,129 @@
+/*
+ * SongbirdProfiler.h - Scoped timing zones for loop()
+ *
+ * Everything a sketch does shares loop(): display flushes, SD writes,
+ * serial transfers, LED updates. The profiler shows where that time goes
+ * and, above all, which zone made the slowest loop() iteration.
+ *
+ *   PROFILE_LOOP();           first line of loop()
+ *   PROFILE_ZONE("display");  first line of anything worth timing
+ *   PROFILE_REPORT(Serial, 5000);
+ *
+ * Each zone keeps count, min/avg/max and a log2 histogram in a fixed
+ * table (PROFILER_MAX_ZONES). Each loop() iteration also records how long
+ * every zone ran in it; the iteration that sets a new worst case keeps
+ * that breakdown, reported as worst_us per zone. Zones may nest; a nested
+ * zone's time is also in its parent's.
+ *
+ * Ticks are the Cortex-M7 DWT cycle counter on Teensy 4 and
+ * std::chrono::steady_clock nanoseconds elsewhere (host builds). Neither
+ * is reported raw: everything is in microseconds.
+ *
+ * The macros compile to nothing unless SONGBIRD_PROFILE is defined before
+ * this header is included (a sketch's Config.h); the profiler itself is
+ * then never referenced and the linker drops it.
+ */
+
+#ifndef SONGBIRD_PROFILER_H
+#define SONGBIRD_PROFILER_H
+
+#include <Arduino.h>
+
+#if !defined(__IMXRT1062__)
+#include <chrono>
+#endif
+
+#define PROFILER_MAX_ZONES      16
+#define PROFILER_BUCKETS        16      // Histogram: <1 us, <2 us, <4 us ... >=16 ms
+#define PROFILER_LINE_MAX       160
+
+class SongbirdProfiler {
+public:
+    // Ticks from the cycle counter (or the host clock)
+    static inline uint32_t now() {
+#if defined(__IMXRT1062__)
+        return ARM_DWT_CYCCNT;
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Register a zone by name (once per call site). Returns its index;
+    // zones past PROFILER_MAX_ZONES all share the last slot.
+    static uint8_t zone(const char* name);
+
+    static void record(uint8_t zone, uint32_t ticks);
+    static void loopStart();
+    static void loopEnd();
+
+    // Report: a header line then one line per zone. formatLine() is for
+    // sketches that send the lines over their own protocol.
+    static uint8_t lineCount();
+    static void formatLine(uint8_t line, char* text, size_t size);
+    static void print(Print& out);
+    static void report(Print& out, uint32_t intervalMs);
+
+    static void reset();
+
+    // Leave the current loop() iteration out of the statistics (it did
+    // something unrepresentative, like sending the report)
+    static void discardIteration() { discardLoop = true; }
+
+private:
+    struct Zone {
+        const char* name;
+        uint32_t count;
+        uint32_t minTicks;
+        uint32_t maxTicks;
+        uint64_t totalTicks;
+        uint32_t loopTicks;         // In the current loop() iteration
+        uint32_t worstLoopTicks;    // In the slowest iteration so far
+        uint32_t histogram[PROFILER_BUCKETS];
+    };
+
+    static Zone zones[PROFILER_MAX_ZONES];
+    static uint8_t zoneCount;
+    static uint32_t loopStartTicks;
+    static uint32_t loopCount;
+    static uint32_t worstLoopTicks;
+    static uint32_t lastReport;
+    static bool discardLoop;        // This iteration printed the report
+
+    static uint32_t toMicros(uint64_t ticks);
+};
+
+// Times the enclosing scope
+class SongbirdProfileScope {
+public:
+    explicit SongbirdProfileScope(uint8_t zone) : zone(zone), start(SongbirdProfiler::now()) {}
+    ~SongbirdProfileScope() { SongbirdProfiler::record(zone, SongbirdProfiler::now() - start); }
+
+private:
+    uint8_t zone;
+    uint32_t start;
+};
+
+// Marks one loop() iteration
+class SongbirdProfileLoop {
+public:
+    SongbirdProfileLoop() { SongbirdProfiler::loopStart(); }
+    ~SongbirdProfileLoop() { SongbirdProfiler::loopEnd(); }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT2(a, b)
+
+#ifdef SONGBIRD_PROFILE
+  #define PROFILE_ZONE(name) \
+      static const uint8_t PROFILE_CONCAT(profileZone, __LINE__) = SongbirdProfiler::zone(name); \
+      SongbirdProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__))
+  #define PROFILE_LOOP()                SongbirdProfileLoop profileLoop
+  #define PROFILE_REPORT(port, ms)      SongbirdProfiler::report(port, ms)
+#else
+  #define PROFILE_ZONE(name)
+  #define PROFILE_LOOP()
+  #define PROFILE_REPORT(port, ms)
+#endif
+
+#endif
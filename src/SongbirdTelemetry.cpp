@@ -0,0 +1,198 @@
+/*
+ * SongbirdTelemetry.cpp - Audio CPU and memory telemetry
+ */
+
+#include "SongbirdTelemetry.h"
+
+static_assert(sizeof(TelemetryFrame) == 46, "TelemetryFrame layout changed: bump TELEMETRY_VERSION");
+
+#if defined(__IMXRT1062__)
+// Teensy 4.x linker symbols: the stack grows down from _estack towards
+// the end of .bss in DTCM, the heap grows up from _heap_start in RAM2
+extern unsigned long _ebss;
+extern unsigned long _heap_start;
+extern unsigned long _heap_end;
+extern "C" char* __brkval;
+
+#define TELEMETRY_STACK_PAINT   0x5A5A5A5AUL
+#endif
+
+SongbirdTelemetry::SongbirdTelemetry() {
+    blocksAllocated = 0;
+    commandLength = 0;
+    command[0] = '\0';
+    resetLoopWindow();
+}
+
+void SongbirdTelemetry::begin(uint16_t audioBlocks) {
+    blocksAllocated = audioBlocks;
+
+#if defined(__IMXRT1062__)
+    // Paint the unused stack so minFreeStack() can find how deep it has
+    // ever been. Interrupts nest below the stack pointer, so anything
+    // they write here is already dead when painting resumes.
+    uint32_t* bottom = (uint32_t*)&_ebss;
+    uint32_t* top = (uint32_t*)((char*)__builtin_frame_address(0) - TELEMETRY_STACK_MARGIN);
+    for (volatile uint32_t* word = bottom; word < top; word++) {
+        *word = TELEMETRY_STACK_PAINT;
+    }
+#endif
+
+    resetLoopWindow();
+}
+
+void SongbirdTelemetry::loopTick() {
+    uint32_t now = micros();
+    if (lastTickUs != 0) {
+        uint32_t elapsed = now - lastTickUs;
+        loopCount++;
+        loopTotalUs += elapsed;
+        if (elapsed > loopMaxUs) loopMaxUs = elapsed;
+    }
+    lastTickUs = now;
+}
+
+void SongbirdTelemetry::resetLoopWindow() {
+    lastTickUs = 0;
+    loopCount = 0;
+    loopTotalUs = 0;
+    loopMaxUs = 0;
+}
+
+void SongbirdTelemetry::resetPeaks() {
+    AudioProcessorUsageMaxReset();
+    AudioMemoryUsageMaxReset();
+    resetLoopWindow();
+}
+
+// =============================================================================
+// Memory
+// =============================================================================
+
+uint32_t SongbirdTelemetry::freeHeap() {
+#if defined(__IMXRT1062__)
+    return (uint32_t)((char*)&_heap_end - __brkval);
+#else
+    return 0;
+#endif
+}
+
+uint32_t SongbirdTelemetry::freeStack() {
+#if defined(__IMXRT1062__)
+    return (uint32_t)((char*)__builtin_frame_address(0) - (char*)&_ebss);
+#else
+    return 0;
+#endif
+}
+
+// Paint still intact above the end of .bss: the stack never got there
+uint32_t SongbirdTelemetry::minFreeStack() const {
+#if defined(__IMXRT1062__)
+    const uint32_t* bottom = (const uint32_t*)&_ebss;
+    const uint32_t* top = (const uint32_t*)__builtin_frame_address(0);
+    const uint32_t* word = bottom;
+    while (word < top && *word == TELEMETRY_STACK_PAINT) word++;
+    return (uint32_t)((const char*)word - (const char*)bottom);
+#else
+    return 0;
+#endif
+}
+
+// =============================================================================
+// Reports
+// =============================================================================
+
+void SongbirdTelemetry::frame(TelemetryFrame& out) {
+    memset(&out, 0, sizeof(out));
+    out.magic[0] = TELEMETRY_MAGIC_1;
+    out.magic[1] = TELEMETRY_MAGIC_2;
+    out.version = TELEMETRY_VERSION;
+    out.size = sizeof(TelemetryFrame);
+    out.uptimeMs = millis();
+
+    out.audioCpu = (uint16_t)(AudioProcessorUsage() * 100.0f + 0.5f);
+    out.audioCpuMax = (uint16_t)(AudioProcessorUsageMax() * 100.0f + 0.5f);
+    out.blocksUsed = AudioMemoryUsage();
+    out.blocksMax = AudioMemoryUsageMax();
+    out.blocksAllocated = blocksAllocated;
+
+    out.loops = loopCount;
+    out.loopAvgUs = loopCount ? loopTotalUs / loopCount : 0;
+    out.loopMaxUs = loopMaxUs;
+
+    out.heapFree = freeHeap();
+    out.stackFree = freeStack();
+    out.stackMinFree = minFreeStack();
+
+    out.crc = crc16((const uint8_t*)&out, offsetof(TelemetryFrame, crc));
+    resetLoopWindow();
+}
+
+void SongbirdTelemetry::writeFrame(Print& out) {
+    TelemetryFrame report;
+    frame(report);
+    out.write((const uint8_t*)&report, sizeof(report));
+}
+
+void SongbirdTelemetry::print(Print& out) {
+    char line[TELEMETRY_LINE_MAX];
+    format(line, sizeof(line));
+    out.println(line);
+}
+
+void SongbirdTelemetry::format(char* line, size_t size) {
+    TelemetryFrame report;
+    frame(report);
+
+    snprintf(line, size,
+             "TELEMETRY up_ms=%lu cpu=%u.%02u cpu_max=%u.%02u blocks=%u blocks_max=%u blocks_alloc=%u "
+             "loops=%lu loop_avg_us=%lu loop_max_us=%lu heap_free=%lu stack_free=%lu stack_min_free=%lu",
+             (unsigned long)report.uptimeMs,
+             report.audioCpu / 100, report.audioCpu % 100,
+             report.audioCpuMax / 100, report.audioCpuMax % 100,
+             report.blocksUsed, report.blocksMax, report.blocksAllocated,
+             (unsigned long)report.loops, (unsigned long)report.loopAvgUs, (unsigned long)report.loopMaxUs,
+             (unsigned long)report.heapFree, (unsigned long)report.stackFree,
+             (unsigned long)report.stackMinFree);
+}
+
+// =============================================================================
+// Commands
+// =============================================================================
+
+void SongbirdTelemetry::poll(Stream& port) {
+    while (port.available()) {
+        char c = port.read();
+        if (c == '\r' || c == '\n') {
+            if (commandLength > 0) {
+                command[commandLength] = '\0';
+                handleCommand(port);
+            }
+            commandLength = 0;
+        } else if (commandLength < TELEMETRY_COMMAND_MAX) {
+            command[commandLength++] = toupper(c);
+        }
+    }
+}
+
+void SongbirdTelemetry::handleCommand(Stream& port) {
+    if (strcmp(command, "TELEMETRY") == 0) {
+        print(port);
+    } else if (strcmp(command, "TELEMETRY BIN") == 0) {
+        writeFrame(port);
+    } else if (strcmp(command, "TELEMETRY RESET") == 0) {
+        resetPeaks();
+        port.println("TELEMETRY reset");
+    }
+}
+
+uint16_t SongbirdTelemetry::crc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,107 @@
+/*
+ * SongbirdTelemetry.h - Audio CPU and memory telemetry for Songbird sketches
+ *
+ * Samples what is needed to size a sketch from data instead of guesses:
+ * audio library CPU (now and peak), audio block pool use (now, peak and
+ * the AudioMemory() allocation), loop() iteration time, and free heap
+ * and stack (with the stack's low-water mark).
+ *
+ * Two ways out:
+ *   - print(): one "TELEMETRY key=value ..." text line (format() for a
+ *     sketch that sends it over its own protocol)
+ *   - frame(): a fixed 46-byte little-endian binary frame with a magic,
+ *     a version and a CRC-16, for sketches whose serial port carries a
+ *     binary protocol
+ *
+ * Sketches without a command interface call poll(Serial) from loop();
+ * it answers "TELEMETRY", "TELEMETRY BIN" and "TELEMETRY RESET" lines
+ * without blocking.
+ *
+ * Usage:
+ *   SongbirdTelemetry telemetry;
+ *   setup(): AudioMemory(AUDIO_MEMORY_BLOCKS); telemetry.begin(AUDIO_MEMORY_BLOCKS);
+ *   loop():  telemetry.loopTick(); ... telemetry.poll(Serial);
+ */
+
+#ifndef SONGBIRD_TELEMETRY_H
+#define SONGBIRD_TELEMETRY_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#define TELEMETRY_MAGIC_1       'S'
+#define TELEMETRY_MAGIC_2       'T'
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_COMMAND_MAX   24      // Longest command line poll() accepts
+#define TELEMETRY_STACK_MARGIN  256     // Bytes below the stack pointer left unpainted
+#define TELEMETRY_LINE_MAX      224     // print()/format() line, with the terminator
+
+// Binary frame. All fields little-endian; crc is CRC-16/CCITT-FALSE over
+// every byte before it.
+struct __attribute__((packed)) TelemetryFrame {
+    uint8_t  magic[2];          // 'S' 'T'
+    uint8_t  version;           // TELEMETRY_VERSION
+    uint8_t  size;              // sizeof(TelemetryFrame)
+    uint32_t uptimeMs;
+    uint16_t audioCpu;          // AudioProcessorUsage(), hundredths of a percent
+    uint16_t audioCpuMax;       // AudioProcessorUsageMax()
+    uint16_t blocksUsed;        // AudioMemoryUsage()
+    uint16_t blocksMax;         // AudioMemoryUsageMax()
+    uint16_t blocksAllocated;   // AudioMemory() allocation
+    uint16_t reserved;
+    uint32_t loops;             // loop() iterations since the last report
+    uint32_t loopAvgUs;         // ...their mean and longest time
+    uint32_t loopMaxUs;
+    uint32_t heapFree;          // Bytes never taken by malloc (0 if unknown)
+    uint32_t stackFree;         // Bytes between the stack pointer and the data
+    uint32_t stackMinFree;      // Least free stack seen since begin()
+    uint16_t crc;
+};
+
+class SongbirdTelemetry {
+public:
+    SongbirdTelemetry();
+
+    // Record the pool size and paint the free stack for the low-water mark.
+    // Call from setup(), after AudioMemory().
+    void begin(uint16_t audioBlocks);
+
+    // Call once at the top of loop()
+    void loopTick();
+
+    // Fill a frame (or print a line) and start a new loop-time window
+    void frame(TelemetryFrame& out);
+    void print(Print& out);
+    void format(char* line, size_t size);
+    void writeFrame(Print& out);
+
+    // Clear the audio CPU, block pool and loop peaks
+    void resetPeaks();
+
+    // Answer TELEMETRY commands on a port nothing else reads
+    void poll(Stream& port);
+
+    // Free memory right now
+    static uint32_t freeHeap();
+    static uint32_t freeStack();
+    uint32_t minFreeStack() const;
+
+    static uint16_t crc16(const uint8_t* data, size_t length);
+
+private:
+    uint16_t blocksAllocated;
+
+    // Loop timing, since the last report
+    uint32_t lastTickUs;
+    uint32_t loopCount;
+    uint32_t loopTotalUs;
+    uint32_t loopMaxUs;
+
+    char command[TELEMETRY_COMMAND_MAX + 1];
+    uint8_t commandLength;
+
+    void resetLoopWindow();
+    void handleCommand(Stream& port);
+};
+
+#endif